@@ -39,7 +39,7 @@ void GSDumpGenerator::write_reg(const Reg64<T> &t)
 
 void GSDumpGenerator::write_register_state(const GSInterface &iface)
 {
-	auto &regs = iface.get_register_state();
+	auto regs = iface.get_register_state();
 
 	write_u32(STATE_VERSION);
 	write_reg(regs.prim);
@@ -94,8 +94,9 @@ void GSDumpGenerator::write_vsync(uint32_t field, const ParallelGS::GSInterface
 	if (!file)
 		return;
 
+	auto priv = iface.get_priv_register_state();
 	write_u8(uint8_t(GSDumpPacketType::PrivRegisters));
-	write_data(&iface.get_priv_register_state(), sizeof(iface.get_priv_register_state()));
+	write_data(&priv, sizeof(priv));
 
 	write_u8(uint8_t(GSDumpPacketType::Vsync));
 	write_u8(field);
@@ -224,7 +225,8 @@ bool GSDumpGenerator::init(const char *path, uint32_t vram_size, GSInterface &if
 		write_f32(iface.get_register_state().internal_q);
 
 		// PrivRegisterState
-		write_data(&iface.get_priv_register_state(), sizeof(iface.get_priv_register_state()));
+		auto priv = iface.get_priv_register_state();
+		write_data(&priv, sizeof(priv));
 	}
 	catch (const std::exception &e)
 	{
@@ -1,12 +1,186 @@
 #include "gs_dump_parser.hpp"
 #include "gs_interface.hpp"
+#include <string.h>
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PGS_DUMP_MMAP 1
+#endif
 
 namespace ParallelGS
 {
+GSDumpParser::~GSDumpParser()
+{
+	unmap_file();
+}
+
+bool GSDumpParser::map_file(const char *path)
+{
+	unmap_file();
+
+#ifdef PGS_DUMP_MMAP
+	int fd = ::open(path, O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat s = {};
+		if (fstat(fd, &s) == 0 && s.st_size > 0)
+		{
+			void *ptr = mmap(nullptr, size_t(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED)
+			{
+				// We parse front to back.
+				madvise(ptr, size_t(s.st_size), MADV_SEQUENTIAL);
+				mapped = static_cast<const uint8_t *>(ptr);
+				mapped_size = size_t(s.st_size);
+				is_mmapped = true;
+			}
+		}
+		::close(fd);
+	}
+
+	if (mapped)
+		return true;
+#endif
+
+	// Fallback is one big read.
+	std::unique_ptr<FILE, FileDeleter> f(fopen(path, "rb"));
+	if (!f)
+		return false;
+
+	if (fseek(f.get(), 0, SEEK_END) != 0)
+		return false;
+	long len = ftell(f.get());
+	if (len <= 0 || fseek(f.get(), 0, SEEK_SET) != 0)
+		return false;
+
+	buffered.resize(size_t(len));
+	if (fread(buffered.data(), 1, buffered.size(), f.get()) != buffered.size())
+	{
+		buffered.clear();
+		return false;
+	}
+
+	mapped = buffered.data();
+	mapped_size = buffered.size();
+	return true;
+}
+
+void GSDumpParser::unmap_file()
+{
+#ifdef PGS_DUMP_MMAP
+	if (is_mmapped)
+		munmap(const_cast<uint8_t *>(mapped), mapped_size);
+#endif
+	is_mmapped = false;
+	buffered.clear();
+	buffered.shrink_to_fit();
+	mapped = nullptr;
+	mapped_size = 0;
+	mapped_offset = 0;
+	vsync_offsets.clear();
+}
+
+void GSDumpParser::build_vsync_index()
+{
+	// One pass over packet headers only, payloads are never touched.
+	vsync_offsets.clear();
+	size_t offset = mapped_offset;
+
+	while (offset < mapped_size)
+	{
+		auto type = GSDumpPacketType(mapped[offset++]);
+		size_t skip = 0;
+
+		switch (type)
+		{
+		case GSDumpPacketType::Transfer:
+		{
+			uint32_t size = 0;
+			if (mapped_size - offset < 5)
+				return;
+			memcpy(&size, mapped + offset + 1, sizeof(size));
+			skip = 5 + size_t(size);
+			break;
+		}
+
+		case GSDumpPacketType::Vsync:
+			skip = 1;
+			break;
+
+		case GSDumpPacketType::PrivRegisters:
+			skip = sizeof(PrivRegisterState);
+			break;
+
+		case GSDumpPacketType::ReadFIFO:
+			skip = 4;
+			break;
+
+		default:
+			LOGW("Unrecognized packet type %u at offset %zu, truncating index.\n", unsigned(type), offset - 1);
+			return;
+		}
+
+		if (mapped_size - offset < skip)
+			return;
+		offset += skip;
+
+		if (type == GSDumpPacketType::Vsync)
+			vsync_offsets.push_back(offset);
+	}
+}
+
+const std::vector<size_t> &GSDumpParser::get_vsync_offsets() const
+{
+	return vsync_offsets;
+}
+
+size_t GSDumpParser::get_vsync_count() const
+{
+	return vsync_count;
+}
+
+bool GSDumpParser::seek_to_vsync(size_t index)
+{
+	if (!mapped || index >= vsync_offsets.size())
+		return false;
+
+	mapped_offset = vsync_offsets[index];
+	vsync_count = index + 1;
+	eof = mapped_offset >= mapped_size;
+	return !eof;
+}
+
+const void *GSDumpParser::map_data(size_t size)
+{
+	if (size > mapped_size - mapped_offset)
+	{
+		mapped_offset = mapped_size;
+		eof = true;
+		return nullptr;
+	}
+
+	const void *ptr = mapped + mapped_offset;
+	mapped_offset += size;
+	return ptr;
+}
+
 bool GSDumpParser::restart()
 {
-	rewind(file.get());
-	eof = feof(file.get()) != 0;
+	vsync_count = 0;
+
+	if (mapped)
+	{
+		mapped_offset = 0;
+		eof = mapped_size == 0;
+	}
+	else
+	{
+		rewind(file.get());
+		eof = feof(file.get()) != 0;
+	}
 
 	if (is_raw)
 		return !eof;
@@ -61,6 +235,7 @@ bool GSDumpParser::open_raw(const char *path, uint32_t vram_size_, GSInterface *
 {
 	iface = iface_;
 	vram_size = vram_size_;
+	unmap_file();
 	file.reset(fopen(path, "rb"));
 	is_raw = true;
 	return file != nullptr;
@@ -70,12 +245,16 @@ bool GSDumpParser::open(const char *path, uint32_t vram_size_, GSInterface *ifac
 {
 	iface = iface_;
 	vram_size = vram_size_;
-	file.reset(fopen(path, "rb"));
-	if (!file)
+	file.reset();
+	if (!map_file(path))
 		return false;
 
 	is_raw = false;
-	return restart();
+	if (!restart())
+		return false;
+
+	build_vsync_index();
+	return true;
 }
 
 void GSDumpParser::read_register_state()
@@ -130,7 +309,7 @@ void GSDumpParser::read_register_state()
 
 bool GSDumpParser::iterate_until_vsync(bool high_res_scanout)
 {
-	if (!file)
+	if (!file && !mapped)
 		return false;
 
 	bool has_transfer = false;
@@ -148,11 +327,35 @@ bool GSDumpParser::iterate_until_vsync(bool high_res_scanout)
 			auto path = read_u8();
 			auto size = read_u32();
 			auto num_words = size / sizeof(GIFTagBits);
-			if (num_words > gif_tag_buffer.size())
-				gif_tag_buffer.resize(num_words);
-			read_data(gif_tag_buffer.data(), size);
-			if (!eof)
-				iface->gif_transfer(path, gif_tag_buffer.data(), size);
+
+			if (mapped)
+			{
+				auto *payload = map_data(size);
+				if (!payload)
+					break;
+
+				// Packet headers are not padded, so only some payloads end up suitably aligned.
+				if ((reinterpret_cast<uintptr_t>(payload) & (alignof(GIFTagBits) - 1)) == 0)
+				{
+					iface->gif_transfer(path, payload, size);
+				}
+				else
+				{
+					if (num_words > gif_tag_buffer.size())
+						gif_tag_buffer.resize(num_words);
+					memcpy(gif_tag_buffer.data(), payload, size);
+					iface->gif_transfer(path, gif_tag_buffer.data(), size);
+				}
+			}
+			else
+			{
+				if (num_words > gif_tag_buffer.size())
+					gif_tag_buffer.resize(num_words);
+				read_data(gif_tag_buffer.data(), size);
+				if (!eof)
+					iface->gif_transfer(path, gif_tag_buffer.data(), size);
+			}
+
 			has_transfer = true;
 			break;
 		}
@@ -170,6 +373,7 @@ bool GSDumpParser::iterate_until_vsync(bool high_res_scanout)
 			vsync.overscan = false;
 			iface->flush();
 			vsync_result = iface->vsync(vsync);
+			vsync_count++;
 			if (has_transfer)
 				return true;
 			break;
@@ -201,32 +405,28 @@ ScanoutResult GSDumpParser::consume_vsync_result()
 uint8_t GSDumpParser::read_u8()
 {
 	uint8_t v = 0;
-	if (fread(&v, sizeof(v), 1, file.get()) != 1)
-		eof = true;
+	read_data(&v, sizeof(v));
 	return v;
 }
 
 uint32_t GSDumpParser::read_u32()
 {
 	uint32_t v = 0;
-	if (fread(&v, sizeof(v), 1, file.get()) != 1)
-		eof = true;
+	read_data(&v, sizeof(v));
 	return v;
 }
 
 float GSDumpParser::read_f32()
 {
 	float v = 0;
-	if (fread(&v, sizeof(v), 1, file.get()) != 1)
-		eof = true;
+	read_data(&v, sizeof(v));
 	return v;
 }
 
 uint64_t GSDumpParser::read_u64()
 {
 	uint64_t v = 0;
-	if (fread(&v, sizeof(v), 1, file.get()) != 1)
-		eof = true;
+	read_data(&v, sizeof(v));
 	return v;
 }
 
@@ -238,12 +438,21 @@ void GSDumpParser::read_reg(T &reg)
 
 void GSDumpParser::read_skip(size_t size)
 {
-	fseek(file.get(), long(size), SEEK_CUR);
+	if (mapped)
+		map_data(size);
+	else
+		fseek(file.get(), long(size), SEEK_CUR);
 }
 
 void GSDumpParser::read_data(void *data, size_t size)
 {
-	if (fread(data, 1, size, file.get()) != size)
+	if (mapped)
+	{
+		auto *ptr = map_data(size);
+		if (ptr)
+			memcpy(data, ptr, size);
+	}
+	else if (fread(data, 1, size, file.get()) != size)
 		eof = true;
 }
-}
\ No newline at end of file
+}
@@ -38,12 +38,28 @@ struct DumpHeader
 class GSDumpParser
 {
 public:
+	GSDumpParser() = default;
+	~GSDumpParser();
+	GSDumpParser(const GSDumpParser &) = delete;
+	void operator=(const GSDumpParser &) = delete;
+
+	// The dump is memory mapped and transfers are passed straight from the mapping to gif_transfer.
 	bool open(const char *path, uint32_t vram_size, GSInterface *iface);
+	// Raw streams are read incrementally with stdio, so they can come from a pipe.
 	bool open_raw(const char *path, uint32_t vram_size, GSInterface *iface);
 	bool iterate_until_vsync(bool high_res_scanout = false);
 	ScanoutResult consume_vsync_result();
 	bool restart();
 
+	// Only available for dumps opened with open().
+	// Entry N is the byte offset of the first packet following Vsync packet N.
+	const std::vector<size_t> &get_vsync_offsets() const;
+	// Jumps to the first packet following Vsync packet N. GS state is not touched,
+	// so this is only meaningful if the caller restores the state for that point separately.
+	bool seek_to_vsync(size_t index);
+	// Number of Vsync packets consumed since the last restart, including skipped ones.
+	size_t get_vsync_count() const;
+
 private:
 	struct FileDeleter { void operator()(FILE *file) { if (file) fclose(file); } };
 	GSInterface *iface = nullptr;
@@ -53,6 +69,20 @@ private:
 	uint32_t vram_size;
 	bool is_raw = false;
 
+	// Backing store for open(). Either an mmap or, if that fails, the whole file read up front.
+	const uint8_t *mapped = nullptr;
+	size_t mapped_size = 0;
+	size_t mapped_offset = 0;
+	bool is_mmapped = false;
+	std::vector<uint8_t> buffered;
+	std::vector<size_t> vsync_offsets;
+	size_t vsync_count = 0;
+
+	bool map_file(const char *path);
+	void unmap_file();
+	void build_vsync_index();
+	const void *map_data(size_t size);
+
 	uint8_t read_u8();
 	uint32_t read_u32();
 	float read_f32();
@@ -65,4 +95,4 @@ private:
 	void read_register_state();
 	void read_skip(size_t size);
 };
-}
\ No newline at end of file
+}
@@ -9,9 +9,50 @@
 #include "shaders/swizzle_utils.h"
 #include "muglm/muglm_impl.hpp"
 #include "gs_registers_debug.hpp"
+#include "timer.hpp"
+#include "thread_id.hpp"
+#include "thread_name.hpp"
+#include "bitops.hpp"
 
 namespace ParallelGS
 {
+namespace
+{
+// Accumulates exclusive time. Time spent in nested timers is reported to the parent,
+// which subtracts it from its own total.
+struct ScopedCPUTimer
+{
+	ScopedCPUTimer(bool enable, double &accum_, uint64_t *&active_nested_ns_)
+		: accum(enable ? &accum_ : nullptr), active_nested_ns(active_nested_ns_)
+	{
+		if (accum)
+		{
+			parent_nested_ns = active_nested_ns;
+			active_nested_ns = &nested_ns;
+			start_ns = Util::get_current_time_nsecs();
+		}
+	}
+
+	~ScopedCPUTimer()
+	{
+		if (accum)
+		{
+			uint64_t elapsed_ns = Util::get_current_time_nsecs() - start_ns;
+			*accum += 1e-9 * double(elapsed_ns - std::min(nested_ns, elapsed_ns));
+			if (parent_nested_ns)
+				*parent_nested_ns += elapsed_ns;
+			active_nested_ns = parent_nested_ns;
+		}
+	}
+
+	double *accum;
+	uint64_t *&active_nested_ns;
+	uint64_t *parent_nested_ns = nullptr;
+	uint64_t start_ns = 0;
+	uint64_t nested_ns = 0;
+};
+}
+
 GSInterface::GSInterface()
 	: tracker(*this), renderer(tracker)
 {
@@ -21,10 +62,188 @@ GSInterface::GSInterface()
 	// Ensure that default states will trigger a dirty flag.
 	render_pass.instances[0].frame.desc.PSM = 0x3f;
 	render_pass.instances[0].zbuf.desc.PSM = 0x7;
+
+	gif_worker.write_count = 0;
+	gif_worker.read_count = 0;
+	gif_worker.consumer_sleeping = false;
+	gif_worker.producer_sleeping = false;
+	gif_worker.shutdown = false;
+}
+
+GSInterface::~GSInterface()
+{
+	stop_gif_worker();
+}
+
+void GSInterface::start_gif_worker(unsigned thread_index)
+{
+	stop_gif_worker();
+
+	gif_worker.ring.resize(GIFWorker::RingSize);
+	gif_worker.write_count = 0;
+	gif_worker.read_count = 0;
+	gif_worker.shutdown = false;
+	gif_worker.active = true;
+	gif_worker.thread = std::thread([this, thread_index]() {
+		Util::set_current_thread_name("PGS-GIF");
+		Util::register_thread_index(thread_index);
+		gif_worker_loop();
+	});
+	gif_worker.thread_id = gif_worker.thread.get_id();
+}
+
+void GSInterface::stop_gif_worker()
+{
+	if (!gif_worker.active)
+		return;
+
+	sync_gif_worker();
+
+	{
+		std::lock_guard<std::mutex> holder{gif_worker.lock};
+		gif_worker.shutdown = true;
+		gif_worker.consumer_cond.notify_one();
+	}
+
+	gif_worker.thread.join();
+	gif_worker.active = false;
+	gif_worker.ring.clear();
+	gif_worker.ring.shrink_to_fit();
+}
+
+void GSInterface::gif_worker_loop()
+{
+	auto &w = gif_worker;
+	uint64_t read = w.read_count.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		if (w.write_count.load(std::memory_order_acquire) == read)
+		{
+			// Announce that we're going to sleep before re-checking, so the producer cannot miss us.
+			w.consumer_sleeping.store(true);
+			if (w.write_count.load() == read)
+			{
+				std::unique_lock<std::mutex> holder{w.lock};
+				w.consumer_cond.wait(holder, [&]() {
+					return w.write_count.load() != read || w.shutdown.load();
+				});
+			}
+			w.consumer_sleeping.store(false);
+
+			if (w.write_count.load(std::memory_order_acquire) == read)
+			{
+				if (w.shutdown.load())
+					break;
+				continue;
+			}
+		}
+
+		auto pos = size_t(read % GIFWorker::RingSize);
+		uint32_t header[2];
+		memcpy(header, &w.ring[pos], sizeof(header));
+
+		if (header[0] == GIFWorker::WrapMarker)
+		{
+			read += GIFWorker::RingSize - pos;
+		}
+		else
+		{
+			gif_transfer_direct(header[0], &w.ring[pos + 1], size_t(header[1]) * sizeof(GIFTagBits));
+			read += 1 + header[1];
+		}
+
+		w.read_count.store(read);
+		if (w.producer_sleeping.load())
+		{
+			std::lock_guard<std::mutex> holder{w.lock};
+			w.producer_cond.notify_one();
+		}
+	}
+}
+
+void GSInterface::wait_gif_worker_read_count(uint64_t count) const
+{
+	auto &w = gif_worker;
+	if (w.read_count.load(std::memory_order_acquire) >= count)
+		return;
+
+	w.producer_sleeping.store(true);
+	if (w.read_count.load() < count)
+	{
+		std::unique_lock<std::mutex> holder{w.lock};
+		w.producer_cond.wait(holder, [&]() { return w.read_count.load() >= count; });
+	}
+	w.producer_sleeping.store(false);
+}
+
+void GSInterface::sync_gif_worker() const
+{
+	// The worker itself may end up calling back into public entry points.
+	if (!gif_worker.active || std::this_thread::get_id() == gif_worker.thread_id)
+		return;
+	wait_gif_worker_read_count(gif_worker.write_count.load(std::memory_order_relaxed));
+}
+
+void GSInterface::push_gif_packet(uint32_t path, const void *data, size_t num_qwords)
+{
+	auto &w = gif_worker;
+	uint64_t write = w.write_count.load(std::memory_order_relaxed);
+	auto pos = size_t(write % GIFWorker::RingSize);
+
+	const auto required_read_count = [](uint64_t end) -> uint64_t {
+		return end > GIFWorker::RingSize ? end - GIFWorker::RingSize : 0;
+	};
+
+	// Packets are contiguous in the ring.
+	if (pos + 1 + num_qwords > GIFWorker::RingSize)
+	{
+		wait_gif_worker_read_count(required_read_count(write + 1));
+		const uint32_t header[4] = { GIFWorker::WrapMarker };
+		memcpy(&w.ring[pos], header, sizeof(header));
+		write += GIFWorker::RingSize - pos;
+		pos = 0;
+	}
+
+	wait_gif_worker_read_count(required_read_count(write + 1 + num_qwords));
+
+	const uint32_t header[4] = { path, uint32_t(num_qwords) };
+	memcpy(&w.ring[pos], header, sizeof(header));
+	memcpy(&w.ring[pos + 1], data, num_qwords * sizeof(GIFTagBits));
+
+	w.write_count.store(write + 1 + num_qwords);
+	if (w.consumer_sleeping.load())
+	{
+		std::lock_guard<std::mutex> holder{w.lock};
+		w.consumer_cond.notify_one();
+	}
+}
+
+void GSInterface::gif_transfer(uint32_t path, const void *data, size_t size)
+{
+	assert(path < 4);
+	assert(size % 16 == 0);
+	size_t num_qwords = size / sizeof(GIFTagBits);
+
+	if (!gif_worker.active || std::this_thread::get_id() == gif_worker.thread_id)
+	{
+		gif_transfer_direct(path, data, size);
+	}
+	else if (num_qwords + 1 > GIFWorker::RingSize / 2)
+	{
+		// Not worth splitting huge transfers, just run them here.
+		sync_gif_worker();
+		gif_transfer_direct(path, data, size);
+	}
+	else if (num_qwords)
+	{
+		push_gif_packet(path, data, num_qwords);
+	}
 }
 
 void GSInterface::reset_context_state()
 {
+	sync_gif_worker();
 	flush();
 	reset_context_state_registers();
 }
@@ -40,7 +259,56 @@ void GSInterface::reset_context_state_registers()
 
 bool GSInterface::init(Vulkan::Device *device, const GSOptions &options)
 {
+	stop_gif_worker();
+
+	if (options.threaded_gif_frontend)
+	{
+		unsigned index = options.threaded_gif_frontend_thread_index;
+		if (index >= device->get_num_thread_indices())
+		{
+			LOGE("GIF front-end thread index %u is out of range, device only has %u thread indices.\n",
+			     index, device->get_num_thread_indices());
+			return false;
+		}
+
+		if (index == Util::get_current_thread_index())
+		{
+			LOGE("GIF front-end thread index %u collides with the calling thread.\n", index);
+			return false;
+		}
+	}
+
+	if (options.threaded_render_pass_recording)
+	{
+		unsigned index = options.render_pass_recording_thread_index;
+		if (index >= device->get_num_thread_indices())
+		{
+			LOGE("Render pass recording thread index %u is out of range, device only has %u thread indices.\n",
+			     index, device->get_num_thread_indices());
+			return false;
+		}
+
+		if (index == Util::get_current_thread_index())
+		{
+			LOGE("Render pass recording thread index %u collides with the calling thread.\n", index);
+			return false;
+		}
+
+		if (options.threaded_gif_frontend && index == options.threaded_gif_frontend_thread_index)
+		{
+			LOGE("Render pass recording thread index %u collides with the GIF front-end worker.\n", index);
+			return false;
+		}
+	}
+
 	vram_size = options.vram_size;
+	texture_content_hashing = options.texture_content_hashing;
+	clut_content_hashing = options.clut_content_hashing;
+	host_transfer_ring = options.host_transfer_ring_size != 0;
+	hierarchical_z_culling = options.hierarchical_z_culling;
+	adaptive_tiling = options.adaptive_tiling;
+	fb_working_set_merging = options.fb_working_set_merging;
+	reset_hierarchical_z();
 	uint32_t num_pages = vram_size / PageSize;
 	tracker.set_num_pages(num_pages);
 	uint32_t num_pages_u32 = (num_pages + 31) / 32;
@@ -51,6 +319,15 @@ bool GSInterface::init(Vulkan::Device *device, const GSOptions &options)
 	if (!renderer.init(device, options))
 		return false;
 
+	if (options.super_sampling_governor && !options.dynamic_super_sampling)
+		LOGW("Super sampling governor requires dynamic super sampling, ignoring.\n");
+
+	ssaa_governor.enable = options.super_sampling_governor && options.dynamic_super_sampling;
+	ssaa_governor.budget_ms = options.super_sampling_governor_budget_ms;
+	ssaa_governor.min_rate = options.super_sampling_governor_min;
+	ssaa_governor.window = std::max<uint32_t>(1, options.super_sampling_governor_window);
+	renderer.set_enable_timestamps(debug_mode.timestamps || ssaa_governor.enable || trace_recorder);
+
 	set_super_sampling_rate(options.super_sampling,
 	                        options.ordered_super_sampling,
 	                        options.super_sampled_textures);
@@ -59,62 +336,139 @@ bool GSInterface::init(Vulkan::Device *device, const GSOptions &options)
 	render_pass.positions = renderer.get_reserved_vertex_positions();
 	render_pass.attributes = renderer.get_reserved_vertex_attributes();
 	render_pass.prim = renderer.get_reserved_primitive_attributes();
+	render_pass.position_shadow = renderer.get_vertex_position_shadow();
+	render_pass.attribute_shadow = renderer.get_vertex_attribute_shadow();
+
+	if (options.threaded_gif_frontend)
+		start_gif_worker(options.threaded_gif_frontend_thread_index);
+	else
+		stop_gif_worker();
+
 	return true;
 }
 
 void GSInterface::set_super_sampling_rate(SuperSampling super_sampling,
                                           bool ordered_grid, bool super_sampled_textures_)
 {
-	super_sampled_textures = super_sampled_textures_;
+	sync_gif_worker();
 	super_sampling = SuperSampling(std::min<uint32_t>(
 			uint32_t(super_sampling), uint32_t(renderer.get_max_supported_super_sampling())));
 
-	switch (super_sampling)
-	{
-	case SuperSampling::X1:
-		sampling_rate_x_log2 = 0;
-		sampling_rate_y_log2 = 0;
+	ssaa_governor.requested = super_sampling;
+	ssaa_governor.ordered_grid = ordered_grid;
+	ssaa_governor.super_sampled_textures = super_sampled_textures_;
+	reset_super_sampling_governor();
+	apply_super_sampling_rate(super_sampling);
+}
+
+void GSInterface::apply_super_sampling_rate(SuperSampling super_sampling)
+{
+	super_sampled_textures = ssaa_governor.super_sampled_textures;
+	get_super_sampling_rate_log2(super_sampling, ssaa_governor.ordered_grid,
+	                             sampling_rate_x_log2, sampling_rate_y_log2);
+	if (super_sampling == SuperSampling::X1)
 		super_sampled_textures = false;
-		break;
 
-	case SuperSampling::X2:
-		sampling_rate_x_log2 = 0;
-		sampling_rate_y_log2 = 1;
-		break;
+	renderer.invalidate_super_sampling_state(sampling_rate_x_log2, sampling_rate_y_log2);
+	ssaa_governor.current = super_sampling;
+}
 
-	case SuperSampling::X4:
-		if (ordered_grid)
+void GSInterface::reset_super_sampling_governor()
+{
+	auto &gov = ssaa_governor;
+	gov.current = gov.requested;
+	gov.window_vsyncs = 0;
+	gov.window_start_gpu_time = get_total_gpu_time();
+	gov.discard_window = true;
+	gov.headroom_windows = 0;
+	gov.step_up_delay = SuperSamplingGovernor::BaseStepUpDelay;
+	gov.last_step_was_up = false;
+}
+
+double GSInterface::get_total_gpu_time() const
+{
+	return renderer.get_accumulated_busy_time();
+}
+
+void GSInterface::update_super_sampling_governor()
+{
+	auto &gov = ssaa_governor;
+	if (!gov.enable)
+		return;
+
+	if (++gov.window_vsyncs < gov.window)
+		return;
+
+	// Timestamps are only resolved once the GPU is done with them, so this lags behind by a few frames.
+	// Over a full window that evens out.
+	double gpu_time = get_total_gpu_time();
+	double ms_per_vsync = 1e3 * (gpu_time - gov.window_start_gpu_time) / double(gov.window_vsyncs);
+	gov.window_start_gpu_time = gpu_time;
+	gov.window_vsyncs = 0;
+
+	if (gov.discard_window)
+	{
+		gov.discard_window = false;
+		return;
+	}
+
+	auto next = gov.current;
+
+	if (ms_per_vsync > gov.budget_ms)
+	{
+		if (uint32_t(gov.current) > uint32_t(gov.min_rate))
 		{
-			sampling_rate_x_log2 = 1;
-			sampling_rate_y_log2 = 1;
+			next = SuperSampling(uint32_t(gov.current) >> 1);
+			// If we just stepped up, that rate did not fit after all.
+			// Back off exponentially so we don't keep bouncing between two rates.
+			if (gov.last_step_was_up)
+			{
+				gov.step_up_delay = std::min<uint32_t>(gov.step_up_delay * 2,
+				                                       SuperSamplingGovernor::MaxStepUpDelay);
+			}
 		}
-		else
+		gov.last_step_was_up = false;
+		gov.headroom_windows = 0;
+	}
+	else
+	{
+		// A step up which held for a full window is considered stable.
+		if (gov.last_step_was_up)
 		{
-			sampling_rate_x_log2 = 0;
-			sampling_rate_y_log2 = 2;
+			gov.step_up_delay = SuperSamplingGovernor::BaseStepUpDelay;
+			gov.last_step_was_up = false;
 		}
-		break;
 
-	case SuperSampling::X8:
-		sampling_rate_x_log2 = 1;
-		sampling_rate_y_log2 = 2;
-		break;
-
-	case SuperSampling::X16:
-		if (ordered_grid)
+		// Shading cost scales roughly with sample count,
+		// so only step up if twice the current GPU time would still fit with some margin.
+		constexpr double StepUpMargin = 0.8;
+		if (uint32_t(gov.current) < uint32_t(gov.requested) &&
+		    2.0 * ms_per_vsync < StepUpMargin * gov.budget_ms)
 		{
-			sampling_rate_x_log2 = 2;
-			sampling_rate_y_log2 = 2;
+			if (++gov.headroom_windows >= gov.step_up_delay)
+			{
+				next = SuperSampling(uint32_t(gov.current) << 1);
+				gov.last_step_was_up = true;
+				gov.headroom_windows = 0;
+			}
 		}
 		else
-		{
-			sampling_rate_x_log2 = 1;
-			sampling_rate_y_log2 = 3;
-		}
-		break;
+			gov.headroom_windows = 0;
 	}
 
-	renderer.invalidate_super_sampling_state(sampling_rate_x_log2, sampling_rate_y_log2);
+	if (next != gov.current)
+	{
+		LOGI("Super sampling governor: %.3f ms GPU time per vsync, switching from %ux to %ux SSAA.\n",
+		     ms_per_vsync, uint32_t(gov.current), uint32_t(next));
+		apply_super_sampling_rate(next);
+		gov.discard_window = true;
+	}
+}
+
+SuperSampling GSInterface::get_current_super_sampling_rate() const
+{
+	sync_gif_worker();
+	return ssaa_governor.current;
 }
 
 static bool write_mask_is_16bit_channel_slice(uint32_t psm, uint32_t color_mask)
@@ -130,21 +484,70 @@ static bool write_mask_is_16bit_channel_slice(uint32_t psm, uint32_t color_mask)
 	return false;
 }
 
-void GSInterface::flush_render_pass(FlushReason reason)
+uint32_t GSInterface::select_adaptive_coarse_tile_size_log2(const RenderPass &rp) const
 {
-	ParallelGS::RenderPass rp = {};
+	// Aim for tiles roughly the size of an average primitive.
+	// Tiles much smaller than a primitive only multiply binning work,
+	// and tiles much larger than a primitive make every shading invocation consider primitives it cannot hit.
+	uint32_t tile_size_log2 = std::max<uint32_t>(Util::floor_log2(rp.average_primitive_area) / 2, 3);
+	tile_size_log2 = std::min<uint32_t>(tile_size_log2, 6);
 
-	if (render_pass.primitive_count)
-	{
-		rp.num_primitives = render_pass.primitive_count;
+	// Binning is cheap enough that the smallest tiles are always fine for tiny passes.
+	constexpr uint64_t MinBinningCost = 10 * 1000;
+	// Grow tiles when the number of tile-primitive pairs we have to test starts to dominate.
+	constexpr uint64_t MaxBinningCost = 32 * 1000 * 1000;
+
+	const auto binning_cost = [&](uint32_t size_log2) {
+		uint64_t cost = 0;
+		for (uint32_t i = 0; i < render_pass.num_instances; i++)
+		{
+			auto &inst = render_pass.instances[i];
+			if (inst.bb.z < inst.bb.x)
+				continue;
+			uint64_t tiles_width = ((inst.bb.z - inst.bb.x) >> size_log2) + 1;
+			uint64_t tiles_height = ((inst.bb.w - inst.bb.y) >> size_log2) + 1;
+			cost += tiles_width * tiles_height * rp.num_primitives;
+		}
+		return cost;
+	};
 
-		rp.states = render_pass.state_vectors.data();
-		rp.num_states = render_pass.state_vectors.size();
-		rp.allow_blend_demote = hacks.allow_blend_demote;
+	if (binning_cost(3) < MinBinningCost)
+		return 3;
 
-		rp.textures = render_pass.tex_infos.data();
-		rp.num_textures = render_pass.tex_infos.size();
+	while (tile_size_log2 < 6 && binning_cost(tile_size_log2) > MaxBinningCost)
+		tile_size_log2++;
 
+	return tile_size_log2;
+}
+
+void GSInterface::build_render_pass(RenderPass &rp, FlushReason reason)
+{
+	rp.num_primitives = render_pass.primitive_count;
+
+	rp.states = render_pass.state_vectors.data();
+	rp.num_states = render_pass.state_vectors.size();
+	rp.allow_blend_demote = hacks.allow_blend_demote;
+
+	rp.textures = render_pass.tex_infos.data();
+	rp.num_textures = render_pass.tex_infos.size();
+	rp.held_images = render_pass.held_images.data();
+	rp.num_held_images = render_pass.held_images.size();
+
+	rp.average_primitive_area = 0;
+	if (adaptive_tiling && rp.num_primitives)
+	{
+		rp.average_primitive_area = uint32_t(std::min<uint64_t>(
+				render_pass.primitive_bb_area / rp.num_primitives, UINT32_MAX));
+		rp.average_primitive_area = std::max<uint32_t>(rp.average_primitive_area, 1);
+	}
+	render_pass.primitive_bb_area = 0;
+
+	if (rp.average_primitive_area)
+	{
+		rp.coarse_tile_size_log2 = select_adaptive_coarse_tile_size_log2(rp);
+	}
+	else
+	{
 		uint32_t binning_cost = 0;
 
 		for (uint32_t i = 0; i < render_pass.num_instances; i++)
@@ -164,139 +567,181 @@ void GSInterface::flush_render_pass(FlushReason reason)
 			rp.coarse_tile_size_log2 = 5;
 		else
 			rp.coarse_tile_size_log2 = 6;
+	}
 
-		if (sampling_rate_y_log2 != 0 && rp.coarse_tile_size_log2 > 3)
-			rp.coarse_tile_size_log2 -= 1;
+	if (sampling_rate_y_log2 != 0 && rp.coarse_tile_size_log2 > 3)
+		rp.coarse_tile_size_log2 -= 1;
 
-		for (uint32_t i = 0; i < render_pass.num_instances; i++)
+	for (uint32_t i = 0; i < render_pass.num_instances; i++)
+	{
+		auto &inst = render_pass.instances[i];
+		uint32_t coarse_tiles_width = ((inst.bb.z - inst.bb.x) >> rp.coarse_tile_size_log2) + 1;
+		uint32_t coarse_tiles_height = ((inst.bb.w - inst.bb.y) >> rp.coarse_tile_size_log2) + 1;
+
+		// Try to avoid overflowing the 64 MiB sub-allocation limit in Granite when
+		// allocating binning list.
+		// Just a mild performance optimization, will still work without this heuristic.
+		// TODO: Maybe expose something in Granite to make this less hard-coded.
+		VkDeviceSize primitive_list_size = coarse_tiles_width * coarse_tiles_height * rp.num_primitives * sizeof(uint16_t);
+		while (primitive_list_size > 48 * 1024 * 1024)
 		{
-			auto &inst = render_pass.instances[i];
-			uint32_t coarse_tiles_width = ((inst.bb.z - inst.bb.x) >> rp.coarse_tile_size_log2) + 1;
-			uint32_t coarse_tiles_height = ((inst.bb.w - inst.bb.y) >> rp.coarse_tile_size_log2) + 1;
-
-			// Try to avoid overflowing the 64 MiB sub-allocation limit in Granite when
-			// allocating binning list.
-			// Just a mild performance optimization, will still work without this heuristic.
-			// TODO: Maybe expose something in Granite to make this less hard-coded.
-			VkDeviceSize primitive_list_size = coarse_tiles_width * coarse_tiles_height * rp.num_primitives * sizeof(uint16_t);
-			while (primitive_list_size > 48 * 1024 * 1024)
-			{
-				rp.coarse_tile_size_log2 += 1;
-				primitive_list_size /= 4;
-			}
+			rp.coarse_tile_size_log2 += 1;
+			primitive_list_size /= 4;
 		}
+	}
+
+	rp.num_instances = render_pass.num_instances;
+
+	// It's possible the last RP instance was added, but there are no primitives yet, since
+	// we ended up flushing before we could expand the BB.
+	if (render_pass.instances[rp.num_instances - 1].bb.z < 0)
+		rp.num_instances--;
+	assert(rp.num_instances);
+
+	for (uint32_t i = 0; i < rp.num_instances; i++)
+	{
+		auto &inst = render_pass.instances[i];
+		auto &pass = rp.instances[i];
 
-		rp.num_instances = render_pass.num_instances;
+		assert(inst.bb.x <= inst.bb.z && inst.bb.y <= inst.bb.w);
+		assert(inst.bb.x >= 0 && inst.bb.y >= 0);
+		assert(inst.bb.z < 2048 && inst.bb.w < 2048);
 
-		// It's possible the last RP instance was added, but there are no primitives yet, since
-		// we ended up flushing before we could expand the BB.
-		if (render_pass.instances[rp.num_instances - 1].bb.z < 0)
-			rp.num_instances--;
-		assert(rp.num_instances);
+		pass.fb.frame = inst.frame;
+		pass.fb.z = inst.zbuf;
+		assert(inst.bb.z < std::max<int>(1, pass.fb.frame.desc.FBW) * PGS_BUFFER_WIDTH_SCALE);
 
-		for (uint32_t i = 0; i < rp.num_instances; i++)
+		pass.base_x = inst.bb.x;
+		pass.base_y = inst.bb.y;
+		pass.coarse_tiles_width = ((inst.bb.z - inst.bb.x) >> rp.coarse_tile_size_log2) + 1;
+		pass.coarse_tiles_height = ((inst.bb.w - inst.bb.y) >> rp.coarse_tile_size_log2) + 1;
+
+		// This should be possible to vary based on dynamic usage.
+		// If there are only trivial UI passes, we should make it single-sampled.
+		pass.sampling_rate_x_log2 = sampling_rate_x_log2;
+		pass.sampling_rate_y_log2 = sampling_rate_y_log2;
+
+		// Any FBMASK that masks more than the global mask must be demoted from OPAQUE.
+		pass.opaque_fbmask = ~inst.color_write_mask;
+		pass.channel_shuffle = inst.has_channel_shuffle ||
+		                       write_mask_is_16bit_channel_slice(inst.frame.desc.PSM, inst.color_write_mask);
+
+		// If we're super sampling textures, we can avoid a ton of common SSAA issues which
+		// arise when doing single-sampled textures resolving on top of super-sampled framebuffer data.
+		// If we're rendering field aware upscaling, we essentially need to force super-sampling everywhere all the time.
+		if (!render_pass.field_aware_rendering &&
+		    (!super_sampled_textures || !render_pass.tex_infos_has_super_samples))
 		{
-			auto &inst = render_pass.instances[i];
-			auto &pass = rp.instances[i];
-
-			assert(inst.bb.x <= inst.bb.z && inst.bb.y <= inst.bb.w);
-			assert(inst.bb.x >= 0 && inst.bb.y >= 0);
-			assert(inst.bb.z < 2048 && inst.bb.w < 2048);
-
-			pass.fb.frame = inst.frame;
-			pass.fb.z = inst.zbuf;
-			assert(inst.bb.z < std::max<int>(1, pass.fb.frame.desc.FBW) * PGS_BUFFER_WIDTH_SCALE);
-
-			pass.base_x = inst.bb.x;
-			pass.base_y = inst.bb.y;
-			pass.coarse_tiles_width = ((inst.bb.z - inst.bb.x) >> rp.coarse_tile_size_log2) + 1;
-			pass.coarse_tiles_height = ((inst.bb.w - inst.bb.y) >> rp.coarse_tile_size_log2) + 1;
-
-			// This should be possible to vary based on dynamic usage.
-			// If there are only trivial UI passes, we should make it single-sampled.
-			pass.sampling_rate_x_log2 = sampling_rate_x_log2;
-			pass.sampling_rate_y_log2 = sampling_rate_y_log2;
-
-			// Any FBMASK that masks more than the global mask must be demoted from OPAQUE.
-			pass.opaque_fbmask = ~inst.color_write_mask;
-			pass.channel_shuffle = inst.has_channel_shuffle ||
-			                       write_mask_is_16bit_channel_slice(inst.frame.desc.PSM, inst.color_write_mask);
-
-			// If we're super sampling textures, we can avoid a ton of common SSAA issues which
-			// arise when doing single-sampled textures resolving on top of super-sampled framebuffer data.
-			// If we're rendering field aware upscaling, we essentially need to force super-sampling everywhere all the time.
-			if (!render_pass.field_aware_rendering &&
-			    (!super_sampled_textures || !render_pass.tex_infos_has_super_samples))
+			// This case is to handle certain channel shuffling effects which render with 16-bit over a 32-bit FB
+			// using 0x3fff FBMSK. This ends up slicing the green channel and trying to resolve super-sampling in 16-bit
+			// domain leads to bogus results.
+			// If a channel is considered "odd" w.r.t. masking, force single-sampled rendering.
+			// Don't apply this fixup for 24/32-bit bpp, since there are no reasonable shuffle effects
+			// that operate on those bit-depths. Try to avoid false positives.
+			if ((sampling_rate_x_log2 || sampling_rate_y_log2) && pass.channel_shuffle)
 			{
-				// This case is to handle certain channel shuffling effects which render with 16-bit over a 32-bit FB
-				// using 0x3fff FBMSK. This ends up slicing the green channel and trying to resolve super-sampling in 16-bit
-				// domain leads to bogus results.
-				// If a channel is considered "odd" w.r.t. masking, force single-sampled rendering.
-				// Don't apply this fixup for 24/32-bit bpp, since there are no reasonable shuffle effects
-				// that operate on those bit-depths. Try to avoid false positives.
-				if ((sampling_rate_x_log2 || sampling_rate_y_log2) && pass.channel_shuffle)
-				{
-					pass.sampling_rate_x_log2 = 0;
-					pass.sampling_rate_y_log2 = 0;
-				}
-				else if (inst.z_feedback)
-				{
-					// If we're doing Z-feedback effects, it's not safe to run super-sampled since there are too many glitches in play
-					// for it to be viable. When super-sampled Z is converted to color, then downsampled, there will be bleeding
-					// across geometry, and we have no way of resolving this other than forwarding super-sampled textures
-					// everywhere.
-					pass.sampling_rate_x_log2 = 0;
-					pass.sampling_rate_y_log2 = 0;
-				}
-				else if (inst.z_write && inst.zbuf.desc.ZBP == inst.frame.desc.FBP)
-				{
-					// If we're doing color/Z aliasing like this, we're not doing normal rendering,
-					// and any super sampling state is likely to get clobbered hard either way.
-					// There's no useful use case for rendering 3D with this configuration,
-					// so be careful and just disable SSAA.
-					pass.sampling_rate_x_log2 = 0;
-					pass.sampling_rate_y_log2 = 0;
-				}
+				pass.sampling_rate_x_log2 = 0;
+				pass.sampling_rate_y_log2 = 0;
+			}
+			else if (inst.z_feedback)
+			{
+				// If we're doing Z-feedback effects, it's not safe to run super-sampled since there are too many glitches in play
+				// for it to be viable. When super-sampled Z is converted to color, then downsampled, there will be bleeding
+				// across geometry, and we have no way of resolving this other than forwarding super-sampled textures
+				// everywhere.
+				pass.sampling_rate_x_log2 = 0;
+				pass.sampling_rate_y_log2 = 0;
+			}
+			else if (inst.z_write && inst.zbuf.desc.ZBP == inst.frame.desc.FBP)
+			{
+				// If we're doing color/Z aliasing like this, we're not doing normal rendering,
+				// and any super sampling state is likely to get clobbered hard either way.
+				// There's no useful use case for rendering 3D with this configuration,
+				// so be careful and just disable SSAA.
+				pass.sampling_rate_x_log2 = 0;
+				pass.sampling_rate_y_log2 = 0;
 			}
-
-			pass.z_sensitive = inst.z_sensitive;
-			pass.z_write = inst.z_write;
 		}
 
-		rp.feedback_mode = render_pass.feedback_mode;
-		rp.feedback_texture_psm = render_pass.feedback_psm;
-		rp.feedback_texture_cpsm = render_pass.feedback_cpsm;
+		pass.z_sensitive = inst.z_sensitive;
+		pass.z_write = inst.z_write;
+		pass.has_triangles_or_lines = inst.has_triangles_or_lines;
+	}
 
-		// Affects shader variants.
-		rp.has_aa1 = render_pass.has_aa1;
-		rp.has_scanmsk = render_pass.has_scanmsk;
+	rp.feedback_mode = render_pass.feedback_mode;
+	rp.feedback_texture_psm = render_pass.feedback_psm;
+	rp.feedback_texture_cpsm = render_pass.feedback_cpsm;
 
-		// Debug stuff
-		rp.feedback_color = debug_mode.feedback_render_target;
+	// Affects shader variants.
+	rp.has_aa1 = render_pass.has_aa1;
+	rp.has_scanmsk = render_pass.has_scanmsk;
 
-		if (debug_mode.feedback_render_target)
-			for (uint32_t i = 0; i < render_pass.num_instances && !rp.feedback_depth; i++)
-				rp.feedback_depth = render_pass.instances[i].z_sensitive;
+	// Debug stuff
+	rp.feedback_color = debug_mode.feedback_render_target;
 
-		switch (debug_mode.draw_mode)
-		{
-		case DebugMode::DrawDebugMode::Strided:
-			// Try to balance debuggability so there's not a million events to step through
-			// while being able to identify a faulty primitive.
-			rp.debug_capture_stride = 16;
-			break;
+	if (debug_mode.feedback_render_target)
+		for (uint32_t i = 0; i < render_pass.num_instances && !rp.feedback_depth; i++)
+			rp.feedback_depth = render_pass.instances[i].z_sensitive;
 
-		case DebugMode::DrawDebugMode::Full:
-			rp.debug_capture_stride = 1;
-			break;
+	switch (debug_mode.draw_mode)
+	{
+	case DebugMode::DrawDebugMode::Strided:
+		// Try to balance debuggability so there's not a million events to step through
+		// while being able to identify a faulty primitive.
+		rp.debug_capture_stride = 16;
+		break;
 
-		default:
-			break;
-		}
+	case DebugMode::DrawDebugMode::Full:
+		rp.debug_capture_stride = 1;
+		break;
 
-		rp.label_key = render_pass.label_key++;
-		rp.flush_reason = reason;
-		//////
+	default:
+		break;
+	}
+
+	rp.label_key = render_pass.label_key++;
+	rp.flush_reason = reason;
+	rp.num_z_culled_primitives = render_pass.num_z_culled_primitives;
+	render_pass.num_z_culled_primitives = 0;
+	rp.num_merged_fb_switches = render_pass.num_merged_fb_switches;
+	render_pass.num_merged_fb_switches = 0;
+}
+
+void GSInterface::note_flush_hazard(uint32_t page, uint32_t tbp)
+{
+	flush_hazard.page = page;
+	flush_hazard.tbp = tbp;
+}
+
+void GSInterface::add_flush_trace_args(TraceScope &trace, FlushReason reason)
+{
+	trace.set_detail("reason", flush_reason_to_str(reason));
+	if (flush_hazard.page != UINT32_MAX)
+		trace.add_arg("hazardPage", flush_hazard.page);
+	if (flush_hazard.tbp != UINT32_MAX)
+		trace.add_arg("hazardTBP", flush_hazard.tbp);
+}
+
+void GSInterface::flush_render_pass(FlushReason reason)
+{
+	ScopedCPUTimer timer(debug_mode.timestamps, cpu_time_total[int(CPUTimestampType::FlushRenderPass)],
+	                     active_cpu_timer_nested_ns);
+	TraceScope trace(trace_recorder, "RenderPass", "flush");
+	if (trace_recorder)
+	{
+		auto &inst = render_pass.instances[0];
+		add_flush_trace_args(trace, reason);
+		trace.add_arg("primitives", render_pass.primitive_count);
+		trace.add_arg("instances", render_pass.num_instances);
+		trace.add_arg("FBP", inst.frame.desc.FBP);
+		trace.add_arg("ZBP", inst.zbuf.desc.ZBP);
+	}
+
+	ParallelGS::RenderPass rp = {};
+
+	if (render_pass.primitive_count)
+	{
+		build_render_pass(rp, reason);
 
 		renderer.flush_rendering(rp);
 
@@ -339,8 +784,10 @@ void GSInterface::flush_render_pass(FlushReason reason)
 	render_pass.feedback_mode = RenderPass::Feedback::None;
 	render_pass.has_aa1 = false;
 	render_pass.has_scanmsk = false;
+	reset_hierarchical_z();
 	render_pass.has_hazardous_short_term_texture_caching = false;
 	render_pass.has_optimized_short_term_texture_caching = false;
+	render_pass.promotion_attributes_valid = hacks.backbuffer_promotion;
 	state_tracker.dirty_flags = STATE_DIRTY_ALL_BITS;
 	//state_tracker.current_copy_cache_hazard_counter = 0;
 
@@ -352,6 +799,13 @@ void GSInterface::flush_render_pass(FlushReason reason)
 
 void GSInterface::flush(PageTrackerFlushFlags flags, FlushReason reason)
 {
+	TraceScope trace(trace_recorder, "Flush", "flush");
+	if (trace_recorder)
+	{
+		add_flush_trace_args(trace, reason);
+		trace.add_arg("flags", flags);
+	}
+
 	if ((flags & PAGE_TRACKER_FLUSH_HOST_VRAM_SYNC_BIT) != 0)
 	{
 		block_buffer.clear();
@@ -371,17 +825,8 @@ void GSInterface::flush(PageTrackerFlushFlags flags, FlushReason reason)
 
 	if ((flags & PAGE_TRACKER_FLUSH_COPY_BIT) != 0)
 	{
-		if ((flags & (PAGE_TRACKER_FLUSH_CACHE_BIT | PAGE_TRACKER_FLUSH_FB_BIT | PAGE_TRACKER_FLUSH_WRITE_BACK_BIT)) != 0)
-		{
-			TRACE_HEADER("FLUSH COPY", Reg64<DummyBits>{0});
-			renderer.flush_transfer();
-		}
-		else
-		{
-			// If we're not flushing anything beyond copies, it means we're just resolving a WAW hazard internally.
-			TRACE_HEADER("BARRIER COPY", Reg64<DummyBits>{0});
-			renderer.transfer_overlap_barrier();
-		}
+		TRACE_HEADER("FLUSH COPY", Reg64<DummyBits>{0});
+		renderer.flush_transfer();
 	}
 
 	if ((flags & PAGE_TRACKER_FLUSH_CACHE_BIT) != 0)
@@ -410,6 +855,8 @@ void GSInterface::flush(PageTrackerFlushFlags flags, FlushReason reason)
 		if (!block_buffer.empty())
 			renderer.flush_readback(block_buffer.data(), block_buffer.size());
 	}
+
+	flush_hazard = {};
 }
 
 void GSInterface::sync_host_vram_page(uint32_t page_index, uint32_t block_mask)
@@ -422,11 +869,6 @@ void GSInterface::sync_vram_host_page(uint32_t page_index)
 	sync_vram_host_pages[page_index / 32] |= 1u << (page_index & 31);
 }
 
-void GSInterface::sync_shadow_page(uint32_t page_index)
-{
-	renderer.mark_shadow_page_sync(page_index);
-}
-
 void GSInterface::rewrite_forwarded_clut_upload(
 		const ContextState &ctx, PaletteUploadDescriptor &upload,
 		uint32_t &palette_width, uint32_t &palette_height)
@@ -480,10 +922,12 @@ void GSInterface::rewrite_forwarded_clut_upload(
 		if ((state.blend_mode & (BLEND_MODE_ABE_BIT | BLEND_MODE_DATE_BIT | BLEND_MODE_DATM_BIT)) != 0)
 			return;
 
-		auto &pos0 = render_pass.positions[3 * render_pass.primitive_count - 5];
-		auto &pos1 = render_pass.positions[3 * render_pass.primitive_count - 6];
-		auto &pos2 = render_pass.positions[3 * render_pass.primitive_count - 2];
-		auto &pos3 = render_pass.positions[3 * render_pass.primitive_count - 3];
+		auto *prev_pos = render_pass.recent_positions[render_pass.primitive_count & 1];
+		auto *last_pos = render_pass.recent_positions[(render_pass.primitive_count - 1) & 1];
+		auto &pos0 = prev_pos[1];
+		auto &pos1 = prev_pos[0];
+		auto &pos2 = last_pos[1];
+		auto &pos3 = last_pos[0];
 
 		// Ensure the full 16 color palette is written as expected.
 		if (pos0.pos.x != 0 || pos0.pos.y != 0)
@@ -495,10 +939,12 @@ void GSInterface::rewrite_forwarded_clut_upload(
 		if (pos3.pos.x <= 7 * PGS_SUBPIXEL_BITS || pos3.pos.y != PGS_SUBPIXELS)
 			return;
 
-		auto &attr0 = render_pass.attributes[3 * render_pass.primitive_count - 5];
-		auto &attr1 = render_pass.attributes[3 * render_pass.primitive_count - 6];
-		auto &attr2 = render_pass.attributes[3 * render_pass.primitive_count - 2];
-		auto &attr3 = render_pass.attributes[3 * render_pass.primitive_count - 3];
+		auto *prev_attr = render_pass.recent_attributes[render_pass.primitive_count & 1];
+		auto *last_attr = render_pass.recent_attributes[(render_pass.primitive_count - 1) & 1];
+		auto &attr0 = prev_attr[1];
+		auto &attr1 = prev_attr[0];
+		auto &attr2 = last_attr[1];
+		auto &attr3 = last_attr[0];
 
 		// CSM2 can only sample from a single line.
 		if (attr0.uv.y != attr1.uv.y || attr0.uv.y != attr2.uv.y || attr0.uv.y != attr3.uv.y)
@@ -585,7 +1031,7 @@ void GSInterface::handle_clut_upload(uint32_t ctx_index)
 	// It's possible CLUT upload will depend on this.
 	// TODO: Could hazard check this, but ... w/e. Hazards between copy and cache isn't that bad.
 	if (transfer_state.host_to_local_active &&
-	    transfer_state.host_to_local_payload.size() > transfer_state.last_flushed_qwords)
+	    transfer_state.get_host_to_local_qwords() > transfer_state.last_flushed_qwords)
 	{
 #ifdef PARALLEL_GS_DEBUG
 		LOGW("Flushing partial transfer due to palette read.\n");
@@ -733,9 +1179,36 @@ void GSInterface::handle_clut_upload(uint32_t ctx_index)
 		}
 	}
 
-	render_pass.clut_instance = renderer.update_palette_cache(palette_desc);
-	bool replacing_clut = render_pass.latest_clut_instance == render_pass.clut_instance;
-	render_pass.latest_clut_instance = render_pass.clut_instance;
+	// Games tend to upload the same palettes over and over across render passes.
+	// If the contents are known, we may be able to resolve the upload to an existing CLUT instance.
+	Util::Hash content_hash = 0;
+	uint32_t deduplicated_instance = UINT32_MAX;
+	if (clut_content_hashing && tracker.texture_can_upload_cpu(&page, 1))
+		content_hash = renderer.hash_palette_upload_cpu(palette_desc, page);
+
+	if (content_hash)
+	{
+		uint32_t age = 0;
+		deduplicated_instance = renderer.find_palette_cache(content_hash, age);
+
+		// The instance must not be overwritten while this render pass may still use it.
+		// Account for it as if it was allocated in this render pass.
+		if (deduplicated_instance != UINT32_MAX)
+			render_pass.pending_palette_updates = std::max<uint32_t>(render_pass.pending_palette_updates, age + 1);
+	}
+
+	bool replacing_clut;
+	if (deduplicated_instance != UINT32_MAX)
+	{
+		render_pass.clut_instance = deduplicated_instance;
+		replacing_clut = false;
+	}
+	else
+	{
+		render_pass.clut_instance = renderer.update_palette_cache(palette_desc, content_hash);
+		replacing_clut = render_pass.latest_clut_instance == render_pass.clut_instance;
+		render_pass.latest_clut_instance = render_pass.clut_instance;
+	}
 	mark_texture_state_dirty();
 
 	if (replacing_clut)
@@ -779,7 +1252,7 @@ void GSInterface::handle_clut_upload(uint32_t ctx_index)
 
 	TRACE("CACHE CLUT", palette_desc);
 
-	if (!replacing_clut)
+	if (!replacing_clut && deduplicated_instance == UINT32_MAX)
 	{
 		render_pass.pending_palette_updates++;
 		if (render_pass.pending_palette_updates >= CLUTInstances)
@@ -899,7 +1372,10 @@ bool GSInterface::get_and_clear_dirty_flag(StateDirtyFlags flags)
 void GSInterface::mark_render_pass_has_texture_feedback(const TEX0Bits &tex0, RenderPass::Feedback mode)
 {
 	if (render_pass.feedback_mode != RenderPass::Feedback::None && mode != render_pass.feedback_mode)
+	{
+		note_flush_hazard(UINT32_MAX, uint32_t(tex0.TBP0));
 		tracker.flush_render_pass(FlushReason::TextureHazard);
+	}
 
 	if (render_pass.feedback_mode != RenderPass::Feedback::None)
 	{
@@ -907,6 +1383,7 @@ void GSInterface::mark_render_pass_has_texture_feedback(const TEX0Bits &tex0, Re
 		    (is_palette_format(render_pass.feedback_psm) &&
 		     render_pass.feedback_cpsm != uint32_t(tex0.CPSM)))
 		{
+			note_flush_hazard(UINT32_MAX, uint32_t(tex0.TBP0));
 			tracker.flush_render_pass(FlushReason::TextureHazard);
 		}
 	}
@@ -922,6 +1399,55 @@ void GSInterface::mark_render_pass_has_texture_feedback(const TEX0Bits &tex0, Re
 		render_pass.instances[render_pass.current_instance].z_feedback = true;
 }
 
+uint32_t GSInterface::find_unused_render_pass_instance() const
+{
+	// An instance may never receive primitives if all of them were culled,
+	// or if FRAME changed again before anything was drawn.
+	for (uint32_t i = 0; i < render_pass.num_instances; i++)
+	{
+		auto &inst = render_pass.instances[i];
+		if (inst.bb.x > inst.bb.z)
+			return i;
+	}
+
+	return render_pass.num_instances;
+}
+
+bool GSInterface::fb_switch_aliases_texture_reads() const
+{
+	// Texture uploads for this render pass are batched until it is flushed.
+	// Only merge if the new targets do not overlap those pages, so that texture and FB accesses
+	// in the fused render pass never alias, regardless of how uploads are ordered against shading.
+	// The other direction, sampling what an earlier instance rendered, is caught by mark_texture_read(),
+	// since an FB change bumps the texflush counter and forces textures to be rechecked.
+	auto &ctx = registers.ctx[registers.prim.desc.CTXT];
+
+	uint32_t x = ctx.scissor.desc.SCAX0;
+	uint32_t y = ctx.scissor.desc.SCAY0;
+	uint32_t x1 = std::min<uint32_t>(ctx.scissor.desc.SCAX1, 2047);
+	uint32_t y1 = std::min<uint32_t>(ctx.scissor.desc.SCAY1, 2047);
+	if (x > x1 || y > y1)
+		return false;
+
+	uint32_t width = x1 - x + 1;
+	uint32_t height = y1 - y + 1;
+
+	auto fb_rect = compute_page_rect(ctx.frame.desc.FBP * PGS_BLOCKS_PER_PAGE, x, y, width, height,
+	                                 ctx.frame.desc.FBW, ctx.frame.desc.PSM);
+	if (tracker.page_has_cached_read(fb_rect))
+		return true;
+
+	if (state_is_z_sensitive())
+	{
+		auto z_rect = compute_page_rect(ctx.zbuf.desc.ZBP * PGS_BLOCKS_PER_PAGE, x, y, width, height,
+		                                ctx.frame.desc.FBW, ctx.zbuf.desc.PSM | ZBUFBits::PSM_MSB);
+		if (tracker.page_has_cached_read(z_rect))
+			return true;
+	}
+
+	return false;
+}
+
 void GSInterface::check_frame_buffer_state()
 {
 	auto &prim = registers.prim;
@@ -943,10 +1469,15 @@ void GSInterface::check_frame_buffer_state()
 		render_pass.current_instance = render_pass.num_instances;
 
 		bool can_fuse_render_pass = !render_pass.has_hazardous_short_term_texture_caching;
+		bool merged_fb_switch = false;
 
 		// If we have short-term cached textures, any framebuffer change will need to invalidate those textures,
 		// and therefore end the render pass.
 		// Short-term textures are effectively defer-invalidated until next framebuffer change.
+		// With working set merging, only fuse if the new targets do not alias anything sampled earlier.
+		if (can_fuse_render_pass && fb_working_set_merging && fb_switch_aliases_texture_reads())
+			can_fuse_render_pass = false;
+
 		if (can_fuse_render_pass)
 		{
 			for (uint32_t instance = 0; instance < render_pass.num_instances; instance++)
@@ -963,11 +1494,28 @@ void GSInterface::check_frame_buffer_state()
 
 		if (render_pass.current_instance == render_pass.num_instances)
 		{
+			// The instance index is encoded in 3 bits of the primitive state,
+			// so the working set cannot grow beyond MaxRenderPassInstances, but unused slots can be recycled.
+			if (render_pass.num_instances == MaxRenderPassInstances && can_fuse_render_pass && fb_working_set_merging)
+			{
+				render_pass.current_instance = find_unused_render_pass_instance();
+				if (render_pass.current_instance != render_pass.num_instances)
+					merged_fb_switch = true;
+			}
+
 			// Allocate new offset instance if we can, otherwise, we're forced to flush early.
-			if (render_pass.num_instances < MaxRenderPassInstances && can_fuse_render_pass)
+			if (render_pass.current_instance < MaxRenderPassInstances && can_fuse_render_pass)
 			{
 				render_pass.instances[render_pass.current_instance] = {};
-				render_pass.num_instances++;
+				if (render_pass.current_instance == render_pass.num_instances)
+					render_pass.num_instances++;
+				if (merged_fb_switch)
+				{
+					render_pass.num_merged_fb_switches++;
+					// Hierarchical Z tiles track the instance index, which now refers to a different target.
+					if (hier_z.instance == render_pass.current_instance)
+						clear_hierarchical_z_tiles();
+				}
 				tracker.invalidate_texture_cache(render_pass.clut_instance);
 				if (render_pass.has_optimized_short_term_texture_caching)
 					tracker.invalidate_fb_write_short_term_references();
@@ -1221,6 +1769,8 @@ void GSInterface::recycle_image_handle(Vulkan::ImageHandle image)
 	// It screws with debug label names.
 	if (!debug_mode.feedback_render_target)
 		renderer.recycle_image_handle(std::move(image));
+	else
+		renderer.release_image_handle(std::move(image));
 }
 
 uint64_t GSInterface::query_timeline()
@@ -1679,6 +2229,30 @@ uint32_t GSInterface::drawing_kick_update_texture(FBFeedbackMode feedback_mode,
 		}
 
 		auto image = tracker.find_cached_texture(hasher.get());
+		Util::Hash content_hash = 0;
+
+		// The page tracker may have retired an identical texture, in which case we can skip the upload.
+		// Super-sampled data is not part of host VRAM, so only consider single sampled textures.
+		if (!image && texture_content_hashing && long_term_cache_texture && csa_mask == 0 && desc.samples == 1 &&
+		    tracker.texture_can_upload_cpu(state_tracker.tex.page_rects, desc.rect.levels))
+		{
+			// The hash is needed even without a retired candidate, so this upload can be revived later.
+			content_hash = renderer.hash_cached_texture_upload_cpu(state_tracker.tex.page_rects[0]);
+			if (tracker.has_retired_cached_texture(hasher.get()))
+			{
+				image = tracker.revive_cached_texture(hasher.get(), content_hash);
+				renderer.mark_texture_content_hash_lookup(bool(image));
+			}
+
+			if (image)
+			{
+				state_tracker.last_cpu_compatible_cache_TBP0 = desc.tex0.desc.TBP0;
+				tracker.register_cached_texture(state_tracker.tex.page_rects, desc.rect.levels,
+				                                csa_mask, render_pass.clut_instance,
+				                                hasher.get(), image, content_hash);
+			}
+		}
+
 		if (!image)
 		{
 			TRACE("CACHE IMAGE", desc);
@@ -1700,7 +2274,7 @@ uint32_t GSInterface::drawing_kick_update_texture(FBFeedbackMode feedback_mode,
 
 				if (tracker.register_cached_texture(state_tracker.tex.page_rects, desc.rect.levels,
 				                                    csa_mask, render_pass.clut_instance,
-				                                    hasher.get(), image) == PageTracker::UploadStrategy::CPU)
+				                                    hasher.get(), image, content_hash) == PageTracker::UploadStrategy::CPU)
 				{
 					renderer.promote_cached_texture_upload_cpu(state_tracker.tex.page_rects[0]);
 				}
@@ -2064,43 +2638,232 @@ bool GSInterface::draw_is_degenerate()
 			fbmsk |= 0xff << 24;
 			break;
 
-		default:
-			break;
-		}
+		default:
+			break;
+		}
+	}
+
+	// Color is effectively masked here, functioning as a noop.
+	if (prim.desc.ABE && ctx.alpha.desc.D == BLEND_RGB_DEST && ctx.alpha.desc.A == ctx.alpha.desc.B)
+		fbmsk |= 0xffffff;
+
+	// Any write is ignored. PS2 rendering does not have side effects.
+	// Undefined ZTE seems to mean ignore depth completely.
+
+	bool read_only_color = fbmsk == UINT32_MAX;
+	bool read_only_depth = zmsk || ctx.test.desc.ZTE == TESTBits::ZTE_UNDEFINED;
+	state_tracker.degenerate_draw = read_only_color && read_only_depth;
+	return state_tracker.degenerate_draw;
+}
+
+bool GSInterface::state_is_z_sensitive() const
+{
+	auto &prim = registers.prim;
+	auto &ctx = registers.ctx[prim.desc.CTXT];
+
+	if (ctx.test.desc.ZTE == TESTBits::ZTE_ENABLED)
+	{
+		// We need to read depth.
+		if (ctx.test.desc.has_z_test())
+			return true;
+
+		bool implied_z_mask = ctx.test.desc.ATE != 0 &&
+		                      ctx.test.desc.ATST == ATST_NEVER &&
+		                      ctx.test.desc.AFAIL != AFAIL_ZB_ONLY;
+
+		// We need to write depth.
+		// ZTST_NEVER will trigger degenerate draw and won't hit this path.
+		if (!implied_z_mask && ctx.zbuf.desc.ZMSK == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static bool page_rects_may_overlap(const PageRect &a, const PageRect &b, uint32_t num_pages)
+{
+	uint32_t a_end = a.base_page + (a.page_height - 1) * a.page_stride + a.page_width;
+	uint32_t b_end = b.base_page + (b.page_height - 1) * b.page_stride + b.page_width;
+
+	// Don't bother with wrap-around.
+	if (a_end > num_pages || b_end > num_pages)
+		return true;
+
+	return a.base_page < b_end && b.base_page < a_end;
+}
+
+void GSInterface::clear_hierarchical_z_tiles()
+{
+	auto &hz = hier_z;
+	for (int y = hz.dirty_bb.y; y <= hz.dirty_bb.w; y++)
+	{
+		memset(hz.min_z + y * HierarchicalZ::TilesPerAxis + hz.dirty_bb.x, 0,
+		       (hz.dirty_bb.z - hz.dirty_bb.x + 1) * sizeof(uint32_t));
+	}
+
+	hz.dirty_bb = ivec4(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+	hz.instance = UINT32_MAX;
+}
+
+void GSInterface::reset_hierarchical_z()
+{
+	clear_hierarchical_z_tiles();
+	hier_z.disabled = false;
+}
+
+bool GSInterface::hierarchical_z_is_active()
+{
+	if (!hierarchical_z_culling)
+		return false;
+
+	auto &hz = hier_z;
+	auto &ctx = registers.ctx[registers.prim.desc.CTXT];
+
+	// Tiles are in the coordinate space of the instance, so only track one at a time.
+	if (hz.instance != render_pass.current_instance || !hz.zbuf.desc.compat(ctx.zbuf.desc))
+	{
+		clear_hierarchical_z_tiles();
+		hz.instance = render_pass.current_instance;
+		hz.zbuf = ctx.zbuf;
+	}
+
+	switch (hz.zbuf.desc.PSM | ZBUFBits::PSM_MSB)
+	{
+	case PSMZ32:
+		hz.z_max = UINT32_MAX;
+		break;
+	case PSMZ24:
+		hz.z_max = 0xffffff;
+		break;
+	case PSMZ16:
+	case PSMZ16S:
+		hz.z_max = 0xffff;
+		break;
+	default:
+		return false;
+	}
+
+	// Once depth can be observed or written through anything but plain Z writes, give up for this render pass.
+	if (render_pass.is_color_feedback || render_pass.is_depth_feedback ||
+	    render_pass.current_primitive_is_channel_shuffle)
+	{
+		hz.disabled = true;
+	}
+
+	return !hz.disabled;
+}
+
+bool GSInterface::hierarchical_z_rejects(const ivec4 &bb, uint32_t z_max, bool z_greater) const
+{
+	constexpr int MaxTile = HierarchicalZ::TilesPerAxis - 1;
+	int x0 = std::min<int>(bb.x >> HierarchicalZ::TileSizeLog2, MaxTile);
+	int y0 = std::min<int>(bb.y >> HierarchicalZ::TileSizeLog2, MaxTile);
+	int x1 = std::min<int>(bb.z >> HierarchicalZ::TileSizeLog2, MaxTile);
+	int y1 = std::min<int>(bb.w >> HierarchicalZ::TileSizeLog2, MaxTile);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const uint32_t *row = hier_z.min_z + y * HierarchicalZ::TilesPerAxis;
+		for (int x = x0; x <= x1; x++)
+		{
+			// Any pixel in the tile could pass.
+			if (z_greater ? z_max > row[x] : z_max >= row[x])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void GSInterface::hierarchical_z_update(const ivec4 &bb, uint32_t z_min, bool monotonic, bool full_coverage)
+{
+	// With a Z test, depth can only increase, so only fully covered tiles learn anything.
+	// Without a Z test, depth can decrease anywhere the primitive touches.
+	if (monotonic && !full_coverage)
+		return;
+
+	auto &hz = hier_z;
+	constexpr int TileSizeLog2 = HierarchicalZ::TileSizeLog2;
+	constexpr int MaxTile = HierarchicalZ::TilesPerAxis - 1;
+	int x0 = std::min<int>(bb.x >> TileSizeLog2, MaxTile);
+	int y0 = std::min<int>(bb.y >> TileSizeLog2, MaxTile);
+	int x1 = std::min<int>(bb.z >> TileSizeLog2, MaxTile);
+	int y1 = std::min<int>(bb.w >> TileSizeLog2, MaxTile);
+
+	// Shrink by a pixel, so that super-samples along the edges are not assumed to be covered.
+	ivec4 full_bb = ivec4(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+	if (full_coverage)
+	{
+		constexpr int TileMask = (1 << TileSizeLog2) - 1;
+		ivec4 inner = bb + ivec4(1, 1, -1, -1);
+		full_bb.x = (inner.x + TileMask) >> TileSizeLog2;
+		full_bb.y = (inner.y + TileMask) >> TileSizeLog2;
+		full_bb.z = ((inner.z + 1) >> TileSizeLog2) - 1;
+		full_bb.w = ((inner.w + 1) >> TileSizeLog2) - 1;
 	}
 
-	// Color is effectively masked here, functioning as a noop.
-	if (prim.desc.ABE && ctx.alpha.desc.D == BLEND_RGB_DEST && ctx.alpha.desc.A == ctx.alpha.desc.B)
-		fbmsk |= 0xffffff;
-
-	// Any write is ignored. PS2 rendering does not have side effects.
-	// Undefined ZTE seems to mean ignore depth completely.
+	for (int y = y0; y <= y1; y++)
+	{
+		uint32_t *row = hz.min_z + y * HierarchicalZ::TilesPerAxis;
+		bool full_row = y >= full_bb.y && y <= full_bb.w;
+		for (int x = x0; x <= x1; x++)
+		{
+			if (full_row && x >= full_bb.x && x <= full_bb.z)
+				row[x] = monotonic ? std::max<uint32_t>(row[x], z_min) : z_min;
+			else if (!monotonic)
+				row[x] = std::min<uint32_t>(row[x], z_min);
+		}
+	}
 
-	bool read_only_color = fbmsk == UINT32_MAX;
-	bool read_only_depth = zmsk || ctx.test.desc.ZTE == TESTBits::ZTE_UNDEFINED;
-	state_tracker.degenerate_draw = read_only_color && read_only_depth;
-	return state_tracker.degenerate_draw;
+	if (full_bb.x <= full_bb.z && full_bb.y <= full_bb.w)
+	{
+		hz.dirty_bb.x = std::min<int>(hz.dirty_bb.x, full_bb.x);
+		hz.dirty_bb.y = std::min<int>(hz.dirty_bb.y, full_bb.y);
+		hz.dirty_bb.z = std::max<int>(hz.dirty_bb.z, full_bb.z);
+		hz.dirty_bb.w = std::max<int>(hz.dirty_bb.w, full_bb.w);
+	}
 }
 
-bool GSInterface::state_is_z_sensitive() const
+bool GSInterface::hierarchical_z_cull_primitive(const ivec4 &bb, const VertexPosition *pos, uint32_t num_positions,
+                                                bool constant_z, bool allow_reject)
 {
+	if (!hierarchical_z_is_active())
+		return false;
+
 	auto &prim = registers.prim;
 	auto &ctx = registers.ctx[prim.desc.CTXT];
+	auto &test = ctx.test.desc;
 
-	if (ctx.test.desc.ZTE == TESTBits::ZTE_ENABLED)
+	if (test.ZTE != TESTBits::ZTE_ENABLED || test.ZTST == TESTBits::ZTST_NEVER)
+		return false;
+
+	// Z is clamped to the format before testing and writing, so clamping the range is exact.
+	uint32_t z_lo = UINT32_MAX;
+	uint32_t z_hi = 0;
+	for (uint32_t i = 0; i < num_positions; i++)
 	{
-		// We need to read depth.
-		if (ctx.test.desc.has_z_test())
-			return true;
+		uint32_t z = std::min<uint32_t>(pos[i].z, hier_z.z_max);
+		z_lo = std::min<uint32_t>(z_lo, z);
+		z_hi = std::max<uint32_t>(z_hi, z);
+	}
 
-		bool implied_z_mask = ctx.test.desc.ATE != 0 &&
-		                      ctx.test.desc.ATST == ATST_NEVER &&
-		                      ctx.test.desc.AFAIL != AFAIL_ZB_ONLY;
+	// Interpolated Z can round slightly outside the range of the vertices.
+	uint32_t margin = constant_z ? 0 : 1 + ((z_hi - z_lo) >> 10);
+	z_lo = z_lo > margin ? z_lo - margin : 0;
+	z_hi = uint32_t(std::min<uint64_t>(uint64_t(z_hi) + margin, hier_z.z_max));
 
-		// We need to write depth.
-		// ZTST_NEVER will trigger degenerate draw and won't hit this path.
-		if (!implied_z_mask && ctx.zbuf.desc.ZMSK == 0)
-			return true;
+	if (allow_reject && test.has_z_test() &&
+	    hierarchical_z_rejects(bb, z_hi, test.ZTST == TESTBits::ZTST_GREATER))
+	{
+		return true;
+	}
+
+	if (ctx.zbuf.desc.ZMSK == 0)
+	{
+		// Any pixel which can be discarded keeps its old depth.
+		bool no_discard = (!test.ATE || test.ATST == ATST_ALWAYS || test.AFAIL == AFAIL_ZB_ONLY) &&
+		                  !test.DATE && !prim.desc.AA1 && !registers.scanmsk.desc.has_mask();
+		hierarchical_z_update(bb, z_lo, test.has_z_test(), constant_z && no_discard);
 	}
 
 	return false;
@@ -2545,8 +3308,8 @@ void GSInterface::drawing_kick_append()
 		if (state_tracker.dirty_flags == 0 && is_parallelogram_candidate &&
 		    render_pass.last_triangle_is_parallelogram_candidate &&
 		    triangles_form_parallelogram(pos, attr, order,
-		                                 render_pass.positions + (render_pass.primitive_count - 1) * 3,
-		                                 render_pass.attributes + (render_pass.primitive_count - 1) * 3,
+		                                 render_pass.recent_positions[(render_pass.primitive_count - 1) & 1],
+		                                 render_pass.recent_attributes[(render_pass.primitive_count - 1) & 1],
 		                                 render_pass.last_triangle_parallelogram_order,
 		                                 prim.desc))
 		{
@@ -2554,6 +3317,9 @@ void GSInterface::drawing_kick_append()
 			state |= (1u << STATE_BIT_PARALLELOGRAM) |
 			         (render_pass.last_triangle_parallelogram_order.x << STATE_PARALLELOGRAM_PROVOKING_OFFSET);
 
+			// The other half is now part of a queued primitive, so it must be accounted for.
+			hierarchical_z_cull_primitive(bb, pos, num_vertices, false, false);
+
 			render_pass.last_triangle_is_parallelogram_candidate = false;
 			TRACE("Promote Parallelogram", DummyBits{});
 			return;
@@ -2592,7 +3358,7 @@ void GSInterface::drawing_kick_append()
 	// The write should technically happen as soon as we write HWREG.
 	// This can trigger a texture invalidation. We need to do it here, before checking for texture dirty state.
 	if (prim.desc.TME && transfer_state.host_to_local_active &&
-	    transfer_state.host_to_local_payload.size() > transfer_state.last_flushed_qwords)
+	    transfer_state.get_host_to_local_qwords() > transfer_state.last_flushed_qwords)
 	{
 #ifdef PARALLEL_GS_DEBUG
 		LOGW("Flushing partial transfer due to texture read ...\n");
@@ -2672,35 +3438,6 @@ void GSInterface::drawing_kick_append()
 
 	prim_attr.state |= render_pass.current_instance << STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET;
 
-	// If our damage region expands, then mark hazards.
-	// This avoids spam where we have to remark pages as dirty every single draw.
-	bool rp_expands = false;
-	bool is_z_sensitive = state_is_z_sensitive();
-
-	// We go from no Z pages to at least read-only Z.
-	if (!fb_instance.z_sensitive && is_z_sensitive)
-	{
-		fb_instance.z_sensitive = true;
-		rp_expands = true;
-	}
-
-	// We go from read-only Z to read-write Z.
-	if (is_z_sensitive && ctx.zbuf.desc.ZMSK == 0 && !fb_instance.z_write)
-	{
-		fb_instance.z_write = true;
-		// With Z writes existing, we might have a feedback we didn't have before.
-		state_tracker.dirty_flags |= STATE_DIRTY_FEEDBACK_BIT;
-		rp_expands = true;
-	}
-
-	// Color write mask increases, redamage all pages.
-	uint32_t write_mask = ~ctx.frame.desc.FBMSK;
-	if ((write_mask & fb_instance.color_write_mask) != write_mask)
-	{
-		fb_instance.color_write_mask |= write_mask;
-		rp_expands = true;
-	}
-
 	auto &current_bb = fb_instance.bb;
 
 	if (render_pass.can_fb_wraparound && bb.x > render_pass.scissor_hi_x_fb)
@@ -2749,6 +3486,46 @@ void GSInterface::drawing_kick_append()
 	assert(bb.z < int(std::max<int>(1, fb_instance.frame.desc.FBW) * PGS_BUFFER_WIDTH_SCALE));
 	assert(bb.z < int(std::max<int>(1, ctx.frame.desc.FBW) * PGS_BUFFER_WIDTH_SCALE));
 
+	// Cull before the instance state and bounding box grow, so a culled primitive leaves no trace in the
+	// render pass. An instance which only received culled primitives can then be recycled.
+	if (hierarchical_z_cull_primitive(bb, pos, num_vertices == 3 ? 3 : 2, quad || num_vertices == 1, true))
+	{
+		TRACE("Z culled", bb);
+		render_pass.num_z_culled_primitives++;
+		render_pass.last_triangle_is_parallelogram_candidate = false;
+		state_tracker.dirty_flags = 0;
+		return;
+	}
+
+	// If our damage region expands, then mark hazards.
+	// This avoids spam where we have to remark pages as dirty every single draw.
+	bool rp_expands = false;
+	bool is_z_sensitive = state_is_z_sensitive();
+
+	// We go from no Z pages to at least read-only Z.
+	if (!fb_instance.z_sensitive && is_z_sensitive)
+	{
+		fb_instance.z_sensitive = true;
+		rp_expands = true;
+	}
+
+	// We go from read-only Z to read-write Z.
+	if (is_z_sensitive && ctx.zbuf.desc.ZMSK == 0 && !fb_instance.z_write)
+	{
+		fb_instance.z_write = true;
+		// With Z writes existing, we might have a feedback we didn't have before.
+		state_tracker.dirty_flags |= STATE_DIRTY_FEEDBACK_BIT;
+		rp_expands = true;
+	}
+
+	// Color write mask increases, redamage all pages.
+	uint32_t write_mask = ~ctx.frame.desc.FBMSK;
+	if ((write_mask & fb_instance.color_write_mask) != write_mask)
+	{
+		fb_instance.color_write_mask |= write_mask;
+		rp_expands = true;
+	}
+
 	// Expand render pass BB.
 	// If we expand, damage pages.
 	// Writing fine-grained FB results is too costly on CPU,
@@ -2774,9 +3551,19 @@ void GSInterface::drawing_kick_append()
 				tracker.mark_fb_write(z_rect);
 			else
 				tracker.mark_fb_read(z_rect);
+
+			// Color writes which alias the Z buffer change depth behind our back.
+			if (hierarchical_z_culling && fb_rect.write_mask &&
+			    page_rects_may_overlap(fb_rect, z_rect, vram_size / PageSize))
+			{
+				hier_z.disabled = true;
+			}
 		}
 	}
 
+	render_pass.primitive_bb_area += uint64_t(bb.z - bb.x + 1) * uint64_t(bb.w - bb.y + 1);
+	if (!quad && num_vertices != 1)
+		fb_instance.has_triangles_or_lines = true;
 	prim_attr.bb = i16vec4(bb);
 
 	TRACE("Primitive", prim_attr);
@@ -2785,6 +3572,18 @@ void GSInterface::drawing_kick_append()
 	render_pass.prim[render_pass.primitive_count] = prim_attr;
 	memcpy(render_pass.positions + 3 * render_pass.primitive_count, pos, sizeof(pos));
 	memcpy(render_pass.attributes + 3 * render_pass.primitive_count, attr, sizeof(attr));
+
+	// The primitive buffers may be uncached, so keep cached copies of anything that is read back later.
+	memcpy(render_pass.recent_positions[render_pass.primitive_count & 1], pos, sizeof(pos));
+	memcpy(render_pass.recent_attributes[render_pass.primitive_count & 1], attr, sizeof(attr));
+	if (render_pass.primitive_count < MaxShadowedPrimitives)
+	{
+		memcpy(render_pass.position_shadow + 3 * render_pass.primitive_count, pos, sizeof(pos));
+		memcpy(render_pass.attribute_shadow + 3 * render_pass.primitive_count, attr, sizeof(attr));
+	}
+	if (render_pass.promotion_attributes_valid)
+		memcpy(&render_pass.promotion_attributes[2 * render_pass.primitive_count], attr, 2 * sizeof(attr[0]));
+
 	render_pass.primitive_count++;
 	// Commit this here as well. Need to do it after flushing state, since that may reset any tracking state.
 	render_pass.last_triangle_is_parallelogram_candidate = is_parallelogram_candidate;
@@ -2929,7 +3728,7 @@ void GSInterface::a_d_TEX2(uint64_t payload)
 void GSInterface::check_pending_transfer()
 {
 	if (transfer_state.host_to_local_active &&
-	    transfer_state.host_to_local_payload.size() >= transfer_state.required_qwords)
+	    transfer_state.get_host_to_local_qwords() >= transfer_state.required_qwords)
 	{
 		flush_pending_transfer(false);
 	}
@@ -2938,7 +3737,7 @@ void GSInterface::check_pending_transfer()
 void GSInterface::flush_pending_transfer(bool keep_alive)
 {
 	if (transfer_state.host_to_local_active &&
-	    transfer_state.host_to_local_payload.size() > transfer_state.last_flushed_qwords)
+	    transfer_state.get_host_to_local_qwords() > transfer_state.last_flushed_qwords)
 	{
 #ifdef PARALLEL_GS_DEBUG
 		if (transfer_state.copy.bitbltbuf.bits != registers.bitbltbuf.bits)
@@ -2959,8 +3758,8 @@ void GSInterface::flush_pending_transfer(bool keep_alive)
 
 		bool copy_cpu = false;
 
-		transfer_state.copy.host_data = transfer_state.host_to_local_payload.data();
-		transfer_state.copy.host_data_size = transfer_state.host_to_local_payload.size() * sizeof(uint64_t);
+		transfer_state.copy.host_data = transfer_state.get_host_to_local_data();
+		transfer_state.copy.host_data_size = transfer_state.get_host_to_local_qwords() * sizeof(uint64_t);
 		transfer_state.copy.host_data_size_offset = transfer_state.last_flushed_qwords * sizeof(uint64_t);
 		transfer_state.copy.host_data_size_required = transfer_state.required_qwords * sizeof(uint64_t);
 
@@ -3086,12 +3885,12 @@ void GSInterface::flush_pending_transfer(bool keep_alive)
 		if (!copy_cpu)
 		{
 			tracker.mark_transfer_write(dst_rect);
-			renderer.copy_vram(transfer_state.copy, dst_rect);
+			renderer.copy_vram(transfer_state.copy, dst_rect, {});
 		}
 
 		// Very possible we just have to flush early and we never receive more image data until
 		// game kicks a new transfer.
-		transfer_state.last_flushed_qwords = uint32_t(transfer_state.host_to_local_payload.size());
+		transfer_state.last_flushed_qwords = uint32_t(transfer_state.get_host_to_local_qwords());
 		tracker.invalidate_texture_cache(render_pass.clut_instance);
 		invalidate_promoted_backbuffer(transfer_state.copy.bitbltbuf.desc.DBP / PGS_BLOCKS_PER_PAGE);
 
@@ -3100,14 +3899,68 @@ void GSInterface::flush_pending_transfer(bool keep_alive)
 
 	if (!keep_alive)
 	{
+		if (transfer_state.host_to_local_ring)
+		{
+			renderer.end_host_transfer();
+			transfer_state.host_to_local_ring = nullptr;
+			transfer_state.host_to_local_ring_qwords = 0;
+		}
+
 		transfer_state.host_to_local_payload.clear();
 		transfer_state.last_flushed_qwords = 0;
 		transfer_state.host_to_local_active = false;
 	}
 }
 
+void GSInterface::append_host_to_local_payload(const uint64_t *payload, size_t count)
+{
+	if (transfer_state.host_to_local_ring)
+	{
+		// The ring allocation is sized for the transfer. Excess data is never read by the copy anyway.
+		count = std::min<size_t>(count, transfer_state.required_qwords - transfer_state.host_to_local_ring_qwords);
+		memcpy(transfer_state.host_to_local_ring + transfer_state.host_to_local_ring_qwords,
+		       payload, count * sizeof(uint64_t));
+		transfer_state.host_to_local_ring_qwords += count;
+	}
+	else
+	{
+		transfer_state.host_to_local_payload.insert(transfer_state.host_to_local_payload.end(),
+		                                            payload, payload + count);
+	}
+}
+
+uint64_t *GSInterface::map_host_to_local_payload(size_t &max_qwords)
+{
+	sync_gif_worker();
+
+	if (!transfer_state.host_to_local_active || !transfer_state.host_to_local_ring)
+	{
+		max_qwords = 0;
+		return nullptr;
+	}
+
+	max_qwords = transfer_state.required_qwords - transfer_state.host_to_local_ring_qwords;
+	return transfer_state.host_to_local_ring + transfer_state.host_to_local_ring_qwords;
+}
+
+void GSInterface::commit_host_to_local_payload(size_t num_qwords)
+{
+	sync_gif_worker();
+
+	if (!transfer_state.host_to_local_active || !transfer_state.host_to_local_ring)
+		return;
+
+	assert(num_qwords <= transfer_state.required_qwords - transfer_state.host_to_local_ring_qwords);
+	transfer_state.host_to_local_ring_qwords += num_qwords;
+	// Flush out transfer if enough data has been received.
+	check_pending_transfer();
+}
+
 void GSInterface::read_transfer_fifo(void *data, uint32_t num_128b_words)
 {
+	sync_gif_worker();
+	resolve_fifo_readback();
+
 	uint32_t to_copy = std::min<uint32_t>(num_128b_words, transfer_state.fifo_readback_128b_size - transfer_state.fifo_readback_128b_offset);
 
 	if (to_copy)
@@ -3126,6 +3979,7 @@ void GSInterface::read_transfer_fifo(void *data, uint32_t num_128b_words)
 
 void GSInterface::init_transfer()
 {
+	resolve_fifo_readback();
 	flush_pending_transfer(false);
 
 	transfer_state.copy.trxdir = registers.trxdir;
@@ -3155,7 +4009,7 @@ void GSInterface::init_transfer()
 
 		transfer_state.copy.needs_shadow_vram = tracker.mark_transfer_copy(dst_rect, src_rect);
 		tracker.invalidate_texture_cache(render_pass.clut_instance);
-		renderer.copy_vram(transfer_state.copy, dst_rect);
+		renderer.copy_vram(transfer_state.copy, dst_rect, src_rect);
 		invalidate_promoted_backbuffer(transfer_state.copy.bitbltbuf.desc.DBP / PGS_BLOCKS_PER_PAGE);
 	}
 	else if (XDIR == HOST_TO_LOCAL)
@@ -3167,6 +4021,13 @@ void GSInterface::init_transfer()
 
 		transfer_state.host_to_local_active = transfer_state.required_qwords != 0;
 		transfer_state.copy.needs_shadow_vram = false;
+
+		if (transfer_state.host_to_local_active && host_transfer_ring)
+		{
+			transfer_state.host_to_local_ring = static_cast<uint64_t *>(
+					renderer.begin_host_transfer(transfer_state.required_qwords * sizeof(uint64_t)));
+		}
+
 		// Await writes to HWREG.
 	}
 	else if (XDIR == LOCAL_TO_HOST)
@@ -3202,35 +4063,46 @@ void GSInterface::init_transfer()
 			if (debug_mode.deterministic_timeline_query)
 				renderer.wait_timeline(host_timeline);
 		}
-		renderer.wait_timeline(host_timeline);
 
-		void *mapped = renderer.begin_host_vram_access();
+		// Don't wait here. The emulator likely has other work to do before it drains the FIFO.
+		transfer_state.fifo_readback_timeline = host_timeline;
+		transfer_state.fifo_readback_pending = true;
+	}
+}
 
-		switch (transfer_state.copy.bitbltbuf.desc.SPSM)
-		{
+void GSInterface::resolve_fifo_readback()
+{
+	if (!transfer_state.fifo_readback_pending)
+		return;
+	transfer_state.fifo_readback_pending = false;
+
+	renderer.wait_timeline(transfer_state.fifo_readback_timeline);
+	const void *mapped = renderer.begin_host_vram_access();
+
+	switch (transfer_state.copy.bitbltbuf.desc.SPSM)
+	{
 #define PSM_DISPATCH(psm) \
-		case psm: \
-			vram_readback<psm>(transfer_state.fifo_readback.data(), mapped, \
-			                   transfer_state.copy.bitbltbuf.desc.SBP, transfer_state.copy.bitbltbuf.desc.SBW, \
-			                   transfer_state.copy.trxpos.desc.SSAX, transfer_state.copy.trxpos.desc.SSAY, \
-			                   transfer_state.copy.trxreg.desc.RRW, transfer_state.copy.trxreg.desc.RRH, vram_size - 1); \
-			break
-			PSM_DISPATCH(PSMCT32);
-			PSM_DISPATCH(PSMZ32);
-			PSM_DISPATCH(PSMCT24);
-			PSM_DISPATCH(PSMZ24);
-			PSM_DISPATCH(PSMCT16);
-			PSM_DISPATCH(PSMCT16S);
-			PSM_DISPATCH(PSMZ16);
-			PSM_DISPATCH(PSMZ16S);
-			PSM_DISPATCH(PSMT8);
-			PSM_DISPATCH(PSMT8H);
+	case psm: \
+		vram_readback<psm>(transfer_state.fifo_readback.data(), mapped, \
+		                   transfer_state.copy.bitbltbuf.desc.SBP, transfer_state.copy.bitbltbuf.desc.SBW, \
+		                   transfer_state.copy.trxpos.desc.SSAX, transfer_state.copy.trxpos.desc.SSAY, \
+		                   transfer_state.copy.trxreg.desc.RRW, transfer_state.copy.trxreg.desc.RRH, vram_size - 1); \
+		break
+		PSM_DISPATCH(PSMCT32);
+		PSM_DISPATCH(PSMZ32);
+		PSM_DISPATCH(PSMCT24);
+		PSM_DISPATCH(PSMZ24);
+		PSM_DISPATCH(PSMCT16);
+		PSM_DISPATCH(PSMCT16S);
+		PSM_DISPATCH(PSMZ16);
+		PSM_DISPATCH(PSMZ16S);
+		PSM_DISPATCH(PSMT8);
+		PSM_DISPATCH(PSMT8H);
 #undef PSM_DISPATCH
 
-		default:
-			LOGW("Unrecognized FIFO readback PSM: %u\n", transfer_state.copy.bitbltbuf.desc.SPSM);
-			break;
-		}
+	default:
+		LOGW("Unrecognized FIFO readback PSM: %u\n", transfer_state.copy.bitbltbuf.desc.SPSM);
+		break;
 	}
 }
 
@@ -3276,6 +4148,7 @@ void GSInterface::update_optimized_gif_handler(uint32_t path)
 {
 	auto &hand = optimized_draw_handler[path];
 	hand = nullptr;
+	tag_programs[path] = {};
 
 	auto &gif_path = paths[path];
 
@@ -3461,6 +4334,55 @@ void GSInterface::update_optimized_gif_handler(uint32_t path)
 		if ((gif_path.tag.REGS & reg_mask) == (ad_only_mask & reg_mask))
 			hand = ADONLYHandlers[gif_path.tag.NREG];
 	}
+
+	if (!hand)
+		tag_programs[path] = get_tag_program(gif_path.tag.REGS, nreg == 0 ? 16 : nreg);
+}
+
+GSInterface::GIFTagProgramHandle GSInterface::get_tag_program(uint64_t regs, uint32_t nreg)
+{
+	// Registers beyond NREG are ignored, so don't let garbage there fragment the cache.
+	if (nreg < 16)
+		regs &= (1ull << (nreg * 4)) - 1;
+
+	uint64_t h = (regs ^ nreg) * 0x9e3779b97f4a7c15ull;
+	uint32_t slot = uint32_t(h >> 58);
+	auto &program = tag_program_cache[slot];
+	static_assert(TagProgramCacheSize == 64, "Hash must match cache size.");
+
+	if (program.generation == 0 || program.nreg != nreg || program.regs != regs)
+	{
+		program.regs = regs;
+		program.nreg = nreg;
+		// Skip 0 on wrap-around, it marks an empty handle.
+		if (++tag_program_generation == 0)
+			tag_program_generation = 1;
+		program.generation = tag_program_generation;
+		for (uint32_t i = 0; i < nreg; i++)
+			program.handlers[i] = packed_handlers[(regs >> (4 * i)) & 0xf];
+	}
+
+	return { slot, program.generation };
+}
+
+const GSInterface::GIFTagProgram &GSInterface::resolve_tag_program(uint32_t path)
+{
+	auto &handle = tag_programs[path];
+	if (tag_program_cache[handle.slot].generation != handle.generation)
+	{
+		// Another path evicted our slot, decode it again.
+		auto &tag = paths[path].tag;
+		handle = get_tag_program(tag.REGS, tag.NREG == 0 ? 16 : tag.NREG);
+	}
+	return tag_program_cache[handle.slot];
+}
+
+void GSInterface::run_tag_program(const GIFTagProgram &program, const GIFTagBits *qwords, uint32_t num_loops)
+{
+	uint32_t nreg = program.nreg;
+	for (uint32_t i = 0; i < num_loops; i++)
+		for (uint32_t j = 0; j < nreg; j++, qwords++)
+			(this->*program.handlers[j])(qwords);
 }
 
 void GSInterface::a_d_PRIM(uint64_t payload)
@@ -3904,7 +4826,7 @@ void GSInterface::a_d_HWREG(uint64_t payload)
 {
 	if (transfer_state.host_to_local_active)
 	{
-		transfer_state.host_to_local_payload.push_back(payload);
+		append_host_to_local_payload(&payload, 1);
 		// Flush out transfer if enough data has been received.
 		check_pending_transfer();
 	}
@@ -3914,8 +4836,7 @@ void GSInterface::a_d_HWREG_multi(const uint64_t *payload, size_t count)
 {
 	if (transfer_state.host_to_local_active)
 	{
-		transfer_state.host_to_local_payload.insert(transfer_state.host_to_local_payload.end(),
-													payload, payload + count);
+		append_host_to_local_payload(payload, count);
 		// Flush out transfer if enough data has been received.
 		check_pending_transfer();
 	}
@@ -4071,6 +4992,12 @@ void GSInterface::packed_STXYZSTRGBAXYZ_sprite(const void *words_, uint32_t num_
 	}
 }
 
+void GSInterface::packed_A_D(const void *words)
+{
+	auto &ad = *static_cast<const Reg128<PackedADBits> *>(words);
+	(this->*ad_handlers[ad.desc.ADDR])(ad.desc.data);
+}
+
 void GSInterface::packed_FOG(const void *words)
 {
 	auto &fog = *static_cast<const PackedFOGBits *>(words);
@@ -4120,10 +5047,14 @@ void GSInterface::setup_handlers()
 	packed_handlers[int(GIFAddr::XYZ2)] = &GSInterface::packed_XYZ<false>;
 	packed_handlers[int(GIFAddr::XYZF3)] = &GSInterface::packed_XYZF<true>;
 	packed_handlers[int(GIFAddr::XYZ3)] = &GSInterface::packed_XYZ<true>;
+	packed_handlers[int(GIFAddr::A_D)] = &GSInterface::packed_A_D;
 }
 
 void *GSInterface::map_vram_write(size_t offset, size_t size)
 {
+	sync_gif_worker();
+	resolve_fifo_readback();
+
 	if (!size)
 		return nullptr;
 
@@ -4151,6 +5082,7 @@ void *GSInterface::map_vram_write(size_t offset, size_t size)
 
 void GSInterface::end_vram_write(size_t offset, size_t size)
 {
+	sync_gif_worker();
 	if (!size)
 		return;
 
@@ -4170,8 +5102,20 @@ void GSInterface::end_vram_write(size_t offset, size_t size)
 
 const void *GSInterface::map_vram_read(size_t offset, size_t size)
 {
+	return map_vram_read(request_vram_read(offset, size));
+}
+
+VRAMReadTicket GSInterface::request_vram_read(size_t offset, size_t size)
+{
+	sync_gif_worker();
+	resolve_fifo_readback();
+
+	VRAMReadTicket ticket = {};
+	ticket.offset = offset;
+	ticket.size = size;
+
 	if (!size)
-		return nullptr;
+		return ticket;
 
 	size_t begin_page = offset / PageSize;
 	size_t end_page = (offset + size - 1) / PageSize;
@@ -4190,13 +5134,38 @@ const void *GSInterface::map_vram_read(size_t offset, size_t size)
 		renderer.flush_submit(host_read_timeline);
 	}
 
-	renderer.wait_timeline(host_read_timeline);
+	ticket.timeline = host_read_timeline;
+	return ticket;
+}
+
+bool GSInterface::poll_vram_read(const VRAMReadTicket &ticket)
+{
+	sync_gif_worker();
+	return renderer.query_timeline() >= ticket.timeline;
+}
+
+const void *GSInterface::try_map_vram_read(const VRAMReadTicket &ticket)
+{
+	sync_gif_worker();
+	if (!ticket.size || !poll_vram_read(ticket))
+		return nullptr;
+	return static_cast<const uint8_t *>(renderer.begin_host_vram_access()) + ticket.offset;
+}
+
+const void *GSInterface::map_vram_read(const VRAMReadTicket &ticket)
+{
+	sync_gif_worker();
+	if (!ticket.size)
+		return nullptr;
 
-	return static_cast<const uint8_t *>(renderer.begin_host_vram_access()) + offset;
+	renderer.wait_timeline(ticket.timeline);
+	return static_cast<const uint8_t *>(renderer.begin_host_vram_access()) + ticket.offset;
 }
 
 void GSInterface::flush()
 {
+	sync_gif_worker();
+	resolve_fifo_readback();
 	flush_pending_transfer(true);
 	uint64_t value = tracker.mark_submission_timeline();
 	renderer.flush_submit(value);
@@ -4206,6 +5175,7 @@ void GSInterface::flush()
 
 void GSInterface::clobber_register_state()
 {
+	sync_gif_worker();
 	state_tracker.dirty_flags = STATE_DIRTY_ALL_BITS;
 	update_draw_handler();
 	// We don't know which path will start executing so we cannot infer anything from pending GIFTags.
@@ -4216,6 +5186,7 @@ void GSInterface::clobber_register_state()
 
 void GSInterface::write_register(RegisterAddr addr, uint64_t payload)
 {
+	sync_gif_worker();
 	(this->*ad_handlers[int(addr)])(payload);
 }
 
@@ -4225,20 +5196,25 @@ void GSInterface::packed_ADONLY(const void *words, uint32_t num_loops)
 	auto *ad = static_cast<const Reg128<PackedADBits> *>(words);
 	for (uint32_t i = 0; i < num_loops; i++)
 		for (int j = 0; j < count; j++, ad++)
-			write_register(RegisterAddr(ad->desc.ADDR), ad->desc.data);
+			(this->*ad_handlers[ad->desc.ADDR])(ad->desc.data);
 }
 
-void GSInterface::gif_transfer(uint32_t path_index, const void *data, size_t size)
+void GSInterface::gif_transfer_direct(uint32_t path_index, const void *data, size_t size)
 {
 	// Transfers are in units of 128 bits.
 	assert(path_index < 4);
 	assert(size % 16 == 0);
+	ScopedCPUTimer timer(debug_mode.timestamps, cpu_time_total[int(CPUTimestampType::GIFTransfer)],
+	                     active_cpu_timer_nested_ns);
 	size /= 16;
 	auto &path = paths[path_index];
 
 	if (size == 0)
 		return;
 
+	// Any further GS work may clobber the data we're about to read back.
+	resolve_fifo_readback();
+
 	const auto *qwords = static_cast<const GIFTagBits *>(data);
 	const auto *word64 = static_cast<const uint64_t *>(data);
 
@@ -4271,26 +5247,27 @@ void GSInterface::gif_transfer(uint32_t path_index, const void *data, size_t siz
 		}
 		else
 		{
-			if (path.reg == 0 && optimized_draw_handler[path_index])
+			if (path.reg == 0 && optimized_draw_handler[path_index] && size - i >= nreg)
 			{
 				// Should this divide be optimized to use divide by constant trick?
-				uint32_t nloops_to_run = std::min<uint32_t>(size / nreg, path.tag.NLOOP - path.loop);
+				uint32_t nloops_to_run = std::min<uint32_t>((size - i) / nreg, path.tag.NLOOP - path.loop);
 				(this->*optimized_draw_handler[path_index])(&qwords[i], nloops_to_run);
 				i += nloops_to_run * nreg;
 				path.loop += nloops_to_run;
 			}
+			else if (path.reg == 0 && tag_programs[path_index].generation && size - i >= nreg)
+			{
+				uint32_t nloops_to_run = std::min<uint32_t>((size - i) / nreg, path.tag.NLOOP - path.loop);
+				run_tag_program(resolve_tag_program(path_index), &qwords[i], nloops_to_run);
+				i += nloops_to_run * nreg;
+				path.loop += nloops_to_run;
+			}
 			else if (path.tag.FLG == GIFTagBits::PACKED)
 			{
 				auto addr = uint32_t(path.tag.REGS >> (4 * path.reg)) & 0xf;
 				path.reg++;
 
-				if (GIFAddr(addr) == GIFAddr::A_D)
-				{
-					auto *ad = reinterpret_cast<const Reg128<PackedADBits> *>(&qwords[i]);
-					write_register(RegisterAddr(ad->desc.ADDR), ad->desc.data);
-				}
-				else
-					(this->*packed_handlers[addr])(&qwords[i]);
+				(this->*packed_handlers[addr])(&qwords[i]);
 
 				i++;
 
@@ -4339,42 +5316,66 @@ void GSInterface::gif_transfer(uint32_t path_index, const void *data, size_t siz
 
 RegisterState &GSInterface::get_register_state()
 {
+	sync_gif_worker();
 	return registers;
 }
 
-const RegisterState &GSInterface::get_register_state() const
+RegisterState GSInterface::get_register_state() const
 {
+	sync_gif_worker();
 	return registers;
 }
 
 PrivRegisterState &GSInterface::get_priv_register_state()
 {
+	sync_gif_worker();
 	return priv_registers;
 }
 
-const PrivRegisterState &GSInterface::get_priv_register_state() const
+PrivRegisterState GSInterface::get_priv_register_state() const
 {
+	sync_gif_worker();
 	return priv_registers;
 }
 
 GIFPath &GSInterface::get_gif_path(uint32_t path)
 {
+	sync_gif_worker();
 	return paths[path];
 }
 
-const GIFPath &GSInterface::get_gif_path(uint32_t path) const
+GIFPath GSInterface::get_gif_path(uint32_t path) const
 {
+	sync_gif_worker();
 	return paths[path];
 }
 
 void GSInterface::set_debug_mode(const DebugMode &mode)
 {
+	sync_gif_worker();
 	debug_mode = mode;
-	renderer.set_enable_timestamps(mode.timestamps);
+	renderer.set_enable_timestamps(mode.timestamps || ssaa_governor.enable || trace_recorder);
+}
+
+void GSInterface::set_hierarchical_z_culling(bool enable)
+{
+	sync_gif_worker();
+	hierarchical_z_culling = enable;
+	reset_hierarchical_z();
+}
+
+void GSInterface::set_trace_recorder(TraceRecorder *recorder)
+{
+	sync_gif_worker();
+	trace_recorder = recorder;
+	renderer.set_trace_recorder(recorder);
+	renderer.set_enable_timestamps(debug_mode.timestamps || ssaa_governor.enable || trace_recorder);
 }
 
 void GSInterface::set_hacks(const Hacks &hacks_)
 {
+	sync_gif_worker();
+	bool had_backbuffer_promotion = hacks.backbuffer_promotion;
 	hacks = hacks_;
 
 	if (!hacks.backbuffer_promotion)
@@ -4382,6 +5383,14 @@ void GSInterface::set_hacks(const Hacks &hacks_)
 		for (auto &b : promoted_backbuffers)
 			b = {};
 		num_promoted_backbuffers = 0;
+		render_pass.promotion_attributes = {};
+		render_pass.promotion_attributes_valid = false;
+	}
+	else if (!had_backbuffer_promotion)
+	{
+		// Primitives which are already queued have no copy, so this render pass cannot be promoted.
+		render_pass.promotion_attributes.resize(2 * MaxPrimitivesPerFlush);
+		render_pass.promotion_attributes_valid = render_pass.primitive_count == 0;
 	}
 }
 
@@ -4416,6 +5425,9 @@ void GSInterface::promote_render_pass_to_backbuffer(const RenderPass &rp)
 
 		promoted->img.reset();
 
+		if (!render_pass.promotion_attributes_valid)
+			continue;
+
 		ivec2 lo = ivec2(INT32_MAX);
 		ivec2 hi = ivec2(INT32_MIN);
 		bool is_valid_blit = true;
@@ -4476,16 +5488,16 @@ void GSInterface::promote_render_pass_to_backbuffer(const RenderPass &rp)
 			// Promote that region to be the new backbuffer.
 			if ((state & (1 << STATE_BIT_PERSPECTIVE)) != 0)
 			{
-				auto &attr0 = render_pass.attributes[3 * prim + 0];
-				auto &attr1 = render_pass.attributes[3 * prim + 1];
+				auto &attr0 = render_pass.promotion_attributes[2 * prim + 0];
+				auto &attr1 = render_pass.promotion_attributes[2 * prim + 1];
 				constexpr float rounding_epsilon = 1.0f / 1024.0f;
 				uv0 = ivec2((attr0.st / attr0.q) * rp.textures[tex_index].info.sizes.xy() + rounding_epsilon);
 				uv1 = ivec2((attr1.st / attr1.q) * rp.textures[tex_index].info.sizes.xy() + rounding_epsilon);
 			}
 			else
 			{
-				uv0 = ivec2(render_pass.attributes[3 * prim + 0].uv) >> PGS_SUBPIXEL_BITS;
-				uv1 = ivec2(render_pass.attributes[3 * prim + 1].uv) >> PGS_SUBPIXEL_BITS;
+				uv0 = ivec2(render_pass.promotion_attributes[2 * prim + 0].uv) >> PGS_SUBPIXEL_BITS;
+				uv1 = ivec2(render_pass.promotion_attributes[2 * prim + 1].uv) >> PGS_SUBPIXEL_BITS;
 			}
 
 			lo = muglm::min(lo, uv0);
@@ -4566,6 +5578,11 @@ void GSInterface::register_backbuffer_promotion_fbp(uint32_t fbp)
 
 ScanoutResult GSInterface::vsync(const VSyncInfo &info)
 {
+	sync_gif_worker();
+	ScopedCPUTimer timer(debug_mode.timestamps, cpu_time_total[int(CPUTimestampType::VSync)],
+	                     active_cpu_timer_nested_ns);
+	resolve_fifo_readback();
+
 	auto ffmd = priv_registers.smode2.FFMD;
 
 	const Vulkan::Image *promoted1 = nullptr;
@@ -4603,9 +5620,17 @@ ScanoutResult GSInterface::vsync(const VSyncInfo &info)
 	renderer.set_field_aware_super_sampling(render_pass.field_aware_rendering);
 
 
+	// Anything written from here on, including EXTWRITE, is damage for the next vsync.
+	VkRect2D fb_damage[2] = {};
+	if (priv_registers.pmode.EN1)
+		fb_damage[0] = compute_scanout_damage(priv_registers.dispfb1, priv_registers.display1);
+	if (priv_registers.pmode.EN2)
+		fb_damage[1] = compute_scanout_damage(priv_registers.dispfb2, priv_registers.display2);
+	tracker.clear_scanout_damage();
+
 	auto result = renderer.vsync(priv_registers, info,
 	                             sampling_rate_x_log2, sampling_rate_y_log2,
-								 promoted1, promoted2);
+								 promoted1, promoted2, fb_damage);
 
 	if (hacks.backbuffer_promotion && result.image)
 	{
@@ -4617,21 +5642,92 @@ ScanoutResult GSInterface::vsync(const VSyncInfo &info)
 
 	// Restore FFMD state.
 	priv_registers.smode2.FFMD = ffmd;
+
+	tracker.age_retired_textures();
+	update_super_sampling_governor();
 	return result;
 }
 
+VkRect2D GSInterface::compute_scanout_damage(const DISPFBBits &dispfb, const DISPLAYBits &display) const
+{
+	auto layout = get_data_structure(uint32_t(dispfb.PSM));
+
+	// Covers every line the CRTC may read, with one extra line for field offsets.
+	uint32_t x0 = dispfb.DBX;
+	uint32_t y0 = dispfb.DBY;
+	uint32_t x1 = x0 + (display.DW + 1) / (display.MAGH + 1);
+	uint32_t y1 = y0 + (display.DH + 1) / (display.MAGV + 1) + 1;
+	if (x1 == x0)
+		return {};
+
+	uint32_t page_stride = (uint32_t(dispfb.FBW) * PGS_BUFFER_WIDTH_SCALE) >> layout.page_width_log2;
+	uint32_t page_x0 = x0 >> layout.page_width_log2;
+	uint32_t page_x1 = (x1 - 1) >> layout.page_width_log2;
+	uint32_t page_y0 = y0 >> layout.page_height_log2;
+	uint32_t page_y1 = (y1 - 1) >> layout.page_height_log2;
+
+	uint32_t damage_x0 = UINT32_MAX, damage_y0 = UINT32_MAX;
+	uint32_t damage_x1 = 0, damage_y1 = 0;
+
+	for (uint32_t page_y = page_y0; page_y <= page_y1; page_y++)
+	{
+		uint32_t row = uint32_t(dispfb.FBP) + page_y * page_stride;
+		if (!tracker.page_has_scanout_damage(row + page_x0, page_x1 - page_x0 + 1))
+			continue;
+
+		for (uint32_t page_x = page_x0; page_x <= page_x1; page_x++)
+		{
+			if (!tracker.page_has_scanout_damage(row + page_x, 1))
+				continue;
+
+			damage_x0 = std::min<uint32_t>(damage_x0, page_x << layout.page_width_log2);
+			damage_y0 = std::min<uint32_t>(damage_y0, page_y << layout.page_height_log2);
+			damage_x1 = std::max<uint32_t>(damage_x1, (page_x + 1) << layout.page_width_log2);
+			damage_y1 = std::max<uint32_t>(damage_y1, (page_y + 1) << layout.page_height_log2);
+		}
+	}
+
+	damage_x0 = std::max<uint32_t>(damage_x0, x0);
+	damage_y0 = std::max<uint32_t>(damage_y0, y0);
+	damage_x1 = std::min<uint32_t>(damage_x1, x1);
+	damage_y1 = std::min<uint32_t>(damage_y1, y1);
+
+	if (damage_x0 >= damage_x1 || damage_y0 >= damage_y1)
+		return {};
+
+	VkRect2D rect = {};
+	rect.offset = { int32_t(damage_x0), int32_t(damage_y0) };
+	rect.extent = { damage_x1 - damage_x0, damage_y1 - damage_y0 };
+	return rect;
+}
+
 bool GSInterface::vsync_can_skip(const VSyncInfo &info) const
 {
+	sync_gif_worker();
 	return renderer.vsync_can_skip(priv_registers, info);
 }
 
+Vulkan::Semaphore GSInterface::get_scanout_export_timeline() const
+{
+	return renderer.get_scanout_export_timeline();
+}
+
 FlushStats GSInterface::consume_flush_stats()
 {
+	sync_gif_worker();
 	return renderer.consume_flush_stats();
 }
 
 double GSInterface::get_accumulated_timestamps(TimestampType type) const
 {
+	sync_gif_worker();
 	return renderer.get_accumulated_timestamps(type);
 }
+
+double GSInterface::get_accumulated_cpu_time(CPUTimestampType type) const
+{
+	sync_gif_worker();
+	assert(int(type) < int(CPUTimestampType::Count));
+	return cpu_time_total[int(type)];
+}
 }
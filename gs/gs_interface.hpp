@@ -13,7 +13,12 @@
 #include "dynamic_array.hpp"
 #include <stddef.h>
 #include <vector>
+#include <string>
 #include <type_traits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 namespace ParallelGS
 {
@@ -67,6 +72,14 @@ struct GIFPath
 	uint32_t loop;
 };
 
+// Handle to an in-flight GS -> host VRAM download.
+struct VRAMReadTicket
+{
+	size_t offset = 0;
+	size_t size = 0;
+	uint64_t timeline = 0;
+};
+
 struct PrivRegisterState
 {
 	union
@@ -152,6 +165,17 @@ struct DebugMode
 	DrawDebugMode draw_mode = DrawDebugMode::None;
 };
 
+// CPU time spent in GSInterface entry points. Only collected with DebugMode::timestamps.
+// Times are exclusive, e.g. a render pass flushed from within a GIF transfer only counts towards FlushRenderPass,
+// so the stages can be summed.
+enum class CPUTimestampType
+{
+	GIFTransfer,
+	FlushRenderPass,
+	VSync,
+	Count
+};
+
 struct VSyncInfo
 {
 	uint32_t phase;
@@ -198,8 +222,111 @@ struct GSOptions
 	SuperSampling super_sampling = SuperSampling::X1;
 	uint32_t vram_size = 4 * 1024 * 1024; // This should generally not be touched.
 	bool dynamic_super_sampling = false; // If super sampling rate can be toggled in-flight.
+	// With dynamic super sampling, only allocate super-sampled VRAM for the current rate,
+	// and reallocate it when the rate changes. Rate changes already stall the GPU, but become more expensive.
+	// This does not help a fixed rate. E.g. fixed 16x SSAA still allocates the full (2 + 16) x 2 copies of VRAM
+	// up front, since there is no per-page commit of the sample slices.
+	bool resizable_super_sampled_vram = false;
 	bool ordered_super_sampling = true; // Prefers ordered grid. Aids debugging.
 	bool super_sampled_textures = false;
+
+	// Requires dynamic_super_sampling. Measures GPU time per vsync with timestamps and steps the
+	// super sampling rate down when over budget, and back up when there is enough headroom.
+	// The rate passed to set_super_sampling_rate() is the upper bound.
+	// Every rate change stalls the GPU, so changes are rate limited with hysteresis.
+	bool super_sampling_governor = false;
+	double super_sampling_governor_budget_ms = 16.6;
+	SuperSampling super_sampling_governor_min = SuperSampling::X1;
+	// Number of vsyncs GPU time is averaged over before considering a rate change.
+	uint32_t super_sampling_governor_window = 30;
+
+	// Small CPU-uploaded textures are hashed, so that a texture which is invalidated,
+	// but then rewritten with identical contents can reuse its old image without decoding it again.
+	// Palette textures are not considered since the hash would not cover CLUT contents.
+	bool texture_content_hashing = false;
+
+	// CLUT uploads which can be read from host VRAM are hashed together with the incoming CLUT state.
+	// An upload which would produce the contents of a live CLUT instance reuses that instance instead,
+	// even across render passes and flushes.
+	bool clut_content_hashing = false;
+
+	// Tracks a conservative lower bound of depth per 32x32 tile while rendering,
+	// and drops depth tested primitives which are guaranteed to fail the Z test before they are queued.
+	// Disabled automatically for the rest of a render pass once feedback, channel shuffles
+	// or color writes aliasing the Z buffer are observed.
+	bool hierarchical_z_culling = false;
+
+	// Picks coarse tile size and hierarchical binning factor per render pass from the
+	// primitive count and average primitive bounding box area, rather than from binning cost alone.
+	bool adaptive_tiling = false;
+
+	// Keeps the render pass alive across frame buffer pointer changes which would normally flush.
+	// A switch only stays in the render pass if the page tracker finds no texture reads on the new target pages.
+	// Multi-instance slots which never received primitives are reclaimed when all slots are taken.
+	bool fb_working_set_merging = false;
+
+	// If non-zero, HOST -> LOCAL image data is written into a persistently mapped ring of this size,
+	// which the GPU copy reads from in place. Should be large enough for a few frames worth of uploads.
+	// Transfers which do not fit fall back to copying through scratch memory.
+	VkDeviceSize host_transfer_ring_size = 0;
+
+	// Circuit merging and deinterlacing in vsync() are recorded on the async graphics queue.
+	// VRAM is still sampled on the main queue, so the scanout is a snapshot of VRAM at vsync,
+	// but rendering of the next frame does not have to wait for the post-processing.
+	// ScanoutResult::semaphore must be waited on before using the scanout image.
+	bool async_scanout = false;
+
+	// CRTC circuit images are kept across vsyncs, and only the regions of VRAM written since
+	// the previous vsync are resampled. Ignored with async_scanout.
+	// ScanoutResult::damage is reported regardless.
+	bool incremental_scanout = false;
+
+	// If non-zero, scanout images are allocated from a ring of this many images backed by
+	// exportable memory (opaque FD, or Win32 handle), so video encoders can consume frames without
+	// a copy or a round trip through the frontend. See ScanoutResult::export_image.
+	// The ring must cover how long the frontend holds on to scanout images as well. At least 2 are used.
+	uint32_t scanout_export_images = 0;
+
+	// Texture uploads which only read host data are recorded and submitted on the async compute queue,
+	// so they can overlap with rendering on the main queue. The main queue only waits for them
+	// at the first render pass which samples an uploaded image.
+	bool async_compute_texture_uploads = false;
+
+	// Upper bound in bytes for cached texture images, including recycled images kept around for reuse.
+	// Recycled images are evicted in LRU order before allocating past the budget.
+	// Images which are in use are never evicted, so this is a soft limit.
+	// If 0, only the recycled images are bounded based on the device memory budget.
+	VkDeviceSize texture_memory_budget = 0;
+
+	// If set, the Vulkan pipeline cache is loaded from this path on init and written back on shutdown.
+	// The cache is discarded if the driver or the built-in shaders change.
+	std::string pipeline_cache_path;
+	// Only pre-compile ubershader variants for the initial super-sampling rate.
+	// Other rates are compiled on demand, which can hitch if the rate is changed later.
+	bool precompile_current_sampling_rate_only = false;
+
+	// If set, programs, lookup tables and descriptor pools are shared with every other instance
+	// attached to the same context, which avoids recompiling and re-priming shaders per instance.
+	// Must have been initialized on the same device, and must outlive this instance.
+	GSDeviceContext *device_context = nullptr;
+
+	// gif_transfer() only copies packets into a ring, and a worker thread does the actual GS work.
+	// Every other GSInterface entry point drains the ring first, so this is transparent to the caller,
+	// but the GSInterface must still only be used from one host thread.
+	bool threaded_gif_frontend = false;
+	// Granite thread index the worker registers with. Since the worker records command buffers,
+	// no other thread may use this index on the same device while GS work is in flight.
+	// Must differ from the index of the thread calling init() and be less than the device's thread index count,
+	// otherwise init() fails.
+	unsigned threaded_gif_frontend_thread_index = 1;
+
+	// Render passes are only snapshotted when flushed, and a worker thread records their command buffers.
+	// The front-end builds the next render pass in the meantime and only waits once it needs the renderer again.
+	bool threaded_render_pass_recording = false;
+	// Granite thread index the recording worker registers with. Must not be shared with any other thread,
+	// including the GIF front-end worker. init() fails if it collides with the calling thread or the GIF worker,
+	// or is out of range for the device.
+	unsigned render_pass_recording_thread_index = 2;
 };
 
 // Pragmatic hacks which may or may not be useful.
@@ -236,12 +363,20 @@ class GSInterface final
 {
 public:
 	GSInterface();
+	~GSInterface();
+	GSInterface(const GSInterface &) = delete;
+	void operator=(const GSInterface &) = delete;
 	bool init(Vulkan::Device *device, const GSOptions &options);
 	void reset_context_state();
 
 	void set_super_sampling_rate(SuperSampling super_sampling, bool ordered_grid, bool super_sampled_textures);
 	void set_debug_mode(const DebugMode &mode);
+	// Records flushes, their reasons and hazard attribution, submissions and GPU timestamp ranges.
+	// Enables GPU timestamps. Pass nullptr to stop recording. The recorder must outlive its use.
+	void set_trace_recorder(TraceRecorder *recorder);
 	void set_hacks(const Hacks &hacks);
+	// Overrides GSOptions::hierarchical_z_culling, e.g. for A/B measurements.
+	void set_hierarchical_z_culling(bool enable);
 
 	// GIF payload format.
 	void gif_transfer(uint32_t path, const void *data, size_t size);
@@ -263,36 +398,97 @@ public:
 	void end_vram_write(size_t offset, size_t size);
 	const void *map_vram_read(size_t offset, size_t size);
 
+	// Non-blocking variant of map_vram_read.
+	// request_vram_read() submits any GPU work needed for the range to land in host VRAM, but does not wait.
+	// poll_vram_read() and try_map_vram_read() never block. try_map_vram_read() returns nullptr if not ready yet.
+	// map_vram_read(ticket) only blocks if the data is still not ready when it is consumed.
+	// Like map_vram_read(), the mapped data is only guaranteed to be coherent until more GS work is submitted.
+	VRAMReadTicket request_vram_read(size_t offset, size_t size);
+	bool poll_vram_read(const VRAMReadTicket &ticket);
+	const void *try_map_vram_read(const VRAMReadTicket &ticket);
+	const void *map_vram_read(const VRAMReadTicket &ticket);
+
 	void flush();
 
 	void clobber_register_state();
 
+	// With the threaded GIF front-end, the worker owns this state while transfers are in flight.
+	// The accessors sync with the worker first. The mutable references are only valid until the next
+	// GIF transfer or vsync is queued, since the worker may modify the state after that.
+	// The const accessors return a snapshot.
 	RegisterState &get_register_state();
-	const RegisterState &get_register_state() const;
+	RegisterState get_register_state() const;
 
 	PrivRegisterState &get_priv_register_state();
-	const PrivRegisterState &get_priv_register_state() const;
+	PrivRegisterState get_priv_register_state() const;
 
 	GIFPath &get_gif_path(uint32_t path);
-	const GIFPath &get_gif_path(uint32_t path) const;
+	GIFPath get_gif_path(uint32_t path) const;
 
 	ScanoutResult vsync(const VSyncInfo &info);
 	bool vsync_can_skip(const VSyncInfo &info) const;
+	// Exportable timeline semaphore for ScanoutResult::export_timeline_value. Empty if export is disabled.
+	Vulkan::Semaphore get_scanout_export_timeline() const;
 
 	FlushStats consume_flush_stats();
 	double get_accumulated_timestamps(TimestampType type) const;
+	double get_accumulated_cpu_time(CPUTimestampType type) const;
 
 	void read_transfer_fifo(void *data, uint32_t num_128b_words);
 
+	// The rate currently chosen by the super sampling governor, or the requested rate if it is not enabled.
+	SuperSampling get_current_super_sampling_rate() const;
+
+	// With a host transfer ring, image data for an active HOST -> LOCAL transfer can be written in place,
+	// which bypasses HWREG / GIF packet parsing and any intermediate copies.
+	// Returns nullptr if no transfer is active or the ring is not in use. In that case, feed data as normal.
+	// Otherwise, up to max_qwords can be written, which is the remainder of the transfer.
+	// Data written this way is not observed by anything hooking the GIF stream, e.g. dump generation.
+	uint64_t *map_host_to_local_payload(size_t &max_qwords);
+	// Commits num_qwords written through the pointer returned by map_host_to_local_payload().
+	void commit_host_to_local_payload(size_t num_qwords);
+
 private:
 	friend class PageTracker;
+
+	// SPSC ring for the threaded GIF front-end. Counters are in units of qwords and never wrap.
+	// Each packet is a header qword followed by the payload. A header with WrapMarker skips to the start.
+	struct GIFWorker
+	{
+		enum { RingSize = 1024 * 1024, WrapMarker = UINT32_MAX };
+		std::vector<GIFTagBits> ring;
+		std::atomic<uint64_t> write_count;
+		std::atomic<uint64_t> read_count;
+		std::atomic_bool consumer_sleeping;
+		std::atomic_bool producer_sleeping;
+		std::atomic_bool shutdown;
+		std::mutex lock;
+		std::condition_variable consumer_cond;
+		std::condition_variable producer_cond;
+		std::thread thread;
+		std::thread::id thread_id;
+		bool active = false;
+	};
+	mutable GIFWorker gif_worker;
+
+	void start_gif_worker(unsigned thread_index);
+	void stop_gif_worker();
+	void gif_worker_loop();
+	void push_gif_packet(uint32_t path, const void *data, size_t num_qwords);
+	void wait_gif_worker_read_count(uint64_t count) const;
+	void sync_gif_worker() const;
+	void gif_transfer_direct(uint32_t path, const void *data, size_t size);
+
 	void flush(PageTrackerFlushFlags flags, FlushReason reason);
+	// Attributes the next flush to the offending page and/or TBP for tracing. UINT32_MAX if unknown.
+	void note_flush_hazard(uint32_t page, uint32_t tbp);
+	void add_flush_trace_args(TraceScope &trace, FlushReason reason);
 	void sync_host_vram_page(uint32_t page_index, uint32_t block_mask);
 	void sync_vram_host_page(uint32_t page_index);
-	void sync_shadow_page(uint32_t page_index);
 	void invalidate_texture_hash(Util::Hash hash, bool clut);
 	void forget_in_render_pass_memoization();
 	void recycle_image_handle(Vulkan::ImageHandle image);
+	void build_render_pass(RenderPass &rp, FlushReason reason);
 	void flush_render_pass(FlushReason reason);
 	uint64_t query_timeline();
 
@@ -304,6 +500,9 @@ private:
 	uint32_t vram_size = 0;
 	DebugMode debug_mode;
 	Hacks hacks;
+	double cpu_time_total[int(CPUTimestampType::Count)] = {};
+	// Nested time accumulator of the innermost active CPU timer, so the enclosing stage can subtract it.
+	uint64_t *active_cpu_timer_nested_ns = nullptr;
 
 	std::vector<uint32_t> sync_host_vram_blocks;
 	std::vector<uint32_t> sync_vram_host_pages;
@@ -312,18 +511,37 @@ private:
 	struct TransferState
 	{
 		std::vector<uint64_t> host_to_local_payload;
+		// If non-null, the payload is written directly into the renderer's host transfer ring instead.
+		uint64_t *host_to_local_ring = nullptr;
+		uint32_t host_to_local_ring_qwords = 0;
 		bool host_to_local_active = false;
 		uint32_t required_qwords = 0;
 		uint32_t last_flushed_qwords = 0;
+
+		size_t get_host_to_local_qwords() const
+		{
+			return host_to_local_ring ? host_to_local_ring_qwords : host_to_local_payload.size();
+		}
+
+		const uint64_t *get_host_to_local_data() const
+		{
+			return host_to_local_ring ? host_to_local_ring : host_to_local_payload.data();
+		}
 		CopyDescriptor copy = {};
 		Util::DynamicArray<uint8_t> fifo_readback;
 		uint32_t fifo_readback_128b_offset = 0;
 		uint32_t fifo_readback_128b_size = 0;
+		// Local -> Host is resolved lazily, either when the FIFO is read,
+		// or at the latest when the next GS command comes in.
+		uint64_t fifo_readback_timeline = 0;
+		bool fifo_readback_pending = false;
 	} transfer_state;
 
 	void flush_pending_transfer(bool keep_alive);
+	void append_host_to_local_payload(const uint64_t *payload, size_t count);
 	void check_pending_transfer();
 	void init_transfer();
+	void resolve_fifo_readback();
 
 	RegisterState registers = {};
 	PrivRegisterState priv_registers = {};
@@ -332,11 +550,23 @@ private:
 	enum { NumMemoizedPalettes = 16 };
 	struct RenderPassState
 	{
+		// Positions and attributes may be uncached ReBAR memory, so never read them back.
 		VertexPosition *positions = nullptr;
 		VertexAttribute *attributes = nullptr;
 		PrimitiveAttribute *prim = nullptr;
 		uint32_t primitive_count = 0;
 
+		// Cached copies of the vertex data the front-end reads back instead.
+		// The last two primitives, indexed by the low bit of the primitive index.
+		VertexPosition recent_positions[2][3] = {};
+		VertexAttribute recent_attributes[2][3] = {};
+		// The first MaxShadowedPrimitives primitives, owned by the renderer.
+		VertexPosition *position_shadow = nullptr;
+		VertexAttribute *attribute_shadow = nullptr;
+		// The two sprite corners of every primitive, only kept while backbuffer promotion is enabled.
+		std::vector<VertexAttribute> promotion_attributes;
+		bool promotion_attributes_valid = false;
+
 		std::vector<StateVector> state_vectors;
 		std::vector<Vulkan::ImageHandle> held_images;
 		std::vector<TextureInfo> tex_infos;
@@ -383,6 +613,8 @@ private:
 			bool z_write = false;
 			bool z_feedback = false;
 			bool has_channel_shuffle = false;
+			// Sprites and points are always snapped, so only these can be demoted by the single sample heuristic.
+			bool has_triangles_or_lines = false;
 			uint32_t fb_page_width_log2 = 0;
 			uint32_t fb_page_height_log2 = 0;
 			uint32_t z_page_width_log2 = 0;
@@ -417,6 +649,10 @@ private:
 		bool has_scanmsk = false;
 		bool has_hazardous_short_term_texture_caching = false;
 		bool has_optimized_short_term_texture_caching = false;
+		uint32_t num_z_culled_primitives = 0;
+		uint32_t num_merged_fb_switches = 0;
+		// Sum of bounding box area of queued primitives, for adaptive tiling.
+		uint64_t primitive_bb_area = 0;
 		bool field_aware_rendering = false;
 
 		ivec3 last_triangle_parallelogram_order;
@@ -488,6 +724,34 @@ private:
 	template <bool FOG>
 	void packed_STXYZSTRGBAXYZ_sprite(const void *workds, uint32_t num_loops);
 
+	// Generic fallback for PACKED layouts without a specialized handler.
+	// REGS/NREG are decoded once into a flat handler list and cached by tag bits,
+	// so recurring layouts run whole NLOOPs without re-decoding REGS per qword.
+	struct GIFTagProgram
+	{
+		uint64_t regs;
+		uint32_t nreg;
+		// Bumped every time the slot is (re)decoded, 0 means never filled.
+		uint32_t generation;
+		PackedHandler handlers[16];
+	};
+	enum { TagProgramCacheSize = 64 };
+	GIFTagProgram tag_program_cache[TagProgramCacheSize] = {};
+	uint32_t tag_program_generation = 0;
+	// One per GIFPath. Another path may evict the slot mid-NLOOP,
+	// so the generation is checked before the program is run.
+	// generation == 0 means there is no program.
+	struct GIFTagProgramHandle
+	{
+		uint32_t slot;
+		uint32_t generation;
+	};
+	GIFTagProgramHandle tag_programs[4] = {};
+	GIFTagProgramHandle get_tag_program(uint64_t regs, uint32_t nreg);
+	const GIFTagProgram &resolve_tag_program(uint32_t path);
+	void run_tag_program(const GIFTagProgram &program, const GIFTagBits *qwords, uint32_t num_loops);
+	void packed_A_D(const void *words);
+
 	void update_draw_handler();
 	void update_optimized_gif_handler(uint32_t path);
 
@@ -546,6 +810,8 @@ private:
 	bool get_and_clear_dirty_flag(StateDirtyFlags flags);
 
 	void check_frame_buffer_state();
+	bool fb_switch_aliases_texture_reads() const;
+	uint32_t find_unused_render_pass_instance() const;
 	void mark_render_pass_has_texture_feedback(const TEX0Bits &tex0, RenderPass::Feedback mode);
 	bool draw_is_degenerate();
 	uint32_t find_or_place_unique_state_vector(const StateVector &state);
@@ -554,6 +820,50 @@ private:
 	void drawing_kick_update_state(FBFeedbackMode feedback_mode, const ivec4 &uv_bb, const ivec4 &bb);
 	bool state_is_z_sensitive() const;
 
+	// Conservative lower bound of stored depth per tile for the current render pass instance.
+	// Only the current instance and Z buffer is tracked, anything else resets the state.
+	// This is kept on the CPU rather than as per coarse tile min/max in binning:
+	// - A culled primitive never reaches the GPU, so triangle setup and binning are saved as well, not just shading.
+	// - Whether the bound is still valid depends on state tracked here anyway (feedback, channel shuffles,
+	//   FB writes aliasing the Z pages). Binning runs before any shading of the render pass,
+	//   so a GPU min/max would have to come from a depth reduction of earlier render passes instead.
+	// The cost is a walk over the tiles touched by depth tested primitives. Big primitives touch the most
+	// tiles, but those are also the most expensive to shade. Use the replayer's --compare-hierarchical-z
+	// to check that shading time actually goes down for a given dump.
+	struct HierarchicalZ
+	{
+		enum { TileSizeLog2 = 5, TilesPerAxis = 2048 >> TileSizeLog2 };
+		uint32_t min_z[TilesPerAxis * TilesPerAxis] = {};
+		// Tiles which may be non-zero, in tile coordinates.
+		ivec4 dirty_bb = ivec4(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+		uint32_t instance = UINT32_MAX;
+		Reg64<ZBUFBits> zbuf = {};
+		uint32_t z_max = 0;
+		bool disabled = false;
+	};
+	HierarchicalZ hier_z;
+
+	TraceRecorder *trace_recorder = nullptr;
+	struct FlushHazard
+	{
+		uint32_t page = UINT32_MAX;
+		uint32_t tbp = UINT32_MAX;
+	} flush_hazard;
+	bool hierarchical_z_culling = false;
+	bool adaptive_tiling = false;
+	bool fb_working_set_merging = false;
+	uint32_t select_adaptive_coarse_tile_size_log2(const RenderPass &rp) const;
+
+	void reset_hierarchical_z();
+	void clear_hierarchical_z_tiles();
+	bool hierarchical_z_is_active();
+	bool hierarchical_z_rejects(const ivec4 &bb, uint32_t z_max, bool z_greater) const;
+	void hierarchical_z_update(const ivec4 &bb, uint32_t z_min, bool monotonic, bool full_coverage);
+	// Returns true if the primitive is guaranteed to fail the Z test and can be dropped.
+	// Otherwise, the tile state is updated for any Z writes the primitive may do.
+	bool hierarchical_z_cull_primitive(const ivec4 &bb, const VertexPosition *pos, uint32_t num_positions,
+	                                   bool constant_z, bool allow_reject);
+
 	template <bool quad, unsigned num_vertices>
 	FBFeedbackMode deduce_color_feedback_mode(const VertexPosition *pos, const VertexAttribute *attr,
 	                                          const ContextState &ctx, const PRIMBits &prim,
@@ -596,6 +906,36 @@ private:
 	uint32_t sampling_rate_y_log2 = 0;
 	bool super_sampled_textures = false;
 
+	struct SuperSamplingGovernor
+	{
+		enum { BaseStepUpDelay = 2, MaxStepUpDelay = 32 };
+		SuperSampling requested = SuperSampling::X1;
+		SuperSampling current = SuperSampling::X1;
+		SuperSampling min_rate = SuperSampling::X1;
+		bool ordered_grid = true;
+		bool super_sampled_textures = false;
+		bool enable = false;
+
+		double budget_ms = 0.0;
+		uint32_t window = 0;
+		uint32_t window_vsyncs = 0;
+		double window_start_gpu_time = 0.0;
+		// The first window after a rate change still sees work from the old rate.
+		bool discard_window = false;
+		uint32_t headroom_windows = 0;
+		uint32_t step_up_delay = 0;
+		bool last_step_was_up = false;
+	};
+	SuperSamplingGovernor ssaa_governor;
+
+	void apply_super_sampling_rate(SuperSampling super_sampling);
+	void reset_super_sampling_governor();
+	void update_super_sampling_governor();
+	double get_total_gpu_time() const;
+	bool texture_content_hashing = false;
+	bool clut_content_hashing = false;
+	bool host_transfer_ring = false;
+
 	void reset_context_state_registers();
 
 	enum { MaxPromotedBackbuffers = 4 };
@@ -605,5 +945,7 @@ private:
 	void register_backbuffer_promotion_fbp(uint32_t fbp);
 	PromotedBackbuffer *find_promoted_backbuffer(uint32_t fbp);
 	void invalidate_promoted_backbuffer(uint32_t fbp);
+
+	VkRect2D compute_scanout_damage(const DISPFBBits &dispfb, const DISPLAYBits &display) const;
 };
 }
@@ -13,10 +13,12 @@
 #include "thread_id.hpp"
 #include "gs_util.hpp"
 #include "thread_name.hpp"
+#include "timer.hpp"
 #include <utility>
 #include <algorithm>
 #include <cmath>
 #include <climits>
+#include <stdio.h>
 
 #if defined(__clang__)
 #pragma clang diagnostic ignored "-Wformat-security"
@@ -37,6 +39,8 @@ static constexpr uint32_t MaxPendingPaletteUploads = 4096;
 static constexpr uint32_t MaxPendingCopies = 16 * 1024;
 static constexpr uint32_t MaxPendingCopyThreads = 4 * 1024 * 1024; // 22 bits.
 static constexpr uint32_t MaxPendingCopiesWithoutFlush = 1023; // 10 bits. Reserve highest value for unlinked node.
+// Enough to cover a few flushes in flight at the maximum scratch allocation rate.
+static constexpr size_t MaxRetiredScratchBuffers = 8;
 
 // Pink-ish. Intended to look good in RenderDoc's default light theme.
 static constexpr float LabelColor[] = { 1.0f, 0.8f, 0.8f, 1.0f };
@@ -315,9 +319,17 @@ void GSRenderer::init_phase_lut(uint32_t sampling_rate_x_log2, uint32_t sampling
 void GSRenderer::invalidate_super_sampling_state(
     uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2)
 {
+	sync_recording_worker();
 	if (!device || !buffers.gpu)
 		return;
 
+	if (resizable_vram)
+	{
+		VkDeviceSize size = get_vram_buffer_size(1u << (sampling_rate_x_log2 + sampling_rate_y_log2));
+		if (size != buffers.gpu->get_create_info().size)
+			resize_vram(size);
+	}
+
 	VkDeviceSize clear_size = buffers.gpu->get_create_info().size - vram_size;
 	if (!clear_size)
 		return;
@@ -341,6 +353,54 @@ void GSRenderer::invalidate_super_sampling_state(
 	device->wait_idle();
 }
 
+void get_super_sampling_rate_log2(SuperSampling super_sampling, bool ordered_grid,
+                                  uint32_t &sampling_rate_x_log2, uint32_t &sampling_rate_y_log2)
+{
+	switch (super_sampling)
+	{
+	case SuperSampling::X1:
+		sampling_rate_x_log2 = 0;
+		sampling_rate_y_log2 = 0;
+		break;
+
+	case SuperSampling::X2:
+		sampling_rate_x_log2 = 0;
+		sampling_rate_y_log2 = 1;
+		break;
+
+	case SuperSampling::X4:
+		if (ordered_grid)
+		{
+			sampling_rate_x_log2 = 1;
+			sampling_rate_y_log2 = 1;
+		}
+		else
+		{
+			sampling_rate_x_log2 = 0;
+			sampling_rate_y_log2 = 2;
+		}
+		break;
+
+	case SuperSampling::X8:
+		sampling_rate_x_log2 = 1;
+		sampling_rate_y_log2 = 2;
+		break;
+
+	case SuperSampling::X16:
+		if (ordered_grid)
+		{
+			sampling_rate_x_log2 = 2;
+			sampling_rate_y_log2 = 2;
+		}
+		else
+		{
+			sampling_rate_x_log2 = 1;
+			sampling_rate_y_log2 = 3;
+		}
+		break;
+	}
+}
+
 SuperSampling GSRenderer::get_max_supported_super_sampling() const
 {
 	SuperSampling max_ssaa = SuperSampling::X4;
@@ -354,26 +414,65 @@ SuperSampling GSRenderer::get_max_supported_super_sampling() const
 
 void GSRenderer::set_field_aware_super_sampling(bool enable)
 {
+	sync_recording_worker();
 	field_aware_super_sampling = enable;
 }
 
-void GSRenderer::init_vram(const GSOptions &options)
+VkDeviceSize GSRenderer::get_vram_buffer_size(uint32_t num_samples) const
 {
-	Vulkan::BufferCreateInfo info = {};
-	info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-
 	// One copy of VRAM for single-rate, one reference copy of VRAM, and up to 16 sample references.
 	// About 78 MB. This isn't too bad.
-	if (options.dynamic_super_sampling)
-		info.size = vram_size * (1 + 1 + int(get_max_supported_super_sampling()));
-	else if (options.super_sampling != SuperSampling::X1)
-		info.size = vram_size * (1 + 1 + int(options.super_sampling));
-	else
-		info.size = vram_size;
+	VkDeviceSize size = vram_size;
+	if (num_samples > 1)
+		size *= 1 + 1 + num_samples;
 
 	// Need a shadow copy of VRAM for various difficult feedback hazards.
 	// Simpler to reuse the same buffer.
-	info.size *= 2;
+	return size * 2;
+}
+
+void GSRenderer::resize_vram(VkDeviceSize size)
+{
+	flush_submit(0);
+
+	// Everything beyond single-rate VRAM is cleared after a rate change anyway, so only preserve that.
+	auto info = buffers.gpu->get_create_info();
+	info.size = size;
+	info.misc &= ~Vulkan::BUFFER_MISC_ZERO_INITIALIZE_BIT;
+	auto gpu = device->create_buffer(info);
+	device->set_name(*gpu, "vram-gpu");
+
+	auto cmd = device->request_command_buffer();
+	cmd->begin_region("resize-vram");
+	cmd->barrier(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+	             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	cmd->copy_buffer(*gpu, 0, *buffers.gpu, 0, vram_size);
+	cmd->barrier(VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+	             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+	cmd->end_region();
+	device->submit(cmd);
+	device->wait_idle();
+
+	LOGI("Resized VRAM buffer to %llu MiB.\n", static_cast<unsigned long long>(size / (1024 * 1024)));
+
+	if (buffers.cpu == buffers.gpu)
+		buffers.cpu = gpu;
+	buffers.gpu = std::move(gpu);
+}
+
+void GSRenderer::init_vram(const GSOptions &options)
+{
+	Vulkan::BufferCreateInfo info = {};
+	info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	resizable_vram = options.dynamic_super_sampling && options.resizable_super_sampled_vram;
+	if (options.resizable_super_sampled_vram && !options.dynamic_super_sampling)
+		LOGW("Resizable super-sampled VRAM requires dynamic super sampling, ignoring.\n");
+
+	if (options.dynamic_super_sampling && !resizable_vram)
+		info.size = get_vram_buffer_size(int(get_max_supported_super_sampling()));
+	else
+		info.size = get_vram_buffer_size(int(options.super_sampling));
 
 	// Ideally we just have one big memory pool.
 	// On iGPU there should be no need to copy memory around.
@@ -414,8 +513,13 @@ void GSRenderer::init_vram(const GSOptions &options)
 
 	uint32_t num_pages = vram_size / PageSize;
 	uint32_t num_pages_u32 = (num_pages + 31) / 32;
-	sync_vram_shadow_pages.resize(num_pages_u32);
-	vram_copy_write_pages.resize(num_pages_u32);
+	for (auto &wave : copy_waves)
+	{
+		wave.write_pages.resize(num_pages_u32);
+		wave.shadow_pages.resize(num_pages_u32);
+	}
+	copy_wave_pages.resize(num_pages);
+	copy_wave_accessed_pages.reserve(num_pages);
 
 #if 0
 	info.size = sizeof(uint32_t);
@@ -449,15 +553,143 @@ void GSRenderer::drain_compilation_tasks_nonblock()
 	compilation_tasks.erase(itr, compilation_tasks.end());
 }
 
+namespace
+{
+struct PipelineCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t payload_size;
+};
+
+constexpr uint32_t PipelineCacheMagic = 0x43534750; // PGSC
+constexpr uint32_t PipelineCacheVersion = 1;
+}
+
+Util::Hash GSRenderer::compute_pipeline_cache_key() const
+{
+	// The driver's own cache header is validated by the driver too,
+	// but this lets us reject stale blobs without handing them over in the first place.
+	const auto &props = device->get_gpu_properties();
+	Util::Hasher hasher;
+	hasher.u32(props.vendorID);
+	hasher.u32(props.deviceID);
+	hasher.u32(props.driverVersion);
+	hasher.data(props.pipelineCacheUUID, sizeof(props.pipelineCacheUUID));
+	hasher.data(spirv_bank, sizeof(spirv_bank));
+	return hasher.get();
+}
+
+void GSRenderer::load_pipeline_cache()
+{
+	if (pipeline_cache_path.empty())
+		return;
+
+	FILE *file = fopen(pipeline_cache_path.c_str(), "rb");
+	if (!file)
+	{
+		LOGI("No pipeline cache found at %s.\n", pipeline_cache_path.c_str());
+		return;
+	}
+
+	PipelineCacheHeader header = {};
+	std::vector<uint8_t> payload;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+	             header.magic == PipelineCacheMagic &&
+	             header.version == PipelineCacheVersion &&
+	             header.key == compute_pipeline_cache_key();
+
+	if (valid)
+	{
+		payload.resize(header.payload_size);
+		valid = fread(payload.data(), 1, payload.size(), file) == payload.size();
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		LOGW("Pipeline cache %s is stale or corrupt, ignoring.\n", pipeline_cache_path.c_str());
+		return;
+	}
+
+	if (device->init_pipeline_cache(payload.data(), payload.size()))
+		LOGI("Loaded pipeline cache from %s.\n", pipeline_cache_path.c_str());
+	else
+		LOGW("Failed to initialize pipeline cache from %s.\n", pipeline_cache_path.c_str());
+}
+
+void GSRenderer::save_pipeline_cache()
+{
+	if (pipeline_cache_path.empty() || !device)
+		return;
+
+	std::vector<uint8_t> payload(device->get_pipeline_cache_size());
+	if (payload.empty() || !device->get_pipeline_cache_data(payload.data(), payload.size()))
+	{
+		LOGW("Failed to query pipeline cache data.\n");
+		return;
+	}
+
+	PipelineCacheHeader header = {};
+	header.magic = PipelineCacheMagic;
+	header.version = PipelineCacheVersion;
+	header.key = compute_pipeline_cache_key();
+	header.payload_size = payload.size();
+
+	// Write to a temporary and rename so a crash cannot leave a truncated cache behind.
+	std::string tmp_path = pipeline_cache_path + ".tmp";
+	FILE *file = fopen(tmp_path.c_str(), "wb");
+	if (!file)
+	{
+		LOGW("Failed to open %s for writing.\n", tmp_path.c_str());
+		return;
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	               fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+	success = fclose(file) == 0 && success;
+
+	if (!success || rename(tmp_path.c_str(), pipeline_cache_path.c_str()) != 0)
+	{
+		LOGW("Failed to write pipeline cache to %s.\n", pipeline_cache_path.c_str());
+		remove(tmp_path.c_str());
+	}
+	else
+		LOGI("Wrote pipeline cache to %s.\n", pipeline_cache_path.c_str());
+}
+
 bool GSRenderer::can_potentially_super_sample() const
 {
 	return buffers.gpu->get_create_info().size > vram_size * 2;
 }
 
-void GSRenderer::kick_compilation_tasks()
+void GSRenderer::kick_compilation_tasks(const GSOptions &options)
 {
 	// Pre-prime all potential shader variants early.
+	// Variants for the sampling rate we're starting with are compiled first.
 	std::vector<Vulkan::DeferredPipelineCompile> tasks;
+	std::vector<Vulkan::DeferredPipelineCompile> low_priority_tasks;
+
+	uint32_t current_sample_x = 0, current_sample_y = 0;
+	auto current_super_sampling = SuperSampling(std::min<uint32_t>(
+			uint32_t(options.super_sampling), uint32_t(get_max_supported_super_sampling())));
+	get_super_sampling_rate_log2(current_super_sampling, options.ordered_super_sampling,
+	                             current_sample_x, current_sample_y);
+
+	// With resizable VRAM, the buffer starts out at 1x and can_potentially_super_sample() reflects that,
+	// so base priming on what the configuration allows instead.
+	bool may_super_sample = options.dynamic_super_sampling || current_super_sampling != SuperSampling::X1;
+
+	// Pipelines are cached by the device, so there is no point in priming the same variants
+	// once per instance. Anything which is not primed is still compiled on demand.
+	if (!context->claim_pipeline_priming(current_sample_x, current_sample_y,
+	                                     options.precompile_current_sampling_rate_only))
+	{
+		return;
+	}
+
 	compilation_tasks_active = true;
 
 	{
@@ -541,6 +773,15 @@ void GSRenderer::kick_compilation_tasks()
 				{
 					for (auto &rates : sampling_rates)
 					{
+						// Single-sampled variants are always needed, even when super-sampling.
+						bool high_priority = (rates.sample_x == 0 && rates.sample_y == 0) ||
+						                     (rates.sample_x == current_sample_x && rates.sample_y == current_sample_y);
+
+						if (!high_priority && options.precompile_current_sampling_rate_only)
+							continue;
+
+						auto &task_list = high_priority ? tasks : low_priority_tasks;
+
 						for (auto &feedback : feedbacks)
 						{
 							if ((flags & VARIANT_FLAG_FEEDBACK_BIT) != 0)
@@ -563,22 +804,22 @@ void GSRenderer::kick_compilation_tasks()
 									flags | (rates.sample_y ? VARIANT_FLAG_HAS_SUPER_SAMPLE_REFERENCE_BIT : 0);
 							cmd->set_specialization_constant(5, active_flags);
 							cmd->extract_pipeline_state(deferred);
-							tasks.push_back(deferred);
+							task_list.push_back(deferred);
 
 							if (rates.sample_y != 0)
 							{
 								active_flags |= VARIANT_FLAG_HAS_TEXTURE_ARRAY_BIT;
 								cmd->set_specialization_constant(5, active_flags);
 								cmd->extract_pipeline_state(deferred);
-								tasks.push_back(deferred);
+								task_list.push_back(deferred);
 							}
 
-							if (rates.sample_x == 0 && rates.sample_y == 0 && can_potentially_super_sample())
+							if (rates.sample_x == 0 && rates.sample_y == 0 && may_super_sample)
 							{
 								cmd->set_specialization_constant(
 									5, flags | VARIANT_FLAG_HAS_SUPER_SAMPLE_REFERENCE_BIT);
 								cmd->extract_pipeline_state(deferred);
-								tasks.push_back(deferred);
+								task_list.push_back(deferred);
 							}
 						}
 					}
@@ -618,19 +859,27 @@ void GSRenderer::kick_compilation_tasks()
 		cmd->set_specialization_constant_mask(0x7f);
 		cmd->set_specialization_constant(3, vram_size - 1);
 		cmd->set_specialization_constant(4, HOST_TO_LOCAL);
-		cmd->set_specialization_constant(5, uint32_t(can_potentially_super_sample()));
 
-		for (auto &format : formats)
+		for (uint32_t super_sample = 0; super_sample < 2; super_sample++)
 		{
-			cmd->set_specialization_constant(0, format.wg_size);
-			cmd->set_specialization_constant(1, format.psm);
-			cmd->set_specialization_constant(2, format.psm);
+			// Resizable VRAM uses the single-rate variant until it grows.
+			if (super_sample ? !may_super_sample : (may_super_sample && !resizable_vram))
+				continue;
 
-			for (unsigned prepare_only = 0; prepare_only < 2; prepare_only++)
+			cmd->set_specialization_constant(5, super_sample);
+
+			for (auto &format : formats)
 			{
-				cmd->set_specialization_constant(6, prepare_only);
-				cmd->extract_pipeline_state(deferred);
-				tasks.push_back(deferred);
+				cmd->set_specialization_constant(0, format.wg_size);
+				cmd->set_specialization_constant(1, format.psm);
+				cmd->set_specialization_constant(2, format.psm);
+
+				for (unsigned prepare_only = 0; prepare_only < 2; prepare_only++)
+				{
+					cmd->set_specialization_constant(6, prepare_only);
+					cmd->extract_pipeline_state(deferred);
+					tasks.push_back(deferred);
+				}
 			}
 		}
 
@@ -717,16 +966,18 @@ void GSRenderer::kick_compilation_tasks()
 		device->submit_discard(cmd);
 	}
 
+	tasks.insert(tasks.end(), low_priority_tasks.begin(), low_priority_tasks.end());
+
 	size_t num_tasks = tasks.size();
-	size_t target_threads = (std::thread::hardware_concurrency() + 1) / 2;
-	size_t tasks_per_thread = num_tasks / target_threads;
+	size_t target_threads = std::max<size_t>(1, (std::thread::hardware_concurrency() + 1) / 2);
 
 	for (size_t thread_index = 0; thread_index < target_threads; thread_index++)
 	{
-		std::vector<Vulkan::DeferredPipelineCompile> deferred(
-			tasks.data() + thread_index * tasks_per_thread,
-			tasks.data() + std::min<size_t>((thread_index + 1) * tasks_per_thread, tasks.size())
-		);
+		// Interleave so that all threads work on the high priority variants first.
+		std::vector<Vulkan::DeferredPipelineCompile> deferred;
+		deferred.reserve((num_tasks + target_threads - 1) / target_threads);
+		for (size_t i = thread_index; i < num_tasks; i += target_threads)
+			deferred.push_back(tasks[i]);
 
 		auto async_task = std::async(std::launch::async, [this, moved_tasks = std::move(deferred)]()
 		{
@@ -776,16 +1027,153 @@ GSRenderer::GSRenderer(PageTracker &tracker_)
 	});
 }
 
+bool GSDeviceContext::init(Vulkan::Device *device_)
+{
+	device = device_;
+
+	Vulkan::ResourceLayout layout;
+	shaders = Shaders<>(*device, layout, 0);
+	blit_quad = device->request_program(shaders.quad, shaders.blit_circuit);
+	sample_quad[0] = device->request_program(shaders.quad, shaders.sample_circuit[0]);
+	sample_quad[1] = device->request_program(shaders.quad, shaders.sample_circuit[1]);
+	weave_quad = device->request_program(shaders.quad, shaders.weave);
+
+	init_luts();
+
+	std::lock_guard<std::mutex> holder{lock};
+	idle_bindless_pools.clear();
+	pipeline_cache_claimed = false;
+	primed_sampling_rates = 0;
+	return true;
+}
+
+Vulkan::Device *GSDeviceContext::get_device() const
+{
+	return device;
+}
+
+const Shaders<> &GSDeviceContext::get_shaders() const
+{
+	return shaders;
+}
+
+Vulkan::Program *GSDeviceContext::get_blit_quad() const
+{
+	return blit_quad;
+}
+
+Vulkan::Program *GSDeviceContext::get_sample_quad(uint32_t index) const
+{
+	return sample_quad[index];
+}
+
+Vulkan::Program *GSDeviceContext::get_weave_quad() const
+{
+	return weave_quad;
+}
+
+const Vulkan::BufferViewHandle &GSDeviceContext::get_fixed_rcp_lut_view() const
+{
+	return fixed_rcp_lut_view;
+}
+
+const Vulkan::BufferViewHandle &GSDeviceContext::get_float_rcp_lut_view() const
+{
+	return float_rcp_lut_view;
+}
+
+Vulkan::BindlessDescriptorPoolHandle GSDeviceContext::request_bindless_pool()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	if (idle_bindless_pools.empty())
+		return {};
+
+	auto pool = std::move(idle_bindless_pools.back());
+	idle_bindless_pools.pop_back();
+	return pool;
+}
+
+void GSDeviceContext::recycle_bindless_pool(Vulkan::BindlessDescriptorPoolHandle pool)
+{
+	pool->reset();
+	std::lock_guard<std::mutex> holder{lock};
+	idle_bindless_pools.push_back(std::move(pool));
+}
+
+bool GSDeviceContext::claim_pipeline_cache()
+{
+	std::lock_guard<std::mutex> holder{lock};
+	bool claimed = !pipeline_cache_claimed;
+	pipeline_cache_claimed = true;
+	return claimed;
+}
+
+bool GSDeviceContext::claim_pipeline_priming(
+		uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2, bool current_rate_only)
+{
+	uint32_t mask = current_rate_only ? (2u << (sampling_rate_x_log2 * 4 + sampling_rate_y_log2)) : 1u;
+
+	std::lock_guard<std::mutex> holder{lock};
+	if ((primed_sampling_rates & (mask | 1u)) != 0)
+		return false;
+
+	primed_sampling_rates |= mask;
+	return true;
+}
+
+static bool device_has_resizable_bar(const Vulkan::Device &device)
+{
+	// UMA is handled separately with cached memory.
+	if (device.get_gpu_properties().deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+		return false;
+
+	// Without ReBAR, the host visible window into VRAM is only 256 MiB.
+	constexpr VkDeviceSize LegacyBARSize = 256 * 1024 * 1024;
+	constexpr VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	auto &props = device.get_memory_properties();
+
+	for (uint32_t i = 0; i < props.memoryTypeCount; i++)
+	{
+		if ((props.memoryTypes[i].propertyFlags & flags) == flags &&
+		    props.memoryHeaps[props.memoryTypes[i].heapIndex].size > LegacyBARSize)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool GSRenderer::init(Vulkan::Device *device_, const GSOptions &options)
 {
+	stop_recording_worker();
 	drain_compilation_tasks();
+	recycle_bindless_pools();
 
-	Vulkan::ResourceLayout layout;
-	shaders = Shaders<>(*device_, layout, 0);
-	blit_quad = device_->request_program(shaders.quad, shaders.blit_circuit);
-	sample_quad[0] = device_->request_program(shaders.quad, shaders.sample_circuit[0]);
-	sample_quad[1] = device_->request_program(shaders.quad, shaders.sample_circuit[1]);
-	weave_quad = device_->request_program(shaders.quad, shaders.weave);
+	if (options.device_context)
+	{
+		if (options.device_context->get_device() != device_)
+		{
+			LOGE("Device context was created for a different device.\n");
+			return false;
+		}
+
+		context = options.device_context;
+		owned_context.reset();
+	}
+	else
+	{
+		owned_context.reset(new GSDeviceContext);
+		if (!owned_context->init(device_))
+			return false;
+		context = owned_context.get();
+	}
+
+	shaders = context->get_shaders();
+	blit_quad = context->get_blit_quad();
+	sample_quad[0] = context->get_sample_quad(0);
+	sample_quad[1] = context->get_sample_quad(1);
+	weave_quad = context->get_weave_quad();
 
 	flush_submit(0);
 	// Descriptor indexing is a hard requirement, but timeline semaphore could be elided if really needed.
@@ -824,20 +1212,97 @@ bool GSRenderer::init(Vulkan::Device *device_, const GSOptions &options)
 	}
 
 	buffers = {};
+	recording = {};
 	device = device_;
 	vram_size = options.vram_size;
+	async_compute_texture_uploads = options.async_compute_texture_uploads;
+	async_scanout = options.async_scanout;
+	incremental_scanout = options.incremental_scanout;
 	next_clut_instance = 0;
 	base_clut_instance = 0;
+	clut_instance_content_hashes.clear();
+	clut_instance_content_hashes.resize(CLUTInstances);
+	clut_content_instances.clear();
+	host_transfer_ring = {};
 
 	buffers.ssbo_alignment =
 			std::max<VkDeviceSize>(16, device->get_gpu_properties().limits.minStorageBufferOffsetAlignment);
 
+	buffers.device_scratch.pool = &buffers.device_scratch_pool;
+	buffers.rebar_scratch.pool = &buffers.rebar_scratch_pool;
+	buffers.pos_scratch.pool = &buffers.pos_scratch_pool;
+	buffers.attr_scratch.pool = &buffers.attr_scratch_pool;
+	buffers.prim_scratch.pool = &buffers.prim_scratch_pool;
+	// Primitive attributes are read back by the front-end, which would be very slow from uncached memory.
+	// Positions and attributes are only read back through cached shadow copies, so they can go to ReBAR.
+	buffers.pos_scratch.allow_rebar = true;
+	buffers.attr_scratch.allow_rebar = true;
+	rebar_attribute_scratch = device_has_resizable_bar(*device);
+	if (rebar_attribute_scratch)
+		LOGI("Writing vertex data directly to ReBAR.\n");
+
 	init_vram(options);
+
+	if (options.host_transfer_ring_size)
+	{
+		Vulkan::BufferCreateInfo info = {};
+		// Keep physical offsets aligned across wraparound.
+		info.size = options.host_transfer_ring_size / buffers.ssbo_alignment * buffers.ssbo_alignment;
+		info.domain = Vulkan::BufferDomain::CachedHost;
+		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		host_transfer_ring.buffer = device->create_buffer(info);
+		if (host_transfer_ring.buffer)
+		{
+			device->set_name(*host_transfer_ring.buffer, "host-transfer-ring");
+			host_transfer_ring.mapped = static_cast<uint8_t *>(
+					device->map_host_buffer(*host_transfer_ring.buffer, Vulkan::MEMORY_ACCESS_WRITE_BIT));
+			host_transfer_ring.size = info.size;
+			LOGI("Using host transfer ring of %llu MiB.\n",
+			     static_cast<unsigned long long>(info.size / (1024 * 1024)));
+		}
+
+		if (!host_transfer_ring.mapped)
+			host_transfer_ring = {};
+	}
+
 	timeline = device->request_semaphore(VK_SEMAPHORE_TYPE_TIMELINE);
 	descriptor_timeline = device->request_semaphore(VK_SEMAPHORE_TYPE_TIMELINE);
-	init_luts();
+	next_descriptor_timeline_signal = 1;
+
+	async_upload_timeline.reset();
+	async_upload_signalled_value = 0;
+	async_upload_waited_value = 0;
+	async_uploaded_images.clear();
+	if (async_compute_texture_uploads)
+		async_upload_timeline = device->request_semaphore(VK_SEMAPHORE_TYPE_TIMELINE);
+
+	scanout_export_ring.clear();
+	scanout_export_index = 0;
+	scanout_export_timeline.reset();
+	next_scanout_export_value = 1;
+	if (options.scanout_export_images)
+	{
+		if (device->get_device_features().supports_external)
+		{
+			scanout_export_timeline = device->request_semaphore_external(
+					VK_SEMAPHORE_TYPE_TIMELINE, Vulkan::ExternalHandle::get_opaque_semaphore_handle_type());
+		}
+
+		// The exported circuit and the merged image may both be taken from the ring in one vsync.
+		if (scanout_export_timeline)
+			scanout_export_ring.resize(std::max<uint32_t>(options.scanout_export_images, 2));
+		else
+			LOGW("External memory is not supported, disabling scanout export.\n");
+	}
+	buffers.fixed_rcp_lut_view = context->get_fixed_rcp_lut_view();
+	buffers.float_rcp_lut_view = context->get_float_rcp_lut_view();
 
-	kick_compilation_tasks();
+	// With a shared context, the pipeline cache belongs to the device, so only one instance manages it.
+	pipeline_cache_path.clear();
+	if (context->claim_pipeline_cache())
+		pipeline_cache_path = options.pipeline_cache_path;
+	load_pipeline_cache();
+	kick_compilation_tasks(options);
 
 	// Reserve 1/3 of our budget to slab-allocate image handles.
 	Vulkan::HeapBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
@@ -853,11 +1318,22 @@ bool GSRenderer::init(Vulkan::Device *device_, const GSOptions &options)
 		}
 	}
 
+	texture_memory_budget = options.texture_memory_budget;
+	if (texture_memory_budget)
+	{
+		max_image_slab_size = std::min<VkDeviceSize>(max_image_slab_size, texture_memory_budget);
+		LOGI("Using texture memory budget of %llu MiB.\n",
+		     static_cast<unsigned long long>(texture_memory_budget / (1024 * 1024)));
+	}
+
 	LOGI("Using image slab size of %llu MiB.\n",
 	     static_cast<unsigned long long>(max_image_slab_size / (1024 * 1024)));
 	LOGI("Using max allocated image memory per flush of %llu MiB.\n",
 	     static_cast<unsigned long long>(max_allocated_image_memory_per_flush / (1024 * 1024)));
 
+	if (options.threaded_render_pass_recording)
+		start_recording_worker(options.render_pass_recording_thread_index);
+
 	return true;
 }
 
@@ -883,6 +1359,7 @@ void GSRenderer::check_flush_stats()
 		LOGI("  %u copies\n", stats.num_copies);
 		LOGI("  %zu pending copies\n", pending_copies.size());
 		LOGI("  %u copy threads\n", stats.num_copy_threads);
+		LOGI("  %u copy hazards\n", stats.num_copy_hazards);
 		LOGI("  %u copy barriers\n", stats.num_copy_barriers);
 #endif
 		// Flush the work that is considered pending right now.
@@ -907,6 +1384,64 @@ static VkDeviceSize align_offset(VkDeviceSize offset, VkDeviceSize align)
 	return (offset + align - 1) & ~(align - 1);
 }
 
+void GSRenderer::retire_scratch(const Scratch &scratch, Vulkan::BufferHandle gpu_buffer)
+{
+	if (scratch.pool && scratch.buffer)
+		scratch.pool->retiring.push_back({ scratch.buffer, std::move(gpu_buffer), {}, scratch.size });
+}
+
+bool GSRenderer::pull_scratch_from_pool(ScratchPool &pool, VkDeviceSize size, ScratchPool::Entry &entry)
+{
+	while (!pool.retired.empty() && pool.retired.front().fence->wait_timeout(0))
+	{
+		auto front = std::move(pool.retired.front());
+		pool.retired.pop_front();
+
+		// Buffers too small for this allocation are rare, since they are only oversized for huge allocations.
+		if (front.size >= size)
+		{
+			entry = std::move(front);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void GSRenderer::fence_retired_scratch()
+{
+	ScratchPool *pools[] = {
+		&buffers.device_scratch_pool, &buffers.rebar_scratch_pool,
+		&buffers.pos_scratch_pool, &buffers.attr_scratch_pool, &buffers.prim_scratch_pool,
+	};
+
+	bool has_retiring = false;
+	for (auto *pool : pools)
+		if (!pool->retiring.empty())
+			has_retiring = true;
+
+	if (!has_retiring)
+		return;
+
+	// Every queue which reads scratch memory is waited on by the generic queue before this.
+	Vulkan::Fence fence;
+	device->submit_empty(Vulkan::CommandBuffer::Type::Generic, &fence, nullptr);
+
+	for (auto *pool : pools)
+	{
+		for (auto &entry : pool->retiring)
+		{
+			entry.fence = fence;
+			pool->retired.push_back(std::move(entry));
+		}
+		pool->retiring.clear();
+
+		// Don't hold on to memory after a spike.
+		while (pool->retired.size() > MaxRetiredScratchBuffers)
+			pool->retired.pop_back();
+	}
+}
+
 void GSRenderer::flush_attribute_scratch(AttributeScratch &scratch)
 {
 	if (!scratch.buffer || scratch.offset == scratch.flushed_to)
@@ -934,25 +1469,57 @@ void GSRenderer::flush_attribute_scratch(AttributeScratch &scratch)
 	scratch.flushed_to = scratch.offset;
 }
 
+bool GSRenderer::attribute_scratch_fits(VkDeviceSize size, const AttributeScratch &scratch) const
+{
+	return scratch.buffer && align_offset(scratch.offset, buffers.ssbo_alignment) + size <= scratch.size;
+}
+
 void GSRenderer::reserve_attribute_scratch(VkDeviceSize size, AttributeScratch &scratch)
 {
-	auto align = buffers.ssbo_alignment;
-	scratch.offset = align_offset(scratch.offset, align);
+	bool fits = attribute_scratch_fits(size, scratch);
+	scratch.offset = align_offset(scratch.offset, buffers.ssbo_alignment);
 
-	if (!scratch.buffer || scratch.offset + size > scratch.size)
+	if (!fits)
 	{
 		flush_attribute_scratch(scratch);
+		retire_scratch(scratch, std::move(scratch.gpu_buffer));
+
+		scratch.offset = 0;
+		scratch.flushed_to = 0;
+
+		ScratchPool::Entry entry;
+		if (scratch.pool && pull_scratch_from_pool(*scratch.pool, size, entry))
+		{
+			scratch.buffer = std::move(entry.buffer);
+			scratch.gpu_buffer = std::move(entry.gpu_buffer);
+			scratch.size = entry.size;
+			return;
+		}
+
+		stats.num_scratch_allocations++;
 
 		Vulkan::BufferCreateInfo info = {};
 		constexpr VkDeviceSize DefaultScratchBufferSize = 32 * 1024 * 1024;
 		info.size = std::max<VkDeviceSize>(size, DefaultScratchBufferSize);
-		info.domain = Vulkan::BufferDomain::UMACachedCoherentPreferDevice;
 		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		scratch.size = info.size;
+		scratch.buffer.reset();
+		scratch.gpu_buffer.reset();
+
+		if (scratch.allow_rebar && rebar_attribute_scratch)
+		{
+			// Skip the copy entirely. If mapping fails, e.g. when capturing, fall back to the copy.
+			info.domain = Vulkan::BufferDomain::LinkedDeviceHostPreferDevice;
+			scratch.gpu_buffer = device->create_buffer(info);
+			if (scratch.gpu_buffer && device->map_host_buffer(*scratch.gpu_buffer, 0))
+			{
+				scratch.buffer = scratch.gpu_buffer;
+				return;
+			}
+		}
 
+		info.domain = Vulkan::BufferDomain::UMACachedCoherentPreferDevice;
 		scratch.gpu_buffer = device->create_buffer(info);
-		scratch.offset = 0;
-		scratch.size = info.size;
-		scratch.flushed_to = 0;
 
 		if (device->map_host_buffer(*scratch.gpu_buffer, 0))
 		{
@@ -984,17 +1551,31 @@ VkDeviceSize GSRenderer::allocate_device_scratch(VkDeviceSize size, Scratch &scr
 	scratch.offset = align_offset(scratch.offset, align);
 	if (!scratch.buffer || scratch.offset + size > scratch.size)
 	{
-		Vulkan::BufferCreateInfo info = {};
-		constexpr VkDeviceSize DefaultScratchBufferSize = 32 * 1024 * 1024;
-		info.size = std::max<VkDeviceSize>(size, DefaultScratchBufferSize);
-		info.domain = data ? Vulkan::BufferDomain::LinkedDeviceHostPreferDevice : Vulkan::BufferDomain::Device;
-		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-		             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-		             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		retire_scratch(scratch, {});
+
+		ScratchPool::Entry entry;
+		if (scratch.pool && pull_scratch_from_pool(*scratch.pool, size, entry))
+		{
+			scratch.buffer = std::move(entry.buffer);
+			scratch.size = entry.size;
+		}
+		else
+		{
+			stats.num_scratch_allocations++;
+
+			Vulkan::BufferCreateInfo info = {};
+			constexpr VkDeviceSize DefaultScratchBufferSize = 32 * 1024 * 1024;
+			info.size = std::max<VkDeviceSize>(size, DefaultScratchBufferSize);
+			info.domain = data ? Vulkan::BufferDomain::LinkedDeviceHostPreferDevice : Vulkan::BufferDomain::Device;
+			info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+			scratch.buffer = device->create_buffer(info);
+			scratch.size = info.size;
+		}
 
-		scratch.buffer = device->create_buffer(info);
 		scratch.offset = 0;
-		scratch.size = info.size;
 	}
 
 	auto offset = scratch.offset;
@@ -1025,9 +1606,12 @@ VkDeviceSize GSRenderer::allocate_device_scratch(VkDeviceSize size, Scratch &scr
 
 GSRenderer::~GSRenderer()
 {
+	stop_recording_worker();
 	// Need to get rid of any command buffer handles at the very least. Otherwise, we deadlock the device.
 	flush_submit(0);
 	drain_compilation_tasks();
+	save_pipeline_cache();
+	recycle_bindless_pools();
 
 	{
 		std::lock_guard<std::mutex> holder{timeline_lock};
@@ -1095,19 +1679,67 @@ void GSRenderer::flush_qword_clears()
 
 void GSRenderer::flush_submit(uint64_t value)
 {
+	sync_recording_worker();
 	if (!device)
 		return;
 
+	TraceScope trace(trace_recorder, "Submit", "renderer");
+	trace.add_arg("timeline", value);
+	trace.add_arg("renderPasses", stats.num_render_passes);
+	trace.add_arg("primitives", stats.num_primitives);
+	trace.add_arg("copies", stats.num_copies);
+
 	total_stats.allocated_scratch_memory += stats.allocated_scratch_memory;
 	total_stats.allocated_image_memory += stats.allocated_image_memory;
 	total_stats.num_copies += stats.num_copies;
 	total_stats.num_primitives += stats.num_primitives;
 	total_stats.num_palette_updates += stats.num_palette_updates;
 	total_stats.num_render_passes += stats.num_render_passes;
+	total_stats.num_copy_hazards += stats.num_copy_hazards;
 	total_stats.num_copy_barriers += stats.num_copy_barriers;
 	total_stats.num_copy_threads += stats.num_copy_threads;
+	total_stats.num_overflow_flushes += stats.num_overflow_flushes;
+	total_stats.num_texture_content_hash_hits += stats.num_texture_content_hash_hits;
+	total_stats.num_texture_content_hash_misses += stats.num_texture_content_hash_misses;
+	total_stats.num_palette_content_hash_hits += stats.num_palette_content_hash_hits;
+	total_stats.num_z_culled_primitives += stats.num_z_culled_primitives;
+	total_stats.num_merged_fb_switches += stats.num_merged_fb_switches;
+	total_stats.num_scratch_allocations += stats.num_scratch_allocations;
 	stats = {};
 
+	submit_pending_command_buffers();
+
+	// Uploads which no render pass in this batch consumed must still be waited for,
+	// since scratch memory they read is fenced on the generic queue below.
+	wait_async_texture_uploads(async_upload_signalled_value);
+
+	if (value)
+	{
+		auto binary = device->request_timeline_semaphore_as_binary(*timeline, value);
+		device->submit_empty(Vulkan::CommandBuffer::Type::Generic, nullptr, binary.get());
+		{
+			std::lock_guard<std::mutex> holder{timeline_lock};
+			last_submitted_timeline = value;
+			timeline_cond.notify_all();
+		}
+		binary = device->request_timeline_semaphore_as_binary(*descriptor_timeline, next_descriptor_timeline_signal++);
+		device->submit_empty(Vulkan::CommandBuffer::Type::Generic, nullptr, binary.get());
+	}
+
+	// Pending texture uploads may still reference retired scratch buffers, so hold them back.
+	if (texture_uploads.empty() && async_texture_uploads.empty())
+		fence_retired_scratch();
+
+	// This is a delayed sync-point between CPU and GPU, and garbage collection can happen here.
+	drain_compilation_tasks_nonblock();
+	device->next_frame_context();
+
+	log_timestamps();
+	check_bug_feedback();
+}
+
+void GSRenderer::submit_pending_command_buffers()
+{
 	flush_attribute_scratch(buffers.pos_scratch);
 	flush_attribute_scratch(buffers.attr_scratch);
 	flush_attribute_scratch(buffers.prim_scratch);
@@ -1170,27 +1802,20 @@ void GSRenderer::flush_submit(uint64_t value)
 	}
 
 	if (direct_cmd)
-		device->submit(direct_cmd);
-
-	if (value)
 	{
-		auto binary = device->request_timeline_semaphore_as_binary(*timeline, value);
-		device->submit_empty(Vulkan::CommandBuffer::Type::Generic, nullptr, binary.get());
+		if (host_transfer_ring.has_pending_references)
 		{
-			std::lock_guard<std::mutex> holder{timeline_lock};
-			last_submitted_timeline = value;
-			timeline_cond.notify_all();
+			// Ring memory can be recycled once the copies reading it have completed.
+			// A transfer which is still receiving data may be read by later submissions, so keep it alive.
+			auto &ring = host_transfer_ring;
+			Vulkan::Fence fence;
+			device->submit(direct_cmd, &fence);
+			ring.in_flight.push_back({ std::move(fence), std::min<VkDeviceSize>(ring.head, ring.active_begin) });
+			ring.has_pending_references = false;
 		}
-		binary = device->request_timeline_semaphore_as_binary(*descriptor_timeline, next_descriptor_timeline_signal++);
-		device->submit_empty(Vulkan::CommandBuffer::Type::Generic, nullptr, binary.get());
+		else
+			device->submit(direct_cmd);
 	}
-
-	// This is a delayed sync-point between CPU and GPU, and garbage collection can happen here.
-	drain_compilation_tasks_nonblock();
-	device->next_frame_context();
-
-	log_timestamps();
-	check_bug_feedback();
 }
 
 void GSRenderer::check_bug_feedback()
@@ -1209,36 +1834,131 @@ void GSRenderer::check_bug_feedback()
 #endif
 }
 
+static const char *timestamp_type_to_str(TimestampType type)
+{
+	switch (type)
+	{
+	case TimestampType::SyncHostToVRAM:
+		return "SyncHostToVRAM";
+	case TimestampType::CopyVRAM:
+		return "CopyVRAM";
+	case TimestampType::PaletteUpdate:
+		return "PaletteUpdate";
+	case TimestampType::TextureUpload:
+		return "TextureUpload";
+	case TimestampType::TriangleSetup:
+		return "TriangleSetup";
+	case TimestampType::Binning:
+		return "Binning";
+	case TimestampType::Shading:
+		return "Shading";
+	case TimestampType::Readback:
+		return "Readback";
+	case TimestampType::VSync:
+		return "VSync";
+	default:
+		return "";
+	}
+}
+
+void GSRenderer::trace_timestamp(const Timestamp &ts)
+{
+	uint64_t start_ticks = ts.ts_start->get_timestamp_ticks();
+	uint64_t end_ticks = ts.ts_end->get_timestamp_ticks();
+	uint64_t now_ns = Util::get_current_time_nsecs();
+	auto duration_ns = uint64_t(1e9 * std::max(0.0, device->convert_device_timestamp_delta(start_ticks, end_ticks)));
+
+	// There is no calibration between the clocks, but resolved work must have completed in the past.
+	// Anchor the GPU timeline on the first range, and pull the anchor back whenever it would
+	// place the end of a range in the future. GPU ranges can only end up slightly late this way.
+	if (!gpu_trace_anchor_ticks)
+	{
+		gpu_trace_anchor_ticks = start_ticks;
+		gpu_trace_anchor_ns = now_ns - duration_ns;
+	}
+
+	auto start_ns = uint64_t(int64_t(gpu_trace_anchor_ns) + int64_t(1e9 * device->convert_device_timestamp_delta(
+			gpu_trace_anchor_ticks, start_ticks)));
+	if (start_ns + duration_ns > now_ns)
+	{
+		gpu_trace_anchor_ns -= start_ns + duration_ns - now_ns;
+		start_ns = now_ns - duration_ns;
+	}
+
+	TraceEvent event = {};
+	event.name = timestamp_type_to_str(ts.type);
+	event.category = "gpu";
+	event.start_ns = start_ns;
+	event.duration_ns = duration_ns;
+	event.gpu = true;
+	trace_recorder->record(event);
+}
+
 void GSRenderer::log_timestamps()
 {
 	auto itr = timestamps.begin();
+	resolved_timestamp_ranges.clear();
 	for (; itr != timestamps.end() && itr->ts_start->is_signalled() && itr->ts_end->is_signalled(); ++itr)
 	{
-		double t = device->convert_device_timestamp_delta(
-				itr->ts_start->get_timestamp_ticks(), itr->ts_end->get_timestamp_ticks());
+		uint64_t start_ticks = itr->ts_start->get_timestamp_ticks();
+		uint64_t end_ticks = itr->ts_end->get_timestamp_ticks();
+		double t = device->convert_device_timestamp_delta(start_ticks, end_ticks);
 		timestamp_total_time[int(itr->type)] += t;
+		resolved_timestamp_ranges.emplace_back(start_ticks, end_ticks);
+		if (trace_recorder)
+			trace_timestamp(*itr);
 	}
 	timestamps.erase(timestamps.begin(), itr);
+
+	// Ranges are recorded in submission order, but async compute work can execute
+	// concurrently with the main queue. Merge the ranges so overlap is not counted twice.
+	std::sort(resolved_timestamp_ranges.begin(), resolved_timestamp_ranges.end());
+	for (auto &range : resolved_timestamp_ranges)
+	{
+		uint64_t start_ticks = std::max<uint64_t>(range.first, timestamp_busy_end_ticks);
+		if (range.second > start_ticks)
+		{
+			timestamp_busy_time += device->convert_device_timestamp_delta(start_ticks, range.second);
+			timestamp_busy_end_ticks = range.second;
+		}
+	}
 }
 
 FlushStats GSRenderer::consume_flush_stats()
 {
+	sync_recording_worker();
 	FlushStats s = total_stats;
+	s.current_image_memory = current_image_memory;
+	s.peak_image_memory = peak_image_memory;
 	total_stats = {};
 	return s;
 }
 
 void GSRenderer::set_enable_timestamps(bool enable)
 {
+	sync_recording_worker();
 	enable_timestamps = enable;
 }
 
+void GSRenderer::set_trace_recorder(TraceRecorder *recorder)
+{
+	sync_recording_worker();
+	trace_recorder = recorder;
+	gpu_trace_anchor_ticks = 0;
+	gpu_trace_anchor_ns = 0;
+}
+
 double GSRenderer::get_accumulated_timestamps(TimestampType type) const
 {
 	assert(int(type) < int(TimestampType::Count));
 	return timestamp_total_time[int(type)];
 }
 
+double GSRenderer::get_accumulated_busy_time() const
+{
+	return timestamp_busy_time;
+}
+
 TexRect GSRenderer::compute_effective_texture_rect(const TextureDescriptor &desc)
 {
 	uint32_t width_log2 = std::min<uint32_t>(desc.tex0.desc.TW, TEX0Bits::MAX_SIZE_LOG2);
@@ -1273,6 +1993,7 @@ TexRect GSRenderer::compute_effective_texture_rect(const TextureDescriptor &desc
 
 void GSRenderer::recycle_image_handle(Vulkan::ImageHandle image)
 {
+	sync_recording_worker();
 	// Have to defer this until render pass is flushed, since an invalidate doesn't mean the texture is
 	// immune from reuse.
 	if (Util::is_pow2(image->get_width()) && Util::is_pow2(image->get_height()) &&
@@ -1280,10 +2001,22 @@ void GSRenderer::recycle_image_handle(Vulkan::ImageHandle image)
 	{
 		recycled_image_handles.push_back(std::move(image));
 	}
+	else
+		release_image_handle(std::move(image));
+}
+
+void GSRenderer::release_image_handle(Vulkan::ImageHandle image)
+{
+	sync_recording_worker();
+	VkDeviceSize size = image->get_width() * image->get_height() *
+	                    image->get_create_info().layers * sizeof(uint32_t);
+	assert(current_image_memory >= size);
+	current_image_memory -= size;
 }
 
 Vulkan::ImageHandle GSRenderer::copy_cached_texture(const Vulkan::Image &img, const VkRect2D &rect)
 {
+	sync_recording_worker();
 	ensure_command_buffer(direct_cmd, Vulkan::CommandBuffer::Type::Generic);
 	auto &cmd = *direct_cmd;
 
@@ -1323,12 +2056,18 @@ Vulkan::ImageHandle GSRenderer::copy_cached_texture(const Vulkan::Image &img, co
 
 Vulkan::ImageHandle GSRenderer::create_cached_texture(const TextureDescriptor &desc)
 {
+	sync_recording_worker();
 	if (!device)
 		return {};
 
 	assert(desc.rect.width && desc.rect.height);
 
 	Vulkan::ImageHandle img = pull_image_handle_from_slab(desc.rect.width, desc.rect.height, desc.rect.levels, desc.samples);
+	bool fresh_image = !img;
+
+	// A recycled image may have been uploaded on the async queue without any render pass sampling it.
+	if (img)
+		wait_async_texture_uploads(get_async_upload_timeline_value(*img));
 
 	if (!img)
 	{
@@ -1342,9 +2081,25 @@ Vulkan::ImageHandle GSRenderer::create_cached_texture(const TextureDescriptor &d
 		info.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 		info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		info.misc |= Vulkan::IMAGE_MISC_CREATE_PER_MIP_LEVEL_VIEWS_BIT;
+		if (async_compute_texture_uploads)
+		{
+			info.misc |= Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_GRAPHICS_BIT |
+			             Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_ASYNC_COMPUTE_BIT;
+		}
 
 		// Ignore mips. This is just a crude heuristic.
-		stats.allocated_image_memory += info.width * info.height * info.layers * sizeof(uint32_t);
+		VkDeviceSize size = info.width * info.height * info.layers * sizeof(uint32_t);
+		stats.allocated_image_memory += size;
+
+		// Make room before allocating, rather than trimming the slab afterwards.
+		if (texture_memory_budget && current_image_memory + size > texture_memory_budget)
+		{
+			VkDeviceSize excess = current_image_memory + size - texture_memory_budget;
+			evict_image_slab(total_image_slab_size > excess ? total_image_slab_size - excess : 0);
+		}
+
+		current_image_memory += size;
+		peak_image_memory = std::max<VkDeviceSize>(peak_image_memory, current_image_memory);
 
 		img = device->create_image(info);
 	}
@@ -1388,6 +2143,7 @@ Vulkan::ImageHandle GSRenderer::create_cached_texture(const TextureDescriptor &d
 
 	post_image_barriers.push_back(barrier);
 	texture_uploads.push_back({ img, desc });
+	texture_uploads.back().fresh_image = fresh_image;
 
 	return img;
 }
@@ -1435,6 +2191,7 @@ void GSRenderer::allocate_upload_indirection(TextureAnalysis &analysis, TextureU
 
 void GSRenderer::commit_cached_texture(uint32_t tex_info_index, bool sampler_feedback)
 {
+	sync_recording_worker();
 	// Assert that there were no stray flushes between create_cached_texture() and commit_cached_texture().
 	assert(!texture_uploads.empty());
 
@@ -1485,8 +2242,22 @@ void GSRenderer::ensure_conservative_indirect_texture_uploads()
 		upload.indirection = {};
 }
 
+static uint32_t get_cpu_upload_size(const PageRect &rect)
+{
+	// Only copy what we need.
+	uint32_t scratch_size;
+
+	if (rect.block_mask == UINT32_MAX)
+		scratch_size = 32;
+	else
+		scratch_size = 32 - Util::leading_zeroes(rect.block_mask);
+
+	return scratch_size * PGS_BLOCK_ALIGNMENT_BYTES;
+}
+
 void GSRenderer::promote_cached_texture_upload_cpu(const PageRect &rect)
 {
+	sync_recording_worker();
 	// Assert that there were no stray flushed between create_cached_texture() and commit_cached_texture().
 	assert(!texture_uploads.empty());
 	auto &upload = texture_uploads.back();
@@ -1495,23 +2266,41 @@ void GSRenderer::promote_cached_texture_upload_cpu(const PageRect &rect)
 	auto *vram = static_cast<const uint8_t *>(begin_host_vram_access());
 	vram += (rect.base_page * PageSize) & (vram_size - 1);
 
-	// Only copy what we need.
-	uint32_t scratch_size;
-
-	if (rect.block_mask == UINT32_MAX)
-		scratch_size = 32;
-	else
-		scratch_size = 32 - Util::leading_zeroes(rect.block_mask);
-
-	scratch_size *= PGS_BLOCK_ALIGNMENT_BYTES;
+	uint32_t scratch_size = get_cpu_upload_size(rect);
 
 	upload.scratch.offset = allocate_device_scratch(scratch_size, buffers.rebar_scratch, vram);
 	upload.scratch.size = scratch_size;
 	upload.scratch.buffer = buffers.rebar_scratch.buffer;
 }
 
+Util::Hash GSRenderer::hash_cached_texture_upload_cpu(const PageRect &rect)
+{
+	assert(rect.page_width == 1 && rect.page_height == 1);
+	auto *vram = static_cast<const uint32_t *>(begin_host_vram_access());
+	if (!vram)
+		return 0;
+	vram += ((rect.base_page * PageSize) & (vram_size - 1)) / sizeof(uint32_t);
+
+	Util::Hasher hasher;
+	hasher.data(vram, get_cpu_upload_size(rect));
+
+	// 0 is reserved for unknown contents.
+	Util::Hash h = hasher.get();
+	return h ? h : 1;
+}
+
+void GSRenderer::mark_texture_content_hash_lookup(bool hit)
+{
+	// Render pass recording does not touch these stats, so no need to sync.
+	if (hit)
+		stats.num_texture_content_hash_hits++;
+	else
+		stats.num_texture_content_hash_misses++;
+}
+
 void *GSRenderer::begin_host_vram_access()
 {
+	sync_recording_worker();
 	if (!device)
 		return nullptr;
 	return device->map_host_buffer(*buffers.cpu, Vulkan::MEMORY_ACCESS_READ_WRITE_BIT);
@@ -1519,6 +2308,7 @@ void *GSRenderer::begin_host_vram_access()
 
 void GSRenderer::end_host_write_vram_access()
 {
+	sync_recording_worker();
 	if (!device)
 		return;
 	device->unmap_host_buffer(*buffers.cpu, Vulkan::MEMORY_ACCESS_WRITE_BIT);
@@ -1547,6 +2337,7 @@ void GSRenderer::copy_blocks(Vulkan::CommandBuffer &cmd, const Vulkan::Buffer &d
 
 void GSRenderer::flush_host_vram_copy(const uint32_t *block_indices, uint32_t num_indices)
 {
+	sync_recording_worker();
 	if (buffers.gpu == buffers.cpu)
 		return;
 
@@ -1589,6 +2380,7 @@ void GSRenderer::flush_host_vram_copy(const uint32_t *block_indices, uint32_t nu
 
 void GSRenderer::flush_readback(const uint32_t *page_indices, uint32_t num_indices)
 {
+	sync_recording_worker();
 	if (buffers.gpu == buffers.cpu)
 		return;
 
@@ -1634,12 +2426,36 @@ Vulkan::BindlessDescriptorPoolHandle GSRenderer::get_bindless_pool()
 		ret->reset();
 		return ret;
 	}
+	else if (auto pool = context->request_bindless_pool())
+	{
+		return pool;
+	}
 	else
 	{
 		return device->create_bindless_descriptor_pool(Vulkan::BindlessResourceType::Image, 4096, 64 * 1024);
 	}
 }
 
+void GSRenderer::recycle_bindless_pools()
+{
+	if (!context || !descriptor_timeline)
+		return;
+
+	// Make sure the GPU is done with every pool before handing them over to other instances.
+	auto binary = device->request_timeline_semaphore_as_binary(*descriptor_timeline, next_descriptor_timeline_signal);
+	device->submit_empty(Vulkan::CommandBuffer::Type::Generic, nullptr, binary.get());
+	descriptor_timeline->wait_timeline(next_descriptor_timeline_signal++);
+
+	if (bindless_allocator)
+		context->recycle_bindless_pool(std::move(bindless_allocator));
+
+	while (!exhausted_descriptor_pools.empty())
+	{
+		context->recycle_bindless_pool(std::move(exhausted_descriptor_pools.front().exhausted_pool));
+		exhausted_descriptor_pools.pop();
+	}
+}
+
 void GSRenderer::bind_textures(Vulkan::CommandBuffer &cmd, const RenderPass &rp)
 {
 	VK_ASSERT(rp.num_textures <= MaxTextures);
@@ -1709,34 +2525,30 @@ void GSRenderer::bind_frame_resources(const RenderPass &rp)
 	triangle_setup_cmd->set_buffer_view(0, BINDING_FLOAT_RCP_LUT, *buffers.float_rcp_lut_view);
 	cmd.set_texture(0, BINDING_PHASE_LUT, buffers.phase_lut->get_view(), Vulkan::StockSampler::NearestClamp);
 
-	triangle_setup_cmd->set_storage_buffer(0, BINDING_VERTEX_POSITION, *buffers.pos_scratch.gpu_buffer,
-	                                       buffers.pos_scratch.offset, rp.num_primitives * 3 * sizeof(VertexPosition));
+	triangle_setup_cmd->set_storage_buffer(0, BINDING_VERTEX_POSITION, *recording.pos_scratch.gpu_buffer,
+	                                       recording.pos_scratch.offset, rp.num_primitives * 3 * sizeof(VertexPosition));
 	if (heuristic_cmd)
 	{
-		heuristic_cmd->set_storage_buffer(0, BINDING_VERTEX_POSITION, *buffers.pos_scratch.gpu_buffer,
-		                                  buffers.pos_scratch.offset, rp.num_primitives * 3 * sizeof(VertexPosition));
+		heuristic_cmd->set_storage_buffer(0, BINDING_VERTEX_POSITION, *recording.pos_scratch.gpu_buffer,
+		                                  recording.pos_scratch.offset, rp.num_primitives * 3 * sizeof(VertexPosition));
 	}
 
-	triangle_setup_cmd->set_storage_buffer(0, BINDING_VERTEX_ATTRIBUTES, *buffers.attr_scratch.gpu_buffer,
-	                                       buffers.attr_scratch.offset, rp.num_primitives * 3 * sizeof(VertexAttribute));
+	triangle_setup_cmd->set_storage_buffer(0, BINDING_VERTEX_ATTRIBUTES, *recording.attr_scratch.gpu_buffer,
+	                                       recording.attr_scratch.offset, rp.num_primitives * 3 * sizeof(VertexAttribute));
 
-	cmd.set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *buffers.prim_scratch.gpu_buffer,
-	                       buffers.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
-	triangle_setup_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *buffers.prim_scratch.gpu_buffer,
-	                                       buffers.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
+	cmd.set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *recording.prim_scratch.gpu_buffer,
+	                       recording.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
+	triangle_setup_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *recording.prim_scratch.gpu_buffer,
+	                                       recording.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
 
 	if (heuristic_cmd)
 	{
-		heuristic_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *buffers.prim_scratch.gpu_buffer,
-		                                  buffers.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
+		heuristic_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *recording.prim_scratch.gpu_buffer,
+		                                  recording.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
 	}
 
-	binning_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *buffers.prim_scratch.gpu_buffer,
-	                                buffers.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
-
-	commit_attribute_scratch(rp.num_primitives * 3 * sizeof(VertexPosition), buffers.pos_scratch);
-	commit_attribute_scratch(rp.num_primitives * 3 * sizeof(VertexAttribute), buffers.attr_scratch);
-	commit_attribute_scratch(rp.num_primitives * sizeof(PrimitiveAttribute), buffers.prim_scratch);
+	binning_cmd->set_storage_buffer(0, BINDING_PRIMITIVE_ATTRIBUTES, *recording.prim_scratch.gpu_buffer,
+	                                recording.prim_scratch.offset, rp.num_primitives * sizeof(PrimitiveAttribute));
 }
 
 static uint32_t align_coarse_tiles(uint32_t num_tiles, uint32_t hier_binning)
@@ -1752,8 +2564,7 @@ void GSRenderer::bind_frame_resources_instanced(const RenderPass &rp, uint32_t i
 
 	auto &inst = rp.instances[instance];
 
-	uint32_t hier_binning = get_target_hierarchical_binning(
-			num_primitives, inst.coarse_tiles_width, inst.coarse_tiles_height);
+	uint32_t hier_binning = get_target_hierarchical_binning(rp, instance, num_primitives);
 
 	constants.base_pixel.x = int(inst.base_x);
 	constants.base_pixel.y = int(inst.base_y);
@@ -1815,8 +2626,11 @@ void GSRenderer::allocate_scratch_buffers(Vulkan::CommandBuffer &cmd, const Rend
 }
 
 uint32_t GSRenderer::get_target_hierarchical_binning(
-		uint32_t num_primitives, uint32_t coarse_tiles_width, uint32_t coarse_tiles_height) const
+		const RenderPass &rp, uint32_t instance, uint32_t num_primitives) const
 {
+	uint32_t coarse_tiles_width = rp.instances[instance].coarse_tiles_width;
+	uint32_t coarse_tiles_height = rp.instances[instance].coarse_tiles_height;
+
 #ifdef __APPLE__
 	// Broken Metal drivers can't deal with the hierarchical binning for some reason.
 	return 1;
@@ -1831,7 +2645,30 @@ uint32_t GSRenderer::get_target_hierarchical_binning(
 	if (coarse_tiles_width <= 4 || coarse_tiles_height <= 4)
 		return 1;
 
-	uint32_t target_binning = num_primitives < 4096 ? 2 : 4;
+	uint32_t target_binning = num_primitives < 4096 ? 2 : 4;
+
+	if (rp.average_primitive_area)
+	{
+		// The hierarchical level only pays off if it can reject primitives for a whole group of tiles.
+		// Dense passes of small primitives benefit from the widest grouping even with fewer primitives,
+		// while a group of tiles smaller than the typical primitive rejects next to nothing.
+		uint32_t tile_size = 1u << rp.coarse_tile_size_log2;
+		uint32_t group_area = 16 * tile_size * tile_size;
+		if (num_primitives >= 1024 && rp.average_primitive_area * 4 <= group_area &&
+		    coarse_tiles_width >= 16 && coarse_tiles_height >= 16)
+		{
+			target_binning = 4;
+		}
+
+		while (target_binning > 1)
+		{
+			group_area = target_binning * target_binning * tile_size * tile_size;
+			if (uint64_t(rp.average_primitive_area) * 2 <= group_area)
+				break;
+			target_binning /= 2;
+		}
+	}
+
 	uint32_t maximum_invocations = device->get_device_features().vk11_props.subgroupSize * target_binning * target_binning;
 
 	// Make sure that we can support the worst case size of the workgroup.
@@ -1851,8 +2688,7 @@ void GSRenderer::allocate_scratch_buffers_instanced(Vulkan::CommandBuffer &cmd,
 {
 	auto &inst = rp.instances[instance];
 
-	uint32_t hier_binning = get_target_hierarchical_binning(
-			num_primitives, inst.coarse_tiles_width, inst.coarse_tiles_height);
+	uint32_t hier_binning = get_target_hierarchical_binning(rp, instance, num_primitives);
 	uint32_t aligned_width = align_coarse_tiles(inst.coarse_tiles_width, hier_binning);
 	uint32_t aligned_height = align_coarse_tiles(inst.coarse_tiles_height, hier_binning);
 
@@ -1898,7 +2734,8 @@ void GSRenderer::allocate_scratch_buffers_instanced(Vulkan::CommandBuffer &cmd,
 bool GSRenderer::render_pass_instance_is_deduced_blur(const RenderPass &rp, uint32_t instance) const
 {
 	// Crude heuristic to figure out if a render pass instance attempts a blur kernel.
-	if (rp.num_primitives > 64)
+	// Only small render passes are considered, which fit in the shadow copy of the vertex data.
+	if (rp.num_primitives > MaxShadowedPrimitives)
 		return false;
 
 	uint32_t last_tex_index = UINT32_MAX;
@@ -1906,18 +2743,18 @@ bool GSRenderer::render_pass_instance_is_deduced_blur(const RenderPass &rp, uint
 
 	for (uint32_t i = 0; i < rp.num_primitives; i++)
 	{
-		uint32_t prim_instance = (buffers.prim[i].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
+		uint32_t prim_instance = (recording.prim[i].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 		                         ((1 << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1);
 
-		if (prim_instance != instance || (buffers.prim[i].tex & TEX_PER_SAMPLE_BIT) == 0)
+		if (prim_instance != instance || (recording.prim[i].tex & TEX_PER_SAMPLE_BIT) == 0)
 			continue;
-		if ((buffers.prim[i].state & (1 << STATE_BIT_PERSPECTIVE)) != 0)
+		if ((recording.prim[i].state & (1 << STATE_BIT_PERSPECTIVE)) != 0)
 			return false;
 
-		uint32_t tex_index = (buffers.prim[i].tex >> TEX_TEXTURE_INDEX_OFFSET) &
+		uint32_t tex_index = (recording.prim[i].tex >> TEX_TEXTURE_INDEX_OFFSET) &
 		                     ((1 << TEX_TEXTURE_INDEX_BITS) - 1);
 
-		ivec2 phase = ivec2(buffers.attr[3 * i].uv) - buffers.pos[3 * i].pos;
+		ivec2 phase = ivec2(recording.attr_shadow[3 * i].uv) - recording.pos_shadow[3 * i].pos;
 
 		if (last_tex_index == tex_index)
 		{
@@ -2048,7 +2885,8 @@ void GSRenderer::dispatch_single_sample_heuristic(Vulkan::CommandBuffer &cmd, co
 		auto &inst = rp.instances[i];
 		push.instance = i;
 
-		if (inst.sampling_rate_y_log2 == 0)
+		// Sprite-only instances have nothing to demote.
+		if (inst.sampling_rate_y_log2 == 0 || !inst.has_triangles_or_lines)
 			continue;
 
 		// If we don't know, assume 24-bit range. If Z buffer isn't used at all, it's unlikely there will be proper 3D objects anyway.
@@ -2118,8 +2956,7 @@ void GSRenderer::dispatch_binning(Vulkan::CommandBuffer &cmd, const RenderPass &
 {
 	auto &inst = rp.instances[instance];
 
-	uint32_t hier_binning = get_target_hierarchical_binning(
-			num_primitives, inst.coarse_tiles_width, inst.coarse_tiles_height);
+	uint32_t hier_binning = get_target_hierarchical_binning(rp, instance, num_primitives);
 
 	cmd.enable_subgroup_size_control(true);
 	cmd.set_specialization_constant_mask(0x1f);
@@ -2392,7 +3229,7 @@ void GSRenderer::dispatch_shading_commands(
 			begin_region(cmd, "Prim [%u, %u]", lo_primitive_index, hi_primitive_index);
 			for (uint32_t j = lo_primitive_index; j <= hi_primitive_index; j++)
 			{
-				auto s = buffers.prim[j].state;
+				auto s = recording.prim[j].state;
 
 				uint32_t prim_instance = (s >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 				                         ((1 << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1);
@@ -2413,14 +3250,14 @@ void GSRenderer::dispatch_shading_commands(
 				             (s >> STATE_BIT_PARALLELOGRAM) & 1,
 				             (s >> STATE_BIT_IIP) & 1,
 				             (s >> STATE_BIT_LINE) & 1,
-				             buffers.prim[j].fbmsk);
+				             recording.prim[j].fbmsk);
 
-				auto alpha = buffers.prim[j].alpha;
+				auto alpha = recording.prim[j].alpha;
 				insert_label(cmd, "  AFIX: %u, AREF: %u",
 				             (alpha >> ALPHA_AFIX_OFFSET) & ((1u << ALPHA_AFIX_BITS) - 1u),
 				             (alpha >> ALPHA_AREF_OFFSET) & ((1u << ALPHA_AREF_BITS) - 1u));
 
-				auto tex = buffers.prim[j].tex;
+				auto tex = recording.prim[j].tex;
 				insert_label(cmd, "  TEX: %u, MXL: %u, CLAMPS: %u, CLAMPT: %u, MAG: %u, MIN: %u, MIP: %u",
 				             (tex >> TEX_TEXTURE_INDEX_OFFSET) & ((1u << TEX_TEXTURE_INDEX_BITS) - 1u),
 				             (tex >> TEX_MAX_MIP_LEVEL_OFFSET) & ((1u << TEX_MAX_MIP_LEVEL_BITS) - 1u),
@@ -2478,7 +3315,7 @@ void GSRenderer::dispatch_read_aliased_depth_passes(Vulkan::CommandBuffer &cmd,
 
 	for (uint32_t i = next_lo_index; i < num_primitives; i++)
 	{
-		auto &state = buffers.prim[base_primitive + i].state;
+		auto &state = recording.prim[base_primitive + i].state;
 		uint32_t prim_instance = (state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 		                         ((1u << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1u);
 
@@ -2488,7 +3325,7 @@ void GSRenderer::dispatch_read_aliased_depth_passes(Vulkan::CommandBuffer &cmd,
 		if (instance != prim_instance || (state & (1u << STATE_BIT_SPRITE)) == 0)
 			continue;
 
-		auto &prim_bb = buffers.prim[base_primitive + i].bb;
+		auto &prim_bb = recording.prim[base_primitive + i].bb;
 
 		auto hazard_bb = ivec4(std::max<int>(bb.x, prim_bb.x),
 		                       std::max<int>(bb.y, prim_bb.y),
@@ -2588,7 +3425,7 @@ void GSRenderer::dispatch_shading(Vulkan::CommandBuffer &cmd, const RenderPass &
 	{
 		for (uint32_t i = 0; i < num_primitives; i++)
 		{
-			auto &state = buffers.prim[base_primitive + i].state;
+			auto &state = recording.prim[base_primitive + i].state;
 
 			uint32_t prim_instance = (state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 			                         ((1u << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1u);
@@ -2869,65 +3706,189 @@ void GSRenderer::emit_copy_vram(Vulkan::CommandBuffer &cmd,
 		cmd.dispatch(num_wgs, 1, 1);
 }
 
-void GSRenderer::copy_vram(const CopyDescriptor &desc, const PageRect &damage_rect)
+uint32_t GSRenderer::schedule_copy_wave(const PageRect &dst_rect, const PageRect &src_rect, bool &has_hazard) const
+{
+	uint32_t page_mask = vram_size / PageSize - 1;
+	uint32_t wave = 0;
+
+	const auto scan = [&](const PageRect &rect, bool write) {
+		for (uint32_t y = 0; y < rect.page_height; y++)
+		{
+			for (uint32_t x = 0; x < rect.page_width; x++)
+			{
+				uint32_t page = (rect.base_page + y * rect.page_stride + x) & page_mask;
+				auto &state = copy_wave_pages[page];
+				uint32_t wave_mask = state.wave_mask;
+
+				// Walk from the latest wave. The first conflict is the strongest constraint for this page.
+				while (wave_mask)
+				{
+					uint32_t w = Util::floor_log2(wave_mask);
+					if (w < wave)
+						break;
+
+					if ((write && (state.read_block_mask[w] & rect.block_mask) != 0) ||
+					    (!write && (state.write_block_mask[w] & rect.block_mask) != 0))
+					{
+						// Read-after-write or write-after-read. We must go in a later wave.
+						wave = w + 1;
+						has_hazard = true;
+						break;
+					}
+					else if (write && (state.write_block_mask[w] & rect.block_mask) != 0)
+					{
+						// Write-after-write is resolved within a wave.
+						wave = w;
+						break;
+					}
+
+					wave_mask &= ~(1u << w);
+				}
+			}
+		}
+	};
+
+	scan(dst_rect, true);
+	scan(src_rect, false);
+	return wave;
+}
+
+void GSRenderer::register_copy_wave_pages(const PageRect &rect, uint32_t wave, bool write)
+{
+	uint32_t page_mask = vram_size / PageSize - 1;
+	for (uint32_t y = 0; y < rect.page_height; y++)
+	{
+		for (uint32_t x = 0; x < rect.page_width; x++)
+		{
+			uint32_t page = (rect.base_page + y * rect.page_stride + x) & page_mask;
+			auto &state = copy_wave_pages[page];
+
+			if (state.wave_mask == 0)
+				copy_wave_accessed_pages.push_back(page);
+
+			if ((state.wave_mask & (1u << wave)) == 0)
+			{
+				state.wave_mask |= 1u << wave;
+				state.write_block_mask[wave] = 0;
+				state.read_block_mask[wave] = 0;
+			}
+
+			if (write)
+				state.write_block_mask[wave] |= rect.block_mask;
+			else
+				state.read_block_mask[wave] |= rect.block_mask;
+		}
+	}
+}
+
+void GSRenderer::copy_vram(const CopyDescriptor &desc, const PageRect &dst_rect, const PageRect &src_rect)
 {
+	sync_recording_worker();
 	Vulkan::BufferBlockAllocation alloc = {};
 	stats.num_copy_threads += desc.trxreg.desc.RRW * desc.trxreg.desc.RRH;
 	if (stats.num_copy_threads > MaxPendingCopyThreads)
 		flush_transfer();
 
+	// When there's copy wraparound, we don't get exact page tracking atm, so be conservative
+	// since the writes will be scattered all over the place.
+	bool wraparound = desc.trxreg.desc.RRW + desc.trxpos.desc.DSAX > 2048 ||
+	                  desc.trxreg.desc.RRH + desc.trxpos.desc.DSAY > 2048;
+	bool has_hazard = false;
+	uint32_t wave;
+
+	if (wraparound)
+	{
+		wave = num_copy_waves;
+		has_hazard = num_copy_waves != 0;
+	}
+	else
+		wave = schedule_copy_wave(dst_rect, src_rect, has_hazard);
+
+	if (has_hazard)
+		stats.num_copy_hazards++;
+
+	if (wave >= MaxCopyWaves)
+	{
+		// Commit what we have so far. The page tracker still considers those copies pending, which is conservative.
+		flush_copy_waves();
+		wave = 0;
+	}
+
+	VkDeviceAddress host_bda = 0;
 	if (desc.trxdir.desc.XDIR == HOST_TO_LOCAL)
 	{
 		ensure_command_buffer(direct_cmd, Vulkan::CommandBuffer::Type::Generic);
-		stats.allocated_scratch_memory += desc.host_data_size;
-		alloc = direct_cmd->request_scratch_buffer_memory(desc.host_data_size);
-		memcpy(alloc.host, desc.host_data, desc.host_data_size);
+
+		if (host_transfer_ring_contains(desc.host_data))
+		{
+			// Zero-copy, just make sure the new data is visible to the GPU.
+			auto &ring = host_transfer_ring;
+			VkDeviceSize offset = static_cast<const uint8_t *>(desc.host_data) - ring.mapped;
+			device->unmap_host_buffer(*ring.buffer, Vulkan::MEMORY_ACCESS_WRITE_BIT,
+			                          offset + desc.host_data_size_offset,
+			                          desc.host_data_size - desc.host_data_size_offset);
+			host_bda = ring.buffer->get_device_address() + offset;
+			ring.has_pending_references = true;
+		}
+		else
+		{
+			stats.allocated_scratch_memory += desc.host_data_size;
+			alloc = direct_cmd->request_scratch_buffer_memory(desc.host_data_size);
+			memcpy(alloc.host, desc.host_data, desc.host_data_size);
+			host_bda = alloc.buffer->get_device_address() + alloc.offset;
+		}
 	}
-	pending_copies.push_back({ desc, std::move(alloc) });
+	pending_copies.push_back({ desc, std::move(alloc), host_bda, wave });
+	num_copy_waves = std::max<uint32_t>(num_copy_waves, wave + 1);
 
-	if (desc.trxreg.desc.RRW + desc.trxpos.desc.DSAX > 2048 || desc.trxreg.desc.RRH + desc.trxpos.desc.DSAY > 2048)
+	auto &copy_wave = copy_waves[wave];
+	uint32_t page_mask = vram_size / PageSize - 1;
+
+	if (wraparound)
 	{
-		// When there's copy wraparound, we don't get exact page tracking atm, so be conservative
-		// since the writes will be scattered all over the place.
-		for (auto &v : vram_copy_write_pages)
+		for (auto &v : copy_wave.write_pages)
 			v = UINT32_MAX;
+
+		// Every later copy must be ordered after this one.
+		PageRect all_pages = {};
+		all_pages.page_width = vram_size / PageSize;
+		all_pages.page_height = 1;
+		all_pages.block_mask = UINT32_MAX;
+		register_copy_wave_pages(all_pages, wave, true);
 	}
 	else
 	{
-		for (uint32_t y = 0; y < damage_rect.page_height; y++)
+		for (uint32_t y = 0; y < dst_rect.page_height; y++)
 		{
-			for (uint32_t x = 0; x < damage_rect.page_width; x++)
+			for (uint32_t x = 0; x < dst_rect.page_width; x++)
 			{
-				uint32_t effective_page = damage_rect.base_page + y * damage_rect.page_stride + x;
-				effective_page &= vram_size / PageSize - 1;
-				vram_copy_write_pages[effective_page / 32] |= 1u << (effective_page & 31);
+				uint32_t effective_page = dst_rect.base_page + y * dst_rect.page_stride + x;
+				effective_page &= page_mask;
+				copy_wave.write_pages[effective_page / 32] |= 1u << (effective_page & 31);
 			}
 		}
+
+		register_copy_wave_pages(dst_rect, wave, true);
 	}
 
-	stats.num_copies++;
-	check_flush_stats();
-}
+	register_copy_wave_pages(src_rect, wave, false);
 
-static const char *reason_to_str(FlushReason reason)
-{
-	switch (reason)
+	// Overlapping copies read from a snapshot of VRAM taken just before the wave executes.
+	if (desc.needs_shadow_vram)
 	{
-	case FlushReason::SubmissionFlush:
-		return "Submission";
-	case FlushReason::TextureHazard:
-		return "TextureHazard";
-	case FlushReason::CopyHazard:
-		return "CopyHazard";
-	case FlushReason::Overflow:
-		return "Overflow";
-	case FlushReason::FBPointer:
-		return "FBPointer";
-	case FlushReason::HostAccess:
-		return "HostAccess";
-	default:
-		return "";
+		for (uint32_t y = 0; y < src_rect.page_height; y++)
+		{
+			for (uint32_t x = 0; x < src_rect.page_width; x++)
+			{
+				uint32_t effective_page = src_rect.base_page + y * src_rect.page_stride + x;
+				effective_page &= page_mask;
+				copy_wave.shadow_pages[effective_page / 32] |= 1u << (effective_page & 31);
+			}
+		}
 	}
+
+	stats.num_copies++;
+	check_flush_stats();
 }
 
 #ifdef PARALLEL_GS_DEBUG
@@ -2993,7 +3954,7 @@ void GSRenderer::flush_rendering(const RenderPass &rp, uint32_t instance,
 		             psm_to_str(inst.fb.frame.desc.PSM),
 		             (inst.z_sensitive ? inst.fb.z.desc.ZBP * PGS_PAGE_ALIGNMENT_BYTES : ~0u),
 		             psm_to_str(depth_psm),
-		             reason_to_str(rp.flush_reason));
+		             flush_reason_to_str(rp.flush_reason));
 
 		for (uint32_t i = 0; i < rp.num_states && instance == 0; i++)
 		{
@@ -3074,6 +4035,11 @@ static bool instance_has_hazard(const RenderPass::Instance &a, const RenderPass:
 	return false;
 }
 
+// Only FB and Z accesses are considered here.
+// Regular textures are uploaded before shading starts, so they cannot race with instance writes.
+// Sampling pages which an earlier instance rendered to is caught by the page tracker, which flushes the render pass,
+// and with working set merging, targets which alias earlier texture reads are not fused either.
+// Texture feedback samples the instance's own frame buffer, which is covered by the FB rects.
 static bool compute_instance_hazard_mask(uint8_t (&mask)[MaxRenderPassInstances],
                                          const RenderPass::Instance *instance,
                                          uint32_t num_instances, uint32_t coarse_tile_size_log2)
@@ -3119,6 +4085,14 @@ static bool compute_instance_hazard_mask(uint8_t (&mask)[MaxRenderPassInstances]
 
 void GSRenderer::reserve_primitive_buffers(uint32_t num_primitives)
 {
+	// Allocating a new scratch buffer records a transfer, which cannot overlap with the worker.
+	if (!attribute_scratch_fits(num_primitives * 3 * sizeof(VertexPosition), buffers.pos_scratch) ||
+	    !attribute_scratch_fits(num_primitives * 3 * sizeof(VertexAttribute), buffers.attr_scratch) ||
+	    !attribute_scratch_fits(num_primitives * sizeof(PrimitiveAttribute), buffers.prim_scratch))
+	{
+		sync_recording_worker();
+	}
+
 	reserve_attribute_scratch(num_primitives * 3 * sizeof(VertexPosition), buffers.pos_scratch);
 	reserve_attribute_scratch(num_primitives * 3 * sizeof(VertexAttribute), buffers.attr_scratch);
 	reserve_attribute_scratch(num_primitives * sizeof(PrimitiveAttribute), buffers.prim_scratch);
@@ -3157,6 +4131,16 @@ PrimitiveAttribute *GSRenderer::get_reserved_primitive_attributes() const
 	return buffers.prim;
 }
 
+VertexPosition *GSRenderer::get_vertex_position_shadow()
+{
+	return buffers.pos_shadow;
+}
+
+VertexAttribute *GSRenderer::get_vertex_attribute_shadow()
+{
+	return buffers.attr_shadow;
+}
+
 void GSRenderer::ensure_clear_cmd()
 {
 	// Attempted async compute here for binning, etc, but it's not very useful in practice.
@@ -3172,12 +4156,147 @@ void GSRenderer::flush_rendering(const RenderPass &rp)
 		return;
 	assert(rp.num_primitives <= MaxPrimitivesPerFlush);
 
+	sync_recording_worker();
+
+	if (async_upload_waited_value != async_upload_signalled_value)
+	{
+		// Shading is the first point which reads textures, so only wait for the uploads this render pass samples.
+		uint64_t wait_value = 0;
+		for (uint32_t i = 0; i < rp.num_textures; i++)
+		{
+			wait_value = std::max<uint64_t>(
+					wait_value, get_async_upload_timeline_value(rp.textures[i].view->get_image()));
+		}
+		wait_async_texture_uploads(wait_value);
+	}
+
+	if (rp.flush_reason == FlushReason::Overflow)
+		stats.num_overflow_flushes++;
+
+	stats.num_z_culled_primitives += rp.num_z_culled_primitives;
+	stats.num_merged_fb_switches += rp.num_merged_fb_switches;
+
+	// Hand the reserved primitive buffers over to recording.
+	// The next render pass can reserve fresh ones while this one is being recorded.
+	recording.pos_scratch = buffers.pos_scratch;
+	recording.attr_scratch = buffers.attr_scratch;
+	recording.prim_scratch = buffers.prim_scratch;
+	recording.prim = buffers.prim;
+	uint32_t num_shadowed_vertices = std::min<uint32_t>(rp.num_primitives, MaxShadowedPrimitives) * 3;
+	std::copy(buffers.pos_shadow, buffers.pos_shadow + num_shadowed_vertices, recording.pos_shadow);
+	std::copy(buffers.attr_shadow, buffers.attr_shadow + num_shadowed_vertices, recording.attr_shadow);
+	commit_attribute_scratch(rp.num_primitives * 3 * sizeof(VertexPosition), buffers.pos_scratch);
+	commit_attribute_scratch(rp.num_primitives * 3 * sizeof(VertexAttribute), buffers.attr_scratch);
+	commit_attribute_scratch(rp.num_primitives * sizeof(PrimitiveAttribute), buffers.prim_scratch);
+
+	if (!recording_worker.active)
+	{
+		record_render_pass(rp);
+		check_flush_stats();
+		return;
+	}
+
+	// The caller is free to reuse its state once we return, so take a copy of everything we reference.
+	auto &w = recording_worker;
+	w.states.assign(rp.states, rp.states + rp.num_states);
+	w.textures.assign(rp.textures, rp.textures + rp.num_textures);
+	w.held_images.assign(rp.held_images, rp.held_images + rp.num_held_images);
+	w.rp = rp;
+	w.rp.states = w.states.data();
+	w.rp.textures = w.textures.data();
+	w.rp.held_images = w.held_images.data();
+
+	std::lock_guard<std::mutex> holder{w.lock};
+	w.pending = true;
+	w.cond.notify_all();
+}
+
+void GSRenderer::start_recording_worker(unsigned thread_index)
+{
+	stop_recording_worker();
+
+	auto &w = recording_worker;
+	w.pending = false;
+	w.shutdown = false;
+	w.needs_flush_stats_check = false;
+	w.active = true;
+	w.thread = std::thread([this, thread_index]() {
+		Util::set_current_thread_name("PGS-Record");
+		Util::register_thread_index(thread_index);
+		recording_worker_loop();
+	});
+	w.thread_id = w.thread.get_id();
+}
+
+void GSRenderer::stop_recording_worker()
+{
+	auto &w = recording_worker;
+	if (!w.active)
+		return;
+
+	sync_recording_worker();
+
+	{
+		std::lock_guard<std::mutex> holder{w.lock};
+		w.shutdown = true;
+		w.cond.notify_all();
+	}
+
+	w.thread.join();
+	w.active = false;
+}
+
+void GSRenderer::recording_worker_loop()
+{
+	auto &w = recording_worker;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> holder{w.lock};
+			w.cond.wait(holder, [&]() { return w.pending || w.shutdown; });
+			if (!w.pending)
+				break;
+		}
+
+		record_render_pass(w.rp);
+		w.held_images.clear();
+
+		std::lock_guard<std::mutex> holder{w.lock};
+		w.pending = false;
+		w.needs_flush_stats_check = true;
+		w.cond.notify_all();
+	}
+}
+
+void GSRenderer::sync_recording_worker()
+{
+	auto &w = recording_worker;
+	if (!w.active || std::this_thread::get_id() == w.thread_id)
+		return;
+
+	{
+		std::unique_lock<std::mutex> holder{w.lock};
+		w.cond.wait(holder, [&]() { return !w.pending; });
+	}
+
+	// Deferred from the worker since it may submit, and it also touches the page tracker,
+	// which the front-end keeps using while we record.
+	if (w.needs_flush_stats_check)
+	{
+		w.needs_flush_stats_check = false;
+		check_flush_stats();
+	}
+}
+
+void GSRenderer::record_render_pass(const RenderPass &rp)
+{
 	// We didn't end up flushing indirect texture uploads before flushing the full render pass, so we're safe.
 	pending_indirect_uploads.clear();
 	pending_indirect_analysis.clear();
 
 #ifdef PARALLEL_GS_DEBUG
-	sanitize_state_indices(buffers.prim, rp);
+	sanitize_state_indices(recording.prim, rp);
 #endif
 
 	ensure_clear_cmd();
@@ -3186,7 +4305,7 @@ void GSRenderer::flush_rendering(const RenderPass &rp)
 	bool needs_single_sample_heuristic = false;
 	for (uint32_t i = 0; i < rp.num_instances; i++)
 	{
-		if (rp.instances[i].sampling_rate_y_log2 != 0)
+		if (rp.instances[i].sampling_rate_y_log2 != 0 && rp.instances[i].has_triangles_or_lines)
 		{
 			ensure_command_buffer(heuristic_cmd, Vulkan::CommandBuffer::Type::Generic);
 			needs_single_sample_heuristic = true;
@@ -3252,7 +4371,7 @@ void GSRenderer::flush_rendering(const RenderPass &rp)
 
 				for (uint32_t prim = 0; prim < rp.num_primitives; prim++)
 				{
-					uint32_t instance = (buffers.prim[prim].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
+					uint32_t instance = (recording.prim[prim].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 					                    ((1u << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1u);
 
 					if (active_hazards & (1u << instance))
@@ -3298,7 +4417,7 @@ void GSRenderer::flush_rendering(const RenderPass &rp)
 
 				for (uint32_t prim = 0; prim < rp.num_primitives; prim++)
 				{
-					uint32_t instance = (buffers.prim[prim].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
+					uint32_t instance = (recording.prim[prim].state >> STATE_VERTEX_RENDER_PASS_INSTANCE_OFFSET) &
 					                    ((1u << STATE_VERTEX_RENDER_PASS_INSTANCE_COUNT) - 1u);
 
 					if (prim_lo[instance] == UINT32_MAX)
@@ -3325,7 +4444,6 @@ void GSRenderer::flush_rendering(const RenderPass &rp)
 		}
 
 		stats.num_primitives += rp.num_primitives;
-		check_flush_stats();
 	}
 
 	move_image_handles_to_slab();
@@ -3350,8 +4468,10 @@ Vulkan::ImageHandle GSRenderer::pull_image_handle_from_slab(
 	if (pool.empty())
 		return {};
 
-	auto res = std::move(pool.back());
+	// The LRU record for this handle is left behind as stale.
+	auto res = std::move(pool.back().image);
 	pool.pop_back();
+	num_image_slab_entries--;
 	assert(total_image_slab_size >= (sizeof(uint32_t) << (W + H)) * res->get_create_info().layers);
 	total_image_slab_size -= (sizeof(uint32_t) << (W + H)) * res->get_create_info().layers;
 	return res;
@@ -3366,10 +4486,13 @@ void GSRenderer::move_image_handles_to_slab()
 		uint32_t levels = handle->get_create_info().levels;
 		assert(W <= 10 && H <= 10 && levels <= 7);
 		total_image_slab_size += (sizeof(uint32_t) << (W + H)) * handle->get_create_info().layers;
-		if (handle->get_create_info().layers > 1)
-			super_sampled_recycled_image_pool[H][W].push_back(std::move(handle));
-		else
-			recycled_image_pool[levels - 1][H][W].push_back(std::move(handle));
+
+		auto &pool = handle->get_create_info().layers > 1 ?
+		             super_sampled_recycled_image_pool[H][W] : recycled_image_pool[levels - 1][H][W];
+		uint64_t stamp = ++image_slab_stamp;
+		pool.push_back({ std::move(handle), stamp });
+		image_slab_lru.push_back({ &pool, stamp });
+		num_image_slab_entries++;
 	}
 	recycled_image_handles.clear();
 
@@ -3382,16 +4505,66 @@ void GSRenderer::move_image_handles_to_slab()
 		image_slab_high_water_mark = total_image_slab_size;
 	}
 
-	// If we end up exhausting this pool, just flush everything and start over, no need to be more clever about it.
-	// Shouldn't happen in normal use.
+	// If we end up exhausting this pool, drop the least recently recycled handles.
 	if (total_image_slab_size > max_image_slab_size)
 	{
-		flush_slab_cache();
+		evict_image_slab(max_image_slab_size);
 
 #ifdef PARALLEL_GS_DEBUG
-		LOGW("Image slab pool was exhausted, flushing it ...\n");
+		LOGW("Image slab pool was exhausted, evicting ...\n");
 #endif
 	}
+
+	// Handles which are pulled again before eviction leave stale records.
+	// Don't let those accumulate when nothing is evicted for a long time.
+	if (image_slab_lru.size() > 2 * num_image_slab_entries + 1024)
+		compact_image_slab_lru();
+}
+
+void GSRenderer::evict_image_slab(VkDeviceSize target_size)
+{
+	while (total_image_slab_size > target_size && !image_slab_lru.empty())
+	{
+		auto record = image_slab_lru.front();
+		image_slab_lru.pop_front();
+
+		// Stamps within a bucket are increasing, and any older live handle would already have been evicted
+		// by an earlier record, so a live handle for this record must be at the front.
+		auto &pool = *record.bucket;
+		if (pool.empty() || pool.front().stamp != record.stamp)
+			continue;
+
+		auto &image = *pool.front().image;
+		VkDeviceSize size = image.get_width() * image.get_height() * image.get_create_info().layers * sizeof(uint32_t);
+		assert(total_image_slab_size >= size && current_image_memory >= size);
+		total_image_slab_size -= size;
+		current_image_memory -= size;
+		pool.pop_front();
+		num_image_slab_entries--;
+	}
+}
+
+void GSRenderer::compact_image_slab_lru()
+{
+	image_slab_lru.clear();
+
+	const auto gather = [this](SlabBucket &pool) {
+		for (auto &entry : pool)
+			image_slab_lru.push_back({ &pool, entry.stamp });
+	};
+
+	for (auto &l : recycled_image_pool)
+		for (auto &y : l)
+			for (auto &x : y)
+				gather(x);
+
+	for (auto &h : super_sampled_recycled_image_pool)
+		for (auto &w : h)
+			gather(w);
+
+	std::sort(image_slab_lru.begin(), image_slab_lru.end(), [](const SlabRecord &a, const SlabRecord &b) {
+		return a.stamp < b.stamp;
+	});
 }
 
 void GSRenderer::flush_slab_cache()
@@ -3405,7 +4578,11 @@ void GSRenderer::flush_slab_cache()
 		for (auto &w : h)
 			w.clear();
 
+	assert(current_image_memory >= total_image_slab_size);
+	current_image_memory -= total_image_slab_size;
 	total_image_slab_size = 0;
+	image_slab_lru.clear();
+	num_image_slab_entries = 0;
 }
 
 void GSRenderer::mark_clut_read(uint32_t clut_instance)
@@ -3428,6 +4605,84 @@ bool PaletteUploadDescriptor::fully_replaces_clut_upload(const PaletteUploadDesc
 	       is_8bit == old_is_8bit;
 }
 
+static bool palette_upload_is_full_replacement(const PaletteUploadDescriptor &desc)
+{
+	auto &clut = desc.tex0.desc;
+	return clut.CSA == 0 && clut.CPSM == PSMCT32 && get_bits_per_pixel(clut.PSM) == 8;
+}
+
+void GSRenderer::set_clut_instance_content_hash(uint32_t instance, Util::Hash content_hash)
+{
+	Util::Hash old_hash = clut_instance_content_hashes[instance];
+	if (old_hash)
+	{
+		// Another instance may have taken over the entry since.
+		auto *entry = clut_content_instances.find(old_hash);
+		if (entry && entry->get() == instance)
+			clut_content_instances.erase(entry);
+	}
+
+	if (content_hash)
+		clut_content_instances.emplace_replace(content_hash, instance);
+	clut_instance_content_hashes[instance] = content_hash;
+}
+
+Util::Hash GSRenderer::hash_palette_upload_cpu(const PaletteUploadDescriptor &desc, const PageRect &rect)
+{
+	Util::Hasher hasher;
+
+	if (!palette_upload_is_full_replacement(desc))
+	{
+		// Entries which are not written are inherited from the incoming instance.
+		Util::Hash incoming_hash = clut_instance_content_hashes[desc.incoming_clut_instance];
+		if (!incoming_hash)
+			return 0;
+		hasher.u64(incoming_hash);
+	}
+
+	assert(rect.page_width == 1 && rect.page_height == 1);
+	auto *vram = static_cast<const uint32_t *>(begin_host_vram_access());
+	if (!vram)
+		return 0;
+	vram += ((rect.base_page * PageSize) & (vram_size - 1)) / sizeof(uint32_t);
+	hasher.data(vram, get_cpu_upload_size(rect));
+
+	hasher.u32(uint32_t(desc.tex0.desc.PSM));
+	hasher.u32(uint32_t(desc.tex0.desc.CPSM));
+	hasher.u32(uint32_t(desc.tex0.desc.CBP));
+	hasher.u32(uint32_t(desc.tex0.desc.CSA));
+	hasher.u32(uint32_t(desc.tex0.desc.CSM));
+	hasher.u64(desc.texclut.bits);
+	hasher.u32(desc.csm2_x_bias);
+	hasher.data(&desc.csm2_x_scale, sizeof(desc.csm2_x_scale));
+	hasher.u32(desc.csm1_reference_base);
+	hasher.u32(desc.csm1_mask);
+
+	// 0 is reserved for unknown contents.
+	Util::Hash h = hasher.get();
+	return h ? h : 1;
+}
+
+uint32_t GSRenderer::find_palette_cache(Util::Hash content_hash, uint32_t &age)
+{
+	sync_recording_worker();
+	auto *entry = clut_content_instances.find(content_hash);
+	if (!entry)
+		return UINT32_MAX;
+
+	uint32_t instance = entry->get();
+	age = (next_clut_instance + CLUTInstances - instance) % CLUTInstances;
+
+	// Not worth it if the ring is about to overwrite the instance.
+	if (age + 1 >= CLUTInstances)
+		return UINT32_MAX;
+
+	// Later uploads no longer build on top of the latest upload, so it must not be replaced in-place.
+	last_clut_update_is_read = true;
+	stats.num_palette_content_hash_hits++;
+	return instance;
+}
+
 void GSRenderer::rewind_clut_instance(uint32_t index)
 {
 	assert(palette_uploads.empty());
@@ -3444,14 +4699,19 @@ void GSRenderer::rewind_clut_instance(uint32_t index)
 	next_clut_instance = index;
 }
 
-uint32_t GSRenderer::update_palette_cache(const PaletteUploadDescriptor &desc)
+uint32_t GSRenderer::update_palette_cache(const PaletteUploadDescriptor &desc, Util::Hash content_hash)
 {
+	sync_recording_worker();
 	if (!last_clut_update_is_read && !palette_uploads.empty() &&
 	    desc.fully_replaces_clut_upload(palette_uploads.back()))
 	{
 		uint32_t old_incoming = palette_uploads.back().incoming_clut_instance;
 		palette_uploads.back() = desc;
 		palette_uploads.back().incoming_clut_instance = old_incoming;
+
+		// The hash was computed against a different incoming instance than what we end up reading.
+		if (desc.incoming_clut_instance != next_clut_instance && !palette_upload_is_full_replacement(desc))
+			content_hash = 0;
 	}
 	else
 	{
@@ -3461,6 +4721,7 @@ uint32_t GSRenderer::update_palette_cache(const PaletteUploadDescriptor &desc)
 		check_flush_stats();
 	}
 
+	set_clut_instance_content_hash(next_clut_instance, content_hash);
 	last_clut_update_is_read = false;
 	return next_clut_instance;
 }
@@ -3506,12 +4767,11 @@ void GSRenderer::dispatch_texture_analysis(Vulkan::CommandBuffer &cmd, const Ren
 	pending_indirect_analysis.push_back({ buffers.rebar_scratch.buffer, indirect_offset });
 }
 
-void GSRenderer::upload_texture(const TextureUpload &upload)
+void GSRenderer::upload_texture(Vulkan::CommandBuffer &cmd, const TextureUpload &upload)
 {
 	auto &desc = upload.desc;
 	auto &img = *upload.image;
 	auto &scratch = upload.scratch;
-	auto &cmd = *direct_cmd;
 
 	uint32_t levels = img.get_create_info().levels;
 	cmd.set_program(shaders.upload[int(upload.desc.samples > 1)]);
@@ -3646,7 +4906,7 @@ void GSRenderer::upload_texture(const TextureUpload &upload)
 	cmd.set_specialization_constant_mask(0);
 }
 
-void GSRenderer::init_luts()
+void GSDeviceContext::init_luts()
 {
 	static const uint8_t rcp_tab[256] =
 	{
@@ -3692,20 +4952,20 @@ void GSRenderer::init_luts()
 	buf_info.size = sizeof(rcp_tab);
 	buf_info.domain = Vulkan::BufferDomain::Device;
 	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT;
-	buffers.fixed_rcp_lut = device->create_buffer(buf_info, rcp_tab);
+	fixed_rcp_lut = device->create_buffer(buf_info, rcp_tab);
 
 	Vulkan::BufferViewCreateInfo view_info = {};
 	view_info.offset = 0;
 	view_info.range = VK_WHOLE_SIZE;
 	view_info.format = VK_FORMAT_R8_UINT;
-	view_info.buffer = buffers.fixed_rcp_lut.get();
-	buffers.fixed_rcp_lut_view = device->create_buffer_view(view_info);
+	view_info.buffer = fixed_rcp_lut.get();
+	fixed_rcp_lut_view = device->create_buffer_view(view_info);
 
 	buf_info.size = sizeof(lut);
-	buffers.float_rcp_lut = device->create_buffer(buf_info, lut);
+	float_rcp_lut = device->create_buffer(buf_info, lut);
 	view_info.format = VK_FORMAT_R32_SFLOAT;
-	view_info.buffer = buffers.float_rcp_lut.get();
-	buffers.float_rcp_lut_view = device->create_buffer_view(view_info);
+	view_info.buffer = float_rcp_lut.get();
+	float_rcp_lut_view = device->create_buffer_view(view_info);
 }
 
 void GSRenderer::flush_palette_upload()
@@ -3799,10 +5059,8 @@ void GSRenderer::flush_palette_upload()
 
 	for (size_t i = 0, n = palette_uploads.size(); i < n; i++)
 	{
-		auto &clut = palette_uploads[i].tex0.desc;
-
 		uint32_t write_clut_index = (base_clut_instance + 1 + i) % CLUTInstances;
-		bool full_replacement = clut.CSA == 0 && clut.CPSM == PSMCT32 && get_bits_per_pixel(clut.PSM) == 8;
+		bool full_replacement = palette_upload_is_full_replacement(palette_uploads[i]);
 		bool out_of_order_read = (palette_uploads[i].incoming_clut_instance + 1) % CLUTInstances != write_clut_index;
 
 		assert(write_clut_index != palette_uploads[i].incoming_clut_instance);
@@ -3849,72 +5107,240 @@ void GSRenderer::flush_palette_upload()
 		insert_label(cmd, "Split [%u, %u)", push.wg_offset, push.wg_offset + push.count);
 	cmd.dispatch(1, 1, 1);
 
-	if (enable_timestamps)
-	{
-		end_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-		timestamps.push_back({ TimestampType::PaletteUpdate, std::move(start_ts), std::move(end_ts) });
-	}
+	if (enable_timestamps)
+	{
+		end_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		timestamps.push_back({ TimestampType::PaletteUpdate, std::move(start_ts), std::move(end_ts) });
+	}
+
+	cmd.barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+	            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	cmd.end_region();
+	cmd.set_specialization_constant_mask(0);
+
+	base_clut_instance = next_clut_instance;
+	palette_uploads.clear();
+}
+
+void GSRenderer::record_texture_uploads(Vulkan::CommandBuffer &cmd,
+                                        const std::vector<TextureUpload> &uploads,
+                                        const std::vector<VkImageMemoryBarrier2> &pre_barriers,
+                                        const std::vector<VkImageMemoryBarrier2> &post_barriers)
+{
+	VkDependencyInfo dep = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dep.imageMemoryBarrierCount = pre_barriers.size();
+	dep.pImageMemoryBarriers = pre_barriers.data();
+	cmd.barrier(dep);
+
+	cmd.begin_region("cache-upload");
+	Vulkan::QueryPoolHandle start_ts, end_ts;
+	if (enable_timestamps)
+		start_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	// TODO: We could potentially sort this based on shader key to avoid some context rolls, but eeeeeh.
+	for (auto &upload : uploads)
+		upload_texture(cmd, upload);
+
+	if (enable_timestamps)
+	{
+		end_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		timestamps.push_back({ TimestampType::TextureUpload, std::move(start_ts), std::move(end_ts) });
+	}
+	cmd.end_region();
+
+	dep.imageMemoryBarrierCount = post_barriers.size();
+	dep.pImageMemoryBarriers = post_barriers.data();
+	cmd.barrier(dep);
+}
+
+bool GSRenderer::texture_upload_is_async_compatible(const TextureUpload &upload) const
+{
+	// GPU VRAM and CLUT are written on the main queue, and indirect uploads depend on texture analysis there.
+	// Only CPU forwarded uploads of non-palette formats are free of such dependencies.
+	// Recycled images may not have been created for concurrent use, and may still be read by
+	// render passes recorded in direct_cmd, which is submitted after the async queue.
+	return upload.fresh_image && upload.scratch.buffer && !upload.indirection.buffer &&
+	       !is_palette_format(uint32_t(upload.desc.tex0.desc.PSM)) &&
+	       (upload.image->get_create_info().misc & Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_ASYNC_COMPUTE_BIT) != 0;
+}
+
+void GSRenderer::flush_async_texture_uploads()
+{
+	// Pre and post barriers are allocated along with every upload, so they can be split in lock-step.
+	assert(pre_image_barriers.size() == texture_uploads.size());
+	assert(post_image_barriers.size() == texture_uploads.size());
+
+	size_t write_index = 0;
+	for (size_t i = 0, n = texture_uploads.size(); i < n; i++)
+	{
+		if (texture_upload_is_async_compatible(texture_uploads[i]))
+		{
+			async_texture_uploads.push_back(std::move(texture_uploads[i]));
+			async_pre_image_barriers.push_back(pre_image_barriers[i]);
+			async_post_image_barriers.push_back(post_image_barriers[i]);
+		}
+		else
+		{
+			if (write_index != i)
+			{
+				texture_uploads[write_index] = std::move(texture_uploads[i]);
+				pre_image_barriers[write_index] = pre_image_barriers[i];
+				post_image_barriers[write_index] = post_image_barriers[i];
+			}
+			write_index++;
+		}
+	}
+
+	texture_uploads.resize(write_index);
+	pre_image_barriers.resize(write_index);
+	post_image_barriers.resize(write_index);
+
+	if (async_texture_uploads.empty())
+		return;
+
+	// Without ReBAR, the scratch data is written by the async transfer queue, so it must be submitted first.
+	if (async_transfer_cmd)
+	{
+		Vulkan::Semaphore sems[2];
+		async_transfer_cmd->end_region();
+		device->submit(async_transfer_cmd, nullptr, 2, sems);
+		device->add_wait_semaphore(Vulkan::CommandBuffer::Type::AsyncCompute, std::move(sems[0]),
+		                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, true);
+		device->add_wait_semaphore(Vulkan::CommandBuffer::Type::Generic, std::move(sems[1]),
+		                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, true);
+	}
+
+	ensure_command_buffer(async_compute_cmd, Vulkan::CommandBuffer::Type::AsyncCompute);
+	async_compute_cmd->begin_region("AsyncCompute");
+	record_texture_uploads(*async_compute_cmd, async_texture_uploads,
+	                       async_pre_image_barriers, async_post_image_barriers);
+	async_compute_cmd->end_region();
+
+	// Submit right away, so the uploads can overlap with main queue work which is already in flight.
+	uint64_t value = ++async_upload_signalled_value;
+	device->submit(async_compute_cmd);
+	auto binary = device->request_timeline_semaphore_as_binary(*async_upload_timeline, value);
+	device->submit_empty(Vulkan::CommandBuffer::Type::AsyncCompute, nullptr, binary.get());
+
+	for (auto &upload : async_texture_uploads)
+		async_uploaded_images.emplace_replace(upload.image->get_cookie(), value);
+
+	async_texture_uploads.clear();
+	async_pre_image_barriers.clear();
+	async_post_image_barriers.clear();
+}
+
+uint64_t GSRenderer::get_async_upload_timeline_value(const Vulkan::Image &image)
+{
+	if (async_upload_waited_value == async_upload_signalled_value)
+		return 0;
+	auto *entry = async_uploaded_images.find(image.get_cookie());
+	return entry && entry->get() > async_upload_waited_value ? entry->get() : 0;
+}
+
+void GSRenderer::wait_async_texture_uploads(uint64_t value)
+{
+	if (value <= async_upload_waited_value)
+		return;
 
-	cmd.barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-	            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
-	cmd.end_region();
-	cmd.set_specialization_constant_mask(0);
+	// Everything recorded so far does not depend on these uploads, so let it run ahead of the wait.
+	submit_pending_command_buffers();
 
-	base_clut_instance = next_clut_instance;
-	palette_uploads.clear();
+	auto binary = device->request_timeline_semaphore_as_binary(*async_upload_timeline, value);
+	device->add_wait_semaphore(Vulkan::CommandBuffer::Type::Generic, std::move(binary),
+	                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+	                           VK_PIPELINE_STAGE_2_COPY_BIT, true);
+	async_upload_waited_value = value;
+
+	if (async_upload_waited_value == async_upload_signalled_value)
+		async_uploaded_images.clear();
 }
 
 void GSRenderer::flush_cache_upload()
 {
+	sync_recording_worker();
 	tracker.clear_cache_pages();
 
 	ensure_command_buffer(direct_cmd, Vulkan::CommandBuffer::Type::Generic);
 	flush_palette_upload();
+
+	if (async_compute_texture_uploads)
+		flush_async_texture_uploads();
+
 	if (texture_uploads.empty())
 		return;
 
-	auto &cmd = *direct_cmd;
+	record_texture_uploads(*direct_cmd, texture_uploads, pre_image_barriers, post_image_barriers);
 
-	VkDependencyInfo dep = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-	dep.imageMemoryBarrierCount = pre_image_barriers.size();
-	dep.pImageMemoryBarriers = pre_image_barriers.data();
-	cmd.barrier(dep);
+	texture_uploads.clear();
+	pre_image_barriers.clear();
+	post_image_barriers.clear();
+}
 
-	cmd.begin_region("cache-upload");
-	Vulkan::QueryPoolHandle start_ts, end_ts;
-	if (enable_timestamps)
-		start_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-	// TODO: We could potentially sort this based on shader key to avoid some context rolls, but eeeeeh.
-	for (auto &upload : texture_uploads)
-		upload_texture(upload);
+bool GSRenderer::host_transfer_ring_contains(const void *ptr) const
+{
+	auto *data = static_cast<const uint8_t *>(ptr);
+	return host_transfer_ring.mapped &&
+	       data >= host_transfer_ring.mapped &&
+	       data < host_transfer_ring.mapped + host_transfer_ring.size;
+}
 
-	if (enable_timestamps)
+void *GSRenderer::begin_host_transfer(VkDeviceSize size)
+{
+	sync_recording_worker();
+	auto &ring = host_transfer_ring;
+	assert(ring.active_begin == UINT64_MAX);
+
+	if (!ring.mapped || size > ring.size)
+		return nullptr;
+
+	// Payloads must be contiguous in the ring.
+	VkDeviceSize begin = align_offset(ring.head, buffers.ssbo_alignment);
+	VkDeviceSize physical_begin = begin % ring.size;
+	if (physical_begin + size > ring.size)
+		begin += ring.size - physical_begin;
+
+	while (begin + size > ring.tail + ring.size)
 	{
-		end_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-		timestamps.push_back({ TimestampType::TextureUpload, std::move(start_ts), std::move(end_ts) });
+		if (!ring.in_flight.empty())
+		{
+			ring.in_flight.front().fence->wait();
+			ring.tail = std::max<VkDeviceSize>(ring.tail, ring.in_flight.front().end);
+			ring.in_flight.pop_front();
+		}
+		else if (!ring.has_pending_references)
+		{
+			// Nothing can be reading from the ring anymore.
+			ring.tail = begin;
+		}
+		else
+		{
+			// Pending copies are still holding on to the ring. Fall back to scratch memory.
+			return nullptr;
+		}
 	}
-	cmd.end_region();
-
-	dep.imageMemoryBarrierCount = post_image_barriers.size();
-	dep.pImageMemoryBarriers = post_image_barriers.data();
-	cmd.barrier(dep);
 
-	texture_uploads.clear();
-	pre_image_barriers.clear();
-	post_image_barriers.clear();
+	ring.head = begin + size;
+	ring.active_begin = begin;
+	return ring.mapped + begin % ring.size;
 }
 
-void GSRenderer::mark_shadow_page_sync(uint32_t page_index)
+void GSRenderer::end_host_transfer()
 {
-	sync_vram_shadow_pages[page_index / 32u] |= 1u << (page_index & 31u);
+	sync_recording_worker();
+	host_transfer_ring.active_begin = UINT64_MAX;
 }
 
 void GSRenderer::flush_transfer()
 {
+	sync_recording_worker();
 	tracker.clear_copy_pages();
 	total_stats.num_copy_threads += stats.num_copy_threads;
 	stats.num_copy_threads = 0;
+	flush_copy_waves();
+}
 
+void GSRenderer::flush_copy_waves()
+{
 	if (pending_copies.empty())
 		return;
 
@@ -3931,65 +5357,6 @@ void GSRenderer::flush_transfer()
 	            VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
 				VK_ACCESS_TRANSFER_WRITE_BIT);
 
-	// Prepare atomic buffer for a new linked list setup.
-	{
-		RangeMerger merger;
-		const auto flush_range = [&](VkDeviceSize offset, VkDeviceSize range)
-		{
-			cmd.fill_buffer(*buffers.vram_copy_atomics, UINT32_MAX, offset + PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET, range);
-		};
-
-		cmd.begin_region("reset-vram-copy-state");
-		// Reset atomic counter.
-		cmd.fill_buffer(*buffers.vram_copy_atomics, 0, 0, PGS_VALID_PAGE_COPY_WRITE_OFFSET);
-		// Reset hazard exist bitfield.
-		cmd.fill_buffer(*buffers.vram_copy_atomics, 0, PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET + vram_size, vram_size / 32);
-
-#if 0
-		// For safety reasons, make absolutely sure it's safe to traverse the linked list.
-		assert(PGS_VALID_PAGE_COPY_WRITE_OFFSET + vram_copy_write_pages.size() * sizeof(uint32_t) <= PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET);
-		cmd.update_buffer_inline(*buffers.vram_copy_atomics, PGS_VALID_PAGE_COPY_WRITE_OFFSET,
-		                         vram_copy_write_pages.size() * sizeof(uint32_t), vram_copy_write_pages.data());
-#endif
-
-		for (size_t i = 0, n = vram_copy_write_pages.size(); i < n; i++)
-		{
-			Util::for_each_bit(vram_copy_write_pages[i], [&](uint32_t bit) {
-				merger.push((i * 32 + bit) * PageSize, PageSize, flush_range);
-			});
-			vram_copy_write_pages[i] = 0;
-		}
-
-		merger.flush(flush_range);
-		cmd.end_region();
-	}
-
-	// Upper half of VRAM is reserved for read-only caching.
-	{
-		VkDeviceSize read_only_offset = buffers.gpu->get_create_info().size / 2;
-		RangeMerger merger;
-
-		const auto flush_range = [&](VkDeviceSize offset, VkDeviceSize range)
-		{
-			cmd.copy_buffer(*buffers.gpu, offset + read_only_offset, *buffers.gpu, offset, range);
-		};
-
-		cmd.begin_region("shadow-vram-cache");
-		for (size_t i = 0, n = sync_vram_shadow_pages.size(); i < n; i++)
-		{
-			Util::for_each_bit(sync_vram_shadow_pages[i], [i, &merger, &flush_range](uint32_t bit) {
-				merger.push((i * 32 + bit) * PageSize, PageSize, flush_range);
-			});
-			sync_vram_shadow_pages[i] = 0;
-		}
-
-		merger.flush(flush_range);
-		cmd.end_region();
-	}
-
-	cmd.barrier(VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-	            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
-
 	auto *ubo = cmd.allocate_typed_constant_data<TransferDescriptor>(0, 3, pending_copies.size());
 	uint32_t copy_index = 0;
 	for (auto &copy : pending_copies)
@@ -4012,7 +5379,7 @@ void GSRenderer::flush_transfer()
 		// We handle robustness anyway, so this is fine.
 		if (desc.trxdir.desc.XDIR == HOST_TO_LOCAL)
 		{
-			ubo->source_bda = copy.alloc.buffer->get_device_address() + copy.alloc.offset;
+			ubo->source_bda = copy.host_bda;
 			ubo->source_size = desc.host_data_size;
 		}
 		else
@@ -4026,7 +5393,7 @@ void GSRenderer::flush_transfer()
 		ubo++;
 	}
 
-	// Sort and batch copy work that uses same shader.
+	// Sort and batch copy work that uses same shader within a wave.
 	uint32_t dispatch_order[MaxPendingCopiesWithoutFlush];
 	struct
 	{
@@ -4038,16 +5405,21 @@ void GSRenderer::flush_transfer()
 	for (size_t i = 0, n = pending_copies.size(); i < n; i++)
 		dispatch_order[i] = i;
 
+	const auto get_sort_key = [this](uint32_t index) -> uint64_t {
+		auto &copy = pending_copies[index];
+		return (uint64_t(copy.wave) << 32) | copy_pipeline_key(copy.copy);
+	};
+
 	std::sort(dispatch_order, dispatch_order + pending_copies.size(), [&](uint32_t a, uint32_t b) {
-		return copy_pipeline_key(pending_copies[a].copy) < copy_pipeline_key(pending_copies[b].copy);
+		return get_sort_key(a) < get_sort_key(b);
 	});
 
-	uint32_t current_key = copy_pipeline_key(pending_copies[dispatch_order[0]].copy);
+	uint64_t current_key = get_sort_key(dispatch_order[0]);
 	dispatches[0] = { 0, 1 };
 
 	for (size_t i = 1, n = pending_copies.size(); i < n; i++)
 	{
-		uint32_t next_key = copy_pipeline_key(pending_copies[dispatch_order[i]].copy);
+		uint64_t next_key = get_sort_key(dispatch_order[i]);
 		if (next_key == current_key)
 		{
 			dispatches[num_dispatches - 1].range++;
@@ -4061,20 +5433,101 @@ void GSRenderer::flush_transfer()
 		}
 	}
 
-	// Sort copies by pipeline key.
+	uint32_t dispatch_index = 0;
+	for (uint32_t wave = 0; wave < num_copy_waves; wave++)
+	{
+		auto &copy_wave = copy_waves[wave];
 
-	cmd.begin_region("prepare-copy");
-	for (uint32_t i = 0; i < num_dispatches; i++)
-		emit_copy_vram(cmd, dispatch_order + dispatches[i].offset, dispatches[i].range, true);
-	cmd.end_region();
+		if (wave != 0)
+		{
+			// This wave depends on the results of the earlier waves, and reuses the atomic state.
+			cmd.barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			            VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT |
+			            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			            VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_TRANSFER_READ_BIT |
+			            VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+			stats.num_copy_barriers++;
+		}
 
-	cmd.barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-	            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		// Prepare atomic buffer for a new linked list setup.
+		{
+			RangeMerger merger;
+			const auto flush_range = [&](VkDeviceSize offset, VkDeviceSize range)
+			{
+				cmd.fill_buffer(*buffers.vram_copy_atomics, UINT32_MAX, offset + PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET, range);
+			};
 
-	cmd.begin_region("actual-copy");
-	for (uint32_t i = 0; i < num_dispatches; i++)
-		emit_copy_vram(cmd, dispatch_order + dispatches[i].offset, dispatches[i].range, false);
-	cmd.end_region();
+			cmd.begin_region("reset-vram-copy-state");
+			// Reset atomic counter.
+			cmd.fill_buffer(*buffers.vram_copy_atomics, 0, 0, PGS_VALID_PAGE_COPY_WRITE_OFFSET);
+			// Reset hazard exist bitfield.
+			cmd.fill_buffer(*buffers.vram_copy_atomics, 0, PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET + vram_size, vram_size / 32);
+
+#if 0
+			// For safety reasons, make absolutely sure it's safe to traverse the linked list.
+			assert(PGS_VALID_PAGE_COPY_WRITE_OFFSET + copy_wave.write_pages.size() * sizeof(uint32_t) <= PGS_LINKED_VRAM_COPY_WRITE_LIST_OFFSET);
+			cmd.update_buffer_inline(*buffers.vram_copy_atomics, PGS_VALID_PAGE_COPY_WRITE_OFFSET,
+			                         copy_wave.write_pages.size() * sizeof(uint32_t), copy_wave.write_pages.data());
+#endif
+
+			for (size_t i = 0, n = copy_wave.write_pages.size(); i < n; i++)
+			{
+				Util::for_each_bit(copy_wave.write_pages[i], [&](uint32_t bit) {
+					merger.push((i * 32 + bit) * PageSize, PageSize, flush_range);
+				});
+				copy_wave.write_pages[i] = 0;
+			}
+
+			merger.flush(flush_range);
+			cmd.end_region();
+		}
+
+		// Upper half of VRAM is reserved for read-only caching.
+		{
+			VkDeviceSize read_only_offset = buffers.gpu->get_create_info().size / 2;
+			RangeMerger merger;
+
+			const auto flush_range = [&](VkDeviceSize offset, VkDeviceSize range)
+			{
+				cmd.copy_buffer(*buffers.gpu, offset + read_only_offset, *buffers.gpu, offset, range);
+			};
+
+			cmd.begin_region("shadow-vram-cache");
+			for (size_t i = 0, n = copy_wave.shadow_pages.size(); i < n; i++)
+			{
+				Util::for_each_bit(copy_wave.shadow_pages[i], [i, &merger, &flush_range](uint32_t bit) {
+					merger.push((i * 32 + bit) * PageSize, PageSize, flush_range);
+				});
+				copy_wave.shadow_pages[i] = 0;
+			}
+
+			merger.flush(flush_range);
+			cmd.end_region();
+		}
+
+		cmd.barrier(VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+		uint32_t first_dispatch = dispatch_index;
+		while (dispatch_index < num_dispatches &&
+		       pending_copies[dispatch_order[dispatches[dispatch_index].offset]].wave == wave)
+		{
+			dispatch_index++;
+		}
+
+		cmd.begin_region("prepare-copy");
+		for (uint32_t i = first_dispatch; i < dispatch_index; i++)
+			emit_copy_vram(cmd, dispatch_order + dispatches[i].offset, dispatches[i].range, true);
+		cmd.end_region();
+
+		cmd.barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+		cmd.begin_region("actual-copy");
+		for (uint32_t i = first_dispatch; i < dispatch_index; i++)
+			emit_copy_vram(cmd, dispatch_order + dispatches[i].offset, dispatches[i].range, false);
+		cmd.end_region();
+	}
 
 	if (enable_timestamps)
 	{
@@ -4084,6 +5537,11 @@ void GSRenderer::flush_transfer()
 
 	pending_copies.clear();
 
+	for (uint32_t page : copy_wave_accessed_pages)
+		copy_wave_pages[page].wave_mask = 0;
+	copy_wave_accessed_pages.clear();
+	num_copy_waves = 0;
+
 	cmd.barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
 	            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
 	            VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
@@ -4092,24 +5550,37 @@ void GSRenderer::flush_transfer()
 	cmd.end_region();
 }
 
-void GSRenderer::transfer_overlap_barrier()
-{
-	flush_transfer();
-	stats.num_copy_barriers++;
-}
-
 void GSRenderer::sample_crtc_circuit(Vulkan::CommandBuffer &cmd, const Vulkan::Image &img, const DISPFBBits &dispfb,
                                      const SamplingRect &rect, uint32_t super_samples,
-                                     const Vulkan::Image *promoted)
+                                     const Vulkan::Image *promoted, const VkRect2D *damage)
 {
-	cmd.image_barrier(img, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	                  0, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	if (damage)
+	{
+		// The previous scanout sampled it in either fragment or compute (EXTWRITE).
+		cmd.image_barrier(img, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+
+		if (!damage->extent.width || !damage->extent.height)
+			return;
+	}
+	else
+	{
+		cmd.image_barrier(img, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		                  0, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	}
 
 	Vulkan::RenderPassInfo rp_info;
 	rp_info.num_color_attachments = 1;
 	rp_info.color_attachments[0] = &img.get_view();
 	rp_info.store_attachments = 1u << 0;
-	if (memcmp(&rect.valid_extent, &rect.image_extent, sizeof(VkExtent2D)) != 0)
+	if (damage)
+	{
+		rp_info.load_attachments = 1u << 0;
+		rp_info.render_area = *damage;
+	}
+	else if (memcmp(&rect.valid_extent, &rect.image_extent, sizeof(VkExtent2D)) != 0)
 		rp_info.clear_attachments = 1u << 0;
 	cmd.begin_render_pass(rp_info);
 
@@ -4126,7 +5597,14 @@ void GSRenderer::sample_crtc_circuit(Vulkan::CommandBuffer &cmd, const Vulkan::I
 		valid_extent.width *= 2;
 		valid_extent.height *= 2;
 	}
-	cmd.set_scissor({{ 0, 0 }, valid_extent });
+
+	VkRect2D scissor = {{ 0, 0 }, valid_extent };
+	if (damage)
+	{
+		// Damage is already clipped to the valid region.
+		scissor = *damage;
+	}
+	cmd.set_scissor(scissor);
 
 	cmd.set_specialization_constant_mask(0x7);
 	cmd.set_specialization_constant(0, uint32_t(dispfb.PSM));
@@ -4156,6 +5634,85 @@ void GSRenderer::sample_crtc_circuit(Vulkan::CommandBuffer &cmd, const Vulkan::I
 	cmd.end_render_pass();
 }
 
+VkRect2D GSRenderer::compute_circuit_damage(const DISPFBBits &dispfb, const SamplingRect &rect,
+                                            const VkRect2D &fb_damage, uint32_t super_samples)
+{
+	if (!fb_damage.extent.width || !fb_damage.extent.height)
+		return {};
+
+	// Circuit line y samples frame buffer line DBY + y * phase_stride + phase_offset.
+	int stride = int(rect.phase_stride);
+	int x0 = fb_damage.offset.x - int(dispfb.DBX);
+	int x1 = x0 + int(fb_damage.extent.width);
+	int y0 = fb_damage.offset.y - int(dispfb.DBY) - int(rect.phase_offset);
+	int y1 = y0 + int(fb_damage.extent.height);
+
+	x0 = std::max<int>(x0, 0);
+	x1 = std::min<int>(x1, int(rect.valid_extent.width));
+	y0 = std::max<int>(y0, 0) / stride;
+	y1 = std::min<int>((std::max<int>(y1, 0) + stride - 1) / stride, int(rect.valid_extent.height));
+
+	if (x0 >= x1 || y0 >= y1)
+		return {};
+
+	// High resolution scanout doubles the circuit in both dimensions.
+	int scale_log2 = super_samples > 1 ? 1 : 0;
+	VkRect2D damage = {};
+	damage.offset.x = x0 << scale_log2;
+	damage.offset.y = y0 << scale_log2;
+	damage.extent.width = uint32_t(x1 - x0) << scale_log2;
+	damage.extent.height = uint32_t(y1 - y0) << scale_log2;
+	return damage;
+}
+
+Vulkan::ImageHandle GSRenderer::sample_scanout_circuit(Vulkan::CommandBuffer &cmd, uint32_t index,
+                                                       const Vulkan::ImageCreateInfo &info,
+                                                       const DISPFBBits &dispfb, const SamplingRect &rect,
+                                                       uint32_t super_samples, const Vulkan::Image *promoted,
+                                                       const VkRect2D *fb_damage, VkRect2D &damage,
+                                                       ScanoutResult *export_result)
+{
+	// Promoted backbuffers are not sampled from VRAM, so VRAM damage says nothing about them.
+	if (fb_damage && !promoted)
+		damage = compute_circuit_damage(dispfb, rect, *fb_damage, super_samples);
+	else
+		damage = {{ 0, 0 }, { info.width, info.height }};
+
+	// With async scanout, the previous circuit may still be read on the async queue.
+	// Exported circuits are handed to the frontend as-is, so they cannot be updated in place either.
+	bool can_keep = incremental_scanout && !async_scanout && !promoted && !export_result;
+	auto &cached = scanout_circuits[index];
+	Vulkan::ImageHandle img;
+
+	if (can_keep && fb_damage && cached.image &&
+	    cached.image->get_width() == info.width && cached.image->get_height() == info.height &&
+	    cached.super_samples == super_samples &&
+	    memcmp(&cached.dispfb, &dispfb, sizeof(dispfb)) == 0 &&
+	    memcmp(&cached.rect, &rect, sizeof(rect)) == 0)
+	{
+		img = cached.image;
+		sample_crtc_circuit(cmd, *img, dispfb, rect, super_samples, promoted, &damage);
+	}
+	else
+	{
+		img = create_scanout_image(cmd, info, export_result);
+		sample_crtc_circuit(cmd, *img, dispfb, rect, super_samples, promoted, nullptr);
+		device->set_name(*img, index ? "Circuit2" : "Circuit1");
+	}
+
+	if (can_keep)
+	{
+		cached.image = img;
+		cached.dispfb = dispfb;
+		cached.rect = rect;
+		cached.super_samples = super_samples;
+	}
+	else
+		cached = {};
+
+	return img;
+}
+
 GSRenderer::SamplingRect GSRenderer::compute_circuit_rect(const PrivRegisterState &priv, uint32_t phase,
                                                           const DISPLAYBits &display, bool force_progressive,
                                                           const Vulkan::Image *promoted)
@@ -4231,10 +5788,67 @@ bool GSRenderer::vsync_can_skip(const PrivRegisterState &priv, const VSyncInfo &
 	return !scanout_is_interlaced(priv, info);
 }
 
+Vulkan::Semaphore GSRenderer::get_scanout_export_timeline() const
+{
+	return scanout_export_timeline;
+}
+
+Vulkan::ImageHandle GSRenderer::create_scanout_image(Vulkan::CommandBuffer &cmd, const Vulkan::ImageCreateInfo &info,
+                                                     ScanoutResult *result)
+{
+	if (!result || scanout_export_ring.empty())
+		return device->create_image(info);
+
+	uint32_t index = scanout_export_index;
+	auto &slot = scanout_export_ring[index];
+	bool reallocated = false;
+
+	if (!slot || slot->get_width() != info.width || slot->get_height() != info.height ||
+	    slot->get_format() != info.format)
+	{
+		auto export_info = info;
+		export_info.misc |= Vulkan::IMAGE_MISC_EXTERNAL_MEMORY_BIT;
+		export_info.external.memory_handle_type = Vulkan::ExternalHandle::get_opaque_memory_handle_type();
+
+		slot = device->create_image(export_info);
+		if (!slot)
+		{
+			LOGE("Failed to allocate exportable scanout image.\n");
+			return device->create_image(info);
+		}
+
+		reallocated = true;
+	}
+	else
+	{
+		// The frontend may still have been reading the previous contents on this queue.
+		cmd.barrier(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+	}
+
+	result->export_image = slot;
+	result->export_index = index;
+	result->export_image_reallocated = reallocated;
+	scanout_export_index = (scanout_export_index + 1) % uint32_t(scanout_export_ring.size());
+	return slot;
+}
+
+void GSRenderer::signal_scanout_export(Vulkan::CommandBuffer::Type type, ScanoutResult &result)
+{
+	if (!result.export_image)
+		return;
+
+	// Must come after the submission which copied the image.
+	result.export_timeline_value = next_scanout_export_value++;
+	auto binary = device->request_timeline_semaphore_as_binary(*scanout_export_timeline, result.export_timeline_value);
+	device->submit_empty(type, nullptr, binary.get());
+}
+
 ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &info,
                                 uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2,
-                                const Vulkan::Image *promoted1, const Vulkan::Image *promoted2)
+                                const Vulkan::Image *promoted1, const Vulkan::Image *promoted2,
+                                const VkRect2D *fb_damage)
 {
+	sync_recording_worker();
 	if (!device)
 		return {};
 
@@ -4248,6 +5862,11 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 	image_info.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	image_info.misc |= Vulkan::IMAGE_MISC_MUTABLE_SRGB_BIT;
+	if (async_scanout)
+	{
+		image_info.misc |= Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_GRAPHICS_BIT |
+		                   Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_ASYNC_GRAPHICS_BIT;
+	}
 
 	Vulkan::ImageHandle circuit1, circuit2;
 
@@ -4483,6 +6102,38 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		phase = info.phase;
 	}
 
+	// Anything which changes the scanout other than VRAM contents invalidates all damage tracking.
+	Util::Hasher scanout_hasher;
+	scanout_hasher.data(&priv.pmode, sizeof(priv.pmode));
+	scanout_hasher.data(&priv.smode1, sizeof(priv.smode1));
+	scanout_hasher.data(&priv.smode2, sizeof(priv.smode2));
+	scanout_hasher.data(&priv.dispfb1, sizeof(priv.dispfb1));
+	scanout_hasher.data(&priv.display1, sizeof(priv.display1));
+	scanout_hasher.data(&priv.dispfb2, sizeof(priv.dispfb2));
+	scanout_hasher.data(&priv.display2, sizeof(priv.display2));
+	scanout_hasher.data(&priv.extbuf, sizeof(priv.extbuf));
+	scanout_hasher.data(&priv.extdata, sizeof(priv.extdata));
+	scanout_hasher.data(&priv.extwrite, sizeof(priv.extwrite));
+	scanout_hasher.data(&priv.bgcolor, sizeof(priv.bgcolor));
+	scanout_hasher.u32(force_progressive);
+	scanout_hasher.u32(overscan);
+	scanout_hasher.u32(anti_blur);
+	scanout_hasher.u32(info.crtc_offsets);
+	scanout_hasher.u32(info.adapt_to_internal_horizontal_resolution);
+	scanout_hasher.u32(info.raw_circuit_scanout);
+	scanout_hasher.u32(high_resolution_scanout);
+	scanout_hasher.u32(sampling_rate_x_log2);
+	scanout_hasher.u32(sampling_rate_y_log2);
+	scanout_hasher.u64(reinterpret_cast<uintptr_t>(promoted1));
+	scanout_hasher.u64(reinterpret_cast<uintptr_t>(promoted2));
+	// Field phase moves the sampled lines or the output viewport.
+	if (alternative_sampling || field_aware_rendering)
+		scanout_hasher.u32(info.phase);
+
+	bool full_damage = !fb_damage || scanout_hasher.get() != last_scanout_key;
+	last_scanout_key = scanout_hasher.get();
+	VkRect2D circuit_damage[2] = {};
+
 	bool EN1 = priv.pmode.EN1;
 	bool EN2 = priv.pmode.EN2;
 	uint32_t MMOD = priv.pmode.MMOD;
@@ -4538,6 +6189,18 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		}
 	}
 
+	ScanoutResult result = {};
+
+	// A circuit which is likely to be handed out as-is is sampled straight into the export ring.
+	bool may_scanout_raw_circuit = !scanout_export_ring.empty() && info.raw_circuit_scanout &&
+	                               !info.crtc_offsets && !info.overscan &&
+	                               info.adapt_to_internal_horizontal_resolution &&
+	                               !force_deinterlace && !is_interlaced && !priv.extwrite.WRITE;
+	bool export_circuit1 = may_scanout_raw_circuit && EN1 && !EN2 &&
+	                       MMOD == PMODEBits::MMOD_ALPHA_ALP && ALP == 0xff;
+	bool export_circuit2 = may_scanout_raw_circuit && EN2 && !EN1 &&
+	                       SLBG == PMODEBits::SLBG_ALPHA_BLEND_CIRCUIT2;
+
 	if (EN1)
 	{
 		if (device->consumes_debug_markers())
@@ -4564,9 +6227,9 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 				image_info.width *= 2;
 				image_info.height *= 2;
 			}
-			circuit1 = device->create_image(image_info);
-			sample_crtc_circuit(cmd, *circuit1, priv.dispfb1, rect, super_samples, promoted1);
-			device->set_name(*circuit1, "Circuit1");
+			circuit1 = sample_scanout_circuit(cmd, 0, image_info, priv.dispfb1, rect, super_samples, promoted1,
+			                                  full_damage ? nullptr : &fb_damage[0], circuit_damage[0],
+			                                  export_circuit1 ? &result : nullptr);
 		}
 
 		int off_x = int(priv.display1.DX) / int(clock_divider) - scan_offset_x;
@@ -4617,9 +6280,9 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 				image_info.width *= 2;
 				image_info.height *= 2;
 			}
-			circuit2 = device->create_image(image_info);
-			sample_crtc_circuit(cmd, *circuit2, priv.dispfb2, rect, super_samples, promoted2);
-			device->set_name(*circuit2, "Circuit2");
+			circuit2 = sample_scanout_circuit(cmd, 1, image_info, priv.dispfb2, rect, super_samples, promoted2,
+			                                  full_damage ? nullptr : &fb_damage[1], circuit_damage[1],
+			                                  export_circuit2 ? &result : nullptr);
 		}
 
 		int off_x = int(priv.display2.DX) / int(clock_divider) - scan_offset_x;
@@ -4643,6 +6306,11 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		crtc_shift.y = std::min<int32_t>(off_y, crtc_shift.y);
 	}
 
+	if (!circuit1)
+		scanout_circuits[0] = {};
+	if (!circuit2)
+		scanout_circuits[1] = {};
+
 	if (!info.overscan && !info.crtc_offsets)
 	{
 		if (!skip_shift_x)
@@ -4688,7 +6356,6 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		}
 	}
 
-	ScanoutResult result = {};
 	result.mode_width = mode_width;
 	result.mode_height = mode_height;
 	result.high_resolution_scanout = high_resolution_scanout;
@@ -4707,20 +6374,32 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 			effective_mode_height *= 2;
 		}
 
+		// With scanout export, a raw circuit must live in the export ring, otherwise it is merged into one.
 		bool is_raw_circuit1 =
 				circuit1 && !circuit2 && MMOD == PMODEBits::MMOD_ALPHA_ALP && ALP == 0xff &&
-				circuit1->get_width() <= effective_mode_width && circuit1->get_height() <= effective_mode_height;
+				circuit1->get_width() <= effective_mode_width && circuit1->get_height() <= effective_mode_height &&
+				(scanout_export_ring.empty() || result.export_image == circuit1);
 		bool is_raw_circuit2 =
 				circuit2 && !circuit1 && SLBG == PMODEBits::SLBG_ALPHA_BLEND_CIRCUIT2 &&
-				circuit2->get_width() <= effective_mode_width && circuit2->get_height() <= effective_mode_height;
+				circuit2->get_width() <= effective_mode_width && circuit2->get_height() <= effective_mode_height &&
+				(scanout_export_ring.empty() || result.export_image == circuit2);
 
 		if (is_raw_circuit1)
+		{
 			result.image = std::move(circuit1);
+			result.damage = circuit_damage[0];
+		}
 		else if (is_raw_circuit2)
+		{
 			result.image = std::move(circuit2);
+			result.damage = circuit_damage[1];
+		}
 
 		if (result.image)
 		{
+			// The frontend owns the image now, so it cannot be updated in place next time.
+			scanout_circuits[is_raw_circuit1 ? 0 : 1] = {};
+
 			cmd.image_barrier(*result.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 			                  info.dst_layout,
 			                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
@@ -4731,6 +6410,7 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 			result.internal_height = result.image->get_height() >> int(high_resolution_scanout);
 
 			flush_submit(0);
+			signal_scanout_export(Vulkan::CommandBuffer::Type::Generic, result);
 			return result;
 		}
 	}
@@ -4746,9 +6426,52 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		image_info.height--;
 	}
 
-	auto merged = device->create_image(image_info);
+	// Deinterlacing and EXTWRITE mix in other fields, so only plain merges can report partial damage.
+	bool merged_full_damage = full_damage || priv.extwrite.WRITE || is_interlaced || force_deinterlace;
+	if (!merged_full_damage)
+	{
+		int damage_x0 = INT32_MAX, damage_y0 = INT32_MAX, damage_x1 = INT32_MIN, damage_y1 = INT32_MIN;
+		int scale = high_resolution_scanout ? 2 : 1;
+
+		// Map through the CRTC viewport, with a pixel of margin for linear filtering.
+		const auto accumulate_damage = [&](const VkRect2D &damage, const Vulkan::Image &circuit, const VkRect2D &crtc) {
+			if (!damage.extent.width || !damage.extent.height || !crtc.extent.width || !crtc.extent.height)
+				return;
 
-	device->set_name(*merged, "Merged field");
+			int64_t vp_x = int64_t(crtc.offset.x) * scale;
+			int64_t vp_y = int64_t(crtc.offset.y) * scale;
+			int64_t vp_w = int64_t(crtc.extent.width) * scale;
+			int64_t vp_h = int64_t(crtc.extent.height) * scale;
+			int64_t w = circuit.get_width();
+			int64_t h = circuit.get_height();
+
+			int64_t x0 = vp_x + damage.offset.x * vp_w / w - 1;
+			int64_t y0 = vp_y + damage.offset.y * vp_h / h - 1;
+			int64_t x1 = vp_x + ((damage.offset.x + damage.extent.width) * vp_w + w - 1) / w + 1;
+			int64_t y1 = vp_y + ((damage.offset.y + damage.extent.height) * vp_h + h - 1) / h + 1;
+
+			damage_x0 = std::min<int>(damage_x0, int(x0));
+			damage_y0 = std::min<int>(damage_y0, int(y0));
+			damage_x1 = std::max<int>(damage_x1, int(x1));
+			damage_y1 = std::max<int>(damage_y1, int(y1));
+		};
+
+		if (circuit1)
+			accumulate_damage(circuit_damage[0], *circuit1, crtc_rects[0]);
+		if (circuit2 && SLBG == PMODEBits::SLBG_ALPHA_BLEND_CIRCUIT2)
+			accumulate_damage(circuit_damage[1], *circuit2, crtc_rects[1]);
+
+		damage_x0 = std::max<int>(damage_x0, 0);
+		damage_y0 = std::max<int>(damage_y0, 0);
+		damage_x1 = std::min<int>(damage_x1, int(image_info.width));
+		damage_y1 = std::min<int>(damage_y1, int(image_info.height));
+
+		if (damage_x0 < damage_x1 && damage_y0 < damage_y1)
+		{
+			result.damage.offset = { damage_x0, damage_y0 };
+			result.damage.extent = { uint32_t(damage_x1 - damage_x0), uint32_t(damage_y1 - damage_y0) };
+		}
+	}
 
 	if (circuit1)
 	{
@@ -4766,13 +6489,48 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
 	}
 
-	cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	                  0, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-	                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
-
 	// Execution barrier so that we don't render to VRAM before we're done sampling.
 	cmd.barrier(VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, 0);
 
+	// The circuits are a snapshot of VRAM at this point, so the rest of the scanout can move off the main queue.
+	// EXTWRITE writes the merged result back to VRAM, which has to remain ordered with rendering.
+	Vulkan::CommandBufferHandle async_cmd;
+	if (async_scanout && !priv.extwrite.WRITE)
+	{
+		cmd.end_region();
+		flush_submit(0);
+
+		// Signal once everything up to and including circuit sampling has completed.
+		Vulkan::Semaphore sem;
+		auto signal_cmd = device->request_command_buffer();
+		device->submit(signal_cmd, nullptr, 1, &sem);
+		device->add_wait_semaphore(Vulkan::CommandBuffer::Type::AsyncGraphics, std::move(sem),
+		                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, true);
+
+		async_cmd = device->request_command_buffer(Vulkan::CommandBuffer::Type::AsyncGraphics);
+		async_cmd->begin_region("vsync-async");
+	}
+
+	// cmd is no longer valid if scanout moved to the async queue.
+	auto &merge_cmd = async_cmd ? *async_cmd : cmd;
+
+	// EXTWRITE forces scanout back to the main queue, which may sample fields an earlier async scanout wrote.
+	if (!async_cmd && vsync_async_semaphore)
+	{
+		device->add_wait_semaphore(Vulkan::CommandBuffer::Type::Generic, std::move(vsync_async_semaphore),
+		                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, true);
+	}
+
+	// Fields which are kept for deinterlacing cannot live in the export ring.
+	const bool merged_is_scanout = high_resolution_scanout || (!is_interlaced && !force_deinterlace);
+	auto merged = create_scanout_image(merge_cmd, image_info, merged_is_scanout ? &result : nullptr);
+
+	device->set_name(*merged, "Merged field");
+
+	merge_cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	                        0, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+
 	Vulkan::RenderPassInfo rp = {};
 	rp.num_color_attachments = 1;
 	rp.color_attachments[0] = &merged->get_view();
@@ -4787,15 +6545,15 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 
 	Vulkan::QueryPoolHandle start_ts, end_ts;
 	if (enable_timestamps)
-		start_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+		start_ts = merge_cmd.write_timestamp(VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
 
-	cmd.begin_render_pass(rp);
-	cmd.set_opaque_sprite_state();
+	merge_cmd.begin_render_pass(rp);
+	merge_cmd.set_opaque_sprite_state();
 
 	if (SLBG == PMODEBits::SLBG_ALPHA_BLEND_CIRCUIT2 && circuit2)
 	{
-		cmd.set_program(blit_quad);
-		cmd.set_texture(0, 0, circuit2->get_view(), Vulkan::StockSampler::LinearClamp);
+		merge_cmd.set_program(blit_quad);
+		merge_cmd.set_texture(0, 0, circuit2->get_view(), Vulkan::StockSampler::LinearClamp);
 
 		if (crtc_rects[1].extent.width && crtc_rects[1].extent.height)
 		{
@@ -4818,16 +6576,16 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 					vp.y -= 1.0f;
 			}
 
-			cmd.set_viewport(vp);
+			merge_cmd.set_viewport(vp);
 
-			cmd.draw(3);
+			merge_cmd.draw(3);
 		}
 	}
 
 	if (circuit1)
 	{
-		cmd.set_program(blit_quad);
-		cmd.set_texture(0, 0, circuit1->get_view(), Vulkan::StockSampler::LinearClamp);
+		merge_cmd.set_program(blit_quad);
+		merge_cmd.set_texture(0, 0, circuit1->get_view(), Vulkan::StockSampler::LinearClamp);
 
 		if (crtc_rects[0].extent.width && crtc_rects[0].extent.height)
 		{
@@ -4850,37 +6608,37 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 					vp.y -= 1.0f;
 			}
 
-			cmd.set_viewport(vp);
+			merge_cmd.set_viewport(vp);
 
 			if (MMOD == PMODEBits::MMOD_ALPHA_ALP)
 			{
 				// Constant blend factor blend.
 				if (ALP != 0xff)
 				{
-					cmd.set_blend_enable(true);
-					cmd.set_blend_op(VK_BLEND_OP_ADD);
-					cmd.set_blend_factors(VK_BLEND_FACTOR_CONSTANT_ALPHA, VK_BLEND_FACTOR_ONE,
-					                      VK_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA, VK_BLEND_FACTOR_ZERO);
+					merge_cmd.set_blend_enable(true);
+					merge_cmd.set_blend_op(VK_BLEND_OP_ADD);
+					merge_cmd.set_blend_factors(VK_BLEND_FACTOR_CONSTANT_ALPHA, VK_BLEND_FACTOR_ONE,
+					                            VK_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA, VK_BLEND_FACTOR_ZERO);
 
 					float alp = float(uint32_t(priv.pmode.ALP)) * (1.0f / 255.0f);
 					const float alps[4] = { alp, alp, alp, alp };
-					cmd.set_blend_constants(alps);
+					merge_cmd.set_blend_constants(alps);
 				}
 			}
 			else
 			{
 				// Normal alpha-blend.
-				cmd.set_blend_enable(true);
-				cmd.set_blend_op(VK_BLEND_OP_ADD);
-				cmd.set_blend_factors(VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE,
+				merge_cmd.set_blend_enable(true);
+				merge_cmd.set_blend_op(VK_BLEND_OP_ADD);
+				merge_cmd.set_blend_factors(VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE,
 					VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA, VK_BLEND_FACTOR_ZERO);
 			}
 
-			cmd.draw(3);
+			merge_cmd.draw(3);
 		}
 	}
 
-	cmd.end_render_pass();
+	merge_cmd.end_render_pass();
 
 	const bool need_intermediate_pass = priv.extwrite.WRITE || is_interlaced || force_deinterlace;
 	VkPipelineStageFlags2 dst_stage =
@@ -4888,17 +6646,17 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 	if (priv.extwrite.WRITE)
 		dst_stage |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
-	cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	                  need_intermediate_pass ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : info.dst_layout,
-	                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+	merge_cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	                        need_intermediate_pass ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : info.dst_layout,
+	                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 					  dst_stage, need_intermediate_pass ? VkAccessFlags2(VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) : info.dst_access);
 
 	if (priv.extwrite.WRITE)
 	{
-		cmd.set_program(shaders.extwrite);
-		cmd.set_specialization_constant_mask(3);
-		cmd.set_specialization_constant(0, vram_size - 1);
-		cmd.set_specialization_constant(1, uint32_t(can_potentially_super_sample()));
+		merge_cmd.set_program(shaders.extwrite);
+		merge_cmd.set_specialization_constant_mask(3);
+		merge_cmd.set_specialization_constant(0, vram_size - 1);
+		merge_cmd.set_specialization_constant(1, uint32_t(can_potentially_super_sample()));
 
 		struct Registers
 		{
@@ -4930,7 +6688,7 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		if (!priv.extbuf.WFFMD)
 			push.resolution.y *= 2;
 
-		cmd.set_storage_buffer(0, 0, *buffers.gpu);
+		merge_cmd.set_storage_buffer(0, 0, *buffers.gpu);
 		const Vulkan::ImageView *view = nullptr;
 
 		uint32_t scanout_width = real_mode_width;
@@ -4966,14 +6724,14 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 			push.uv_base = vec2(0.5f) / vec2(push.resolution);
 			push.uv_scale.x = float(priv.extdata.SMPH + 1) / float(scanout_width * clock_divider);
 			push.uv_scale.y = float(priv.extdata.SMPV + 1) / float(scanout_height);
-			cmd.push_constants(&push, 0, sizeof(push));
+			merge_cmd.push_constants(&push, 0, sizeof(push));
 
 			// Is the write-back filtered at all? Probably not, but whatever.
-			cmd.set_texture(0, 1, *view, Vulkan::StockSampler::NearestClamp);
-			cmd.dispatch((push.resolution.x + 7) / 8, (push.resolution.y + 7) / 8, 1);
-			cmd.barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
-			            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+			merge_cmd.set_texture(0, 1, *view, Vulkan::StockSampler::NearestClamp);
+			merge_cmd.dispatch((push.resolution.x + 7) / 8, (push.resolution.y + 7) / 8, 1);
+			merge_cmd.barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			                  VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
 		}
 
 		if (!is_interlaced && !force_deinterlace &&
@@ -4981,9 +6739,9 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 		     info.dst_access != VK_ACCESS_2_SHADER_SAMPLED_READ_BIT ||
 		     info.dst_layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
 		{
-			cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, info.dst_layout,
-			                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
-			                  info.dst_stage, info.dst_access);
+			merge_cmd.image_barrier(*merged, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, info.dst_layout,
+			                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			                        info.dst_stage, info.dst_access);
 		}
 	}
 
@@ -5002,7 +6760,7 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 			vsync_last_fields[3] = vsync_last_fields[1];
 
 		// Crude de-interlace. Get something working for now.
-		merged = fastmad_deinterlace(cmd, info);
+		merged = fastmad_deinterlace(merge_cmd, info, result);
 	}
 	else
 	{
@@ -5010,28 +6768,48 @@ ScanoutResult GSRenderer::vsync(const PrivRegisterState &priv, const VSyncInfo &
 			field.reset();
 	}
 
-	cmd.end_region();
+	merge_cmd.end_region();
 
 	if (enable_timestamps)
 	{
-		end_ts = cmd.write_timestamp(VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+		end_ts = merge_cmd.write_timestamp(VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
 		timestamps.push_back({ TimestampType::VSync, std::move(start_ts), std::move(end_ts) });
 	}
 
 	result.image = std::move(merged);
-	flush_submit(0);
+	if (merged_full_damage)
+		result.damage = {{ 0, 0 }, { result.image->get_width(), result.image->get_height() }};
+	if (async_cmd)
+	{
+		Vulkan::Semaphore sems[2];
+		device->submit(async_cmd, nullptr, 2, sems);
+		result.semaphore = std::move(sems[0]);
+		vsync_async_semaphore = std::move(sems[1]);
+		signal_scanout_export(Vulkan::CommandBuffer::Type::AsyncGraphics, result);
+	}
+	else
+	{
+		flush_submit(0);
+		signal_scanout_export(Vulkan::CommandBuffer::Type::Generic, result);
+	}
 	return result;
 }
 
-Vulkan::ImageHandle GSRenderer::fastmad_deinterlace(Vulkan::CommandBuffer &cmd, const VSyncInfo &vsync)
+Vulkan::ImageHandle GSRenderer::fastmad_deinterlace(Vulkan::CommandBuffer &cmd, const VSyncInfo &vsync,
+                                                    ScanoutResult &result)
 {
 	auto image_info = Vulkan::ImageCreateInfo::immutable_2d_image(
 			vsync_last_fields[0]->get_width(), vsync_last_fields[0]->get_height() * 2, VK_FORMAT_R8G8B8A8_UNORM);
 	image_info.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	image_info.misc |= Vulkan::IMAGE_MISC_MUTABLE_SRGB_BIT;
+	if (async_scanout)
+	{
+		image_info.misc |= Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_GRAPHICS_BIT |
+		                   Vulkan::IMAGE_MISC_CONCURRENT_QUEUE_ASYNC_GRAPHICS_BIT;
+	}
 
-	auto deinterlaced = device->create_image(image_info);
+	auto deinterlaced = create_scanout_image(cmd, image_info, &result);
 	device->set_name(*deinterlaced, "Deinterlaced");
 
 	cmd.image_barrier(*deinterlaced, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
@@ -12,11 +12,16 @@
 #include "page_tracker.hpp"
 #include "shaders/data_structures.h"
 #include "shaders/slangmosh_iface.hpp"
+#include "trace_recorder.hpp"
 #include <queue>
+#include <deque>
 #include <future>
 #include <atomic>
 #include <condition_variable>
 #include <thread>
+#include <string>
+#include <mutex>
+#include <memory>
 
 namespace ParallelGS
 {
@@ -35,18 +40,57 @@ struct ScanoutResult
 
 	// Set to true if we scanned out at a higher resolution.
 	bool high_resolution_scanout;
+
+	// With async scanout, the image may be written on another queue.
+	// If set, the semaphore must be waited on in VSyncInfo::dst_stage before the image is used.
+	Vulkan::Semaphore semaphore;
+
+	// Region of image which may differ from the previous scanout, for partial presentation or encoding.
+	// Covers the entire image whenever this cannot be determined.
+	VkRect2D damage;
+
+	// With GSOptions::scanout_export_images, image is allocated in exportable memory and export_image refers to it.
+	// It is complete, and in VSyncInfo::dst_layout, once the export timeline reaches export_timeline_value.
+	// Images are recycled in ring order, so the frontend and any consumer must be done reading it
+	// before the ring wraps around. A slot is reallocated when the resolution changes,
+	// which is signalled by export_image_reallocated, and the memory must then be exported again.
+	Vulkan::ImageHandle export_image;
+	uint64_t export_timeline_value;
+	uint32_t export_index;
+	bool export_image_reallocated;
 };
 
 struct FlushStats
 {
 	VkDeviceSize allocated_scratch_memory;
 	VkDeviceSize allocated_image_memory;
+	// Snapshot of cached texture image memory, including the recycled images in the slab.
+	VkDeviceSize current_image_memory;
+	VkDeviceSize peak_image_memory;
 	uint32_t num_primitives;
 	uint32_t num_render_passes;
 	uint32_t num_palette_updates;
 	uint32_t num_copies;
 	uint32_t num_copy_threads;
+	// Copies which depended on a pending copy. Each of these used to require a barrier.
+	uint32_t num_copy_hazards;
+	// Barriers actually emitted between dependent waves of copies.
 	uint32_t num_copy_barriers;
+	// Render passes which had to be flushed since a hard limit was hit.
+	uint32_t num_overflow_flushes;
+	// Invalidated textures which were revived since their VRAM contents did not change.
+	uint32_t num_texture_content_hash_hits;
+	// Retired textures which were requested again, but had to be re-uploaded since their VRAM contents changed.
+	// First-time textures are not counted.
+	uint32_t num_texture_content_hash_misses;
+	// CLUT uploads which resolved to a live CLUT instance with identical contents.
+	uint32_t num_palette_content_hash_hits;
+	// Primitives dropped by hierarchical Z culling before they reached the render pass.
+	uint32_t num_z_culled_primitives;
+	// Frame buffer pointer changes which would have ended the render pass without working set merging.
+	uint32_t num_merged_fb_switches;
+	// Scratch buffers which could not be recycled and had to be allocated. Zero in steady state.
+	uint32_t num_scratch_allocations;
 };
 
 enum class TimestampType
@@ -136,6 +180,9 @@ struct FBDescriptor
 	Reg64<ZBUFBits> z;
 };
 
+// Hard limit per render pass. Exceeding it ends the render pass with FlushReason::Overflow.
+// There is no way to continue binning a render pass across chunks yet,
+// since binning.comp and the ubershader always start from cleared tile state.
 static constexpr uint32_t MaxPrimitivesPerFlush = 64 * 1024;
 static constexpr uint32_t MaxStateVectors = Vulkan::VULKAN_MAX_UBO_SIZE / sizeof(StateVector);
 static constexpr uint32_t MaxTextures = std::min<uint32_t>(
@@ -144,6 +191,10 @@ static constexpr uint32_t CLUTInstances = 1024;
 static constexpr uint32_t PageSize = 8 * 1024;
 static constexpr uint32_t CLUTSize = 1024; // This cannot be larger unless we also increase texture index bits.
 static constexpr uint32_t MaxRenderPassInstances = 8;
+// Leading primitives of a render pass which are mirrored in cached memory for CPU side heuristics.
+static constexpr uint32_t MaxShadowedPrimitives = 64;
+// Copies are scheduled in dependency waves, one bit per wave.
+static constexpr uint32_t MaxCopyWaves = 32;
 
 // While 64x MSAA is theoretically possible,
 // it can only work on AMD since we'd need wave size of 64.
@@ -172,11 +223,16 @@ struct RenderPass
 		bool z_sensitive;
 		bool z_write;
 		bool channel_shuffle;
+		// If false, the instance only contains sprites and points, which the single sample heuristic never touches.
+		bool has_triangles_or_lines;
 	};
 	Instance instances[MaxRenderPassInstances];
 	uint32_t num_instances;
 
 	uint32_t coarse_tile_size_log2;
+	// Average bounding box area in pixels of primitives in the render pass.
+	// Non-zero when tiling is picked adaptively, which also adapts the hierarchical binning factor.
+	uint32_t average_primitive_area;
 
 	uint32_t num_primitives;
 
@@ -186,6 +242,10 @@ struct RenderPass
 	const TextureInfo *textures;
 	uint32_t num_textures;
 
+	// Keeps texture views alive if recording is deferred to a worker thread.
+	const Vulkan::ImageHandle *held_images;
+	uint32_t num_held_images;
+
 	uint32_t label_key;
 	uint32_t debug_capture_stride;
 
@@ -209,6 +269,10 @@ struct RenderPass
 	uint32_t feedback_texture_psm;
 	uint32_t feedback_texture_cpsm;
 	FlushReason flush_reason;
+
+	// Only used for statistics.
+	uint32_t num_z_culled_primitives;
+	uint32_t num_merged_fb_switches;
 };
 
 struct PrivRegisterState;
@@ -223,9 +287,62 @@ enum class SuperSampling
 	X16 = 16
 };
 
+void get_super_sampling_rate_log2(SuperSampling super_sampling, bool ordered_grid,
+                                  uint32_t &sampling_rate_x_log2, uint32_t &sampling_rate_y_log2);
+
 struct GSOptions;
 class PageTracker;
 
+// Device-wide state which is identical for every GS instance on a Vulkan::Device:
+// compiled programs, lookup tables and recycled bindless descriptor pools.
+// Any number of GSInterface instances can attach to one context through GSOptions::device_context,
+// and VRAM, page tracking and all rendering state remain per instance.
+// The context must outlive every instance attached to it.
+class GSDeviceContext
+{
+public:
+	bool init(Vulkan::Device *device);
+	Vulkan::Device *get_device() const;
+
+	const Shaders<> &get_shaders() const;
+	Vulkan::Program *get_blit_quad() const;
+	Vulkan::Program *get_sample_quad(uint32_t index) const;
+	Vulkan::Program *get_weave_quad() const;
+
+	const Vulkan::BufferViewHandle &get_fixed_rcp_lut_view() const;
+	const Vulkan::BufferViewHandle &get_float_rcp_lut_view() const;
+
+	// Returns nullptr if there is no idle pool. The caller should create a new pool instead.
+	Vulkan::BindlessDescriptorPoolHandle request_bindless_pool();
+	// The pool must no longer be in use by the GPU.
+	void recycle_bindless_pool(Vulkan::BindlessDescriptorPoolHandle pool);
+
+	// Only the first caller loads and saves the pipeline cache of the device.
+	bool claim_pipeline_cache();
+	// Returns false if equivalent pipeline variants were already primed by another instance.
+	bool claim_pipeline_priming(uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2, bool current_rate_only);
+
+private:
+	Vulkan::Device *device = nullptr;
+	Shaders<> shaders;
+	Vulkan::Program *blit_quad = nullptr;
+	Vulkan::Program *sample_quad[2] = {};
+	Vulkan::Program *weave_quad = nullptr;
+
+	Vulkan::BufferHandle fixed_rcp_lut;
+	Vulkan::BufferViewHandle fixed_rcp_lut_view;
+	Vulkan::BufferHandle float_rcp_lut;
+	Vulkan::BufferViewHandle float_rcp_lut_view;
+
+	std::mutex lock;
+	std::vector<Vulkan::BindlessDescriptorPoolHandle> idle_bindless_pools;
+	bool pipeline_cache_claimed = false;
+	// Bit 0 is set when every sampling rate was primed, otherwise one bit per rate.
+	uint32_t primed_sampling_rates = 0;
+
+	void init_luts();
+};
+
 class GSRenderer
 {
 public:
@@ -237,16 +354,28 @@ public:
 	VertexPosition *get_reserved_vertex_positions() const;
 	VertexAttribute *get_reserved_vertex_attributes() const;
 	PrimitiveAttribute *get_reserved_primitive_attributes() const;
+	// Vertex positions and attributes may live in uncached ReBAR memory, which must not be read back.
+	// The front-end mirrors the first MaxShadowedPrimitives primitives here instead.
+	VertexPosition *get_vertex_position_shadow();
+	VertexAttribute *get_vertex_attribute_shadow();
 
 	// Copies host VRAM into GPU VRAM.
 	// First logical stage.
 	void flush_host_vram_copy(const uint32_t *block_indices, uint32_t num_indices);
 
 	// Caching stage.
-	uint32_t update_palette_cache(const PaletteUploadDescriptor &desc);
+	uint32_t update_palette_cache(const PaletteUploadDescriptor &desc, Util::Hash content_hash = 0);
 	void mark_clut_read(uint32_t clut_instance);
 	void rewind_clut_instance(uint32_t index);
 
+	// Hashes the CLUT contents which desc would produce, using the host copy of VRAM in rect.
+	// Must only be used when the page tracker deems the host copy to be safe to read.
+	// Returns 0 if the contents cannot be known, e.g. the incoming CLUT instance has unknown contents.
+	Util::Hash hash_palette_upload_cpu(const PaletteUploadDescriptor &desc, const PageRect &rect);
+	// Returns UINT32_MAX if no live CLUT instance holds the contents.
+	// age is the number of CLUT instances allocated since the instance was written.
+	uint32_t find_palette_cache(Util::Hash content_hash, uint32_t &age);
+
 	Vulkan::ImageHandle create_cached_texture(const TextureDescriptor &desc);
 	// Should always be called after create_cached_texture().
 	// We'll be able to do some last minute modifications to the upload descriptor
@@ -254,22 +383,36 @@ public:
 	void promote_cached_texture_upload_cpu(const PageRect &rect);
 	void commit_cached_texture(uint32_t tex_info_index, bool sampler_feedback);
 
+	// Hashes the host copy of VRAM which a CPU upload of rect would read.
+	// Must only be used when the page tracker deems the host copy to be safe to read.
+	// The revive decision is made on the CPU at draw kick, so hashing on the GPU would mean waiting for the
+	// result before the upload can be skipped. A single page is at most 8 KiB, and the CPU upload path reads
+	// the same bytes right after, so hashing it on the CPU is cheap in comparison.
+	Util::Hash hash_cached_texture_upload_cpu(const PageRect &rect);
+	void mark_texture_content_hash_lookup(bool hit);
+
 	Vulkan::ImageHandle copy_cached_texture(const Vulkan::Image &img, const VkRect2D &rect);
 
 	// Creating 1k+ VkImages per frame can be a noticeable CPU burden on drivers.
 	// Computing swizzling layouts and stuff is quite complicated and slow.
 	// It's not just about memory allocation.
 	void recycle_image_handle(Vulkan::ImageHandle image);
+	// Drops an image created by create_cached_texture() instead of recycling it,
+	// and removes it from the image memory accounting.
+	void release_image_handle(Vulkan::ImageHandle image);
 	// Uploads to CLUT cache and texture cache. Only reads VRAM.
 	void flush_cache_upload();
 
 	// Copy stage.
-	void copy_vram(const CopyDescriptor &desc, const PageRect &damage_rect);
+	void copy_vram(const CopyDescriptor &desc, const PageRect &dst_rect, const PageRect &src_rect);
 	void flush_transfer();
-	void transfer_overlap_barrier();
 
-	// To deal with local -> local hazards.
-	void mark_shadow_page_sync(uint32_t page_index);
+	// Reserves space for a HOST -> LOCAL payload in the persistently mapped host transfer ring.
+	// Copies which source the payload from the ring read it in place without any intermediate copy.
+	// Returns nullptr if the ring is not enabled or the payload cannot fit right now.
+	void *begin_host_transfer(VkDeviceSize size);
+	// The payload will not receive any more data.
+	void end_host_transfer();
 
 	// FB stage.
 	void flush_rendering(const RenderPass &rp);
@@ -289,17 +432,26 @@ public:
 	void *begin_host_vram_access();
 	void end_host_write_vram_access();
 
+	// fb_damage holds the region of each circuit's frame buffer written since the previous vsync,
+	// in frame buffer pixels. nullptr means everything may have changed.
 	ScanoutResult vsync(const PrivRegisterState &priv, const VSyncInfo &info,
 	                    uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2,
-	                    const Vulkan::Image *promoted1, const Vulkan::Image *promoted2);
+	                    const Vulkan::Image *promoted1, const Vulkan::Image *promoted2,
+	                    const VkRect2D *fb_damage);
 	bool vsync_can_skip(const PrivRegisterState &priv, const VSyncInfo &info) const;
+	Vulkan::Semaphore get_scanout_export_timeline() const;
 
 	static TexRect compute_effective_texture_rect(const TextureDescriptor &desc);
 
 	FlushStats consume_flush_stats();
 
 	double get_accumulated_timestamps(TimestampType type) const;
+	// Time where any timestamped GPU work was executing. Unlike the sum of all types,
+	// work overlapping on the async compute queue is only counted once.
+	double get_accumulated_busy_time() const;
 	void set_enable_timestamps(bool enable);
+	// Records submissions, and GPU timestamp ranges if timestamps are enabled.
+	void set_trace_recorder(TraceRecorder *recorder);
 
 	void invalidate_super_sampling_state(uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2);
 
@@ -312,6 +464,7 @@ private:
 	Vulkan::Device *device = nullptr;
 	Vulkan::CommandBufferHandle direct_cmd;
 	Vulkan::CommandBufferHandle async_transfer_cmd;
+	Vulkan::CommandBufferHandle async_compute_cmd;
 	Vulkan::CommandBufferHandle triangle_setup_cmd;
 	Vulkan::CommandBufferHandle clear_cmd;
 	Vulkan::CommandBufferHandle heuristic_cmd;
@@ -320,6 +473,12 @@ private:
 	uint32_t next_clut_instance = 0;
 	uint32_t base_clut_instance = 0;
 
+	// Content hash of every CLUT instance, or 0 if unknown.
+	// Instances are looked up by content until the ring overwrites them.
+	std::vector<Util::Hash> clut_instance_content_hashes;
+	Util::IntrusiveHashMap<Util::IntrusivePODWrapper<uint32_t>> clut_content_instances;
+	void set_clut_instance_content_hash(uint32_t instance, Util::Hash content_hash);
+
 	Vulkan::Semaphore timeline;
 	std::thread timeline_thread;
 	uint64_t last_submitted_timeline = 0;
@@ -335,17 +494,36 @@ private:
 	std::vector<PaletteUploadDescriptor> palette_uploads;
 	std::vector<VkDeviceAddress> qword_clears;
 
+	// Full scratch buffers are recycled once the GPU is done with them.
+	struct ScratchPool
+	{
+		struct Entry
+		{
+			Vulkan::BufferHandle buffer;
+			Vulkan::BufferHandle gpu_buffer;
+			Vulkan::Fence fence;
+			VkDeviceSize size;
+		};
+		// Retired since the last fence, and may still be referenced by unsubmitted work.
+		std::vector<Entry> retiring;
+		// Oldest first.
+		std::deque<Entry> retired;
+	};
+
 	struct Scratch
 	{
 		Vulkan::BufferHandle buffer;
 		VkDeviceSize offset = 0;
 		VkDeviceSize size = 0;
+		ScratchPool *pool = nullptr;
 	};
 
 	struct AttributeScratch : Scratch
 	{
 		Vulkan::BufferHandle gpu_buffer;
 		VkDeviceSize flushed_to = 0;
+		// The CPU only reads back from cached shadow copies, so uncached ReBAR memory can be written directly.
+		bool allow_rebar = false;
 	};
 
 	struct TextureUpload
@@ -361,6 +539,8 @@ private:
 			Vulkan::BufferHandle indirect;
 			VkDeviceSize indirect_offset;
 		} indirection;
+		// Recycled slab images may still be sampled by unsubmitted work on the main queue.
+		bool fresh_image;
 	};
 
 	struct TextureAnalysis
@@ -381,6 +561,33 @@ private:
 	std::vector<TextureUpload> texture_uploads;
 	std::vector<TextureAnalysis> texture_analysis;
 
+	bool async_scanout = false;
+	bool incremental_scanout = false;
+
+	bool async_compute_texture_uploads = false;
+	std::vector<TextureUpload> async_texture_uploads;
+	std::vector<VkImageMemoryBarrier2> async_pre_image_barriers;
+	std::vector<VkImageMemoryBarrier2> async_post_image_barriers;
+	bool texture_upload_is_async_compatible(const TextureUpload &upload) const;
+	void flush_async_texture_uploads();
+
+	// Async uploads are submitted as soon as they are recorded, and signal async_upload_timeline.
+	// The generic queue only waits for the timeline value once a render pass samples one of the uploaded images,
+	// or a recycled image is about to be written on the main queue.
+	Vulkan::Semaphore async_upload_timeline;
+	uint64_t async_upload_signalled_value = 0;
+	uint64_t async_upload_waited_value = 0;
+	// Image cookie -> timeline value which completes the upload.
+	Util::IntrusiveHashMap<Util::IntrusivePODWrapper<uint64_t>> async_uploaded_images;
+	uint64_t get_async_upload_timeline_value(const Vulkan::Image &image);
+	void wait_async_texture_uploads(uint64_t value);
+	// Submits all pending main queue work without signalling the host timeline.
+	void submit_pending_command_buffers();
+	void record_texture_uploads(Vulkan::CommandBuffer &cmd,
+	                            const std::vector<TextureUpload> &uploads,
+	                            const std::vector<VkImageMemoryBarrier2> &pre_barriers,
+	                            const std::vector<VkImageMemoryBarrier2> &post_barriers);
+
 	struct PendingIndirectTextureUpload
 	{
 		Vulkan::BufferHandle indirect;
@@ -408,29 +615,69 @@ private:
 
 		VkDeviceSize ssbo_alignment = 0;
 
-		Vulkan::BufferHandle fixed_rcp_lut;
+		// Owned by the device context.
 		Vulkan::BufferViewHandle fixed_rcp_lut_view;
-		Vulkan::BufferHandle float_rcp_lut;
 		Vulkan::BufferViewHandle float_rcp_lut_view;
 		Vulkan::ImageHandle phase_lut;
 
 		Vulkan::BufferHandle bug_feedback;
 
-		// Attribute buffers, for zero-copy on UMA and single copy on dGPU.
+		// Attribute buffers, for zero-copy on UMA and ReBAR, and single copy on other dGPUs.
 		AttributeScratch pos_scratch, attr_scratch, prim_scratch;
+		ScratchPool device_scratch_pool, rebar_scratch_pool;
+		ScratchPool pos_scratch_pool, attr_scratch_pool, prim_scratch_pool;
 		VertexPosition *pos = nullptr;
 		VertexAttribute *attr = nullptr;
 		PrimitiveAttribute *prim = nullptr;
+		VertexPosition pos_shadow[MaxShadowedPrimitives * 3];
+		VertexAttribute attr_shadow[MaxShadowedPrimitives * 3];
 	} buffers;
 
+	// Primitive buffers of the render pass being recorded.
+	// Split from the reserved buffers, so the front-end can fill in the next render pass in parallel.
+	struct
+	{
+		AttributeScratch pos_scratch, attr_scratch, prim_scratch;
+		PrimitiveAttribute *prim = nullptr;
+		VertexPosition pos_shadow[MaxShadowedPrimitives * 3];
+		VertexAttribute attr_shadow[MaxShadowedPrimitives * 3];
+	} recording;
+
+	struct RecordingWorker
+	{
+		RenderPass rp = {};
+		std::vector<StateVector> states;
+		std::vector<TextureInfo> textures;
+		std::vector<Vulkan::ImageHandle> held_images;
+		std::mutex lock;
+		std::condition_variable cond;
+		std::thread thread;
+		std::thread::id thread_id;
+		bool pending = false;
+		bool shutdown = false;
+		bool needs_flush_stats_check = false;
+		bool active = false;
+	} recording_worker;
+
+	void start_recording_worker(unsigned thread_index);
+	void stop_recording_worker();
+	void recording_worker_loop();
+	void sync_recording_worker();
+	void record_render_pass(const RenderPass &rp);
+
 	Scratch indirect_single_sample_heuristic;
 	Scratch work_list_single_sample;
 	Scratch work_list_super_sample;
 
 	VkDeviceSize allocate_device_scratch(VkDeviceSize size, Scratch &scratch, const void *data);
+	bool attribute_scratch_fits(VkDeviceSize size, const AttributeScratch &scratch) const;
 	void reserve_attribute_scratch(VkDeviceSize size, AttributeScratch &scratch);
 	void commit_attribute_scratch(VkDeviceSize size, AttributeScratch &scratch);
 	void flush_attribute_scratch(AttributeScratch &scratch);
+	void retire_scratch(const Scratch &scratch, Vulkan::BufferHandle gpu_buffer);
+	bool pull_scratch_from_pool(ScratchPool &pool, VkDeviceSize size, ScratchPool::Entry &entry);
+	void fence_retired_scratch();
+	bool rebar_attribute_scratch = false;
 
 	Vulkan::BindlessDescriptorPoolHandle bindless_allocator;
 	struct ExhaustedDescriptorPool
@@ -444,11 +691,14 @@ private:
 	uint64_t next_descriptor_timeline_signal = 1;
 
 	void ensure_command_buffer(Vulkan::CommandBufferHandle &cmd, Vulkan::CommandBuffer::Type type);
-	void init_luts();
+	void recycle_bindless_pools();
 	void init_phase_lut(uint32_t sampling_rate_x_log2, uint32_t sampling_rate_y_log2);
 	void init_vram(const GSOptions &options);
+	VkDeviceSize get_vram_buffer_size(uint32_t num_samples) const;
+	void resize_vram(VkDeviceSize size);
+	bool resizable_vram = false;
 
-	void upload_texture(const TextureUpload &upload);
+	void upload_texture(Vulkan::CommandBuffer &cmd, const TextureUpload &upload);
 	void bind_textures(Vulkan::CommandBuffer &cmd, const RenderPass &rp);
 
 	bool bound_texture_has_array = false;
@@ -497,14 +747,46 @@ private:
 		uint32_t phase_stride;
 	};
 
+	// If damage is set, the image holds the previous scanout, and only the damaged region is resampled.
 	void sample_crtc_circuit(Vulkan::CommandBuffer &cmd, const Vulkan::Image &img,
 	                         const DISPFBBits &dispfb, const SamplingRect &rect, uint32_t super_samples,
-	                         const Vulkan::Image *promoted);
+	                         const Vulkan::Image *promoted, const VkRect2D *damage);
 
 	static SamplingRect compute_circuit_rect(const PrivRegisterState &priv, uint32_t phase,
 	                                         const DISPLAYBits &display, bool force_progressive,
 	                                         const Vulkan::Image *promoted);
 
+	static VkRect2D compute_circuit_damage(const DISPFBBits &dispfb, const SamplingRect &rect,
+	                                       const VkRect2D &fb_damage, uint32_t super_samples);
+
+	// Circuits from the previous vsync, for incremental scanout.
+	struct ScanoutCircuit
+	{
+		Vulkan::ImageHandle image;
+		DISPFBBits dispfb;
+		SamplingRect rect;
+		uint32_t super_samples;
+	};
+	ScanoutCircuit scanout_circuits[2];
+	Util::Hash last_scanout_key = 0;
+
+	std::vector<Vulkan::ImageHandle> scanout_export_ring;
+	uint32_t scanout_export_index = 0;
+	Vulkan::Semaphore scanout_export_timeline;
+	uint64_t next_scanout_export_value = 1;
+	// With a non-null result and scanout export enabled, the image is the next slot of the export ring,
+	// and result's export members are filled in. Otherwise, a regular image is created.
+	Vulkan::ImageHandle create_scanout_image(Vulkan::CommandBuffer &cmd, const Vulkan::ImageCreateInfo &info,
+	                                         ScanoutResult *result);
+	void signal_scanout_export(Vulkan::CommandBuffer::Type type, ScanoutResult &result);
+
+	Vulkan::ImageHandle sample_scanout_circuit(Vulkan::CommandBuffer &cmd, uint32_t index,
+	                                           const Vulkan::ImageCreateInfo &info,
+	                                           const DISPFBBits &dispfb, const SamplingRect &rect,
+	                                           uint32_t super_samples, const Vulkan::Image *promoted,
+	                                           const VkRect2D *fb_damage, VkRect2D &damage,
+	                                           ScanoutResult *export_result);
+
 	void copy_blocks(Vulkan::CommandBuffer &cmd, const Vulkan::Buffer &dst, const Vulkan::Buffer &src,
 	                 const uint32_t *page_indices, uint32_t num_indices, bool invalidate_super_sampling,
 	                 uint32_t block_size);
@@ -513,8 +795,54 @@ private:
 	{
 		CopyDescriptor copy;
 		Vulkan::BufferBlockAllocation alloc;
+		VkDeviceAddress host_bda;
+		uint32_t wave;
 	};
 	std::vector<CopyDescriptorPayload> pending_copies;
+
+	// Copies within a wave have no read-after-write or write-after-read hazards against each other.
+	// Write-after-write hazards within a wave are resolved through atomics in the copy shader.
+	struct CopyWave
+	{
+		std::vector<uint32_t> write_pages;
+		std::vector<uint32_t> shadow_pages;
+	};
+	CopyWave copy_waves[MaxCopyWaves];
+	uint32_t num_copy_waves = 0;
+
+	struct CopyWavePageState
+	{
+		// Bit N is set if wave N accesses the page. Block masks for other waves are stale.
+		uint32_t wave_mask;
+		uint32_t write_block_mask[MaxCopyWaves];
+		uint32_t read_block_mask[MaxCopyWaves];
+	};
+	std::vector<CopyWavePageState> copy_wave_pages;
+	std::vector<uint32_t> copy_wave_accessed_pages;
+
+	struct HostTransferRing
+	{
+		Vulkan::BufferHandle buffer;
+		uint8_t *mapped = nullptr;
+		VkDeviceSize size = 0;
+		// Offsets never wrap. The physical offset is modulo size.
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+		VkDeviceSize active_begin = UINT64_MAX;
+		// Set when pending copies read from the ring.
+		bool has_pending_references = false;
+
+		struct Region
+		{
+			Vulkan::Fence fence;
+			VkDeviceSize end;
+		};
+		std::deque<Region> in_flight;
+	} host_transfer_ring;
+	bool host_transfer_ring_contains(const void *ptr) const;
+	uint32_t schedule_copy_wave(const PageRect &dst_rect, const PageRect &src_rect, bool &has_hazard) const;
+	void register_copy_wave_pages(const PageRect &rect, uint32_t wave, bool write);
+	void flush_copy_waves();
 	void emit_copy_vram(Vulkan::CommandBuffer &cmd,
 	                    const uint32_t *dispatch_order,
 	                    uint32_t num_dispatches, bool prepare_only);
@@ -527,14 +855,30 @@ private:
 	};
 	std::vector<Timestamp> timestamps;
 	void log_timestamps();
+
+	TraceRecorder *trace_recorder = nullptr;
+	// Maps GPU timestamp ticks onto the CPU timeline for tracing.
+	uint64_t gpu_trace_anchor_ticks = 0;
+	uint64_t gpu_trace_anchor_ns = 0;
+	void trace_timestamp(const Timestamp &ts);
 	double timestamp_total_time[int(TimestampType::Count)] = {};
+	double timestamp_busy_time = 0.0;
+	uint64_t timestamp_busy_end_ticks = 0;
+	std::vector<std::pair<uint64_t, uint64_t>> resolved_timestamp_ranges;
 
 	FlushStats stats = {}, total_stats = {};
 	void check_flush_stats();
 	bool enable_timestamps = false;
 
 	Vulkan::ImageHandle vsync_last_fields[4];
-	Vulkan::ImageHandle fastmad_deinterlace(Vulkan::CommandBuffer &cmd, const VSyncInfo &vsync);
+	// Signalled by the last async scanout. The fields were written on the async graphics queue,
+	// so a main queue scanout must wait for it before sampling them.
+	Vulkan::Semaphore vsync_async_semaphore;
+	Vulkan::ImageHandle fastmad_deinterlace(Vulkan::CommandBuffer &cmd, const VSyncInfo &vsync,
+	                                        ScanoutResult &result);
+
+	GSDeviceContext *context = nullptr;
+	std::unique_ptr<GSDeviceContext> owned_context;
 
 	// Slangmosh
 	Shaders<> shaders;
@@ -544,34 +888,61 @@ private:
 
 	void drain_compilation_tasks();
 	void drain_compilation_tasks_nonblock();
-	void kick_compilation_tasks();
+	void kick_compilation_tasks(const GSOptions &options);
 	std::atomic_bool compilation_tasks_active;
 	std::vector<std::future<void>> compilation_tasks;
 
+	std::string pipeline_cache_path;
+	Util::Hash compute_pipeline_cache_key() const;
+	void load_pipeline_cache();
+	void save_pipeline_cache();
+
 	uint64_t query_timeline(const Vulkan::SemaphoreHolder &sem) const;
 
 	std::vector<Vulkan::ImageHandle> recycled_image_handles;
 	// Only cache textures with reasonable POT size.
-	// Small slab allocator basically.
-	std::vector<Vulkan::ImageHandle> recycled_image_pool[7][11][11];
-	std::vector<Vulkan::ImageHandle> super_sampled_recycled_image_pool[11][11];
+	// Small slab allocator basically. Size classes are (levels, height, width), and (height, width) for SSAA.
+	// Within a size class, newest handles are at the back, and are reused first.
+	struct SlabEntry
+	{
+		Vulkan::ImageHandle image;
+		uint64_t stamp;
+	};
+	using SlabBucket = std::deque<SlabEntry>;
+	SlabBucket recycled_image_pool[7][11][11];
+	SlabBucket super_sampled_recycled_image_pool[11][11];
+
+	// Global LRU order across all size classes.
+	// Records become stale when a handle is pulled again, and are skipped on eviction.
+	struct SlabRecord
+	{
+		SlabBucket *bucket;
+		uint64_t stamp;
+	};
+	std::deque<SlabRecord> image_slab_lru;
+	uint64_t image_slab_stamp = 0;
+	size_t num_image_slab_entries = 0;
+
 	void move_image_handles_to_slab();
 	Vulkan::ImageHandle pull_image_handle_from_slab(uint32_t width, uint32_t height, uint32_t levels, uint32_t samples);
+	void evict_image_slab(VkDeviceSize target_size);
+	void compact_image_slab_lru();
 	VkDeviceSize total_image_slab_size = 0;
 	VkDeviceSize max_image_slab_size = 0;
 	VkDeviceSize max_allocated_image_memory_per_flush = 0;
 	VkDeviceSize image_slab_high_water_mark = 0;
+	VkDeviceSize texture_memory_budget = 0;
+	VkDeviceSize current_image_memory = 0;
+	VkDeviceSize peak_image_memory = 0;
 	void flush_slab_cache();
 
-	std::vector<uint32_t> vram_copy_write_pages;
-	std::vector<uint32_t> sync_vram_shadow_pages;
 
 	bool can_potentially_super_sample() const;
 
 	void check_bug_feedback();
 
 	bool scanout_is_interlaced(const PrivRegisterState &priv, const VSyncInfo &info) const;
-	uint32_t get_target_hierarchical_binning(uint32_t num_primitives, uint32_t coarse_tiles_width, uint32_t coarse_tiles_height) const;
+	uint32_t get_target_hierarchical_binning(const RenderPass &rp, uint32_t instance, uint32_t num_primitives) const;
 	void set_hierarchical_binning_subgroup_config(Vulkan::CommandBuffer &cmd, uint32_t hier_factor) const;
 
 	void allocate_upload_indirection(TextureAnalysis &analysis, TextureUpload &upload);
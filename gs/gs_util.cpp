@@ -7,6 +7,28 @@
 #include "gs_renderer.hpp"
 #include "shaders/data_structures.h"
 #include "shaders/swizzle_utils.h"
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+// Kernels are compiled per ISA and selected at runtime, so the rest of the library keeps the baseline ISA.
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PGS_TARGET_SSE41
+#define PGS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define PGS_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define PGS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#define PGS_SIMD_SSE 1
+#define PGS_SIMD_TARGET PGS_TARGET_SSE41
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PGS_SIMD_NEON 1
+#define PGS_SIMD_TARGET
+#endif
 
 namespace ParallelGS
 {
@@ -372,4 +394,868 @@ bool triangles_form_parallelogram(const VertexPosition *pos, const VertexAttribu
 
 	return true;
 }
-}
\ No newline at end of file
+
+// Within a block, the swizzle is a fixed permutation relative to the block base,
+// so derive the tables straight from swizzle_PS2() at block (0, 0).
+struct BlockSwizzleTables
+{
+	// Offset in units of the VRAM format, indexed by y * block_width + x.
+	uint16_t offset_32[8 * 8];
+	uint16_t offset_16[16 * 8];
+	uint16_t offset_8[16 * 16];
+	uint16_t offset_4[32 * 16];
+
+	// Byte shuffles. Alternating columns in 8-bit and 4-bit formats have a different layout.
+	// Lanes which are not sourced are 0x80, which clears the lane in both PSHUFB and TBL.
+	// [column & 1][16 byte output chunk][input row]
+	uint8_t upload_8[2][4][4][16];
+	// [column & 1][output row][16 byte input chunk]
+	uint8_t readback_8[2][4][4][16];
+	// [column & 1][16 byte output chunk][nibble][input] where input is (row & 1) * 2 + (x & 1).
+	// Low nibbles are sourced from rows 0 and 1 in the column, high nibbles from rows 2 and 3.
+	uint8_t upload_4[2][4][2][4][16];
+
+	BlockSwizzleTables();
+};
+
+BlockSwizzleTables::BlockSwizzleTables()
+{
+	memset(upload_8, 0x80, sizeof(upload_8));
+	memset(readback_8, 0x80, sizeof(readback_8));
+	memset(upload_4, 0x80, sizeof(upload_4));
+
+	for (uint32_t y = 0; y < 8; y++)
+		for (uint32_t x = 0; x < 8; x++)
+			offset_32[y * 8 + x] = uint16_t(swizzle_PS2(x, y, 0, 0, PSMCT32, UINT32_MAX));
+
+	for (uint32_t y = 0; y < 8; y++)
+		for (uint32_t x = 0; x < 16; x++)
+			offset_16[y * 16 + x] = uint16_t(swizzle_PS2(x, y, 0, 0, PSMCT16, UINT32_MAX));
+
+	for (uint32_t y = 0; y < 16; y++)
+	{
+		for (uint32_t x = 0; x < 16; x++)
+		{
+			uint32_t addr = swizzle_PS2(x, y, 0, 0, PSMT8, UINT32_MAX);
+			offset_8[y * 16 + x] = uint16_t(addr);
+
+			uint32_t parity = (y >> 2) & 1;
+			uint32_t row = y & 3;
+			uint32_t chunk = (addr & 63) >> 4;
+			uint32_t lane = addr & 15;
+			upload_8[parity][chunk][row][lane] = uint8_t(x);
+			readback_8[parity][row][chunk][x] = uint8_t(lane);
+		}
+	}
+
+	for (uint32_t y = 0; y < 16; y++)
+	{
+		for (uint32_t x = 0; x < 32; x++)
+		{
+			uint32_t addr = swizzle_PS2(x, y, 0, 0, PSMT4, UINT32_MAX);
+			offset_4[y * 32 + x] = uint16_t(addr);
+
+			uint32_t parity = (y >> 2) & 1;
+			uint32_t row = y & 3;
+			uint32_t nibble = addr & 1;
+			uint32_t byte_offset = (addr & 127) >> 1;
+			assert(nibble == (row >> 1));
+			upload_4[parity][byte_offset >> 4][nibble][(row & 1) * 2 + (x & 1)][byte_offset & 15] = uint8_t(x >> 1);
+		}
+	}
+}
+
+static const BlockSwizzleTables block_tables;
+
+#if defined(PGS_SIMD_SSE)
+using SIMDVec = __m128i;
+
+PGS_SIMD_TARGET static inline SIMDVec simd_load(const void *ptr)
+{
+	return _mm_loadu_si128(static_cast<const __m128i *>(ptr));
+}
+
+PGS_SIMD_TARGET static inline void simd_store(void *ptr, SIMDVec v)
+{
+	_mm_storeu_si128(static_cast<__m128i *>(ptr), v);
+}
+
+PGS_SIMD_TARGET static inline void simd_store_lo64(void *ptr, SIMDVec v)
+{
+	_mm_storel_epi64(static_cast<__m128i *>(ptr), v);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_or(SIMDVec a, SIMDVec b)
+{
+	return _mm_or_si128(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_and(SIMDVec a, SIMDVec b)
+{
+	return _mm_and_si128(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_splat_u32(uint32_t v)
+{
+	return _mm_set1_epi32(int(v));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_lo64(SIMDVec a, SIMDVec b)
+{
+	return _mm_unpacklo_epi64(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_hi64(SIMDVec a, SIMDVec b)
+{
+	return _mm_unpackhi_epi64(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_lo16(SIMDVec a, SIMDVec b)
+{
+	return _mm_unpacklo_epi16(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_hi16(SIMDVec a, SIMDVec b)
+{
+	return _mm_unpackhi_epi16(a, b);
+}
+
+// Even and odd 16-bit lanes of a:b.
+PGS_SIMD_TARGET static inline SIMDVec simd_unzip_lo16(SIMDVec a, SIMDVec b)
+{
+	return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_unzip_hi16(SIMDVec a, SIMDVec b)
+{
+	return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_shuffle(SIMDVec v, const uint8_t *mask)
+{
+	return _mm_shuffle_epi8(v, simd_load(mask));
+}
+
+// Only valid when every byte is a nibble.
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_shl4(SIMDVec v)
+{
+	return _mm_slli_epi16(v, 4);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_shr4(SIMDVec v)
+{
+	return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0xf));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_lo(SIMDVec v)
+{
+	return _mm_and_si128(v, _mm_set1_epi8(0xf));
+}
+#elif defined(PGS_SIMD_NEON)
+using SIMDVec = uint8x16_t;
+
+PGS_SIMD_TARGET static inline SIMDVec simd_load(const void *ptr)
+{
+	return vld1q_u8(static_cast<const uint8_t *>(ptr));
+}
+
+PGS_SIMD_TARGET static inline void simd_store(void *ptr, SIMDVec v)
+{
+	vst1q_u8(static_cast<uint8_t *>(ptr), v);
+}
+
+PGS_SIMD_TARGET static inline void simd_store_lo64(void *ptr, SIMDVec v)
+{
+	vst1_u8(static_cast<uint8_t *>(ptr), vget_low_u8(v));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_or(SIMDVec a, SIMDVec b)
+{
+	return vorrq_u8(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_and(SIMDVec a, SIMDVec b)
+{
+	return vandq_u8(a, b);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_splat_u32(uint32_t v)
+{
+	return vreinterpretq_u8_u32(vdupq_n_u32(v));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_lo64(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u64(vzip1q_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_hi64(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u64(vzip2q_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_lo16(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_zip_hi16(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_unzip_lo16(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u16(vuzp1q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_unzip_hi16(SIMDVec a, SIMDVec b)
+{
+	return vreinterpretq_u8_u16(vuzp2q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_shuffle(SIMDVec v, const uint8_t *mask)
+{
+	return vqtbl1q_u8(v, vld1q_u8(mask));
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_shl4(SIMDVec v)
+{
+	return vshlq_n_u8(v, 4);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_shr4(SIMDVec v)
+{
+	return vshrq_n_u8(v, 4);
+}
+
+PGS_SIMD_TARGET static inline SIMDVec simd_nibble_lo(SIMDVec v)
+{
+	return vandq_u8(v, vdupq_n_u8(0xf));
+}
+#endif
+
+#if defined(PGS_SIMD_SSE) || defined(PGS_SIMD_NEON)
+// A column in the 32-bit layout holds two rows of 8 words, interleaved in pairs of words.
+// a0/a1 is the even row, b0/b1 the odd row.
+PGS_SIMD_TARGET static inline void simd_interleave_column_32(SIMDVec (&column)[4], SIMDVec a0, SIMDVec a1, SIMDVec b0, SIMDVec b1)
+{
+	column[0] = simd_zip_lo64(a0, b0);
+	column[1] = simd_zip_hi64(a0, b0);
+	column[2] = simd_zip_lo64(a1, b1);
+	column[3] = simd_zip_hi64(a1, b1);
+}
+
+PGS_SIMD_TARGET static inline void simd_deinterleave_column_32(const SIMDVec (&column)[4],
+                                               SIMDVec &a0, SIMDVec &a1, SIMDVec &b0, SIMDVec &b1)
+{
+	a0 = simd_zip_lo64(column[0], column[1]);
+	b0 = simd_zip_hi64(column[0], column[1]);
+	a1 = simd_zip_lo64(column[2], column[3]);
+	b1 = simd_zip_hi64(column[2], column[3]);
+}
+#endif
+
+#if defined(PGS_SIMD_SSE) || defined(PGS_SIMD_NEON)
+// 24-bit <-> 32-bit expansion for a row of 4 pixels.
+alignas(16) static const uint8_t expand_24_lo[16] = { 0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11, 0x80 };
+// Loaded from byte offset 8 to avoid reading past the row.
+alignas(16) static const uint8_t expand_24_hi[16] = { 4, 5, 6, 0x80, 7, 8, 9, 0x80, 10, 11, 12, 0x80, 13, 14, 15, 0x80 };
+// Pixel 0-3 + pixel 4-5 (partial).
+alignas(16) static const uint8_t pack_24_lo[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80 };
+alignas(16) static const uint8_t pack_24_mid[16] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 1, 2, 4 };
+// Pixel 5 (partial) - 7.
+alignas(16) static const uint8_t pack_24_hi[16] = { 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+#endif
+
+// Portable reference kernels, used when no SIMD path is available.
+static void vram_upload_block_32_scalar(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst32 = static_cast<uint32_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = reinterpret_cast<const uint32_t *>(src_bytes + y * src_stride);
+		for (uint32_t x = 0; x < 8; x++)
+			dst32[block_tables.offset_32[y * 8 + x]] = row[x];
+	}
+}
+
+static void vram_upload_block_24_scalar(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = src_bytes + y * src_stride;
+		for (uint32_t x = 0; x < 8; x++)
+		{
+			auto *d = dst + 4 * block_tables.offset_32[y * 8 + x];
+			d[0] = row[3 * x + 0];
+			d[1] = row[3 * x + 1];
+			d[2] = row[3 * x + 2];
+		}
+	}
+}
+
+static void vram_upload_block_16_scalar(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst16 = static_cast<uint16_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = reinterpret_cast<const uint16_t *>(src_bytes + y * src_stride);
+		for (uint32_t x = 0; x < 16; x++)
+			dst16[block_tables.offset_16[y * 16 + x]] = row[x];
+	}
+}
+
+static void vram_upload_block_8_scalar(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t y = 0; y < 16; y++)
+	{
+		auto *row = src_bytes + y * src_stride;
+		for (uint32_t x = 0; x < 16; x++)
+			dst[block_tables.offset_8[y * 16 + x]] = row[x];
+	}
+}
+
+static void vram_upload_block_4_scalar(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t y = 0; y < 16; y++)
+	{
+		auto *row = src_bytes + y * src_stride;
+		for (uint32_t x = 0; x < 32; x++)
+		{
+			uint32_t addr = block_tables.offset_4[y * 32 + x];
+			uint8_t value = (row[x >> 1] >> (4 * (x & 1))) & 0xfu;
+			auto &pix = dst[addr >> 1];
+			if (addr & 1)
+				pix = (pix & 0xfu) | (value << 4u);
+			else
+				pix = (pix & 0xf0u) | value;
+		}
+	}
+}
+
+static void vram_readback_block_32_scalar(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src32 = static_cast<const uint32_t *>(vram_block);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = reinterpret_cast<uint32_t *>(dst_bytes + y * dst_stride);
+		for (uint32_t x = 0; x < 8; x++)
+			row[x] = src32[block_tables.offset_32[y * 8 + x]];
+	}
+}
+
+static void vram_readback_block_24_scalar(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = dst_bytes + y * dst_stride;
+		for (uint32_t x = 0; x < 8; x++)
+		{
+			auto *s = src + 4 * block_tables.offset_32[y * 8 + x];
+			row[3 * x + 0] = s[0];
+			row[3 * x + 1] = s[1];
+			row[3 * x + 2] = s[2];
+		}
+	}
+}
+
+static void vram_readback_block_16_scalar(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src16 = static_cast<const uint16_t *>(vram_block);
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		auto *row = reinterpret_cast<uint16_t *>(dst_bytes + y * dst_stride);
+		for (uint32_t x = 0; x < 16; x++)
+			row[x] = src16[block_tables.offset_16[y * 16 + x]];
+	}
+}
+
+static void vram_readback_block_8_scalar(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t y = 0; y < 16; y++)
+	{
+		auto *row = dst_bytes + y * dst_stride;
+		for (uint32_t x = 0; x < 16; x++)
+			row[x] = src[block_tables.offset_8[y * 16 + x]];
+	}
+}
+
+#if defined(PGS_SIMD_SSE) || defined(PGS_SIMD_NEON)
+PGS_SIMD_TARGET static void vram_upload_block_32_simd(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row = src_bytes + 2 * column * src_stride;
+		SIMDVec out[4];
+		simd_interleave_column_32(out, simd_load(row), simd_load(row + 16),
+		                          simd_load(row + src_stride), simd_load(row + src_stride + 16));
+		for (uint32_t i = 0; i < 4; i++)
+			simd_store(dst + 64 * column + 16 * i, out[i]);
+	}
+}
+
+PGS_SIMD_TARGET static void vram_upload_block_24_simd(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+	const SIMDVec keep_mask = simd_splat_u32(0xff000000u);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row0 = src_bytes + 2 * column * src_stride;
+		auto *row1 = row0 + src_stride;
+
+		SIMDVec out[4];
+		simd_interleave_column_32(out,
+		                          simd_shuffle(simd_load(row0), expand_24_lo),
+		                          simd_shuffle(simd_load(row0 + 8), expand_24_hi),
+		                          simd_shuffle(simd_load(row1), expand_24_lo),
+		                          simd_shuffle(simd_load(row1 + 8), expand_24_hi));
+
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			auto *ptr = dst + 64 * column + 16 * i;
+			simd_store(ptr, simd_or(simd_and(simd_load(ptr), keep_mask), out[i]));
+		}
+	}
+}
+
+PGS_SIMD_TARGET static void vram_upload_block_16_simd(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	// Pixel x and x + 8 share a word, after which the layout is the same as 32-bit.
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row0 = src_bytes + 2 * column * src_stride;
+		auto *row1 = row0 + src_stride;
+		SIMDVec a_lo = simd_load(row0);
+		SIMDVec a_hi = simd_load(row0 + 16);
+		SIMDVec b_lo = simd_load(row1);
+		SIMDVec b_hi = simd_load(row1 + 16);
+
+		SIMDVec out[4];
+		simd_interleave_column_32(out,
+		                          simd_zip_lo16(a_lo, a_hi), simd_zip_hi16(a_lo, a_hi),
+		                          simd_zip_lo16(b_lo, b_hi), simd_zip_hi16(b_lo, b_hi));
+		for (uint32_t i = 0; i < 4; i++)
+			simd_store(dst + 64 * column + 16 * i, out[i]);
+	}
+}
+
+PGS_SIMD_TARGET static void vram_upload_block_8_simd(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		SIMDVec rows[4];
+		for (uint32_t i = 0; i < 4; i++)
+			rows[i] = simd_load(src_bytes + (4 * column + i) * src_stride);
+
+		auto &masks = block_tables.upload_8[column & 1];
+		for (uint32_t chunk = 0; chunk < 4; chunk++)
+		{
+			SIMDVec v = simd_shuffle(rows[0], masks[chunk][0]);
+			for (uint32_t i = 1; i < 4; i++)
+				v = simd_or(v, simd_shuffle(rows[i], masks[chunk][i]));
+			simd_store(dst + 64 * column + 16 * chunk, v);
+		}
+	}
+}
+
+PGS_SIMD_TARGET static void vram_upload_block_4_simd(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		// Split even and odd pixels so that we can shuffle whole bytes.
+		SIMDVec even[4], odd[4];
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			SIMDVec row = simd_load(src_bytes + (4 * column + i) * src_stride);
+			even[i] = simd_nibble_lo(row);
+			odd[i] = simd_nibble_shr4(row);
+		}
+
+		auto &masks = block_tables.upload_4[column & 1];
+		for (uint32_t chunk = 0; chunk < 4; chunk++)
+		{
+			SIMDVec nibbles[2];
+			for (uint32_t n = 0; n < 2; n++)
+			{
+				auto &m = masks[chunk][n];
+				SIMDVec v = simd_shuffle(even[2 * n + 0], m[0]);
+				v = simd_or(v, simd_shuffle(odd[2 * n + 0], m[1]));
+				v = simd_or(v, simd_shuffle(even[2 * n + 1], m[2]));
+				v = simd_or(v, simd_shuffle(odd[2 * n + 1], m[3]));
+				nibbles[n] = v;
+			}
+
+			simd_store(dst + 64 * column + 16 * chunk, simd_or(nibbles[0], simd_nibble_shl4(nibbles[1])));
+		}
+	}
+}
+
+PGS_SIMD_TARGET static void vram_readback_block_32_simd(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row = dst_bytes + 2 * column * dst_stride;
+		SIMDVec in[4], a0, a1, b0, b1;
+		for (uint32_t i = 0; i < 4; i++)
+			in[i] = simd_load(src + 64 * column + 16 * i);
+		simd_deinterleave_column_32(in, a0, a1, b0, b1);
+		simd_store(row, a0);
+		simd_store(row + 16, a1);
+		simd_store(row + dst_stride, b0);
+		simd_store(row + dst_stride + 16, b1);
+	}
+}
+
+PGS_SIMD_TARGET static void vram_readback_block_24_simd(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		SIMDVec in[4], rows[2][2];
+		for (uint32_t i = 0; i < 4; i++)
+			in[i] = simd_load(src + 64 * column + 16 * i);
+		simd_deinterleave_column_32(in, rows[0][0], rows[0][1], rows[1][0], rows[1][1]);
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			auto *row = dst_bytes + (2 * column + i) * dst_stride;
+			simd_store(row, simd_or(simd_shuffle(rows[i][0], pack_24_lo), simd_shuffle(rows[i][1], pack_24_mid)));
+			simd_store_lo64(row + 16, simd_shuffle(rows[i][1], pack_24_hi));
+		}
+	}
+}
+
+PGS_SIMD_TARGET static void vram_readback_block_16_simd(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		SIMDVec in[4], rows[2][2];
+		for (uint32_t i = 0; i < 4; i++)
+			in[i] = simd_load(src + 64 * column + 16 * i);
+		simd_deinterleave_column_32(in, rows[0][0], rows[0][1], rows[1][0], rows[1][1]);
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			auto *row = dst_bytes + (2 * column + i) * dst_stride;
+			simd_store(row, simd_unzip_lo16(rows[i][0], rows[i][1]));
+			simd_store(row + 16, simd_unzip_hi16(rows[i][0], rows[i][1]));
+		}
+	}
+}
+
+PGS_SIMD_TARGET static void vram_readback_block_8_simd(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		SIMDVec chunks[4];
+		for (uint32_t i = 0; i < 4; i++)
+			chunks[i] = simd_load(src + 64 * column + 16 * i);
+
+		auto &masks = block_tables.readback_8[column & 1];
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			SIMDVec v = simd_shuffle(chunks[0], masks[row][0]);
+			for (uint32_t i = 1; i < 4; i++)
+				v = simd_or(v, simd_shuffle(chunks[i], masks[row][i]));
+			simd_store(dst_bytes + (4 * column + row) * dst_stride, v);
+		}
+	}
+}
+#endif
+
+#if defined(PGS_SIMD_SSE)
+// A full 32-bit column is two rows of 32 bytes, so AVX2 handles it in one go.
+PGS_TARGET_AVX2 static void vram_upload_block_32_avx2(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row = src_bytes + 2 * column * src_stride;
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + src_stride));
+		__m256i lo = _mm256_unpacklo_epi64(a, b);
+		__m256i hi = _mm256_unpackhi_epi64(a, b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 64 * column), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 64 * column + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+}
+
+PGS_TARGET_AVX2 static void vram_upload_block_16_avx2(void *vram_block, const void *src, size_t src_stride)
+{
+	auto *dst = static_cast<uint8_t *>(vram_block);
+	auto *src_bytes = static_cast<const uint8_t *>(src);
+
+	// Pixel x and x + 8 share a word, after which the layout is the same as 32-bit.
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row = src_bytes + 2 * column * src_stride;
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + src_stride));
+		// [0-3, 8-11 | 4-7, 12-15]
+		a = _mm256_permute4x64_epi64(a, 0xd8);
+		b = _mm256_permute4x64_epi64(b, 0xd8);
+		a = _mm256_unpacklo_epi16(a, _mm256_srli_si256(a, 8));
+		b = _mm256_unpacklo_epi16(b, _mm256_srli_si256(b, 8));
+		__m256i lo = _mm256_unpacklo_epi64(a, b);
+		__m256i hi = _mm256_unpackhi_epi64(a, b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 64 * column), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 64 * column + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+}
+
+PGS_TARGET_AVX2 static void vram_readback_block_32_avx2(void *dst, size_t dst_stride, const void *vram_block)
+{
+	auto *dst_bytes = static_cast<uint8_t *>(dst);
+	auto *src = static_cast<const uint8_t *>(vram_block);
+
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		auto *row = dst_bytes + 2 * column * dst_stride;
+		__m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64 * column));
+		__m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64 * column + 32));
+		__m256i lo = _mm256_permute2x128_si256(c0, c1, 0x20);
+		__m256i hi = _mm256_permute2x128_si256(c0, c1, 0x31);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(row), _mm256_unpacklo_epi64(lo, hi));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(row + dst_stride), _mm256_unpackhi_epi64(lo, hi));
+	}
+}
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t (&regs)[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int r[4];
+	__cpuidex(r, int(leaf), int(subleaf));
+	for (int i = 0; i < 4; i++)
+		regs[i] = uint32_t(r[i]);
+#else
+	if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static uint64_t read_xcr0()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return _xgetbv(0);
+#else
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (uint64_t(hi) << 32) | lo;
+#endif
+}
+
+static SwizzleISA detect_swizzle_isa()
+{
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	uint32_t max_leaf = regs[0];
+	if (max_leaf < 1)
+		return SwizzleISA::Scalar;
+
+	cpuid(1, 0, regs);
+	bool has_ssse3 = (regs[2] & (1u << 9)) != 0;
+	bool has_sse41 = (regs[2] & (1u << 19)) != 0;
+	bool has_osxsave = (regs[2] & (1u << 27)) != 0;
+	bool has_avx = (regs[2] & (1u << 28)) != 0;
+
+	if (!has_ssse3 || !has_sse41)
+		return SwizzleISA::Scalar;
+
+	// AVX2 also needs the OS to save YMM state.
+	if (max_leaf >= 7 && has_osxsave && has_avx && (read_xcr0() & 0x6) == 0x6)
+	{
+		cpuid(7, 0, regs);
+		if ((regs[1] & (1u << 5)) != 0)
+			return SwizzleISA::AVX2;
+	}
+
+	return SwizzleISA::SSE41;
+}
+#elif defined(PGS_SIMD_NEON)
+static SwizzleISA detect_swizzle_isa()
+{
+	return SwizzleISA::NEON;
+}
+#else
+static SwizzleISA detect_swizzle_isa()
+{
+	return SwizzleISA::Scalar;
+}
+#endif
+
+struct SwizzleKernels
+{
+	SwizzleISA isa;
+	void (*upload_32)(void *, const void *, size_t);
+	void (*upload_24)(void *, const void *, size_t);
+	void (*upload_16)(void *, const void *, size_t);
+	void (*upload_8)(void *, const void *, size_t);
+	void (*upload_4)(void *, const void *, size_t);
+	void (*readback_32)(void *, size_t, const void *);
+	void (*readback_24)(void *, size_t, const void *);
+	void (*readback_16)(void *, size_t, const void *);
+	void (*readback_8)(void *, size_t, const void *);
+};
+
+static SwizzleKernels select_swizzle_kernels()
+{
+	SwizzleKernels k = {
+		SwizzleISA::Scalar,
+		vram_upload_block_32_scalar,
+		vram_upload_block_24_scalar,
+		vram_upload_block_16_scalar,
+		vram_upload_block_8_scalar,
+		vram_upload_block_4_scalar,
+		vram_readback_block_32_scalar,
+		vram_readback_block_24_scalar,
+		vram_readback_block_16_scalar,
+		vram_readback_block_8_scalar,
+	};
+
+	k.isa = detect_swizzle_isa();
+
+#if defined(PGS_SIMD_SSE) || defined(PGS_SIMD_NEON)
+	if (k.isa != SwizzleISA::Scalar)
+	{
+		k.upload_32 = vram_upload_block_32_simd;
+		k.upload_24 = vram_upload_block_24_simd;
+		k.upload_16 = vram_upload_block_16_simd;
+		k.upload_8 = vram_upload_block_8_simd;
+		k.upload_4 = vram_upload_block_4_simd;
+		k.readback_32 = vram_readback_block_32_simd;
+		k.readback_24 = vram_readback_block_24_simd;
+		k.readback_16 = vram_readback_block_16_simd;
+		k.readback_8 = vram_readback_block_8_simd;
+	}
+#endif
+
+#if defined(PGS_SIMD_SSE)
+	if (k.isa == SwizzleISA::AVX2)
+	{
+		k.upload_32 = vram_upload_block_32_avx2;
+		k.upload_16 = vram_upload_block_16_avx2;
+		k.readback_32 = vram_readback_block_32_avx2;
+	}
+#endif
+
+	return k;
+}
+
+static const SwizzleKernels swizzle_kernels = select_swizzle_kernels();
+
+SwizzleISA get_swizzle_isa()
+{
+	return swizzle_kernels.isa;
+}
+
+const char *get_swizzle_isa_name(SwizzleISA isa)
+{
+	switch (isa)
+	{
+	case SwizzleISA::SSE41:
+		return "SSE4.1";
+	case SwizzleISA::AVX2:
+		return "AVX2";
+	case SwizzleISA::NEON:
+		return "NEON";
+	default:
+		return "scalar";
+	}
+}
+
+void vram_upload_block_32(void *vram_block, const void *src, size_t src_stride)
+{
+	swizzle_kernels.upload_32(vram_block, src, src_stride);
+}
+
+void vram_upload_block_24(void *vram_block, const void *src, size_t src_stride)
+{
+	swizzle_kernels.upload_24(vram_block, src, src_stride);
+}
+
+void vram_upload_block_16(void *vram_block, const void *src, size_t src_stride)
+{
+	swizzle_kernels.upload_16(vram_block, src, src_stride);
+}
+
+void vram_upload_block_8(void *vram_block, const void *src, size_t src_stride)
+{
+	swizzle_kernels.upload_8(vram_block, src, src_stride);
+}
+
+void vram_upload_block_4(void *vram_block, const void *src, size_t src_stride)
+{
+	swizzle_kernels.upload_4(vram_block, src, src_stride);
+}
+
+void vram_readback_block_32(void *dst, size_t dst_stride, const void *vram_block)
+{
+	swizzle_kernels.readback_32(dst, dst_stride, vram_block);
+}
+
+void vram_readback_block_24(void *dst, size_t dst_stride, const void *vram_block)
+{
+	swizzle_kernels.readback_24(dst, dst_stride, vram_block);
+}
+
+void vram_readback_block_16(void *dst, size_t dst_stride, const void *vram_block)
+{
+	swizzle_kernels.readback_16(dst, dst_stride, vram_block);
+}
+
+void vram_readback_block_8(void *dst, size_t dst_stride, const void *vram_block)
+{
+	swizzle_kernels.readback_8(dst, dst_stride, vram_block);
+}
+}
@@ -46,19 +46,105 @@ Extent1D compute_effective_texture_extent(uint32_t extent, uint32_t wrap_mode,
                                           uint32_t lo, uint32_t hi,
                                           uint32_t levels);
 
+// Block-granular (de)swizzle kernels. vram_block points to the first byte of a block in VRAM.
+// The linear side is row-major with a stride in bytes, and must cover a full block of the format.
+// On x86, SSE4.1 and AVX2 variants are picked at runtime with cpuid. NEON is used on ARM64.
+void vram_upload_block_32(void *vram_block, const void *src, size_t src_stride);
+void vram_upload_block_24(void *vram_block, const void *src, size_t src_stride);
+void vram_upload_block_16(void *vram_block, const void *src, size_t src_stride);
+void vram_upload_block_8(void *vram_block, const void *src, size_t src_stride);
+void vram_upload_block_4(void *vram_block, const void *src, size_t src_stride);
+void vram_readback_block_32(void *dst, size_t dst_stride, const void *vram_block);
+void vram_readback_block_24(void *dst, size_t dst_stride, const void *vram_block);
+void vram_readback_block_16(void *dst, size_t dst_stride, const void *vram_block);
+void vram_readback_block_8(void *dst, size_t dst_stride, const void *vram_block);
+
+enum class SwizzleISA
+{
+	Scalar,
+	SSE41,
+	AVX2,
+	NEON
+};
+
+// Instruction set the block kernels were selected for.
+SwizzleISA get_swizzle_isa();
+const char *get_swizzle_isa_name(SwizzleISA isa);
+
+struct VRAMBlockRect
+{
+	uint32_t x0, x1;
+	uint32_t y0, y1;
+};
+
+// Finds the block-aligned interior of a transfer rect, relative to the transfer origin.
+// Returns false if there is nothing the block kernels can handle, in which case the scalar path must do all the work.
 template <uint32_t PSM>
-static inline void vram_readback(void *readback_data, const void *host_data, uint32_t base_256, uint32_t page_stride,
-                                 uint32_t src_x, uint32_t src_y,
-                                 uint32_t width, uint32_t height,
-                                 uint32_t vram_mask)
+static inline bool compute_vram_block_interior(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                                               uint32_t page_stride, uint32_t vram_mask,
+                                               VRAMBlockRect &rect)
 {
-	// This can definitely be optimized a lot if need be.
-	// Especially if we are block-aligned, it should be possible to de-swizzle a full 8x8 block in one go in SIMD or something ...
-	for (uint32_t y = 0; y < height; y++)
+	switch (PSM)
+	{
+	case PSMCT32:
+	case PSMZ32:
+	case PSMCT24:
+	case PSMZ24:
+	case PSMCT16:
+	case PSMCT16S:
+	case PSMZ16:
+	case PSMZ16S:
+	case PSMT8:
+		break;
+
+	case PSMT4:
+		// Rows must start on a byte boundary in the linear data.
+		if (((x | width) & 1) != 0)
+			return false;
+		break;
+
+	default:
+		return false;
+	}
+
+	// Wrapping transfers are rare, don't bother.
+	if (x + width > 2048 || y + height > 2048)
+		return false;
+
+	const LocalDataStructure layout = get_data_structure(PSM);
+
+	if (PSM == PSMT4 || PSM == PSMT8)
+		page_stride >>= 1;
+
+	// If texels alias each other in VRAM, the result depends on write order, so this must go through the scalar path.
+	// That happens if the transfer is wider than the buffer or covers more than all of VRAM.
+	if (x + width > page_stride * layout.page_width)
+		return false;
+
+	uint32_t page_rows = ((y + height - 1) >> layout.page_height_log2) - (y >> layout.page_height_log2) + 1;
+	if ((page_rows * page_stride + 1) * PGS_PAGE_ALIGNMENT_BYTES > vram_mask + 1)
+		return false;
+
+	rect.x0 = ((x + layout.block_width - 1) & ~(layout.block_width - 1)) - x;
+	rect.y0 = ((y + layout.block_height - 1) & ~(layout.block_height - 1)) - y;
+	rect.x1 = ((x + width) & ~(layout.block_width - 1)) - x;
+	rect.y1 = ((y + height) & ~(layout.block_height - 1)) - y;
+
+	return rect.x0 < rect.x1 && rect.y0 < rect.y1 && rect.x1 <= width && rect.y1 <= height;
+}
+
+// Per-texel reference path. Only handles the sub-rect [x_begin, x_end) x [y_begin, y_end) of the transfer.
+template <uint32_t PSM>
+static inline void vram_readback_rect(void *readback_data, const void *host_data, uint32_t base_256, uint32_t page_stride,
+                                      uint32_t src_x, uint32_t src_y, uint32_t width,
+                                      uint32_t x_begin, uint32_t x_end, uint32_t y_begin, uint32_t y_end,
+                                      uint32_t vram_mask)
+{
+	for (uint32_t y = y_begin; y < y_end; y++)
 	{
 		uint32_t effective_y = (y + src_y) & 2047;
-		uint32_t output_pixel = y * width;
-		for (uint32_t x = 0; x < width; x++, output_pixel++)
+		uint32_t output_pixel = y * width + x_begin;
+		for (uint32_t x = x_begin; x < x_end; x++, output_pixel++)
 		{
 			uint32_t effective_x = (x + src_x) & 2047;
 
@@ -110,19 +196,87 @@ static inline void vram_readback(void *readback_data, const void *host_data, uin
 }
 
 template <uint32_t PSM>
-static inline void vram_upload(void *vram_data, const void *upload_data,
-                               uint32_t base_256, uint32_t page_stride,
-                               uint32_t dst_x, uint32_t dst_y,
-                               uint32_t width, uint32_t height,
-                               uint32_t vram_mask)
+static inline void vram_readback(void *readback_data, const void *host_data, uint32_t base_256, uint32_t page_stride,
+                                 uint32_t src_x, uint32_t src_y,
+                                 uint32_t width, uint32_t height,
+                                 uint32_t vram_mask)
 {
-	// This can definitely be optimized a lot if need be.
-	// Especially if we are block-aligned, it should be possible to de-swizzle a full 8x8 block in one go in SIMD or something ...
-	for (uint32_t y = 0; y < height; y++)
+	// 4-bit is not allowed for readback, so there is no block kernel for it.
+	VRAMBlockRect rect;
+	if (PSM == PSMT4 || !compute_vram_block_interior<PSM>(src_x, src_y, width, height, page_stride, vram_mask, rect))
+	{
+		vram_readback_rect<PSM>(readback_data, host_data, base_256, page_stride,
+		                        src_x, src_y, width, 0, width, 0, height, vram_mask);
+		return;
+	}
+
+	const LocalDataStructure layout = get_data_structure(PSM);
+	const uint32_t linear_bpp = get_bits_per_pixel(PSM);
+	const uint32_t vram_bpp = get_stride_per_pixel(PSM);
+	const size_t dst_stride = size_t(width) * linear_bpp / 8;
+
+	// De-swizzle full blocks in one go.
+	for (uint32_t y = rect.y0; y < rect.y1; y += layout.block_height)
+	{
+		for (uint32_t x = rect.x0; x < rect.x1; x += layout.block_width)
+		{
+			uint32_t addr = swizzle_PS2(x + src_x, y + src_y, base_256, page_stride, PSM, vram_mask);
+			auto *block = static_cast<const uint8_t *>(host_data) + addr * vram_bpp / 8;
+			auto *dst = static_cast<uint8_t *>(readback_data) + y * dst_stride + x * linear_bpp / 8;
+
+			switch (PSM)
+			{
+			case PSMCT32:
+			case PSMZ32:
+				vram_readback_block_32(dst, dst_stride, block);
+				break;
+
+			case PSMCT24:
+			case PSMZ24:
+				vram_readback_block_24(dst, dst_stride, block);
+				break;
+
+			case PSMCT16:
+			case PSMCT16S:
+			case PSMZ16:
+			case PSMZ16S:
+				vram_readback_block_16(dst, dst_stride, block);
+				break;
+
+			case PSMT8:
+				vram_readback_block_8(dst, dst_stride, block);
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	// Unaligned edges.
+	vram_readback_rect<PSM>(readback_data, host_data, base_256, page_stride,
+	                        src_x, src_y, width, 0, width, 0, rect.y0, vram_mask);
+	vram_readback_rect<PSM>(readback_data, host_data, base_256, page_stride,
+	                        src_x, src_y, width, 0, width, rect.y1, height, vram_mask);
+	vram_readback_rect<PSM>(readback_data, host_data, base_256, page_stride,
+	                        src_x, src_y, width, 0, rect.x0, rect.y0, rect.y1, vram_mask);
+	vram_readback_rect<PSM>(readback_data, host_data, base_256, page_stride,
+	                        src_x, src_y, width, rect.x1, width, rect.y0, rect.y1, vram_mask);
+}
+
+// Per-texel reference path. Only handles the sub-rect [x_begin, x_end) x [y_begin, y_end) of the transfer.
+template <uint32_t PSM>
+static inline void vram_upload_rect(void *vram_data, const void *upload_data,
+                                    uint32_t base_256, uint32_t page_stride,
+                                    uint32_t dst_x, uint32_t dst_y, uint32_t width,
+                                    uint32_t x_begin, uint32_t x_end, uint32_t y_begin, uint32_t y_end,
+                                    uint32_t vram_mask)
+{
+	for (uint32_t y = y_begin; y < y_end; y++)
 	{
 		uint32_t effective_y = (y + dst_y) & 2047;
-		uint32_t input_pixel = y * width;
-		for (uint32_t x = 0; x < width; x++, input_pixel++)
+		uint32_t input_pixel = y * width + x_begin;
+		for (uint32_t x = x_begin; x < x_end; x++, input_pixel++)
 		{
 			uint32_t effective_x = (x + dst_x) & 2047;
 
@@ -203,4 +357,77 @@ static inline void vram_upload(void *vram_data, const void *upload_data,
 		}
 	}
 }
+
+template <uint32_t PSM>
+static inline void vram_upload(void *vram_data, const void *upload_data,
+                               uint32_t base_256, uint32_t page_stride,
+                               uint32_t dst_x, uint32_t dst_y,
+                               uint32_t width, uint32_t height,
+                               uint32_t vram_mask)
+{
+	VRAMBlockRect rect;
+	if (!compute_vram_block_interior<PSM>(dst_x, dst_y, width, height, page_stride, vram_mask, rect))
+	{
+		vram_upload_rect<PSM>(vram_data, upload_data, base_256, page_stride,
+		                      dst_x, dst_y, width, 0, width, 0, height, vram_mask);
+		return;
+	}
+
+	const LocalDataStructure layout = get_data_structure(PSM);
+	const uint32_t linear_bpp = get_bits_per_pixel(PSM);
+	const uint32_t vram_bpp = get_stride_per_pixel(PSM);
+	const size_t src_stride = size_t(width) * linear_bpp / 8;
+
+	// Swizzle full blocks in one go.
+	for (uint32_t y = rect.y0; y < rect.y1; y += layout.block_height)
+	{
+		for (uint32_t x = rect.x0; x < rect.x1; x += layout.block_width)
+		{
+			uint32_t addr = swizzle_PS2(x + dst_x, y + dst_y, base_256, page_stride, PSM, vram_mask);
+			auto *block = static_cast<uint8_t *>(vram_data) + addr * vram_bpp / 8;
+			auto *src = static_cast<const uint8_t *>(upload_data) + y * src_stride + x * linear_bpp / 8;
+
+			switch (PSM)
+			{
+			case PSMCT32:
+			case PSMZ32:
+				vram_upload_block_32(block, src, src_stride);
+				break;
+
+			case PSMCT24:
+			case PSMZ24:
+				vram_upload_block_24(block, src, src_stride);
+				break;
+
+			case PSMCT16:
+			case PSMCT16S:
+			case PSMZ16:
+			case PSMZ16S:
+				vram_upload_block_16(block, src, src_stride);
+				break;
+
+			case PSMT8:
+				vram_upload_block_8(block, src, src_stride);
+				break;
+
+			case PSMT4:
+				vram_upload_block_4(block, src, src_stride);
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	// Unaligned edges.
+	vram_upload_rect<PSM>(vram_data, upload_data, base_256, page_stride,
+	                      dst_x, dst_y, width, 0, width, 0, rect.y0, vram_mask);
+	vram_upload_rect<PSM>(vram_data, upload_data, base_256, page_stride,
+	                      dst_x, dst_y, width, 0, width, rect.y1, height, vram_mask);
+	vram_upload_rect<PSM>(vram_data, upload_data, base_256, page_stride,
+	                      dst_x, dst_y, width, 0, rect.x0, rect.y0, rect.y1, vram_mask);
+	vram_upload_rect<PSM>(vram_data, upload_data, base_256, page_stride,
+	                      dst_x, dst_y, width, rect.x1, width, rect.y0, rect.y1, vram_mask);
+}
 }
@@ -5,7 +5,6 @@
 
 #include "page_tracker.hpp"
 #include "gs_interface.hpp"
-#include "unstable_remove_if.hpp"
 #include <algorithm>
 
 #if 0 && defined(PARALLEL_GS_DEBUG) && PARALLEL_GS_DEBUG
@@ -16,6 +15,44 @@
 
 namespace ParallelGS
 {
+const char *flush_reason_to_str(FlushReason reason)
+{
+	switch (reason)
+	{
+	case FlushReason::SubmissionFlush:
+		return "Submission";
+	case FlushReason::TextureHazard:
+		return "TextureHazard";
+	case FlushReason::CopyHazard:
+		return "CopyHazard";
+	case FlushReason::Overflow:
+		return "Overflow";
+	case FlushReason::FBPointer:
+		return "FBPointer";
+	case FlushReason::HostAccess:
+		return "HostAccess";
+	default:
+		return "";
+	}
+}
+
+static bool page_in_rect(const PageRect &rect, uint32_t page, uint32_t page_mask)
+{
+	if (rect.page_stride != 0 && rect.page_stride >= rect.page_width)
+	{
+		uint32_t offset = (page - rect.base_page) & page_mask;
+		return offset % rect.page_stride < rect.page_width && offset / rect.page_stride < rect.page_height;
+	}
+
+	// Rows alias each other, just test every page.
+	for (uint32_t y = 0; y < rect.page_height; y++)
+		for (uint32_t x = 0; x < rect.page_width; x++)
+			if (((rect.base_page + y * rect.page_stride + x) & page_mask) == page)
+				return true;
+
+	return false;
+}
+
 PageTracker::PageTracker(GSInterface &cb_)
 	: cb(cb_)
 {
@@ -26,6 +63,14 @@ void PageTracker::set_num_pages(unsigned num_pages)
 	page_state_mask = num_pages - 1;
 	page_state.resize(num_pages);
 
+	uint32_t num_words = (num_pages + 31) / 32;
+	fb_access_page_bits.resize(num_words);
+	fb_write_page_bits.resize(num_words);
+	cache_page_bits.resize(num_words);
+	copy_page_bits.resize(num_words);
+	readback_page_bits.resize(num_words);
+	scanout_damage_page_bits.resize(num_words);
+
 	potential_invalidated_indices.reserve(num_pages);
 	accessed_fb_pages.reserve(num_pages);
 	accessed_cache_pages.reserve(num_pages);
@@ -33,10 +78,60 @@ void PageTracker::set_num_pages(unsigned num_pages)
 	accessed_readback_pages.reserve(num_pages);
 }
 
+static inline void set_page_bit(std::vector<uint32_t> &bits, uint32_t page)
+{
+	bits[page >> 5] |= 1u << (page & 31);
+}
+
+static inline uint32_t get_page_bits_run(uint32_t page, uint32_t count, uint32_t num_pages)
+{
+	// Stay within one word, and do not cross the VRAM wrap-around.
+	return std::min<uint32_t>(std::min<uint32_t>(count, 32 - (page & 31)), num_pages - page);
+}
+
+static inline uint32_t get_page_bits_mask(uint32_t page, uint32_t run)
+{
+	return (run == 32 ? UINT32_MAX : ((1u << run) - 1u)) << (page & 31);
+}
+
+bool PageTracker::test_page_bits(const std::vector<uint32_t> &bits, uint32_t page, uint32_t count) const
+{
+	page &= page_state_mask;
+	while (count)
+	{
+		uint32_t run = get_page_bits_run(page, count, page_state_mask + 1);
+		if ((bits[page >> 5] & get_page_bits_mask(page, run)) != 0)
+			return true;
+		count -= run;
+		page = (page + run) & page_state_mask;
+	}
+
+	return false;
+}
+
+bool PageTracker::test_page_bits(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+                                 uint32_t page, uint32_t count) const
+{
+	page &= page_state_mask;
+	while (count)
+	{
+		uint32_t run = get_page_bits_run(page, count, page_state_mask + 1);
+		if (((a[page >> 5] | b[page >> 5]) & get_page_bits_mask(page, run)) != 0)
+			return true;
+		count -= run;
+		page = (page + run) & page_state_mask;
+	}
+
+	return false;
+}
+
 bool PageTracker::page_has_host_write_timeline_update(const PageRect &rect) const
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(readback_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -53,6 +148,9 @@ bool PageTracker::page_has_host_read_timeline_update(const PageRect &rect) const
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(readback_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -69,6 +167,9 @@ bool PageTracker::page_has_fb_read_write(const PageRect &rect) const
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(fb_access_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -88,6 +189,9 @@ bool PageTracker::page_has_fb_write(const PageRect &rect) const
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(fb_write_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -107,6 +211,9 @@ bool PageTracker::page_is_copy_cached_sensitive(const PageRect& rect) const
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(cache_page_bits, copy_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -119,6 +226,35 @@ bool PageTracker::page_is_copy_cached_sensitive(const PageRect& rect) const
 	return false;
 }
 
+bool PageTracker::page_has_cached_read(const PageRect &rect) const
+{
+	for (unsigned y = 0; y < rect.page_height; y++)
+	{
+		if (!test_page_bits(cache_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
+		for (unsigned x = 0; x < rect.page_width; x++)
+		{
+			unsigned page = rect.base_page + y * rect.page_stride + x;
+			auto &state = page_state[page & page_state_mask];
+			if ((state.cached_read_block_mask & rect.block_mask) != 0)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+bool PageTracker::page_has_scanout_damage(uint32_t page, uint32_t count) const
+{
+	return test_page_bits(scanout_damage_page_bits, page, count);
+}
+
+void PageTracker::clear_scanout_damage()
+{
+	std::fill(scanout_damage_page_bits.begin(), scanout_damage_page_bits.end(), 0);
+}
+
 void PageTracker::mark_external_write(const PageRect &rect)
 {
 	for (unsigned y = 0; y < rect.page_height; y++)
@@ -132,6 +268,7 @@ void PageTracker::mark_external_write(const PageRect &rect)
 
 			register_accessed_readback_page(page);
 			register_potential_invalidated_indices(page);
+			set_page_bit(scanout_damage_page_bits, page);
 
 			state.need_host_read_timeline_mask |= rect.block_mask;
 			state.need_host_write_timeline_mask |= rect.block_mask;
@@ -168,6 +305,8 @@ void PageTracker::mark_fb_write(const PageRect &rect)
 
 			register_accessed_fb_pages(page);
 			register_accessed_readback_page(page);
+			set_page_bit(fb_write_page_bits, page);
+			set_page_bit(scanout_damage_page_bits, page);
 
 			state.fb_read_mask |= rect.block_mask;
 			state.fb_write_mask |= rect.block_mask;
@@ -221,28 +360,25 @@ void PageTracker::mark_fb_read(const PageRect &rect)
 bool PageTracker::mark_transfer_copy(const PageRect &dst_rect, const PageRect &src_rect)
 {
 	auto dst_block = get_block_state(dst_rect);
-	auto src_block = get_block_state(src_rect);
 
 	bool need_tex_invalidate = false;
 	bool has_hazard = false;
 
-	if (page_has_fb_read_write(dst_rect) || page_has_fb_write(src_rect))
+	bool dst_hazard = page_has_fb_read_write(dst_rect);
+	if (dst_hazard || page_has_fb_write(src_rect))
 	{
+		cb.note_flush_hazard((dst_hazard ? dst_rect : src_rect).base_page & page_state_mask, UINT32_MAX);
 		flush_render_pass(FlushReason::CopyHazard);
 	}
 	else if ((dst_block.cached_read_block_mask & dst_rect.block_mask) != 0)
 	{
+		cb.note_flush_hazard(dst_rect.base_page & page_state_mask, UINT32_MAX);
 		flush_cached();
 		need_tex_invalidate = true;
 	}
-	else if ((dst_block.copy_read_block_mask & dst_rect.block_mask) != 0 ||
-	         (src_block.copy_write_block_mask & src_rect.block_mask) != 0)
-	{
-		flush_copy();
-	}
 
-	// Write-after-Write hazards for copies are handled internally through atomics.
-	// We only need to care about write-after-read and read-after-write.
+	// Hazards against other pending copies are resolved by the copy scheduler in the renderer.
+	// We only need to detect the case where a copy overlaps itself.
 
 	for (unsigned y = 0; y < dst_rect.page_height; y++)
 	{
@@ -255,6 +391,7 @@ bool PageTracker::mark_transfer_copy(const PageRect &dst_rect, const PageRect &s
 			register_accessed_readback_page(page);
 			register_accessed_copy_pages(page);
 			register_potential_invalidated_indices(page);
+			set_page_bit(scanout_damage_page_bits, page);
 
 			state.need_host_write_timeline_mask |= dst_rect.block_mask;
 			state.need_host_read_timeline_mask |= dst_rect.block_mask;
@@ -284,7 +421,7 @@ bool PageTracker::mark_transfer_copy(const PageRect &dst_rect, const PageRect &s
 			register_accessed_copy_pages(page);
 			register_accessed_readback_page(page);
 
-			if ((src_rect.block_mask & state.copy_write_block_mask) != 0)
+			if ((src_rect.block_mask & dst_rect.block_mask) != 0 && page_in_rect(dst_rect, page, page_state_mask))
 				has_hazard = true;
 
 			state.need_host_write_timeline_mask |= dst_rect.block_mask;
@@ -295,26 +432,7 @@ bool PageTracker::mark_transfer_copy(const PageRect &dst_rect, const PageRect &s
 			      src_rect.block_mask, state.copy_read_block_mask);
 
 			// If we detect a COPY hazard here, it means that we have overlapping copy, and need to handle it carefully.
-		}
-	}
-
-	if (has_hazard)
-	{
-		for (unsigned y = 0; y < src_rect.page_height; y++)
-		{
-			for (unsigned x = 0; x < src_rect.page_width; x++)
-			{
-				unsigned page = src_rect.base_page + y * src_rect.page_stride + x;
-				page &= page_state_mask;
-				auto &state = page_state[page];
-
-				if ((state.flags & PAGE_STATE_NEEDS_SHADOW_PAGE_BIT) == 0)
-				{
-					state.flags |= PAGE_STATE_NEEDS_SHADOW_PAGE_BIT;
-					cb.sync_shadow_page(page);
-					accessed_shadow_pages.push_back(page);
-				}
-			}
+			// The renderer will source the copy from a shadow copy of VRAM.
 		}
 	}
 
@@ -341,7 +459,10 @@ void PageTracker::mark_texture_read(const PageRect &rect)
 	// Strict interpretation of minimal caching.
 	// Lots of content forgets TEXFLUSH, insert it automatically if we're trying to read after write.
 	if (page_has_fb_write(rect))
+	{
+		cb.note_flush_hazard(rect.base_page & page_state_mask, UINT32_MAX);
 		flush_render_pass(FlushReason::TextureHazard);
+	}
 }
 
 void PageTracker::register_cached_clut_clobber(const PageRectCLUT &rect)
@@ -399,9 +520,9 @@ void PageTracker::register_short_term_cached_texture(
 
 				garbage_collect_texture_masked_handles(state.short_term_cached_textures);
 
-				if (state.short_term_cached_textures.empty())
+				if (state.short_term_cached_textures == UINT32_MAX)
 					short_term_cache_pages.push_back(page);
-				state.short_term_cached_textures.push_back({ tex, rect.block_mask, rect.write_mask, UINT32_MAX });
+				push_cached_texture(state.short_term_cached_textures, { tex, rect.block_mask, rect.write_mask, UINT32_MAX });
 			}
 		}
 	}
@@ -429,14 +550,27 @@ bool PageTracker::has_punchthrough_host_write(const PageRect &rect) const
 	return true;
 }
 
+bool PageTracker::texture_can_upload_cpu(const PageRect *level_rect, uint32_t levels) const
+{
+	// Only bother trying to optimize small uploads.
+	// There must be no hazards, in the sense that it's safe to just read the CPU VRAM.
+	return levels == 1 &&
+	       level_rect[0].page_width == 1 &&
+	       level_rect[0].page_height == 1 &&
+	       (has_punchthrough_host_write(level_rect[0]) ||
+	        get_host_read_timeline(level_rect[0]) <= cb.query_timeline());
+}
+
 PageTracker::UploadStrategy
 PageTracker::register_cached_texture(const PageRect *level_rect, uint32_t levels,
                                      uint32_t csa_mask, uint32_t clut_instance,
-                                     Util::Hash hash, Vulkan::ImageHandle image)
+                                     Util::Hash hash, Vulkan::ImageHandle image,
+                                     Util::Hash content_hash)
 {
 	CachedTexture *handle = cached_texture_pool.allocate(cached_texture_pool);
 	handle->set_hash(hash);
 	handle->image = std::move(image);
+	handle->content_hash = content_hash;
 
 	auto *delete_t = cached_textures.insert_yield(handle);
 	// We should always have called find_cached_texture before creating a new one.
@@ -448,14 +582,8 @@ PageTracker::register_cached_texture(const PageRect *level_rect, uint32_t levels
 	assert(levels > 0);
 	assert(level_rect[0].page_width && level_rect[0].page_height);
 
-	// Only bother trying to optimize small uploads.
-	// There must be no hazards, in the sense that it's safe to just read the CPU VRAM.
 	// In this case we elide the marking of CACHED reads on the pages.
-	bool promote_to_cpu = levels == 1 &&
-	                      level_rect[0].page_width == 1 &&
-	                      level_rect[0].page_height == 1 &&
-	                      (has_punchthrough_host_write(level_rect[0]) ||
-	                       get_host_read_timeline(level_rect[0]) <= cb.query_timeline());
+	bool promote_to_cpu = texture_can_upload_cpu(level_rect, levels);
 
 	for (unsigned level = 0; level < levels; level++)
 	{
@@ -483,7 +611,7 @@ PageTracker::register_cached_texture(const PageRect *level_rect, uint32_t levels
 				      page, rect.block_mask, state.cached_read_block_mask);
 
 				garbage_collect_texture_masked_handles(state.cached_textures);
-				state.cached_textures.push_back({ tex, rect.block_mask, rect.write_mask, clut_instance });
+				push_cached_texture(state.cached_textures, { tex, rect.block_mask, rect.write_mask, clut_instance });
 			}
 		}
 	}
@@ -492,7 +620,7 @@ PageTracker::register_cached_texture(const PageRect *level_rect, uint32_t levels
 	if (csa_mask != 0)
 	{
 		garbage_collect_texture_masked_handles(texture_cached_palette);
-		texture_cached_palette.push_back({ std::move(tex), csa_mask, UINT32_MAX, clut_instance });
+		push_cached_texture(texture_cached_palette, { std::move(tex), csa_mask, UINT32_MAX, clut_instance });
 	}
 
 	return promote_to_cpu ? UploadStrategy::CPU : UploadStrategy::GPU;
@@ -521,13 +649,7 @@ void PageTracker::clear_copy_pages()
 		page.copy_write_block_mask = 0;
 	}
 	accessed_copy_pages.clear();
-
-	for (uint32_t page_index : accessed_shadow_pages)
-	{
-		auto &page = page_state[page_index];
-		page.flags &= ~PAGE_STATE_NEEDS_SHADOW_PAGE_BIT;
-	}
-	accessed_shadow_pages.clear();
+	std::fill(copy_page_bits.begin(), copy_page_bits.end(), 0);
 }
 
 void PageTracker::clear_cache_pages()
@@ -535,6 +657,7 @@ void PageTracker::clear_cache_pages()
 	for (uint32_t page_index : accessed_cache_pages)
 		page_state[page_index].cached_read_block_mask = 0;
 	accessed_cache_pages.clear();
+	std::fill(cache_page_bits.begin(), cache_page_bits.end(), 0);
 
 	// If we have memoized data earlier in this render pass, need to forget
 	// that and requery properly.
@@ -552,6 +675,8 @@ void PageTracker::clear_fb_pages()
 		page.pending_fb_access_mask = 0;
 	}
 	accessed_fb_pages.clear();
+	std::fill(fb_access_page_bits.begin(), fb_access_page_bits.end(), 0);
+	std::fill(fb_write_page_bits.begin(), fb_write_page_bits.end(), 0);
 
 	pending_fb_write_page_lo = UINT32_MAX;
 	pending_fb_write_page_hi = 0;
@@ -561,22 +686,18 @@ void PageTracker::clear_fb_pages()
 	for (uint32_t page_index : short_term_cache_pages)
 	{
 		auto &page = page_state[page_index];
-		page.short_term_cached_textures.clear();
+		release_cached_texture_list(page.short_term_cached_textures);
 	}
 	short_term_cache_pages.clear();
 
 	// Once a FB is flushed, we can no longer hold on to CLUT cached images
 	// which are in a floating state.
-	for (auto &cached : texture_cached_palette)
+	for (uint32_t index = texture_cached_palette; index != UINT32_MAX; index = texture_nodes[index].next)
+	{
+		auto &cached = texture_nodes[index].masked;
 		if (cached.tex->status == CachedTexture::Status::Floating)
 			cached.tex->status = CachedTexture::Status::Dead;
-}
-
-void PageTracker::flush_copy()
-{
-	cb.flush(PAGE_TRACKER_FLUSH_COPY_ALL, FlushReason::CopyHazard);
-	clear_copy_pages();
-	TRACE("TRACKER || FLUSH COPY\n");
+	}
 }
 
 void PageTracker::flush_cached()
@@ -595,6 +716,9 @@ BlockState PageTracker::get_block_state(const PageRect &rect) const
 
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
+		if (!test_page_bits(cache_page_bits, copy_page_bits, rect.base_page + y * rect.page_stride, rect.page_width))
+			continue;
+
 		for (unsigned x = 0; x < rect.page_width; x++)
 		{
 			unsigned page = rect.base_page + y * rect.page_stride + x;
@@ -613,7 +737,7 @@ void PageTracker::invalidate_fb_write_short_term_references()
 	for (uint32_t page : accessed_fb_pages)
 	{
 		auto &state = page_state[page];
-		if (!state.short_term_cached_textures.empty())
+		if (state.short_term_cached_textures != UINT32_MAX)
 			invalidate_cached_textures(state.short_term_cached_textures, UINT32_MAX, state.fb_write_mask, UINT32_MAX);
 	}
 }
@@ -626,18 +750,17 @@ void PageTracker::mark_transfer_write(const PageRect &rect)
 	auto block = get_block_state(rect);
 	if (page_has_fb_read_write(rect))
 	{
+		cb.note_flush_hazard(rect.base_page & page_state_mask, UINT32_MAX);
 		flush_render_pass(FlushReason::CopyHazard);
 	}
 	else if ((block.cached_read_block_mask & rect.block_mask) != 0)
 	{
+		cb.note_flush_hazard(rect.base_page & page_state_mask, UINT32_MAX);
 		flush_cached();
 		need_tex_invalidate = true;
 	}
-	else if ((block.copy_read_block_mask & rect.block_mask) != 0)
-		flush_copy();
 
-	// Write-after-Write hazards for copies are handled internally through atomics.
-	// We only need to care about write-after-read and read-after-write.
+	// Hazards against other pending copies are resolved by the copy scheduler in the renderer.
 
 	for (unsigned y = 0; y < rect.page_height; y++)
 	{
@@ -650,6 +773,7 @@ void PageTracker::mark_transfer_write(const PageRect &rect)
 			register_accessed_readback_page(page);
 			register_accessed_copy_pages(page);
 			register_potential_invalidated_indices(page);
+			set_page_bit(scanout_damage_page_bits, page);
 
 			state.need_host_write_timeline_mask |= rect.block_mask;
 			state.need_host_read_timeline_mask |= rect.block_mask;
@@ -707,6 +831,7 @@ void PageTracker::commit_host_write(const PageRect &rect)
 			unsigned page = rect.base_page + y * rect.page_stride + x;
 			page &= page_state_mask;
 			cb.sync_host_vram_page(page, rect.block_mask);
+			set_page_bit(scanout_damage_page_bits, page);
 			auto &state = page_state[page];
 			state.flags &= ~PAGE_STATE_MAY_SUPER_SAMPLE_BIT;
 
@@ -728,6 +853,7 @@ void PageTracker::commit_punchthrough_host_write(const ParallelGS::PageRect &rec
 			auto &state = page_state[page];
 
 			register_accessed_readback_page(page);
+			set_page_bit(scanout_damage_page_bits, page);
 			state.punchthrough_host_write_mask |= rect.block_mask;
 		}
 	}
@@ -742,6 +868,7 @@ void PageTracker::register_potential_invalidated_indices(uint32_t page)
 
 void PageTracker::register_accessed_cache_pages(uint32_t page)
 {
+	set_page_bit(cache_page_bits, page);
 	auto &state = page_state[page];
 	if (state.cached_read_block_mask == 0)
 		accessed_cache_pages.push_back(page);
@@ -749,6 +876,7 @@ void PageTracker::register_accessed_cache_pages(uint32_t page)
 
 void PageTracker::register_accessed_readback_page(uint32_t page)
 {
+	set_page_bit(readback_page_bits, page);
 	auto &state = page_state[page];
 	if (state.need_host_write_timeline_mask == 0 &&
 	    state.need_host_read_timeline_mask == 0 &&
@@ -760,6 +888,7 @@ void PageTracker::register_accessed_readback_page(uint32_t page)
 
 void PageTracker::register_accessed_fb_pages(uint32_t page)
 {
+	set_page_bit(fb_access_page_bits, page);
 	auto &state = page_state[page];
 	if (state.fb_read_mask == 0 && state.fb_write_mask == 0)
 		accessed_fb_pages.push_back(page);
@@ -767,6 +896,7 @@ void PageTracker::register_accessed_fb_pages(uint32_t page)
 
 void PageTracker::register_accessed_copy_pages(uint32_t page)
 {
+	set_page_bit(copy_page_bits, page);
 	auto &state = page_state[page];
 	if (state.copy_read_block_mask == 0 && state.copy_write_block_mask == 0)
 		accessed_copy_pages.push_back(page);
@@ -831,68 +961,186 @@ Vulkan::ImageHandle PageTracker::find_cached_texture(Util::Hash hash) const
 	return cached_texture->image;
 }
 
-void PageTracker::garbage_collect_texture_masked_handles(std::vector<CachedTextureMasked> &textures)
+void PageTracker::retire_cached_texture(CachedTexture &tex)
+{
+	// If there is an older retired variant, it cannot match anymore.
+	auto *retired = retired_textures.find(tex.get_hash());
+	if (retired)
+	{
+		cb.recycle_image_handle(std::move(retired->image));
+		retired_textures.erase(retired);
+	}
+
+	retired_textures.emplace_yield(tex.get_hash(), tex.content_hash, std::move(tex.image));
+}
+
+Vulkan::ImageHandle PageTracker::revive_cached_texture(Util::Hash hash, Util::Hash content_hash)
+{
+	auto *retired = retired_textures.find(hash);
+	if (!retired)
+		return {};
+
+	Vulkan::ImageHandle image;
+	if (retired->content_hash == content_hash)
+		image = std::move(retired->image);
+	else
+		cb.recycle_image_handle(std::move(retired->image));
+
+	retired_textures.erase(retired);
+	return image;
+}
+
+bool PageTracker::has_retired_cached_texture(Util::Hash hash)
+{
+	return retired_textures.find(hash) != nullptr;
+}
+
+void PageTracker::age_retired_textures()
+{
+	// Textures which are re-uploaded every frame are revived within the same frame, or the next one.
+	constexpr uint32_t MaxRetiredTextureAge = 2;
+
+	for (auto &retired : retired_textures)
+		if (++retired.age > MaxRetiredTextureAge)
+			retired_textures_to_erase.push_back(&retired);
+
+	for (auto *retired : retired_textures_to_erase)
+	{
+		cb.recycle_image_handle(std::move(retired->image));
+		retired_textures.erase(retired);
+	}
+	retired_textures_to_erase.clear();
+}
+
+void PageTracker::push_cached_texture(uint32_t &list, CachedTextureMasked masked)
 {
-	auto itr = Util::unstable_remove_if(textures.begin(), textures.end(), [](const CachedTextureMasked &masked) {
-		return masked.tex->status == CachedTexture::Status::Dead;
-	});
-	textures.erase(itr, textures.end());
+	uint32_t index = free_texture_nodes;
+	if (index != UINT32_MAX)
+	{
+		free_texture_nodes = texture_nodes[index].next;
+	}
+	else
+	{
+		index = uint32_t(texture_nodes.size());
+		texture_nodes.emplace_back();
+	}
+
+	auto &node = texture_nodes[index];
+	node.masked = std::move(masked);
+	node.next = list;
+	list = index;
+}
+
+void PageTracker::release_cached_texture_list(uint32_t &list)
+{
+	while (list != UINT32_MAX)
+	{
+		auto &node = texture_nodes[list];
+		uint32_t next = node.next;
+		node.masked.tex.reset();
+		node.next = free_texture_nodes;
+		free_texture_nodes = list;
+		list = next;
+	}
+}
+
+void PageTracker::garbage_collect_texture_masked_handles(uint32_t &list)
+{
+	uint32_t *link = &list;
+	while (*link != UINT32_MAX)
+	{
+		uint32_t index = *link;
+		auto &node = texture_nodes[index];
+
+		if (node.masked.tex->status == CachedTexture::Status::Dead)
+		{
+			*link = node.next;
+			node.masked.tex.reset();
+			node.next = free_texture_nodes;
+			free_texture_nodes = index;
+		}
+		else
+			link = &node.next;
+	}
 }
 
 bool PageTracker::invalidate_cached_textures(
-		std::vector<CachedTextureMasked> &textures,
+		uint32_t &list,
 		uint32_t block_mask, uint32_t write_mask, uint32_t clut_instance)
 {
 	bool did_work = false;
 
-	auto itr = Util::unstable_remove_if(
-			textures.begin(), textures.end(),
-			[this, block_mask, write_mask, clut_instance, &did_work](CachedTextureMasked &masked) {
-				auto &tex = *masked.tex;
+	// CLUT invalidation is a soft invalidation. As long as we can use CLUT memoization
+	// to get back to the original CLUT index, we can keep reusing the image,
+	// but only within the same render pass.
+	bool is_clut_invalidation = clut_instance != UINT32_MAX;
 
-				// CLUT invalidation is a soft invalidation. As long as we can use CLUT memoization
-				// to get back to the original CLUT index, we can keep reusing the image,
-				// but only within the same render pass.
-				bool is_clut_invalidation = clut_instance != UINT32_MAX;
+	// Walk by index. Node references are re-fetched after calling back into the interface.
+	uint32_t prev = UINT32_MAX;
+	uint32_t index = list;
 
-				bool can_invalidate =
-						tex.status == CachedTexture::Status::Live ||
-						(tex.status == CachedTexture::Status::Floating && !is_clut_invalidation);
+	while (index != UINT32_MAX)
+	{
+		auto &masked = texture_nodes[index].masked;
+		auto &tex = *masked.tex;
 
-				if (can_invalidate &&
-				    (masked.block_mask & block_mask) != 0 &&
-				    (masked.write_mask & write_mask) != 0 &&
-				    (clut_instance == UINT32_MAX || masked.clut_instance != clut_instance))
-				{
-					// When we transition away from Live status, remove it from the hashmap lookup.
-					// Handles may persist until render pass end.
-					if (tex.status == CachedTexture::Status::Live)
-						cached_textures.erase(masked.tex.get());
-
-					// If we only invalidated texture due to palette cache being clobbered,
-					// we may be able to ignore the invalidation and keep it alive in the render pass cache if
-					// we sample the texture with same memoized CLUT instance once again.
-					// Essentially, we defer the invalidation until the same texture is used with a different palette instance.
-					cb.invalidate_texture_hash(tex.get_hash(), is_clut_invalidation);
-					if (tex.image)
-					{
-						cb.recycle_image_handle(std::move(tex.image));
-						tex.image = {};
-					}
-
-					// If the image was only invalidated for CLUT, it can remain live until.
-					tex.status = is_clut_invalidation ?
-					             CachedTexture::Status::Floating :
-					             CachedTexture::Status::Dead;
-
-					did_work = true;
-				}
+		bool can_invalidate =
+				tex.status == CachedTexture::Status::Live ||
+				(tex.status == CachedTexture::Status::Floating && !is_clut_invalidation);
 
-				// Can only reap the handle when it's truly dead.
-				return tex.status == CachedTexture::Status::Dead;
-			});
+		if (can_invalidate &&
+		    (masked.block_mask & block_mask) != 0 &&
+		    (masked.write_mask & write_mask) != 0 &&
+		    (clut_instance == UINT32_MAX || masked.clut_instance != clut_instance))
+		{
+			// When we transition away from Live status, remove it from the hashmap lookup.
+			// Handles may persist until render pass end.
+			if (tex.status == CachedTexture::Status::Live)
+				cached_textures.erase(masked.tex.get());
+
+			// If we only invalidated texture due to palette cache being clobbered,
+			// we may be able to ignore the invalidation and keep it alive in the render pass cache if
+			// we sample the texture with same memoized CLUT instance once again.
+			// Essentially, we defer the invalidation until the same texture is used with a different palette instance.
+			cb.invalidate_texture_hash(tex.get_hash(), is_clut_invalidation);
+			if (tex.image)
+			{
+				if (tex.content_hash && !is_clut_invalidation)
+					retire_cached_texture(tex);
+				else
+					cb.recycle_image_handle(std::move(tex.image));
+				tex.image = {};
+			}
+
+			// If the image was only invalidated for CLUT, it can remain live until.
+			tex.status = is_clut_invalidation ?
+			             CachedTexture::Status::Floating :
+			             CachedTexture::Status::Dead;
+
+			did_work = true;
+		}
+
+		auto &node = texture_nodes[index];
+		uint32_t next = node.next;
+
+		// Can only reap the handle when it's truly dead.
+		if (node.masked.tex->status == CachedTexture::Status::Dead)
+		{
+			if (prev == UINT32_MAX)
+				list = next;
+			else
+				texture_nodes[prev].next = next;
+
+			node.masked.tex.reset();
+			node.next = free_texture_nodes;
+			free_texture_nodes = index;
+		}
+		else
+			prev = index;
+
+		index = next;
+	}
 
-	textures.erase(itr, textures.end());
 	return did_work;
 }
 
@@ -904,7 +1152,7 @@ void PageTracker::invalidate_texture_cache(uint32_t clut_instance)
 	{
 		auto &page = page_state[index];
 
-		if (!page.cached_textures.empty())
+		if (page.cached_textures != UINT32_MAX)
 		{
 			TRACE("TRACKER || PAGE 0x%x, invalidate texture mask 0x%x\n", unsigned(&page - page_state.data()),
 			      page.texture_cache_needs_invalidate_mask);
@@ -957,6 +1205,7 @@ uint64_t PageTracker::mark_submission_timeline(FlushReason reason)
 	}
 
 	accessed_readback_pages.clear();
+	std::fill(readback_page_bits.begin(), readback_page_bits.end(), 0);
 
 	cb.flush(PAGE_TRACKER_FLUSH_WRITE_BACK_BIT, reason);
 	return timeline;
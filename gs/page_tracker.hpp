@@ -24,6 +24,10 @@ struct CachedTexture : Util::IntrusiveHashMapEnabled<CachedTexture>,
 	Util::ObjectPool<CachedTexture> &pool;
 	Vulkan::ImageHandle image;
 
+	// Hash of the VRAM contents the image was decoded from, or 0 if not known.
+	// If set, a hard invalidation retires the image rather than recycling it.
+	Util::Hash content_hash = 0;
+
 	enum class Status { Live, Floating, Dead };
 	Status status = Status::Live;
 };
@@ -31,8 +35,7 @@ using CachedTextureHandle = Util::IntrusivePtr<CachedTexture>;
 
 enum PageStateFlagBits : uint32_t
 {
-	PAGE_STATE_NEEDS_SHADOW_PAGE_BIT = 1 << 0,
-	PAGE_STATE_MAY_SUPER_SAMPLE_BIT = 1 << 1
+	PAGE_STATE_MAY_SUPER_SAMPLE_BIT = 1 << 0
 };
 using PageStateFlags = uint32_t;
 
@@ -54,8 +57,9 @@ struct BlockState
 struct PageState
 {
 	// On TEXFLUSH, we may have to clobber these texture handles if there have been writes to the page.
-	std::vector<CachedTextureMasked> cached_textures;
-	std::vector<CachedTextureMasked> short_term_cached_textures;
+	// Heads of intrusive lists which live in PageTracker's node pool.
+	uint32_t cached_textures = UINT32_MAX;
+	uint32_t short_term_cached_textures = UINT32_MAX;
 
 	// To safely read from host memory, this timeline must be reached.
 	uint64_t host_read_timeline = 0;
@@ -129,6 +133,8 @@ enum class FlushReason
 	HostAccess
 };
 
+const char *flush_reason_to_str(FlushReason reason);
+
 class GSInterface;
 
 class PageTracker
@@ -177,12 +183,24 @@ public:
 	};
 	UploadStrategy register_cached_texture(const PageRect *level_rects, uint32_t num_levels,
 	                                       uint32_t csa_mask, uint32_t clut_instance,
-	                                       Util::Hash hash, Vulkan::ImageHandle image);
+	                                       Util::Hash hash, Vulkan::ImageHandle image,
+	                                       Util::Hash content_hash = 0);
+	// If true, register_cached_texture() will return UploadStrategy::CPU,
+	// and the host copy of VRAM is safe to read for this texture.
+	bool texture_can_upload_cpu(const PageRect *level_rects, uint32_t num_levels) const;
 
 	void register_short_term_cached_texture(const PageRect *level_rects, uint32_t num_levels, Util::Hash hash);
 
 	Vulkan::ImageHandle find_cached_texture(Util::Hash hash) const;
 
+	// Textures which are invalidated with a known content hash are retired for a few frames.
+	// If the same texture is requested again with identical VRAM contents, the image can be reused as-is.
+	// A mismatching content hash discards the retired image.
+	Vulkan::ImageHandle revive_cached_texture(Util::Hash hash, Util::Hash content_hash);
+	bool has_retired_cached_texture(Util::Hash hash);
+	// Should be called once per frame. Discards retired images which were not revived in time.
+	void age_retired_textures();
+
 	// If there are hazards, this returns UINT64_MAX. Must explicitly call mark_submission_timeline first.
 	uint64_t get_host_read_timeline(const PageRect &rect) const;
 	uint64_t get_host_write_timeline(const PageRect &rect) const;
@@ -203,6 +221,13 @@ public:
 	bool page_has_fb_read_write(const PageRect &rect) const;
 	bool page_has_fb_write(const PageRect &rect) const;
 	bool page_is_copy_cached_sensitive(const PageRect &rect) const;
+	// True if textures have been read from the rect since the last flush.
+	bool page_has_cached_read(const PageRect &rect) const;
+
+	// Pages written by rendering, copies or the host since the last clear_scanout_damage().
+	// Unlike the FB write masks, this survives render pass flushes, so it covers everything between two vsyncs.
+	bool page_has_scanout_damage(uint32_t page, uint32_t count) const;
+	void clear_scanout_damage();
 
 private:
 	GSInterface &cb;
@@ -212,7 +237,45 @@ private:
 	unsigned page_state_mask = 0;
 	uint64_t timeline = 0;
 	uint32_t csa_written_mask = 0;
-	std::vector<CachedTextureMasked> texture_cached_palette;
+	uint32_t texture_cached_palette = UINT32_MAX;
+
+	// Backing storage for the per-page texture lists.
+	// Dead nodes go to a free list, so steady state does not allocate.
+	struct CachedTextureNode
+	{
+		CachedTextureMasked masked;
+		uint32_t next;
+	};
+	std::vector<CachedTextureNode> texture_nodes;
+	uint32_t free_texture_nodes = UINT32_MAX;
+
+	struct RetiredTexture : Util::IntrusiveHashMapEnabled<RetiredTexture>
+	{
+		RetiredTexture(Util::Hash content_hash_, Vulkan::ImageHandle image_)
+			: content_hash(content_hash_), image(std::move(image_)) {}
+		Util::Hash content_hash;
+		Vulkan::ImageHandle image;
+		uint32_t age = 0;
+	};
+	Util::IntrusiveHashMap<RetiredTexture> retired_textures;
+	std::vector<RetiredTexture *> retired_textures_to_erase;
+	void retire_cached_texture(CachedTexture &tex);
+
+	void push_cached_texture(uint32_t &list, CachedTextureMasked masked);
+	void release_cached_texture_list(uint32_t &list);
+
+	// One bit per page, set whenever the corresponding per-page masks may be non-zero.
+	// Queries over a PageRect test a whole row of pages at once before looking at individual pages.
+	std::vector<uint32_t> fb_access_page_bits;
+	std::vector<uint32_t> fb_write_page_bits;
+	std::vector<uint32_t> cache_page_bits;
+	std::vector<uint32_t> copy_page_bits;
+	std::vector<uint32_t> readback_page_bits;
+	std::vector<uint32_t> scanout_damage_page_bits;
+
+	bool test_page_bits(const std::vector<uint32_t> &bits, uint32_t page, uint32_t count) const;
+	bool test_page_bits(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+	                    uint32_t page, uint32_t count) const;
 
 	// Accelerate mark_texture_read.
 	uint32_t pending_fb_write_page_lo = UINT32_MAX;
@@ -223,12 +286,11 @@ private:
 	std::vector<uint32_t> accessed_cache_pages;
 	std::vector<uint32_t> accessed_copy_pages;
 	std::vector<uint32_t> accessed_readback_pages;
-	std::vector<uint32_t> accessed_shadow_pages;
 	std::vector<uint32_t> short_term_cache_pages;
 
 	void clear_fb_pages();
 
-	bool invalidate_cached_textures(std::vector<CachedTextureMasked> &textures,
+	bool invalidate_cached_textures(uint32_t &list,
 	                                uint32_t block_mask, uint32_t write_mask, uint32_t clut_instance);
 	bool page_has_host_write_timeline_update(const PageRect &rect) const;
 	bool page_has_host_read_timeline_update(const PageRect &rect) const;
@@ -236,9 +298,8 @@ private:
 
 	bool has_punchthrough_host_write(const PageRect &rect) const;
 
-	void flush_copy();
 	void flush_cached();
-	void garbage_collect_texture_masked_handles(std::vector<CachedTextureMasked> &textures);
+	void garbage_collect_texture_masked_handles(uint32_t &list);
 	std::vector<uint32_t> potential_invalidated_indices;
 
 	void register_potential_invalidated_indices(uint32_t page);
@@ -0,0 +1,178 @@
+// SPDX-FileCopyrightText: 2024 Arntzen Software AS
+// SPDX-FileContributor: Hans-Kristian Arntzen
+// SPDX-FileContributor: Runar Heyer
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "trace_recorder.hpp"
+#include "timer.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+
+namespace ParallelGS
+{
+namespace
+{
+std::atomic<uint64_t> next_recorder_id{1};
+
+// Recorders are identified by a unique ID rather than pointer, since a new recorder may reuse the address.
+struct ThreadBufferCache
+{
+	uint64_t recorder_id;
+	void *buffer;
+};
+thread_local ThreadBufferCache thread_buffer_cache = {};
+
+constexpr uint32_t GPUTrackTid = 0;
+}
+
+TraceRecorder::TraceRecorder(size_t events_per_thread_)
+	: events_per_thread(std::max<size_t>(1, events_per_thread_))
+{
+	base_ns = Util::get_current_time_nsecs();
+	id = next_recorder_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+}
+
+uint64_t TraceRecorder::get_base_ns() const
+{
+	return base_ns;
+}
+
+TraceRecorder::ThreadBuffer *TraceRecorder::get_thread_buffer()
+{
+	if (thread_buffer_cache.recorder_id == id)
+		return static_cast<ThreadBuffer *>(thread_buffer_cache.buffer);
+
+	// Slow path, only taken the first time a thread records, or if it alternates between recorders.
+	std::lock_guard<std::mutex> holder{lock};
+	auto thread_id = std::this_thread::get_id();
+	ThreadBuffer *ret = nullptr;
+
+	for (auto &buffer : buffers)
+		if (buffer->thread_id == thread_id)
+			ret = buffer.get();
+
+	if (!ret)
+	{
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+		buffer->events.reset(new TraceEvent[events_per_thread]);
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->thread_id = thread_id;
+		buffer->tid = uint32_t(buffers.size() + 1);
+		ret = buffer.get();
+		buffers.push_back(std::move(buffer));
+	}
+
+	thread_buffer_cache.recorder_id = id;
+	thread_buffer_cache.buffer = ret;
+	return ret;
+}
+
+void TraceRecorder::record(const TraceEvent &event)
+{
+	auto *buffer = get_thread_buffer();
+	// Only the owning thread writes, so this does not need to be an atomic increment.
+	uint64_t count = buffer->count.load(std::memory_order_relaxed);
+	buffer->events[count % events_per_thread] = event;
+	buffer->count.store(count + 1, std::memory_order_release);
+}
+
+static void write_event(FILE *file, const TraceEvent &event, uint32_t tid, uint64_t base_ns)
+{
+	// Chrome trace wants microseconds. GPU events may be placed slightly before the base.
+	double ts = 1e-3 * double(int64_t(event.start_ns - base_ns));
+	double dur = 1e-3 * double(event.duration_ns);
+
+	fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{",
+	        event.name, event.category ? event.category : "", ts, dur, tid);
+
+	bool first_arg = true;
+	if (event.detail_name)
+	{
+		fprintf(file, "\"%s\":\"%s\"", event.detail_name, event.detail ? event.detail : "");
+		first_arg = false;
+	}
+
+	for (uint32_t i = 0; i < event.num_args; i++)
+	{
+		fprintf(file, "%s\"%s\":%llu", first_arg ? "" : ",", event.arg_names[i],
+		        static_cast<unsigned long long>(event.arg_values[i]));
+		first_arg = false;
+	}
+
+	fprintf(file, "}}");
+}
+
+bool TraceRecorder::write_chrome_trace(const char *path) const
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+	{
+		LOGE("Failed to open %s for writing.\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+	        GPUTrackTid);
+
+	for (auto &buffer : buffers)
+	{
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GS thread %u\"}}",
+		        buffer->tid, buffer->tid);
+
+		uint64_t count = buffer->count.load(std::memory_order_acquire);
+		uint64_t num_events = std::min<uint64_t>(count, events_per_thread);
+		for (uint64_t i = count - num_events; i < count; i++)
+		{
+			auto &event = buffer->events[i % events_per_thread];
+			write_event(file, event, event.gpu ? GPUTrackTid : buffer->tid, base_ns);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+TraceScope::TraceScope(TraceRecorder *recorder_, const char *name, const char *category)
+	: recorder(recorder_)
+{
+	if (recorder)
+	{
+		event = {};
+		event.name = name;
+		event.category = category;
+		event.start_ns = Util::get_current_time_nsecs();
+	}
+}
+
+void TraceScope::add_arg(const char *name, uint64_t value)
+{
+	if (recorder && event.num_args < TraceEvent::MaxArgs)
+	{
+		event.arg_names[event.num_args] = name;
+		event.arg_values[event.num_args] = value;
+		event.num_args++;
+	}
+}
+
+void TraceScope::set_detail(const char *name, const char *detail)
+{
+	event.detail_name = name;
+	event.detail = detail;
+}
+
+TraceScope::~TraceScope()
+{
+	if (recorder)
+	{
+		event.duration_ns = Util::get_current_time_nsecs() - event.start_ns;
+		recorder->record(event);
+	}
+}
+}
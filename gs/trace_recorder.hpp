@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2024 Arntzen Software AS
+// SPDX-FileContributor: Hans-Kristian Arntzen
+// SPDX-FileContributor: Runar Heyer
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ParallelGS
+{
+// All strings must have static storage duration. Only pointers are recorded.
+struct TraceEvent
+{
+	enum { MaxArgs = 6 };
+
+	const char *name;
+	const char *category;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+
+	// Optional string argument, e.g. the flush reason.
+	const char *detail_name;
+	const char *detail;
+
+	const char *arg_names[MaxArgs];
+	uint64_t arg_values[MaxArgs];
+	uint32_t num_args;
+
+	// Placed on a dedicated GPU track rather than the recording thread.
+	bool gpu;
+};
+
+// Records timeline events into per-thread ring buffers, and writes them out as Chrome trace JSON,
+// which can be loaded into Perfetto or chrome://tracing.
+// Recording never takes a lock once a thread has recorded its first event,
+// and only the most recent events_per_thread events of every thread are kept.
+// Writing the trace must not race with recording.
+class TraceRecorder
+{
+public:
+	explicit TraceRecorder(size_t events_per_thread = 64 * 1024);
+	~TraceRecorder();
+	TraceRecorder(const TraceRecorder &) = delete;
+	void operator=(const TraceRecorder &) = delete;
+
+	void record(const TraceEvent &event);
+	bool write_chrome_trace(const char *path) const;
+
+	// Start of the trace, events are written relative to this.
+	uint64_t get_base_ns() const;
+
+private:
+	struct ThreadBuffer
+	{
+		std::unique_ptr<TraceEvent[]> events;
+		std::atomic<uint64_t> count;
+		std::thread::id thread_id;
+		uint32_t tid;
+	};
+
+	size_t events_per_thread;
+	uint64_t base_ns;
+	uint64_t id;
+
+	std::mutex lock;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	ThreadBuffer *get_thread_buffer();
+};
+
+// Times a scope and records it on destruction. Does nothing if recorder is nullptr.
+struct TraceScope
+{
+	TraceScope(TraceRecorder *recorder, const char *name, const char *category);
+	~TraceScope();
+
+	void add_arg(const char *name, uint64_t value);
+	void set_detail(const char *name, const char *detail);
+
+	TraceRecorder *recorder;
+	TraceEvent event;
+};
+}
@@ -10,6 +10,7 @@
 #include "gs_interface.hpp"
 #include "gs_dump_generator.hpp"
 #include <stdlib.h>
+#include <assert.h>
 
 using namespace Vulkan;
 using namespace ParallelGS;
@@ -71,6 +72,35 @@ static void write_line_primitive(GSDumpGenerator &iface, float x0, float y0, flo
 	iface.write_packed(prim, addr, 2, 2, vertices);
 }
 
+static void write_point_primitives(GSDumpGenerator &iface, int x, int y, int count)
+{
+	struct Vertex
+	{
+		PackedRGBAQBits rgba;
+		PackedXYZBits xyz;
+	} vertices[16] = {};
+
+	assert(count <= 16);
+
+	for (int i = 0; i < count; i++)
+	{
+		auto &v = vertices[i];
+		v.rgba.R = 0x10 * i;
+		v.rgba.G = 0xff - 0x10 * i;
+		v.rgba.B = 0x80;
+		v.rgba.A = 0x80;
+		v.xyz.X = (x + i) << PGS_SUBPIXEL_BITS;
+		v.xyz.Y = (y + (i & 1)) << PGS_SUBPIXEL_BITS;
+	}
+
+	PRIMBits prim = {};
+	prim.IIP = 1;
+	prim.PRIM = int(PRIMType::Point);
+
+	static const GIFAddr addr[] = { GIFAddr::RGBAQ, GIFAddr::XYZ2 };
+	iface.write_packed(prim, addr, 2, count, vertices);
+}
+
 static void write_sprite_primitive(GSDumpGenerator &iface, int x0, int y0, int x1, int y1)
 {
 	struct Vertex
@@ -184,6 +214,13 @@ static void run_test(GSDumpGenerator &iface)
 	write_line_primitive(iface, 5.0f, 3.0f - 1.0f / 16.0f, 2.0f, 3.0f - 1.0f / 16.0f);
 }
 
+// Runs after a vsync has flushed the previous pass, so the render pass only contains points.
+// Points are neither sprites, lines nor triangles, so this covers any per-instance primitive classification.
+static void run_points_only_test(GSDumpGenerator &iface)
+{
+	write_point_primitives(iface, 2, 10, 12);
+}
+
 int main()
 {
 	if (!Context::init_loader(nullptr))
@@ -247,6 +284,7 @@ int main()
 		priv.display1.DH = 16 - 1;
 
 		dump.write_vsync(0, iface);
+		run_points_only_test(dump);
 		dump.write_vsync(1, iface);
 	}
 
@@ -254,8 +292,10 @@ int main()
 	if (!parser.open("/tmp/test.gs", 4 * 1024 * 1024, &iface))
 		return EXIT_FAILURE;
 
-	if (!parser.iterate_until_vsync())
-		return EXIT_FAILURE;
+	// Second field replays the points-only render pass.
+	for (int i = 0; i < 2; i++)
+		if (!parser.iterate_until_vsync())
+			return EXIT_FAILURE;
 
 	if (use_rdoc)
 		device.end_renderdoc_capture();
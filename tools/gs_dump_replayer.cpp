@@ -14,15 +14,332 @@
 #include "gs_dump_generator.hpp"
 #include "cli_parser.hpp"
 #include "timer.hpp"
+#include "rapidjson_wrapper.hpp"
+#include "hash.hpp"
+#include <sys/stat.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
 
 using namespace Vulkan;
 using namespace ParallelGS;
 using namespace Util;
+using namespace rapidjson;
 
 static void print_help()
 {
-	LOGI("Usage: parallel-gs-replayer <dump.gs> [--ssaa <rate>] [--strided] [--full] [--iterations <count>] [--high-res-scanout] [--ssaa-textures] [--disable-sampler-feedback]\n");
+	LOGI("Usage: parallel-gs-replayer <dump.gs> [--ssaa <rate>] [--ssaa-governor <budget ms>] [--strided] [--full] [--iterations <count>] [--high-res-scanout] [--ssaa-textures] [--texture-content-hashing] [--clut-content-hashing] [--hierarchical-z] [--compare-hierarchical-z] [--adaptive-tiling] [--fb-working-set-merging] [--async-compute-uploads] [--async-scanout] [--incremental-scanout] [--scanout-export <count>] [--texture-memory-budget <MiB>] [--host-transfer-ring <MiB>] [--disable-sampler-feedback] [--pipeline-cache <path>] [--precompile-current-rate-only]\n"
+	     "\t[--frames <first>:<end>] [--checkpoint-dir <dir>] [--checkpoint-interval <vsyncs>]\n"
+	     "\t[--benchmark <report.json>] [--warmup <iterations>] [--instances <count>] [--trace <trace.json>]\n");
+}
+
+// Collects per-frame wall-clock times along with CPU and GPU stage times for --benchmark.
+// Frame time is the time between successive vsyncs as seen by the replayer,
+// so in steady state it reflects throughput of whichever of CPU or GPU is the bottleneck.
+struct BenchmarkReport
+{
+	std::vector<double> frame_times_ms;
+	double cpu_time_base[int(CPUTimestampType::Count)] = {};
+	double cpu_time[int(CPUTimestampType::Count)] = {};
+	double gpu_time_base[int(TimestampType::Count)] = {};
+	double gpu_time[int(TimestampType::Count)] = {};
+	FlushStats stats = {};
+	unsigned iterations = 0;
+
+	// --compare-hierarchical-z alternates culling between measured iterations.
+	// Index 0 is without culling, index 1 is with.
+	bool compare_hierarchical_z = false;
+	double shading_time[2] = {};
+	unsigned compare_frames[2] = {};
+
+	void begin(GSInterface &iface)
+	{
+		iface.consume_flush_stats();
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+			cpu_time_base[i] = iface.get_accumulated_cpu_time(CPUTimestampType(i));
+		for (int i = 0; i < int(TimestampType::Count); i++)
+			gpu_time_base[i] = iface.get_accumulated_timestamps(TimestampType(i));
+	}
+
+	void add_frame(GSInterface &iface, double ms)
+	{
+		frame_times_ms.push_back(ms);
+		auto frame_stats = iface.consume_flush_stats();
+		stats.allocated_scratch_memory += frame_stats.allocated_scratch_memory;
+		stats.allocated_image_memory += frame_stats.allocated_image_memory;
+		stats.num_primitives += frame_stats.num_primitives;
+		stats.num_render_passes += frame_stats.num_render_passes;
+		stats.num_palette_updates += frame_stats.num_palette_updates;
+		stats.num_copies += frame_stats.num_copies;
+		stats.num_copy_threads += frame_stats.num_copy_threads;
+		stats.num_copy_hazards += frame_stats.num_copy_hazards;
+		stats.num_copy_barriers += frame_stats.num_copy_barriers;
+		stats.num_overflow_flushes += frame_stats.num_overflow_flushes;
+		stats.num_texture_content_hash_hits += frame_stats.num_texture_content_hash_hits;
+		stats.num_texture_content_hash_misses += frame_stats.num_texture_content_hash_misses;
+		stats.num_palette_content_hash_hits += frame_stats.num_palette_content_hash_hits;
+		stats.num_z_culled_primitives += frame_stats.num_z_culled_primitives;
+		stats.num_merged_fb_switches += frame_stats.num_merged_fb_switches;
+		stats.num_scratch_allocations += frame_stats.num_scratch_allocations;
+		stats.current_image_memory = frame_stats.current_image_memory;
+		stats.peak_image_memory = std::max(stats.peak_image_memory, frame_stats.peak_image_memory);
+	}
+
+	void end(GSInterface &iface)
+	{
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+			cpu_time[i] = iface.get_accumulated_cpu_time(CPUTimestampType(i)) - cpu_time_base[i];
+		for (int i = 0; i < int(TimestampType::Count); i++)
+			gpu_time[i] = iface.get_accumulated_timestamps(TimestampType(i)) - gpu_time_base[i];
+	}
+
+	bool write(const std::string &path, const std::string &dump_path) const
+	{
+		static const char *cpu_names[] = { "gifTransfer", "flushRenderPass", "vsync" };
+		static const char *gpu_names[] = {
+			"syncHostToVRAM", "copyVRAM", "paletteUpdate", "textureUpload",
+			"triangleSetup", "binning", "shading", "readback", "vsync",
+		};
+		static_assert(sizeof(cpu_names) / sizeof(*cpu_names) == size_t(CPUTimestampType::Count), "Missing CPU timestamp name.");
+		static_assert(sizeof(gpu_names) / sizeof(*gpu_names) == size_t(TimestampType::Count), "Missing GPU timestamp name.");
+
+		auto sorted = frame_times_ms;
+		std::sort(sorted.begin(), sorted.end());
+		double num_frames = double(std::max<size_t>(1, sorted.size()));
+		double total = 0.0;
+		for (auto t : sorted)
+			total += t;
+
+		// Nearest-rank percentiles.
+		auto percentile = [&](double p) -> double {
+			if (sorted.empty())
+				return 0.0;
+			size_t rank = size_t(std::ceil(p * double(sorted.size())));
+			return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+		};
+
+		Document doc;
+		auto &obj = doc.SetObject();
+		auto &alloc = doc.GetAllocator();
+
+		obj.AddMember("dump", Value(dump_path.c_str(), alloc), alloc);
+		obj.AddMember("iterations", iterations, alloc);
+		obj.AddMember("frames", uint64_t(sorted.size()), alloc);
+
+		Value frame_time(kObjectType);
+		frame_time.AddMember("mean", total / num_frames, alloc);
+		frame_time.AddMember("p50", percentile(0.50), alloc);
+		frame_time.AddMember("p99", percentile(0.99), alloc);
+		frame_time.AddMember("min", sorted.empty() ? 0.0 : sorted.front(), alloc);
+		frame_time.AddMember("max", sorted.empty() ? 0.0 : sorted.back(), alloc);
+		obj.AddMember("frameTimeMs", frame_time, alloc);
+
+		// Per-frame means of accumulated stage times.
+		Value cpu(kObjectType);
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+			cpu.AddMember(StringRef(cpu_names[i]), 1e3 * cpu_time[i] / num_frames, alloc);
+		obj.AddMember("cpuTimeMsPerFrame", cpu, alloc);
+
+		Value gpu(kObjectType);
+		for (int i = 0; i < int(TimestampType::Count); i++)
+			gpu.AddMember(StringRef(gpu_names[i]), 1e3 * gpu_time[i] / num_frames, alloc);
+		obj.AddMember("gpuTimeMsPerFrame", gpu, alloc);
+
+		Value flush_stats(kObjectType);
+		flush_stats.AddMember("numPrimitives", stats.num_primitives, alloc);
+		flush_stats.AddMember("numRenderPasses", stats.num_render_passes, alloc);
+		flush_stats.AddMember("numPaletteUpdates", stats.num_palette_updates, alloc);
+		flush_stats.AddMember("numCopies", stats.num_copies, alloc);
+		flush_stats.AddMember("numCopyThreads", stats.num_copy_threads, alloc);
+		flush_stats.AddMember("numCopyHazards", stats.num_copy_hazards, alloc);
+		flush_stats.AddMember("numCopyBarriers", stats.num_copy_barriers, alloc);
+		flush_stats.AddMember("numOverflowFlushes", stats.num_overflow_flushes, alloc);
+		flush_stats.AddMember("numTextureContentHashHits", stats.num_texture_content_hash_hits, alloc);
+		flush_stats.AddMember("numTextureContentHashMisses", stats.num_texture_content_hash_misses, alloc);
+		flush_stats.AddMember("numPaletteContentHashHits", stats.num_palette_content_hash_hits, alloc);
+		flush_stats.AddMember("numZCulledPrimitives", stats.num_z_culled_primitives, alloc);
+		flush_stats.AddMember("numMergedFBSwitches", stats.num_merged_fb_switches, alloc);
+		flush_stats.AddMember("numScratchAllocations", stats.num_scratch_allocations, alloc);
+		flush_stats.AddMember("allocatedImageMemory", uint64_t(stats.allocated_image_memory), alloc);
+		flush_stats.AddMember("allocatedScratchMemory", uint64_t(stats.allocated_scratch_memory), alloc);
+		flush_stats.AddMember("currentImageMemory", uint64_t(stats.current_image_memory), alloc);
+		flush_stats.AddMember("peakImageMemory", uint64_t(stats.peak_image_memory), alloc);
+		obj.AddMember("flushStats", flush_stats, alloc);
+
+		if (compare_hierarchical_z)
+		{
+			Value compare(kObjectType);
+			compare.AddMember("framesWithoutCulling", compare_frames[0], alloc);
+			compare.AddMember("framesWithCulling", compare_frames[1], alloc);
+			compare.AddMember("shadingMsPerFrameWithoutCulling",
+			                  1e3 * shading_time[0] / double(std::max(1u, compare_frames[0])), alloc);
+			compare.AddMember("shadingMsPerFrameWithCulling",
+			                  1e3 * shading_time[1] / double(std::max(1u, compare_frames[1])), alloc);
+			obj.AddMember("hierarchicalZ", compare, alloc);
+		}
+
+		StringBuffer strbuf;
+		PrettyWriter<StringBuffer> writer{strbuf};
+		doc.Accept(writer);
+
+		FILE *file = fopen(path.c_str(), "w");
+		if (!file)
+		{
+			LOGE("Failed to open %s for writing.\n", path.c_str());
+			return false;
+		}
+
+		bool success = fwrite(strbuf.GetString(), 1, strbuf.GetLength(), file) == strbuf.GetLength();
+		success = fclose(file) == 0 && success;
+		if (!success)
+			LOGE("Failed to write benchmark report to %s.\n", path.c_str());
+		return success;
+	}
+};
+
+static constexpr uint32_t VRAMSize = 4 * 1024 * 1024;
+
+// Checkpoints of different dumps may share a directory, and shards or CI machines may see the same dump
+// under different paths. Key them by content: the file size plus a hash of the head and tail of the dump.
+// The head covers the header and initial VRAM state, the tail tells apart dumps which only differ later on.
+static Hash compute_dump_identity(const std::string &dump_path)
+{
+	constexpr size_t IdentitySpan = 4 * 1024 * 1024;
+	Hasher h;
+
+	FILE *file = fopen(dump_path.c_str(), "rb");
+	if (!file)
+	{
+		// Can't be resumed anyway, but don't alias with other dumps.
+		h.string(dump_path);
+		return h.get();
+	}
+
+	std::vector<uint64_t> buffer(IdentitySpan / sizeof(uint64_t));
+
+	const auto hash_span = [&](size_t offset, size_t size) {
+		if (fseek(file, long(offset), SEEK_SET) != 0)
+			return;
+		size_t read_size = fread(buffer.data(), 1, size, file);
+		// Zero-fill the partial word at the end so the hash is deterministic.
+		if (read_size % sizeof(uint64_t))
+			memset(reinterpret_cast<uint8_t *>(buffer.data()) + read_size, 0,
+			       sizeof(uint64_t) - read_size % sizeof(uint64_t));
+		h.u64(read_size);
+		h.data(buffer.data(), (read_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+	};
+
+	struct stat st = {};
+	size_t file_size = fstat(fileno(file), &st) == 0 ? size_t(st.st_size) : 0;
+	h.u64(file_size);
+
+	hash_span(0, std::min<size_t>(file_size, IdentitySpan));
+	if (file_size > IdentitySpan)
+	{
+		size_t tail_offset = std::max<size_t>(file_size - IdentitySpan, IdentitySpan);
+		hash_span(tail_offset, file_size - tail_offset);
+	}
+
+	fclose(file);
+	return h.get();
+}
+
+static std::string get_checkpoint_path(const std::string &dir, Hash dump_identity, size_t vsync_count)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "/checkpoint-%016llx-%08zu.gs",
+	         static_cast<unsigned long long>(dump_identity), vsync_count);
+	return dir + name;
+}
+
+// Other shards may be resuming from the same directory concurrently,
+// so write to a unique temporary file and only expose complete checkpoints through rename.
+static bool write_checkpoint(const std::string &path, GSInterface &iface)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%016llx.tmp",
+	         static_cast<unsigned long long>(Util::get_current_time_nsecs()));
+	auto tmp_path = path + suffix;
+
+	bool success;
+	{
+		GSDumpGenerator checkpoint;
+		success = checkpoint.init(tmp_path.c_str(), VRAMSize, iface);
+	}
+
+	// A shard which got there first wrote the same content, so losing the race is fine.
+	if (success && rename(tmp_path.c_str(), path.c_str()) != 0)
+	{
+		FILE *existing = fopen(path.c_str(), "rb");
+		success = existing != nullptr;
+		if (existing)
+			fclose(existing);
+	}
+
+	remove(tmp_path.c_str());
+	return success;
+}
+
+static bool parse_frame_range(const char *arg, size_t &first, size_t &end)
+{
+	// Either A:B or A: to run until end of dump.
+	char *colon = nullptr;
+	first = strtoull(arg, &colon, 0);
+	if (!colon || *colon != ':')
+		return false;
+
+	if (colon[1] == '\0')
+	{
+		end = SIZE_MAX;
+		return true;
+	}
+
+	char *term = nullptr;
+	end = strtoull(colon + 1, &term, 0);
+	return term && *term == '\0' && end > first;
+}
+
+// Checkpoints are regular GS dumps without any packets, so they can be loaded with GSDumpParser directly.
+// The vertex queue is not part of the dump format, so a strip or fan straddling the checkpoint vsync
+// may lose its first primitives after a resume.
+static bool seek_to_frame(GSDumpParser &parser, GSInterface &iface, const std::string &checkpoint_dir,
+                          Hash dump_identity, size_t frame, bool high_res_scanout)
+{
+	bool resumed = false;
+
+	if (!checkpoint_dir.empty() && frame != 0)
+	{
+		for (size_t vsync_count = std::min<size_t>(frame, parser.get_vsync_offsets().size()); vsync_count; vsync_count--)
+		{
+			auto path = get_checkpoint_path(checkpoint_dir, dump_identity, vsync_count);
+			FILE *file = fopen(path.c_str(), "rb");
+			if (!file)
+				continue;
+			fclose(file);
+
+			GSDumpParser checkpoint;
+			if (checkpoint.open(path.c_str(), VRAMSize, &iface) && parser.seek_to_vsync(vsync_count - 1))
+			{
+				LOGI("Resuming from checkpoint %s.\n", path.c_str());
+				resumed = true;
+			}
+			else
+				LOGW("Failed to load checkpoint %s, replaying from start.\n", path.c_str());
+			break;
+		}
+	}
+
+	if (!resumed && !parser.restart())
+		return false;
+
+	while (parser.get_vsync_count() < frame && parser.iterate_until_vsync(high_res_scanout))
+		continue;
+
+	return parser.get_vsync_count() >= frame;
 }
 
 int main(int argc, char **argv)
@@ -34,16 +351,58 @@ int main(int argc, char **argv)
 	unsigned total_iterations = 1;
 	bool high_res_scanout = false;
 	GSOptions opts = {};
+	size_t first_frame = 0;
+	size_t end_frame = SIZE_MAX;
+	std::string checkpoint_dir;
+	size_t checkpoint_interval = 0;
+	bool invalid_frame_range = false;
+	std::string benchmark_path;
+	unsigned warmup_iterations = 1;
+	unsigned num_instances = 1;
+	std::string trace_path;
+	bool compare_hierarchical_z = false;
 
 	CLICallbacks cbs;
 	cbs.add("--help", [&](CLIParser &parser) { parser.end(); print_help(); });
 	cbs.add("--ssaa", [&](CLIParser &parser) { opts.super_sampling = SuperSampling(parser.next_uint()); });
+	cbs.add("--ssaa-governor", [&](CLIParser &parser) {
+		opts.dynamic_super_sampling = true;
+		opts.super_sampling_governor = true;
+		opts.super_sampling_governor_budget_ms = parser.next_double();
+	});
 	cbs.add("--strided", [&](CLIParser &) { debug_mode.draw_mode = DebugMode::DrawDebugMode::Strided; });
 	cbs.add("--full", [&](CLIParser &) { debug_mode.draw_mode = DebugMode::DrawDebugMode::Full; });
 	cbs.add("--iterations", [&](CLIParser &parser) { total_iterations = parser.next_uint(); });
 	cbs.add("--high-res-scanout", [&](CLIParser &) { high_res_scanout = true; });
 	cbs.add("--ssaa-textures", [&](CLIParser &) { opts.super_sampled_textures = true; });
+	cbs.add("--texture-content-hashing", [&](CLIParser &) { opts.texture_content_hashing = true; });
+	cbs.add("--clut-content-hashing", [&](CLIParser &) { opts.clut_content_hashing = true; });
+	cbs.add("--hierarchical-z", [&](CLIParser &) { opts.hierarchical_z_culling = true; });
+	cbs.add("--compare-hierarchical-z", [&](CLIParser &) { compare_hierarchical_z = true; });
+	cbs.add("--adaptive-tiling", [&](CLIParser &) { opts.adaptive_tiling = true; });
+	cbs.add("--fb-working-set-merging", [&](CLIParser &) { opts.fb_working_set_merging = true; });
+	cbs.add("--async-compute-uploads", [&](CLIParser &) { opts.async_compute_texture_uploads = true; });
+	cbs.add("--async-scanout", [&](CLIParser &) { opts.async_scanout = true; });
+	cbs.add("--incremental-scanout", [&](CLIParser &) { opts.incremental_scanout = true; });
+	cbs.add("--scanout-export", [&](CLIParser &parser) { opts.scanout_export_images = parser.next_uint(); });
+	cbs.add("--texture-memory-budget", [&](CLIParser &parser) {
+		opts.texture_memory_budget = VkDeviceSize(parser.next_uint()) * 1024 * 1024;
+	});
+	cbs.add("--host-transfer-ring", [&](CLIParser &parser) {
+		opts.host_transfer_ring_size = VkDeviceSize(parser.next_uint()) * 1024 * 1024;
+	});
 	cbs.add("--disable-sampler-feedback", [&](CLIParser &) { debug_mode.disable_sampler_feedback = true; });
+	cbs.add("--pipeline-cache", [&](CLIParser &parser) { opts.pipeline_cache_path = parser.next_string(); });
+	cbs.add("--precompile-current-rate-only", [&](CLIParser &) { opts.precompile_current_sampling_rate_only = true; });
+	cbs.add("--frames", [&](CLIParser &parser) {
+		invalid_frame_range = !parse_frame_range(parser.next_string(), first_frame, end_frame);
+	});
+	cbs.add("--checkpoint-dir", [&](CLIParser &parser) { checkpoint_dir = parser.next_string(); });
+	cbs.add("--checkpoint-interval", [&](CLIParser &parser) { checkpoint_interval = parser.next_uint(); });
+	cbs.add("--benchmark", [&](CLIParser &parser) { benchmark_path = parser.next_string(); });
+	cbs.add("--warmup", [&](CLIParser &parser) { warmup_iterations = parser.next_uint(); });
+	cbs.add("--trace", [&](CLIParser &parser) { trace_path = parser.next_string(); });
+	cbs.add("--instances", [&](CLIParser &parser) { num_instances = std::max<unsigned>(1, parser.next_uint()); });
 	cbs.default_handler = [&](const char *arg) { dump_path = arg; };
 
 	CLIParser cli_parser(std::move(cbs), argc - 1, argv + 1);
@@ -63,6 +422,26 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	if (invalid_frame_range)
+	{
+		LOGE("Invalid frame range, expected <first>:<end>.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (checkpoint_interval && checkpoint_dir.empty())
+	{
+		LOGE("--checkpoint-interval requires --checkpoint-dir.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (compare_hierarchical_z && benchmark_path.empty())
+	{
+		LOGE("--compare-hierarchical-z requires --benchmark.\n");
+		return EXIT_FAILURE;
+	}
+
+	Hash dump_identity = checkpoint_dir.empty() ? 0 : compute_dump_identity(dump_path);
+
 	if (!Context::init_loader(nullptr))
 		return EXIT_FAILURE;
 
@@ -76,40 +455,170 @@ int main(int argc, char **argv)
 	device.set_context(ctx);
 	device.init_frame_contexts(4);
 
+	GSDeviceContext device_context;
+	if (!device_context.init(&device))
+		return EXIT_FAILURE;
+	opts.device_context = &device_context;
+
 	GSInterface iface;
 	if (!iface.init(&device, opts))
 		return EXIT_FAILURE;
 
+	// Additional instances replay the same dump in lock-step with the main one.
+	// They share programs and descriptor pools through the device context, but not VRAM.
+	// Frame times include their work, but statistics are only gathered from the main instance.
+	std::vector<std::unique_ptr<GSInterface>> extra_ifaces;
+	std::vector<std::unique_ptr<GSDumpParser>> extra_parsers;
+	for (unsigned i = 1; i < num_instances; i++)
+	{
+		std::unique_ptr<GSInterface> extra_iface(new GSInterface);
+		if (!extra_iface->init(&device, opts))
+			return EXIT_FAILURE;
+
+		std::unique_ptr<GSDumpParser> extra_parser(new GSDumpParser);
+		if (!extra_parser->open(dump_path.c_str(), VRAMSize, extra_iface.get()))
+			return EXIT_FAILURE;
+
+		extra_ifaces.push_back(std::move(extra_iface));
+		extra_parsers.push_back(std::move(extra_parser));
+	}
+
+	std::unique_ptr<TraceRecorder> trace_recorder;
+	if (!trace_path.empty())
+	{
+		trace_recorder.reset(new TraceRecorder);
+		iface.set_trace_recorder(trace_recorder.get());
+	}
+
+	bool benchmark = !benchmark_path.empty();
 	bool use_rdoc = Device::init_renderdoc_capture();
+
 	if (use_rdoc)
 	{
+		debug_mode.timestamps = benchmark;
 		iface.set_debug_mode(debug_mode);
 		device.begin_renderdoc_capture();
 	}
+	else
+	{
+		// Only enable what we need to not skew the measurement.
+		// Options given explicitly on the command line still apply on top.
+		DebugMode mode = {};
+		mode.timestamps = benchmark;
+		mode.draw_mode = debug_mode.draw_mode;
+		mode.disable_sampler_feedback = debug_mode.disable_sampler_feedback;
+		iface.set_debug_mode(mode);
+	}
+
+	// Without --benchmark the first iteration is implicitly warmup.
+	if (!benchmark)
+		warmup_iterations = 1;
+	else
+		total_iterations += warmup_iterations;
+
+	BenchmarkReport report;
+	report.iterations = total_iterations - std::min(total_iterations, warmup_iterations);
+	report.compare_hierarchical_z = compare_hierarchical_z;
+	if (compare_hierarchical_z && report.iterations < 2)
+		LOGW("--compare-hierarchical-z needs at least two measured iterations, use --iterations.\n");
+	if (benchmark && warmup_iterations == 0)
+		report.begin(iface);
 
 	GSDumpParser parser;
-	if (!parser.open(argv[1], 4 * 1024 * 1024, &iface))
+	if (!parser.open(dump_path.c_str(), VRAMSize, &iface))
 		return EXIT_FAILURE;
 
+	LOGI("Dump has %zu vsyncs.\n", parser.get_vsync_offsets().size());
+
 	unsigned iterations = 0;
 	uint64_t start_ns = 0;
 	unsigned vsyncs = 0;
+	size_t next_checkpoint = checkpoint_interval;
+
+	if (warmup_iterations == 0)
+		start_ns = Util::get_current_time_nsecs();
 
 	do
 	{
-		do
+		if (!seek_to_frame(parser, iface, checkpoint_dir, dump_identity, first_frame, high_res_scanout))
 		{
-			LOGI("Running frame ...\n");
-			if (iterations > 0)
-				vsyncs++;
-		} while (parser.iterate_until_vsync(high_res_scanout));
+			LOGE("Frame %zu is out of range.\n", first_frame);
+			break;
+		}
 
-		if (!parser.restart())
+		bool extra_seek_failed = false;
+		for (size_t i = 0; i < extra_parsers.size() && !extra_seek_failed; i++)
 		{
-			LOGE("Failed to rewind capture.\n");
+			extra_seek_failed = !seek_to_frame(*extra_parsers[i], *extra_ifaces[i], checkpoint_dir, dump_identity,
+			                                   first_frame, high_res_scanout);
+		}
+
+		if (extra_seek_failed)
+		{
+			LOGE("Failed to seek additional instance to frame %zu.\n", first_frame);
 			break;
 		}
 
+		bool measured = iterations >= warmup_iterations;
+
+		// Every iteration replays the same frames, so alternating gives a like for like comparison.
+		// Shading time is attributed per iteration, so drain the GPU at the boundaries.
+		unsigned compare_index = (iterations - std::min(iterations, warmup_iterations)) & 1;
+		double shading_time_base = 0.0;
+		if (compare_hierarchical_z)
+		{
+			iface.set_hierarchical_z_culling(compare_index != 0);
+			if (measured)
+			{
+				iface.flush();
+				device.wait_idle();
+				iface.flush();
+				shading_time_base = iface.get_accumulated_timestamps(TimestampType::Shading);
+			}
+		}
+
+		uint64_t frame_start_ns = Util::get_current_time_nsecs();
+
+		while (parser.get_vsync_count() < end_frame && parser.iterate_until_vsync(high_res_scanout))
+		{
+			if (!benchmark)
+				LOGI("Running frame ...\n");
+
+			// Every instance was seeked to the same frame, so they all reach end_frame together.
+			for (auto &extra_parser : extra_parsers)
+				extra_parser->iterate_until_vsync(high_res_scanout);
+
+			if (measured)
+			{
+				vsyncs++;
+				if (compare_hierarchical_z)
+					report.compare_frames[compare_index]++;
+				uint64_t frame_end_ns = Util::get_current_time_nsecs();
+				if (benchmark)
+					report.add_frame(iface, 1e-6 * double(frame_end_ns - frame_start_ns));
+				frame_start_ns = frame_end_ns;
+			}
+
+			if (checkpoint_interval && iterations == 0 && parser.get_vsync_count() >= next_checkpoint)
+			{
+				auto path = get_checkpoint_path(checkpoint_dir, dump_identity, parser.get_vsync_count());
+				if (write_checkpoint(path, iface))
+					LOGI("Wrote checkpoint %s.\n", path.c_str());
+				else
+					LOGW("Failed to write checkpoint %s.\n", path.c_str());
+				next_checkpoint = (parser.get_vsync_count() / checkpoint_interval + 1) * checkpoint_interval;
+			}
+		}
+
+		if (compare_hierarchical_z && measured)
+		{
+			iface.flush();
+			device.wait_idle();
+			iface.flush();
+			report.shading_time[compare_index] +=
+					iface.get_accumulated_timestamps(TimestampType::Shading) - shading_time_base;
+		}
+
 		HeapBudget budget[VK_MAX_MEMORY_HEAPS] = {};
 		device.get_memory_budget(budget);
 
@@ -121,14 +630,52 @@ int main(int argc, char **argv)
 			     static_cast<unsigned long long>(budget[i].device_usage / (1024 * 1024)));
 		}
 
-		if (iterations == 0)
+		if (iterations + 1 == warmup_iterations)
+		{
+			if (benchmark)
+			{
+				// Don't let warmup work leak into the measurement.
+				iface.flush();
+				device.wait_idle();
+				report.begin(iface);
+			}
 			start_ns = Util::get_current_time_nsecs();
+		}
 	} while (++iterations < total_iterations);
+
+	if (benchmark)
+	{
+		iface.flush();
+		device.wait_idle();
+	}
+
 	uint64_t end_ns = Util::get_current_time_nsecs();
 
 	double total_time = double(end_ns - start_ns) * 1e-9;
 	LOGI("Total time per VBlank: %.3f ms\n", 1e3 * total_time / double(vsyncs));
 
+	if (benchmark)
+	{
+		// Resolves any outstanding timestamp queries.
+		iface.flush();
+		report.end(iface);
+		if (!report.write(benchmark_path, dump_path))
+			return EXIT_FAILURE;
+		LOGI("Wrote benchmark report to %s.\n", benchmark_path.c_str());
+	}
+
+	if (trace_recorder)
+	{
+		// The second flush resolves any outstanding timestamp queries.
+		iface.flush();
+		device.wait_idle();
+		iface.flush();
+		iface.set_trace_recorder(nullptr);
+		if (!trace_recorder->write_chrome_trace(trace_path.c_str()))
+			return EXIT_FAILURE;
+		LOGI("Wrote trace to %s.\n", trace_path.c_str());
+	}
+
 	LOGI("Done!\n");
 
 	if (use_rdoc)
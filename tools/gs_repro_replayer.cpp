@@ -13,6 +13,8 @@
 #include "rapidjson_wrapper.hpp"
 #include "os_filesystem.hpp"
 #include "path_utils.hpp"
+#include "timer.hpp"
+#include <algorithm>
 #include <cmath>
 
 using namespace Util;
@@ -23,9 +25,40 @@ using namespace ParallelGS;
 
 static void print_help()
 {
-	LOGI("Usage: parallel-gs-repro [--dir <folder>] [--update]\n");
+	LOGI("Usage: parallel-gs-repro [--dir <folder>] [--update] [--perf] [--perf-iterations <count>] [--perf-threshold <percent>]\n");
 }
 
+struct ReproOptions
+{
+	bool update = false;
+	// Records and compares performance baselines along with the reference image.
+	bool perf = false;
+	unsigned perf_iterations = 3;
+	// Relative growth over the baseline which is considered a regression.
+	double perf_threshold = 0.25;
+};
+
+// Best run out of ReproOptions::perf_iterations, which is far less noisy than the mean.
+struct PerfStats
+{
+	double cpu_time_ms;
+	double cpu_stage_time_ms[int(CPUTimestampType::Count)];
+	double gpu_time_ms[int(TimestampType::Count)];
+	VkDeviceSize peak_image_memory;
+	VkDeviceSize scratch_memory;
+};
+
+static const char *cpu_stage_names[] = { "gifTransfer", "flushRenderPass", "vsync" };
+static const char *gpu_stage_names[] = {
+	"syncHostToVRAM", "copyVRAM", "paletteUpdate", "textureUpload",
+	"triangleSetup", "binning", "shading", "readback", "vsync",
+};
+static_assert(sizeof(cpu_stage_names) / sizeof(*cpu_stage_names) == size_t(CPUTimestampType::Count), "Missing CPU timestamp name.");
+static_assert(sizeof(gpu_stage_names) / sizeof(*gpu_stage_names) == size_t(TimestampType::Count), "Missing GPU timestamp name.");
+
+// Very short stages are dominated by timer noise, so small absolute changes are never a regression.
+static constexpr double MinRegressionMs = 0.05;
+
 static bool compare_reference_image(const u8vec4 *new_pixels, const unsigned char *ref_pixels,
                                     int w, int h, int c)
 {
@@ -63,91 +96,240 @@ static bool compare_reference_image(const u8vec4 *new_pixels, const unsigned cha
 	return true;
 }
 
-static bool parse_flush_stats(Document &doc, FlushStats &stats)
+struct FlushStatCounter
 {
-	stats.num_primitives = doc["numPrimitives"].GetUint();
-	stats.allocated_image_memory = doc["allocatedImageMemory"].GetUint64();
-	stats.allocated_scratch_memory = doc["allocatedScratchMemory"].GetUint64();
-	stats.num_copies = doc["numCopies"].GetUint();
-	stats.num_copy_barriers = doc["numCopyBarriers"].GetUint();
-	stats.num_palette_updates = doc["numPaletteUpdates"].GetUint();
-	stats.num_render_passes = doc["numRenderPasses"].GetUint();
-	return true;
-}
+	const char *name;
+	uint32_t FlushStats::*member;
+};
+
+// All counters are deterministic for a given dump and set of options.
+static const FlushStatCounter flush_stat_counters[] = {
+	{ "numPrimitives", &FlushStats::num_primitives },
+	{ "numRenderPasses", &FlushStats::num_render_passes },
+	{ "numPaletteUpdates", &FlushStats::num_palette_updates },
+	{ "numCopies", &FlushStats::num_copies },
+	{ "numCopyThreads", &FlushStats::num_copy_threads },
+	{ "numCopyHazards", &FlushStats::num_copy_hazards },
+	{ "numCopyBarriers", &FlushStats::num_copy_barriers },
+	{ "numOverflowFlushes", &FlushStats::num_overflow_flushes },
+	{ "numTextureContentHashHits", &FlushStats::num_texture_content_hash_hits },
+	{ "numTextureContentHashMisses", &FlushStats::num_texture_content_hash_misses },
+	{ "numPaletteContentHashHits", &FlushStats::num_palette_content_hash_hits },
+	{ "numZCulledPrimitives", &FlushStats::num_z_culled_primitives },
+	{ "numMergedFBSwitches", &FlushStats::num_merged_fb_switches },
+};
 
 template <typename Alloc>
 static void serialize_flush_stats(Value &value, const FlushStats &stats, Alloc &allocator)
 {
-	value.AddMember("numPrimitives", stats.num_primitives, allocator);
+	for (auto &counter : flush_stat_counters)
+		value.AddMember(StringRef(counter.name), stats.*counter.member, allocator);
 	value.AddMember("allocatedImageMemory", uint64_t(stats.allocated_image_memory), allocator);
 	value.AddMember("allocatedScratchMemory", uint64_t(stats.allocated_scratch_memory), allocator);
-	value.AddMember("numCopies", stats.num_copies, allocator);
-	value.AddMember("numCopyBarriers", stats.num_copy_barriers, allocator);
-	value.AddMember("numPaletteUpdates", stats.num_palette_updates, allocator);
-	value.AddMember("numRenderPasses", stats.num_render_passes, allocator);
 }
 
-static bool compare_flush_stats(const FlushStats &new_stats, const FlushStats &old_stats)
+static bool compare_flush_stats(const FlushStats &new_stats, const Value &ref)
 {
 	bool has_mismatch = false;
-	LOGI("numPrimitives: %u -> %u\n", old_stats.num_primitives, new_stats.num_primitives);
-	if (new_stats.num_primitives != old_stats.num_primitives)
+
+	for (auto &counter : flush_stat_counters)
 	{
-		LOGE("numPrimitives mismatch.\n");
-		has_mismatch = true;
+		// References written before a counter existed are not invalidated by it.
+		if (!ref.HasMember(counter.name))
+		{
+			LOGW("%s: not in reference, skipping.\n", counter.name);
+			continue;
+		}
+
+		uint32_t old_value = ref[counter.name].GetUint();
+		uint32_t new_value = new_stats.*counter.member;
+		LOGI("%s: %u -> %u\n", counter.name, old_value, new_value);
+		if (new_value != old_value)
+		{
+			LOGE("%s mismatch.\n", counter.name);
+			has_mismatch = true;
+		}
 	}
 
-	LOGI("numCopies: %u -> %u\n", old_stats.num_copies, new_stats.num_copies);
-	if (new_stats.num_copies != old_stats.num_copies)
+	uint64_t old_image_memory = ref["allocatedImageMemory"].GetUint64();
+	LOGI("allocatedImageMemory: %llu -> %llu\n",
+	     static_cast<unsigned long long>(old_image_memory),
+	     static_cast<unsigned long long>(new_stats.allocated_image_memory));
+	if (new_stats.allocated_image_memory != old_image_memory)
 	{
-		LOGE("numCopies mismatch.\n");
+		LOGE("allocatedImageMemory mismatch.\n");
 		has_mismatch = true;
 	}
 
-	LOGI("numCopyBarriers: %u -> %u\n", old_stats.num_copy_barriers, new_stats.num_copy_barriers);
-	if (new_stats.num_copy_barriers != old_stats.num_copy_barriers)
+	uint64_t old_scratch_memory = ref["allocatedScratchMemory"].GetUint64();
+	LOGI("allocatedScratchMemory: %llu -> %llu\n",
+	     static_cast<unsigned long long>(old_scratch_memory),
+	     static_cast<unsigned long long>(new_stats.allocated_scratch_memory));
+	if (new_stats.allocated_scratch_memory != old_scratch_memory)
 	{
-		LOGE("numCopyBarriers mismatch.\n");
+		LOGE("allocatedScratchMemory mismatch.\n");
 		has_mismatch = true;
 	}
 
-	LOGI("numRenderPasses: %u -> %u\n", old_stats.num_render_passes, new_stats.num_render_passes);
-	if (new_stats.num_render_passes != old_stats.num_render_passes)
+	return !has_mismatch;
+}
+
+template <typename Alloc>
+static void serialize_perf_stats(Value &value, const PerfStats &perf, Alloc &allocator)
+{
+	Value cpu(kObjectType);
+	cpu.AddMember("total", perf.cpu_time_ms, allocator);
+	for (int i = 0; i < int(CPUTimestampType::Count); i++)
+		cpu.AddMember(StringRef(cpu_stage_names[i]), perf.cpu_stage_time_ms[i], allocator);
+	value.AddMember("cpuTimeMs", cpu, allocator);
+
+	Value gpu(kObjectType);
+	for (int i = 0; i < int(TimestampType::Count); i++)
+		gpu.AddMember(StringRef(gpu_stage_names[i]), perf.gpu_time_ms[i], allocator);
+	value.AddMember("gpuTimeMs", gpu, allocator);
+
+	value.AddMember("peakImageMemory", uint64_t(perf.peak_image_memory), allocator);
+	value.AddMember("scratchMemory", uint64_t(perf.scratch_memory), allocator);
+}
+
+static bool is_regression(double old_value, double new_value, double threshold, double min_delta)
+{
+	return new_value > old_value * (1.0 + threshold) && new_value - old_value > min_delta;
+}
+
+static bool compare_perf_time(const Value &ref, const char *group, const char *name,
+                              double new_ms, double threshold)
+{
+	if (!ref.HasMember(name))
+		return true;
+
+	double old_ms = ref[name].GetDouble();
+	LOGI("%s.%s: %.3f ms -> %.3f ms\n", group, name, old_ms, new_ms);
+	if (is_regression(old_ms, new_ms, threshold, MinRegressionMs))
 	{
-		LOGE("numRenderPasses mismatch.\n");
-		has_mismatch = true;
+		LOGE("%s.%s regressed by %.1f %%.\n", group, name, 100.0 * (new_ms / std::max(old_ms, 1e-6) - 1.0));
+		return false;
 	}
 
-	LOGI("numPaletteUpdates: %u -> %u\n", old_stats.num_palette_updates, new_stats.num_palette_updates);
-	if (new_stats.num_palette_updates != old_stats.num_palette_updates)
+	return true;
+}
+
+static bool compare_perf_memory(const Value &ref, const char *name, VkDeviceSize new_size, double threshold)
+{
+	if (!ref.HasMember(name))
+		return true;
+
+	uint64_t old_size = ref[name].GetUint64();
+	LOGI("%s: %llu -> %llu\n", name,
+	     static_cast<unsigned long long>(old_size),
+	     static_cast<unsigned long long>(new_size));
+	if (is_regression(double(old_size), double(new_size), threshold, 0.0))
 	{
-		LOGE("numPaletteUpdates mismatch.\n");
-		has_mismatch = true;
+		LOGE("%s regressed.\n", name);
+		return false;
 	}
 
-	LOGI("allocatedImageMemory: %llu -> %llu\n",
-	     static_cast<unsigned long long>(old_stats.allocated_image_memory),
-	     static_cast<unsigned long long>(new_stats.allocated_image_memory));
-	if (new_stats.allocated_image_memory != old_stats.allocated_image_memory)
+	return true;
+}
+
+static bool compare_perf_stats(const PerfStats &perf, const Value &ref, double threshold)
+{
+	bool has_regression = false;
+
+	if (ref.HasMember("cpuTimeMs"))
 	{
-		LOGE("allocatedImageMemory mismatch.\n");
-		has_mismatch = true;
+		auto &cpu = ref["cpuTimeMs"];
+		if (!compare_perf_time(cpu, "cpuTimeMs", "total", perf.cpu_time_ms, threshold))
+			has_regression = true;
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+			if (!compare_perf_time(cpu, "cpuTimeMs", cpu_stage_names[i], perf.cpu_stage_time_ms[i], threshold))
+				has_regression = true;
 	}
 
-	LOGI("allocatedScratchMemory: %llu -> %llu\n",
-	     static_cast<unsigned long long>(old_stats.allocated_scratch_memory),
-	     static_cast<unsigned long long>(new_stats.allocated_scratch_memory));
-	if (new_stats.allocated_scratch_memory != old_stats.allocated_scratch_memory)
+	if (ref.HasMember("gpuTimeMs"))
 	{
-		LOGE("allocatedScratchMemory mismatch.\n");
-		has_mismatch = true;
+		auto &gpu = ref["gpuTimeMs"];
+		for (int i = 0; i < int(TimestampType::Count); i++)
+			if (!compare_perf_time(gpu, "gpuTimeMs", gpu_stage_names[i], perf.gpu_time_ms[i], threshold))
+				has_regression = true;
 	}
 
-	return !has_mismatch;
+	if (!compare_perf_memory(ref, "peakImageMemory", perf.peak_image_memory, threshold))
+		has_regression = true;
+	if (!compare_perf_memory(ref, "scratchMemory", perf.scratch_memory, threshold))
+		has_regression = true;
+
+	return !has_regression;
 }
 
-static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &path, bool update)
+// Replays the whole dump again, and keeps the fastest time seen for every stage.
+static bool measure_perf_stats(GSInterface &iface, GSDumpParser &parser, Device &device,
+                               const FlushStats &flush_stats, const ReproOptions &options, PerfStats &perf)
 {
+	perf = {};
+	perf.cpu_time_ms = HUGE_VAL;
+	for (auto &t : perf.cpu_stage_time_ms)
+		t = HUGE_VAL;
+	for (auto &t : perf.gpu_time_ms)
+		t = HUGE_VAL;
+
+	perf.peak_image_memory = flush_stats.peak_image_memory;
+	perf.scratch_memory = flush_stats.allocated_scratch_memory;
+
+	for (unsigned iteration = 0; iteration < options.perf_iterations; iteration++)
+	{
+		if (!parser.restart())
+		{
+			LOGE("Failed to restart dump.\n");
+			return false;
+		}
+
+		// Resolve outstanding timestamp queries so they are not attributed to this iteration.
+		iface.flush();
+		device.wait_idle();
+		iface.flush();
+		iface.consume_flush_stats();
+
+		double cpu_base[int(CPUTimestampType::Count)];
+		double gpu_base[int(TimestampType::Count)];
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+			cpu_base[i] = iface.get_accumulated_cpu_time(CPUTimestampType(i));
+		for (int i = 0; i < int(TimestampType::Count); i++)
+			gpu_base[i] = iface.get_accumulated_timestamps(TimestampType(i));
+
+		uint64_t start_ns = get_current_time_nsecs();
+		while (parser.iterate_until_vsync()) {}
+		parser.consume_vsync_result();
+		double cpu_time_ms = 1e-6 * double(get_current_time_nsecs() - start_ns);
+
+		iface.flush();
+		device.wait_idle();
+		iface.flush();
+
+		auto stats = iface.consume_flush_stats();
+		perf.peak_image_memory = std::max(perf.peak_image_memory, stats.peak_image_memory);
+		perf.scratch_memory = std::max(perf.scratch_memory, stats.allocated_scratch_memory);
+
+		perf.cpu_time_ms = std::min(perf.cpu_time_ms, cpu_time_ms);
+		for (int i = 0; i < int(CPUTimestampType::Count); i++)
+		{
+			double t = 1e3 * (iface.get_accumulated_cpu_time(CPUTimestampType(i)) - cpu_base[i]);
+			perf.cpu_stage_time_ms[i] = std::min(perf.cpu_stage_time_ms[i], t);
+		}
+
+		for (int i = 0; i < int(TimestampType::Count); i++)
+		{
+			double t = 1e3 * (iface.get_accumulated_timestamps(TimestampType(i)) - gpu_base[i]);
+			perf.gpu_time_ms[i] = std::min(perf.gpu_time_ms[i], t);
+		}
+	}
+
+	return true;
+}
+
+static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &path, const ReproOptions &options)
+{
+	bool update = options.update;
 	LOGI("=== Testing %s ===\n", path.c_str());
 
 	auto iface = std::make_unique<GSInterface>();
@@ -162,6 +344,7 @@ static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &pat
 
 	DebugMode debug_mode = {};
 	debug_mode.deterministic_timeline_query = true;
+	debug_mode.timestamps = options.perf;
 	iface->set_debug_mode(debug_mode);
 
 	GSDumpParser parser;
@@ -241,6 +424,10 @@ static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &pat
 		}
 	}
 
+	PerfStats perf = {};
+	if (options.perf && !measure_perf_stats(*iface, parser, device, flush_stats, options, perf))
+		return false;
+
 	Document doc;
 	bool has_json = false;
 	auto file_handle = fs.open(ref_json_path, FileMode::ReadOnly);
@@ -265,17 +452,36 @@ static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &pat
 
 	if (has_json)
 	{
-		FlushStats parsed_stats = {};
-		parse_flush_stats(doc, parsed_stats);
-		if (!compare_flush_stats(flush_stats, parsed_stats) && !update)
+		if (!compare_flush_stats(flush_stats, doc) && !update)
+			return false;
+	}
+
+	bool has_perf_baseline = has_json && doc.HasMember("performance");
+	if (options.perf && has_perf_baseline)
+	{
+		if (!compare_perf_stats(perf, doc["performance"], options.perf_threshold) && !update)
 			return false;
 	}
 
-	if (update || !has_json)
+	if (update || !has_json || (options.perf && !has_perf_baseline))
 	{
 		Document write_doc;
 		auto &obj = write_doc.SetObject();
 		serialize_flush_stats(obj, flush_stats, write_doc.GetAllocator());
+
+		Value perf_value(kObjectType);
+		if (options.perf)
+		{
+			serialize_perf_stats(perf_value, perf, write_doc.GetAllocator());
+			obj.AddMember("performance", perf_value, write_doc.GetAllocator());
+		}
+		else if (has_perf_baseline)
+		{
+			// Refreshing the reference image should not discard the performance baseline.
+			perf_value.CopyFrom(doc["performance"], write_doc.GetAllocator());
+			obj.AddMember("performance", perf_value, write_doc.GetAllocator());
+		}
+
 		StringBuffer strbuf;
 		PrettyWriter<StringBuffer> writer{strbuf};
 		write_doc.Accept(writer);
@@ -300,7 +506,7 @@ static bool run_gs_dump(OSFilesystem &fs, Device &device, const std::string &pat
 	return true;
 }
 
-static int main_inner(const std::string &path, bool update)
+static int main_inner(const std::string &path, const ReproOptions &options)
 {
 	OSFilesystem fs(".");
 
@@ -313,27 +519,35 @@ static int main_inner(const std::string &path, bool update)
 		return EXIT_FAILURE;
 	dev.set_context(ctx);
 
+	// Keep going after a failure, so a single run reports every regressed case.
+	std::vector<std::string> failed;
 	auto files = fs.list(path);
 	for (auto &file : files)
 	{
 		if (file.type == PathType::File && Path::ext(file.path) == "gs")
 		{
-			if (!run_gs_dump(fs, dev, file.path, update))
-				return EXIT_FAILURE;
+			if (!run_gs_dump(fs, dev, file.path, options))
+				failed.push_back(file.path);
 		}
 	}
 
-	return EXIT_SUCCESS;
+	for (auto &file : failed)
+		LOGE("FAILED: %s\n", file.c_str());
+
+	return failed.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char **argv)
 {
 	std::string path;
-	bool update = false;
+	ReproOptions options;
 	CLICallbacks cbs;
 	cbs.add("--help", [&](CLIParser &parser) { print_help(); parser.end(); });
 	cbs.add("--dir", [&](CLIParser &parser) { path = parser.next_string(); });
-	cbs.add("--update", [&](CLIParser &) { update = true; });
+	cbs.add("--update", [&](CLIParser &) { options.update = true; });
+	cbs.add("--perf", [&](CLIParser &) { options.perf = true; });
+	cbs.add("--perf-iterations", [&](CLIParser &parser) { options.perf_iterations = parser.next_uint(); });
+	cbs.add("--perf-threshold", [&](CLIParser &parser) { options.perf_threshold = 0.01 * parser.next_double(); });
 
 	CLIParser parser(std::move(cbs), argc - 1, argv + 1);
 	if (!parser.parse())
@@ -347,5 +561,11 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	return main_inner(path, update);
+	if (options.perf && options.perf_iterations == 0)
+	{
+		LOGE("--perf-iterations must be at least 1.\n");
+		return EXIT_FAILURE;
+	}
+
+	return main_inner(path, options);
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+// SPDX-FileCopyrightText: 2024 Arntzen Software AS
+// SPDX-FileContributor: Hans-Kristian Arntzen
+// SPDX-FileContributor: Runar Heyer
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "gs_util.hpp"
+#include "cli_parser.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace ParallelGS;
+using namespace Util;
+
+// Compares the block-granular CPU swizzle paths against the per-texel reference loop.
+
+static constexpr uint32_t VRAMSize = 4 * 1024 * 1024;
+
+static void print_help()
+{
+	LOGI("Usage: parallel-gs-swizzle-bench [--width <texels>] [--height <texels>] [--x <offset>] [--y <offset>] [--iterations <count>]\n");
+}
+
+struct BenchmarkConfig
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 640;
+	uint32_t height = 448;
+	uint32_t iterations = 100;
+};
+
+static void fill_random(std::vector<uint8_t> &data, uint32_t seed)
+{
+	for (auto &v : data)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v = uint8_t(seed >> 24);
+	}
+}
+
+template <uint32_t PSM>
+static bool run_benchmark(const char *name, const BenchmarkConfig &config)
+{
+	// Buffer must be wide enough to not alias.
+	uint32_t page_stride = (config.x + config.width + 63) / 64;
+	if (PSM == PSMT4 || PSM == PSMT8)
+		page_stride = (page_stride + 1) & ~1u;
+
+	size_t linear_size = (size_t(config.width) * config.height * get_bits_per_pixel(PSM) + 7) / 8;
+	std::vector<uint8_t> linear(linear_size), readback_ref(linear_size), readback(linear_size);
+	std::vector<uint8_t> vram_ref(VRAMSize), vram(VRAMSize);
+
+	fill_random(linear, 1);
+	fill_random(vram_ref, 2);
+	vram = vram_ref;
+
+	uint64_t start_ns = get_current_time_nsecs();
+	for (uint32_t i = 0; i < config.iterations; i++)
+	{
+		vram_upload_rect<PSM>(vram_ref.data(), linear.data(), 0, page_stride,
+		                      config.x, config.y, config.width,
+		                      0, config.width, 0, config.height, VRAMSize - 1);
+	}
+	uint64_t scalar_upload_ns = get_current_time_nsecs() - start_ns;
+
+	start_ns = get_current_time_nsecs();
+	for (uint32_t i = 0; i < config.iterations; i++)
+	{
+		vram_upload<PSM>(vram.data(), linear.data(), 0, page_stride,
+		                 config.x, config.y, config.width, config.height, VRAMSize - 1);
+	}
+	uint64_t block_upload_ns = get_current_time_nsecs() - start_ns;
+
+	if (memcmp(vram_ref.data(), vram.data(), VRAMSize) != 0)
+	{
+		LOGE("%s: Upload mismatch.\n", name);
+		return false;
+	}
+
+	double texels = double(config.width) * double(config.height) * double(config.iterations);
+	LOGI("%6s upload:   scalar %8.1f MTexels/s, block %8.1f MTexels/s (%.2fx)\n", name,
+	     1e3 * texels / double(scalar_upload_ns), 1e3 * texels / double(block_upload_ns),
+	     double(scalar_upload_ns) / double(block_upload_ns));
+
+	// 4-bit is not allowed for readback.
+	if (get_bits_per_pixel(PSM) == 4)
+		return true;
+
+	start_ns = get_current_time_nsecs();
+	for (uint32_t i = 0; i < config.iterations; i++)
+	{
+		vram_readback_rect<PSM>(readback_ref.data(), vram.data(), 0, page_stride,
+		                        config.x, config.y, config.width,
+		                        0, config.width, 0, config.height, VRAMSize - 1);
+	}
+	uint64_t scalar_readback_ns = get_current_time_nsecs() - start_ns;
+
+	start_ns = get_current_time_nsecs();
+	for (uint32_t i = 0; i < config.iterations; i++)
+	{
+		vram_readback<PSM>(readback.data(), vram.data(), 0, page_stride,
+		                   config.x, config.y, config.width, config.height, VRAMSize - 1);
+	}
+	uint64_t block_readback_ns = get_current_time_nsecs() - start_ns;
+
+	if (readback_ref != readback)
+	{
+		LOGE("%s: Readback mismatch.\n", name);
+		return false;
+	}
+
+	LOGI("%6s readback: scalar %8.1f MTexels/s, block %8.1f MTexels/s (%.2fx)\n", name,
+	     1e3 * texels / double(scalar_readback_ns), 1e3 * texels / double(block_readback_ns),
+	     double(scalar_readback_ns) / double(block_readback_ns));
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkConfig config;
+
+	CLICallbacks cbs;
+	cbs.add("--help", [&](CLIParser &parser) { parser.end(); print_help(); });
+	cbs.add("--width", [&](CLIParser &parser) { config.width = parser.next_uint(); });
+	cbs.add("--height", [&](CLIParser &parser) { config.height = parser.next_uint(); });
+	cbs.add("--x", [&](CLIParser &parser) { config.x = parser.next_uint(); });
+	cbs.add("--y", [&](CLIParser &parser) { config.y = parser.next_uint(); });
+	cbs.add("--iterations", [&](CLIParser &parser) { config.iterations = parser.next_uint(); });
+
+	CLIParser cli_parser(std::move(cbs), argc - 1, argv + 1);
+	if (!cli_parser.parse())
+	{
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	if (cli_parser.is_ended_state())
+		return EXIT_SUCCESS;
+
+	if (config.width == 0 || config.height == 0 || config.iterations == 0 ||
+	    config.x + config.width > 2048 || config.y + config.height > 2048)
+	{
+		LOGE("Invalid transfer rect.\n");
+		return EXIT_FAILURE;
+	}
+
+	LOGI("Block kernels: %s\n", get_swizzle_isa_name(get_swizzle_isa()));
+
+	bool success = true;
+	success = run_benchmark<PSMCT32>("CT32", config) && success;
+	success = run_benchmark<PSMCT24>("CT24", config) && success;
+	success = run_benchmark<PSMCT16>("CT16", config) && success;
+	success = run_benchmark<PSMCT16S>("CT16S", config) && success;
+	success = run_benchmark<PSMZ32>("Z32", config) && success;
+	success = run_benchmark<PSMZ16>("Z16", config) && success;
+	success = run_benchmark<PSMT8>("T8", config) && success;
+	success = run_benchmark<PSMT4>("T4", config) && success;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}